@@ -0,0 +1,32 @@
+#include "Bench.h"
+
+#include "mg/box/Arena.h"
+#include "mg/sch/Task.h"
+
+namespace mg {
+namespace bench {
+
+	using BenchAllocator = mg::box::ArenaAllocator<char>;
+	using BenchString = mg::box::ArenaString;
+	template<typename T>
+	using BenchVector = mg::box::ArenaVector<T>;
+
+	static inline BenchAllocator
+	BenchRequestBegin(
+		mg::sch::Task* aTask)
+	{
+		return BenchAllocator(aTask->GetArena());
+	}
+
+	static inline void
+	BenchRequestEnd(
+		mg::sch::Task* aTask)
+	{
+		// All the request's data is dropped at once.
+		aTask->GetArena().Reset();
+	}
+
+}
+}
+
+#include "BenchArenaTemplate.hpp"
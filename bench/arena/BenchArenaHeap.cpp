@@ -0,0 +1,33 @@
+#include "Bench.h"
+
+#include "mg/sch/Task.h"
+
+#include <string>
+#include <vector>
+
+namespace mg {
+namespace bench {
+
+	using BenchAllocator = std::allocator<char>;
+	using BenchString = std::string;
+	template<typename T>
+	using BenchVector = std::vector<T>;
+
+	static inline BenchAllocator
+	BenchRequestBegin(
+		mg::sch::Task*)
+	{
+		return BenchAllocator();
+	}
+
+	static inline void
+	BenchRequestEnd(
+		mg::sch::Task*)
+	{
+		// Each object has already freed its memory in its destructor.
+	}
+
+}
+}
+
+#include "BenchArenaTemplate.hpp"
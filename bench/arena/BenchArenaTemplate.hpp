@@ -0,0 +1,451 @@
+#pragma once
+
+#include "Bench.h"
+
+#include "mg/box/Atomic.h"
+#include "mg/box/Time.h"
+#include "mg/sch/TaskScheduler.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////////////////////////
+// All the heap allocations in the process are counted, including the ones in the worker
+// threads.
+
+static mg::box::AtomicU64 theBenchAllocCount(0);
+
+void*
+operator new(
+	size_t aSize)
+{
+	theBenchAllocCount.IncrementRelaxed();
+	void* res = malloc(aSize == 0 ? 1 : aSize);
+	if (res == nullptr)
+		throw std::bad_alloc();
+	return res;
+}
+
+void*
+operator new[](
+	size_t aSize)
+{
+	return operator new(aSize);
+}
+
+void
+operator delete(
+	void* aPtr) noexcept
+{
+	free(aPtr);
+}
+
+void
+operator delete[](
+	void* aPtr) noexcept
+{
+	free(aPtr);
+}
+
+void
+operator delete(
+	void* aPtr,
+	size_t) noexcept
+{
+	free(aPtr);
+}
+
+void
+operator delete[](
+	void* aPtr,
+	size_t) noexcept
+{
+	free(aPtr);
+}
+
+namespace mg {
+namespace bench {
+
+	struct BenchArenaParams
+	{
+		uint32_t myThreadCount;
+		uint32_t myTaskCount;
+		uint32_t myRequestCount;
+		uint32_t myHeaderCount;
+	};
+
+	struct BenchRunReport
+	{
+		BenchRunReport();
+
+		bool operator<(
+			const BenchRunReport& aOther) const;
+
+		void Print() const;
+
+		uint64_t myRequestsPerSec;
+		double myMallocsPerRequest;
+	};
+
+	struct BenchParam
+	{
+		BenchParam(
+			BenchString&& aName,
+			BenchString&& aValue)
+			: myName(std::move(aName)), myValue(std::move(aValue)) {}
+
+		BenchString myName;
+		BenchString myValue;
+	};
+
+	// What a typical handler extracts from an HTTP request before doing anything
+	// useful. All of it dies when the request is done.
+	struct BenchRequest
+	{
+		BenchRequest(
+			const BenchAllocator& aAlloc);
+
+		uint64_t GetDigest() const;
+
+		BenchString myMethod;
+		BenchString myPath;
+		BenchVector<BenchString> myPathParts;
+		BenchVector<BenchParam> myQuery;
+		BenchVector<BenchParam> myHeaders;
+		BenchVector<BenchParam> myCookies;
+		BenchVector<BenchParam> myForm;
+	};
+
+	//////////////////////////////////////////////////////////////////////////////////////
+
+	static std::string BenchMakeRequestText(
+		uint32_t aHeaderCount);
+
+	static BenchString BenchDecode(
+		const char* aBegin,
+		const char* aEnd,
+		const BenchAllocator& aAlloc);
+
+	static void BenchParseParams(
+		const char* aBegin,
+		const char* aEnd,
+		char aSeparator,
+		BenchVector<BenchParam>& aOut,
+		const BenchAllocator& aAlloc);
+
+	static void BenchParseRequest(
+		const std::string& aText,
+		BenchRequest& aOut,
+		const BenchAllocator& aAlloc);
+
+	static void BenchArenaRound(
+		mg::sch::TaskScheduler& aSched,
+		const BenchArenaParams& aParams,
+		const std::string& aText);
+
+	static BenchRunReport BenchArenaRun(
+		const BenchArenaParams& aParams,
+		const std::string& aText);
+
+	//////////////////////////////////////////////////////////////////////////////////////
+
+	BenchRunReport::BenchRunReport()
+		: myRequestsPerSec(0)
+		, myMallocsPerRequest(0)
+	{
+	}
+
+	inline bool
+	BenchRunReport::operator<(
+		const BenchRunReport& aOther) const
+	{
+		return myRequestsPerSec < aOther.myRequestsPerSec;
+	}
+
+	void
+	BenchRunReport::Print() const
+	{
+		Report("Requests/sec:               %12llu",
+			(unsigned long long)myRequestsPerSec);
+		Report("Mallocs/request:            %12.3lf", myMallocsPerRequest);
+		Report("");
+	}
+
+	//////////////////////////////////////////////////////////////////////////////////////
+
+	BenchRequest::BenchRequest(
+		const BenchAllocator& aAlloc)
+		: myMethod(aAlloc)
+		, myPath(aAlloc)
+		, myPathParts(aAlloc)
+		, myQuery(aAlloc)
+		, myHeaders(aAlloc)
+		, myCookies(aAlloc)
+		, myForm(aAlloc)
+	{
+	}
+
+	uint64_t
+	BenchRequest::GetDigest() const
+	{
+		uint64_t res = myMethod.size() + myPath.size();
+		for (const BenchString& s : myPathParts)
+			res += s.size();
+		for (const BenchVector<BenchParam>* params :
+			{&myQuery, &myHeaders, &myCookies, &myForm})
+		{
+			for (const BenchParam& p : *params)
+				res += p.myName.size() * 3 + p.myValue.size();
+		}
+		return res;
+	}
+
+	//////////////////////////////////////////////////////////////////////////////////////
+
+	static std::string
+	BenchMakeRequestText(
+		uint32_t aHeaderCount)
+	{
+		std::string res =
+			"POST /api/v1/users/1234567/orders/latest?limit=100&offset=2000&"
+			"sort=created_at&filter=status%3Aactive+type%3Aretail HTTP/1.1\r\n"
+			"Host: shop.example.com\r\n"
+			"User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 "
+			"(KHTML, like Gecko) Chrome/120.0.0.0 Safari/537.36\r\n"
+			"Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n"
+			"Accept-Language: en-US,en;q=0.9,de;q=0.7\r\n"
+			"Accept-Encoding: gzip, deflate, br\r\n"
+			"Content-Type: application/x-www-form-urlencoded\r\n"
+			"Cookie: session_id=5f2b8c1e9a7d4e3f8b6a0c2d1e4f7a9b; theme=dark; "
+			"locale=en_US; last_visited_page=%2Fcatalog%2Fshoes%2Frunning\r\n"
+			"Connection: keep-alive\r\n";
+		for (uint32_t i = 0; i < aHeaderCount; ++i)
+		{
+			res += "X-Custom-Header-" + std::to_string(i) + ": some-value-" +
+				std::to_string(i) + "-which-is-long-enough\r\n";
+		}
+		res += "\r\n"
+			"first_name=John&last_name=Smith&email=john.smith%40example.com&"
+			"address=221B+Baker+Street%2C+London&phone=%2B44+20+7224+3688&"
+			"comment=Please+deliver+before+noon%2C+thanks%21";
+		return res;
+	}
+
+	static BenchString
+	BenchDecode(
+		const char* aBegin,
+		const char* aEnd,
+		const BenchAllocator& aAlloc)
+	{
+		BenchString res(aAlloc);
+		for (const char* pos = aBegin; pos < aEnd; ++pos)
+		{
+			if (*pos == '+')
+			{
+				res.push_back(' ');
+				continue;
+			}
+			if (*pos == '%' && aEnd - pos >= 3)
+			{
+				char hex[3] = {pos[1], pos[2], 0};
+				res.push_back((char)strtol(hex, nullptr, 16));
+				pos += 2;
+				continue;
+			}
+			res.push_back(*pos);
+		}
+		return res;
+	}
+
+	static void
+	BenchParseParams(
+		const char* aBegin,
+		const char* aEnd,
+		char aSeparator,
+		BenchVector<BenchParam>& aOut,
+		const BenchAllocator& aAlloc)
+	{
+		while (aBegin < aEnd)
+		{
+			while (aBegin < aEnd && *aBegin == ' ')
+				++aBegin;
+			const char* end = std::find(aBegin, aEnd, aSeparator);
+			const char* eq = std::find(aBegin, end, '=');
+			const char* value = eq < end ? eq + 1 : end;
+			aOut.emplace_back(BenchDecode(aBegin, eq, aAlloc),
+				BenchDecode(value, end, aAlloc));
+			aBegin = end + 1;
+		}
+	}
+
+	static void
+	BenchParseRequest(
+		const std::string& aText,
+		BenchRequest& aOut,
+		const BenchAllocator& aAlloc)
+	{
+		const char* pos = aText.data();
+		const char* end = pos + aText.size();
+		const char* lineEnd = std::search(pos, end, "\r\n", "\r\n" + 2);
+		// Request line.
+		const char* space = std::find(pos, lineEnd, ' ');
+		aOut.myMethod.assign(pos, space);
+		pos = space + 1;
+		space = std::find(pos, lineEnd, ' ');
+		const char* query = std::find(pos, space, '?');
+		aOut.myPath = BenchDecode(pos, query, aAlloc);
+		for (const char* part = pos + 1; part < query;)
+		{
+			const char* partEnd = std::find(part, query, '/');
+			aOut.myPathParts.emplace_back(part, partEnd, aAlloc);
+			part = partEnd + 1;
+		}
+		if (query < space)
+			BenchParseParams(query + 1, space, '&', aOut.myQuery, aAlloc);
+		pos = lineEnd + 2;
+		// Headers.
+		while (pos < end)
+		{
+			lineEnd = std::search(pos, end, "\r\n", "\r\n" + 2);
+			if (lineEnd == pos)
+			{
+				pos += 2;
+				break;
+			}
+			const char* colon = std::find(pos, lineEnd, ':');
+			BenchString name(pos, colon, aAlloc);
+			for (char& c : name)
+				c = (char)tolower(c);
+			const char* value = colon + 1;
+			while (value < lineEnd && *value == ' ')
+				++value;
+			if (name == "cookie")
+				BenchParseParams(value, lineEnd, ';', aOut.myCookies, aAlloc);
+			aOut.myHeaders.emplace_back(std::move(name),
+				BenchString(value, lineEnd, aAlloc));
+			pos = lineEnd + 2;
+		}
+		// Body.
+		BenchParseParams(pos, end, '&', aOut.myForm, aAlloc);
+	}
+
+	static void
+	BenchArenaRound(
+		mg::sch::TaskScheduler& aSched,
+		const BenchArenaParams& aParams,
+		const std::string& aText)
+	{
+		mg::box::AtomicU32 doneCount(0);
+		std::vector<mg::sch::Task> tasks(aParams.myTaskCount);
+		std::vector<uint32_t> counts(aParams.myTaskCount, 0);
+		std::vector<uint64_t> digests(aParams.myTaskCount, 0);
+		for (uint32_t i = 0; i < aParams.myTaskCount; ++i)
+		{
+			uint32_t* count = &counts[i];
+			uint64_t* digest = &digests[i];
+			tasks[i].SetCallback([&, count, digest](mg::sch::Task* aTask) {
+				BenchAllocator alloc = BenchRequestBegin(aTask);
+				{
+					BenchRequest req(alloc);
+					BenchParseRequest(aText, req, alloc);
+					*digest += req.GetDigest();
+				}
+				BenchRequestEnd(aTask);
+				if (++*count < aParams.myRequestCount)
+					return aSched.Post(aTask);
+				doneCount.IncrementRelease();
+			});
+			aSched.Post(&tasks[i]);
+		}
+		while (doneCount.LoadAcquire() != aParams.myTaskCount)
+			mg::box::Sleep(1);
+		aSched.WaitEmpty();
+		for (uint64_t d : digests)
+			MG_BOX_ASSERT(d == digests[0] && d != 0);
+	}
+
+	static BenchRunReport
+	BenchArenaRun(
+		const BenchArenaParams& aParams,
+		const std::string& aText)
+	{
+		mg::sch::TaskScheduler sched("bch", 5000);
+		sched.Start(aParams.myThreadCount);
+		uint64_t requestCount = (uint64_t)aParams.myRequestCount * aParams.myTaskCount;
+		// Warm up. The pools and the scheduler's queues get filled, and the next rounds
+		// work in a steady state.
+		for (int i = 0; i < 3; ++i)
+			BenchArenaRound(sched, aParams, aText);
+
+		BenchRunReport report;
+		uint64_t allocCount = theBenchAllocCount.LoadRelaxed();
+		TimedGuard timed("Requests");
+		BenchArenaRound(sched, aParams, aText);
+		timed.Stop();
+		double durationMs = timed.GetMilliseconds();
+		allocCount = theBenchAllocCount.LoadRelaxed() - allocCount;
+
+		report.myRequestsPerSec = (uint64_t)(requestCount * 1000 / durationMs);
+		report.myMallocsPerRequest = (double)allocCount / requestCount;
+		report.Print();
+		return report;
+	}
+
+}
+}
+
+int
+main(
+	int aArgc,
+	char** aArgv)
+{
+	using namespace mg::bench;
+	mg::tst::CommandLine cmdLine(aArgc - 1, aArgv + 1);
+	BenchArenaParams params;
+	params.myThreadCount = cmdLine.GetU32("threads");
+	params.myTaskCount = cmdLine.GetU32("tasks");
+	params.myRequestCount = cmdLine.GetU32("requests");
+	params.myHeaderCount = 0;
+	if (cmdLine.IsPresent("headers"))
+		params.myHeaderCount = cmdLine.GetU32("headers");
+	uint32_t runCount = 1;
+	if (cmdLine.IsPresent("runs"))
+		runCount = cmdLine.GetU32("runs");
+	MG_BOX_ASSERT(params.myThreadCount > 0 && params.myTaskCount > 0 &&
+		params.myRequestCount > 0);
+
+	BenchCaseGuard guard("Threads=%u, tasks=%u, requests=%u, headers=%u",
+		params.myThreadCount, params.myTaskCount, params.myRequestCount,
+		params.myHeaderCount);
+	std::string text = BenchMakeRequestText(params.myHeaderCount);
+	std::vector<BenchRunReport> reports;
+	reports.resize(runCount);
+	for (BenchRunReport& r : reports)
+		r = BenchArenaRun(params, text);
+	if (runCount == 1)
+		return 0;
+	if (runCount < 3)
+		return -1;
+	std::sort(reports.begin(), reports.end());
+
+	Report("== Aggregated report:");
+	BenchRunReport* rMin = &reports[0];
+	// If the count is even, then intentionally print the lower middle.
+	BenchRunReport* rMed = &reports[runCount / 2];
+	BenchRunReport* rMax = &reports[runCount - 1];
+	Report("Requests/sec min:           %12llu",
+		(unsigned long long)rMin->myRequestsPerSec);
+	Report("Requests/sec median:        %12llu",
+		(unsigned long long)rMed->myRequestsPerSec);
+	Report("Requests/sec max:           %12llu",
+		(unsigned long long)rMax->myRequestsPerSec);
+	Report("");
+
+	Report("== Median report:");
+	rMed->Print();
+	return 0;
+}
@@ -0,0 +1,17 @@
+#include "Bench.h"
+
+#include "mg/box/Coro.h"
+
+namespace mg {
+namespace bench {
+
+	static inline void
+	BenchCoroInit()
+	{
+		// Frames are pooled by default.
+	}
+
+}
+}
+
+#include "BenchCoroTemplate.hpp"
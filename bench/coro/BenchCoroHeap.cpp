@@ -0,0 +1,18 @@
+#include "Bench.h"
+
+#include "mg/box/Coro.h"
+
+namespace mg {
+namespace bench {
+
+	static inline void
+	BenchCoroInit()
+	{
+		// Each frame is allocated on the heap, like it was before the pooling.
+		mg::box::CoroFramePoolSetEnabled(false);
+	}
+
+}
+}
+
+#include "BenchCoroTemplate.hpp"
@@ -0,0 +1,339 @@
+#pragma once
+
+#include "Bench.h"
+
+#include "mg/box/Atomic.h"
+#include "mg/box/Coro.h"
+#include "mg/box/Time.h"
+#include "mg/sch/TaskScheduler.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+#if !MG_CORO_IS_ENABLED
+#error "Coroutines are not supported by the compiler"
+#endif
+
+//////////////////////////////////////////////////////////////////////////////////////////
+// All the heap allocations in the process are counted, including the ones in the worker
+// threads.
+
+static mg::box::AtomicU64 theBenchAllocCount(0);
+
+void*
+operator new(
+	size_t aSize)
+{
+	theBenchAllocCount.IncrementRelaxed();
+	void* res = malloc(aSize == 0 ? 1 : aSize);
+	if (res == nullptr)
+		throw std::bad_alloc();
+	return res;
+}
+
+void*
+operator new[](
+	size_t aSize)
+{
+	return operator new(aSize);
+}
+
+void
+operator delete(
+	void* aPtr) noexcept
+{
+	free(aPtr);
+}
+
+void
+operator delete[](
+	void* aPtr) noexcept
+{
+	free(aPtr);
+}
+
+void
+operator delete(
+	void* aPtr,
+	size_t) noexcept
+{
+	free(aPtr);
+}
+
+void
+operator delete[](
+	void* aPtr,
+	size_t) noexcept
+{
+	free(aPtr);
+}
+
+namespace mg {
+namespace bench {
+
+	enum BenchCoroMode
+	{
+		// Create and run the coroutines in one thread, without a scheduler. Shows the
+		// pure cost of a frame creation and destruction.
+		BENCH_CORO_MODE_CREATE,
+		// Tasks handle requests. Each request is a coroutine call with nested calls and
+		// a yield to the scheduler. Shows the end-to-end throughput.
+		BENCH_CORO_MODE_TASKS,
+	};
+
+	struct BenchCoroParams
+	{
+		BenchCoroMode myMode;
+		uint32_t myThreadCount;
+		uint32_t myTaskCount;
+		uint32_t myRequestCount;
+		uint32_t myDepth;
+	};
+
+	struct BenchRunReport
+	{
+		BenchRunReport();
+
+		bool operator<(
+			const BenchRunReport& aOther) const;
+
+		void Print() const;
+
+		uint64_t myRequestsPerSec;
+		double myMallocsPerRequest;
+	};
+
+	// Not a lambda, because a lambda type stored in a frame of a static coroutine has no
+	// linkage, and GCC complains about that.
+	struct BenchCoroOnTaskDone
+	{
+		void operator()(
+			mg::sch::Task*) const { myDoneCount->IncrementRelease(); }
+
+		mg::box::AtomicU32* myDoneCount;
+	};
+
+	//////////////////////////////////////////////////////////////////////////////////////
+
+	static mg::box::Coro BenchCoroHandler(
+		uint32_t aDepth,
+		uint64_t& aOutSum);
+
+	static mg::box::Coro BenchCoroTaskBody(
+		mg::sch::Task* aTask,
+		const BenchCoroParams& aParams,
+		mg::box::AtomicU32& aDoneCount);
+
+	static void BenchCoroRoundCreate(
+		const BenchCoroParams& aParams);
+
+	static void BenchCoroRoundTasks(
+		mg::sch::TaskScheduler& aSched,
+		const BenchCoroParams& aParams);
+
+	static BenchRunReport BenchCoroRun(
+		const BenchCoroParams& aParams);
+
+	//////////////////////////////////////////////////////////////////////////////////////
+
+	BenchRunReport::BenchRunReport()
+		: myRequestsPerSec(0)
+		, myMallocsPerRequest(0)
+	{
+	}
+
+	inline bool
+	BenchRunReport::operator<(
+		const BenchRunReport& aOther) const
+	{
+		return myRequestsPerSec < aOther.myRequestsPerSec;
+	}
+
+	void
+	BenchRunReport::Print() const
+	{
+		Report("Requests/sec:               %12llu",
+			(unsigned long long)myRequestsPerSec);
+		Report("Mallocs/request:            %12.3lf", myMallocsPerRequest);
+		Report("");
+	}
+
+	//////////////////////////////////////////////////////////////////////////////////////
+
+	static mg::box::Coro
+	BenchCoroHandler(
+		uint32_t aDepth,
+		uint64_t& aOutSum)
+	{
+		// Some locals to make the frame look like a real handler's one.
+		uint64_t data[8];
+		for (uint64_t& d : data)
+			d = aDepth;
+		if (aDepth > 1)
+			co_await mg::box::CoroCall(BenchCoroHandler(aDepth - 1, aOutSum));
+		for (uint64_t d : data)
+			aOutSum += d;
+		co_return;
+	}
+
+	static mg::box::Coro
+	BenchCoroTaskBody(
+		mg::sch::Task* aTask,
+		const BenchCoroParams& aParams,
+		mg::box::AtomicU32& aDoneCount)
+	{
+		uint64_t sum = 0;
+		for (uint32_t i = 0; i < aParams.myRequestCount; ++i)
+		{
+			co_await mg::box::CoroCall(BenchCoroHandler(aParams.myDepth, sum));
+			co_await aTask->AsyncYield();
+		}
+		MG_BOX_ASSERT(sum != 0);
+		co_await aTask->AsyncExitExec(BenchCoroOnTaskDone{&aDoneCount});
+		MG_BOX_ASSERT(!"Unreachable");
+		co_return;
+	}
+
+	static void
+	BenchCoroRoundCreate(
+		const BenchCoroParams& aParams)
+	{
+		uint64_t sum = 0;
+		for (uint32_t i = 0; i < aParams.myRequestCount; ++i)
+		{
+			mg::box::CoroRef coro(BenchCoroHandler(aParams.myDepth, sum));
+			coro.ResumeTop();
+		}
+		MG_BOX_ASSERT(sum != 0);
+	}
+
+	static void
+	BenchCoroRoundTasks(
+		mg::sch::TaskScheduler& aSched,
+		const BenchCoroParams& aParams)
+	{
+		mg::box::AtomicU32 doneCount(0);
+		std::vector<mg::sch::Task> tasks(aParams.myTaskCount);
+		for (mg::sch::Task& t : tasks)
+		{
+			t.SetCallback(BenchCoroTaskBody(&t, aParams, doneCount));
+			aSched.Post(&t);
+		}
+		while (doneCount.LoadAcquire() != aParams.myTaskCount)
+			mg::box::Sleep(1);
+		aSched.WaitEmpty();
+	}
+
+	static BenchRunReport
+	BenchCoroRun(
+		const BenchCoroParams& aParams)
+	{
+		mg::sch::TaskScheduler sched("bch", 5000);
+		uint64_t requestCount = aParams.myRequestCount;
+		if (aParams.myMode == BENCH_CORO_MODE_TASKS)
+		{
+			sched.Start(aParams.myThreadCount);
+			requestCount *= aParams.myTaskCount;
+		}
+		// Warm up. The pools and the scheduler's queues get filled, and the next rounds
+		// work in a steady state.
+		for (int i = 0; i < 3; ++i)
+		{
+			if (aParams.myMode == BENCH_CORO_MODE_TASKS)
+				BenchCoroRoundTasks(sched, aParams);
+			else
+				BenchCoroRoundCreate(aParams);
+		}
+
+		BenchRunReport report;
+		uint64_t allocCount = theBenchAllocCount.LoadRelaxed();
+		TimedGuard timed("Requests");
+		if (aParams.myMode == BENCH_CORO_MODE_TASKS)
+			BenchCoroRoundTasks(sched, aParams);
+		else
+			BenchCoroRoundCreate(aParams);
+		timed.Stop();
+		double durationMs = timed.GetMilliseconds();
+		allocCount = theBenchAllocCount.LoadRelaxed() - allocCount;
+
+		report.myRequestsPerSec = (uint64_t)(requestCount * 1000 / durationMs);
+		report.myMallocsPerRequest = (double)allocCount / requestCount;
+		report.Print();
+		return report;
+	}
+
+}
+}
+
+int
+main(
+	int aArgc,
+	char** aArgv)
+{
+	using namespace mg::bench;
+	BenchCoroInit();
+	mg::tst::CommandLine cmdLine(aArgc - 1, aArgv + 1);
+	BenchCoroParams params;
+	const std::string& mode = cmdLine.GetStr("mode");
+	if (mode == "create")
+		params.myMode = BENCH_CORO_MODE_CREATE;
+	else if (mode == "tasks")
+		params.myMode = BENCH_CORO_MODE_TASKS;
+	else
+		MG_BOX_ASSERT_F(false, "Unknown mode %s", mode.c_str());
+	params.myThreadCount = 1;
+	params.myTaskCount = 1;
+	if (params.myMode == BENCH_CORO_MODE_TASKS)
+	{
+		params.myThreadCount = cmdLine.GetU32("threads");
+		params.myTaskCount = cmdLine.GetU32("tasks");
+	}
+	params.myRequestCount = cmdLine.GetU32("requests");
+	params.myDepth = cmdLine.GetU32("depth");
+	uint32_t runCount = 1;
+	if (cmdLine.IsPresent("runs"))
+		runCount = cmdLine.GetU32("runs");
+	MG_BOX_ASSERT(params.myThreadCount > 0 && params.myTaskCount > 0 &&
+		params.myRequestCount > 0 && params.myDepth > 0);
+
+	BenchCaseGuard guard("Mode=%s, threads=%u, tasks=%u, requests=%u, depth=%u",
+		mode.c_str(), params.myThreadCount, params.myTaskCount, params.myRequestCount,
+		params.myDepth);
+	std::vector<BenchRunReport> reports;
+	reports.resize(runCount);
+	for (BenchRunReport& r : reports)
+		r = BenchCoroRun(params);
+
+	mg::box::CoroFrameStat stat;
+	mg::box::CoroFrameStatSnapshot(stat);
+	Report("== Frame stat:");
+	Report("Pool alloc count:           %12llu",
+		(unsigned long long)stat.myPoolAllocCount);
+	Report("Heap alloc count:           %12llu",
+		(unsigned long long)stat.myHeapAllocCount);
+	Report("");
+	if (runCount == 1)
+		return 0;
+	if (runCount < 3)
+		return -1;
+	std::sort(reports.begin(), reports.end());
+
+	Report("== Aggregated report:");
+	BenchRunReport* rMin = &reports[0];
+	// If the count is even, then intentionally print the lower middle.
+	BenchRunReport* rMed = &reports[runCount / 2];
+	BenchRunReport* rMax = &reports[runCount - 1];
+	Report("Requests/sec min:           %12llu",
+		(unsigned long long)rMin->myRequestsPerSec);
+	Report("Requests/sec median:        %12llu",
+		(unsigned long long)rMed->myRequestsPerSec);
+	Report("Requests/sec max:           %12llu",
+		(unsigned long long)rMax->myRequestsPerSec);
+	Report("");
+
+	Report("== Median report:");
+	rMed->Print();
+	return 0;
+}
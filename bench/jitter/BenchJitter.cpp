@@ -0,0 +1,19 @@
+#include "Bench.h"
+
+#include "mg/sch/TaskScheduler.h"
+
+namespace mg {
+namespace bench {
+
+	static inline void
+	BenchJitterSetDelay(
+		mg::sch::Task* aTask,
+		uint64_t aDelayUs)
+	{
+		aTask->SetDelayUs(aDelayUs);
+	}
+
+}
+}
+
+#include "BenchJitterTemplate.hpp"
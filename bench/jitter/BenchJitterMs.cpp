@@ -0,0 +1,21 @@
+#include "Bench.h"
+
+#include "mg/sch/TaskScheduler.h"
+
+namespace mg {
+namespace bench {
+
+	// How the short delays had to be done with milliseconds only. Rounded up to not fire
+	// earlier than needed.
+	static inline void
+	BenchJitterSetDelay(
+		mg::sch::Task* aTask,
+		uint64_t aDelayUs)
+	{
+		aTask->SetDelay((uint32_t)((aDelayUs + 999) / 1000));
+	}
+
+}
+}
+
+#include "BenchJitterTemplate.hpp"
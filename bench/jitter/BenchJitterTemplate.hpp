@@ -0,0 +1,205 @@
+#pragma once
+
+#include "Bench.h"
+
+#include "mg/box/Atomic.h"
+#include "mg/box/Time.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace mg {
+namespace bench {
+
+	struct BenchRunReport
+	{
+		BenchRunReport();
+
+		bool operator<(
+			const BenchRunReport& aOther) const;
+
+		void Print() const;
+
+		uint64_t myLateP50;
+		uint64_t myLateP99;
+		uint64_t myLateMax;
+		double myLateAvg;
+	};
+
+	// The task re-posts itself with the same delay and measures how much later than the
+	// target time it gets executed each time.
+	struct BenchJitterTask
+	{
+		BenchJitterTask();
+
+		void Post();
+
+		void Execute(
+			mg::sch::Task* aTask);
+
+		mg::sch::Task myTask;
+		mg::sch::TaskScheduler* myScheduler;
+		mg::box::AtomicU32* myDoneCount;
+		uint64_t myDelay;
+		uint64_t myTarget;
+		uint32_t myFireCount;
+		std::vector<uint64_t> myLateness;
+	};
+
+	//////////////////////////////////////////////////////////////////////////////////////
+
+	static BenchRunReport BenchJitterRun(
+		uint32_t aThreadCount,
+		uint32_t aTaskCount,
+		uint64_t aDelay,
+		uint32_t aFireCount);
+
+	//////////////////////////////////////////////////////////////////////////////////////
+
+	BenchRunReport::BenchRunReport()
+		: myLateP50(0)
+		, myLateP99(0)
+		, myLateMax(0)
+		, myLateAvg(0)
+	{
+	}
+
+	inline bool
+	BenchRunReport::operator<(
+		const BenchRunReport& aOther) const
+	{
+		return myLateP99 < aOther.myLateP99;
+	}
+
+	void
+	BenchRunReport::Print() const
+	{
+		Report("Lateness p99 us:            %12llu", (unsigned long long)myLateP99);
+		Report("Lateness p50 us:            %12llu", (unsigned long long)myLateP50);
+		Report("Lateness max us:            %12llu", (unsigned long long)myLateMax);
+		Report("Lateness avg us:            %12.3lf", myLateAvg);
+		Report("");
+	}
+
+	//////////////////////////////////////////////////////////////////////////////////////
+
+	BenchJitterTask::BenchJitterTask()
+		: myTask(std::bind(&BenchJitterTask::Execute, this, std::placeholders::_1))
+		, myScheduler(nullptr)
+		, myDoneCount(nullptr)
+		, myDelay(0)
+		, myTarget(0)
+		, myFireCount(0)
+	{
+	}
+
+	void
+	BenchJitterTask::Post()
+	{
+		myTarget = mg::box::GetMicroseconds() + myDelay;
+		BenchJitterSetDelay(&myTask, myDelay);
+		myScheduler->Post(&myTask);
+	}
+
+	void
+	BenchJitterTask::Execute(
+		mg::sch::Task*)
+	{
+		uint64_t now = mg::box::GetMicroseconds();
+		MG_BOX_ASSERT(now >= myTarget);
+		myLateness.push_back(now - myTarget);
+		if (myLateness.size() < myFireCount)
+			return Post();
+		myDoneCount->IncrementRelease();
+	}
+
+	//////////////////////////////////////////////////////////////////////////////////////
+
+	static BenchRunReport
+	BenchJitterRun(
+		uint32_t aThreadCount,
+		uint32_t aTaskCount,
+		uint64_t aDelay,
+		uint32_t aFireCount)
+	{
+		mg::sch::TaskScheduler sched("bch", 5000);
+		sched.Start(aThreadCount);
+		mg::box::AtomicU32 doneCount(0);
+		std::vector<BenchJitterTask> tasks(aTaskCount);
+		for (BenchJitterTask& t : tasks)
+		{
+			t.myScheduler = &sched;
+			t.myDoneCount = &doneCount;
+			t.myDelay = aDelay;
+			t.myFireCount = aFireCount;
+			t.myLateness.reserve(aFireCount);
+		}
+		for (BenchJitterTask& t : tasks)
+			t.Post();
+		while (doneCount.LoadAcquire() != aTaskCount)
+			mg::box::Sleep(1);
+
+		std::vector<uint64_t> lateness;
+		lateness.reserve((uint64_t)aTaskCount * aFireCount);
+		for (BenchJitterTask& t : tasks)
+			lateness.insert(lateness.end(), t.myLateness.begin(), t.myLateness.end());
+		std::sort(lateness.begin(), lateness.end());
+		uint64_t sum = 0;
+		for (uint64_t l : lateness)
+			sum += l;
+
+		BenchRunReport report;
+		report.myLateP50 = lateness[lateness.size() / 2];
+		report.myLateP99 = lateness[lateness.size() * 99 / 100];
+		report.myLateMax = lateness.back();
+		report.myLateAvg = (double)sum / lateness.size();
+		report.Print();
+		return report;
+	}
+
+}
+}
+
+int
+main(
+	int aArgc,
+	char** aArgv)
+{
+	using namespace mg::bench;
+	mg::tst::CommandLine cmdLine(aArgc - 1, aArgv + 1);
+	uint32_t threadCount = cmdLine.GetU32("threads");
+	uint32_t taskCount = cmdLine.GetU32("tasks");
+	uint64_t delay = cmdLine.GetU64("delay");
+	uint32_t fireCount = cmdLine.GetU32("fires");
+	MG_BOX_ASSERT(taskCount > 0 && fireCount > 0);
+	uint32_t runCount = 1;
+	if (cmdLine.IsPresent("runs"))
+		runCount = cmdLine.GetU32("runs");
+
+	BenchCaseGuard guard("Threads=%u, tasks=%u, delay=%llu us, fires=%u", threadCount,
+		taskCount, (unsigned long long)delay, fireCount);
+	std::vector<BenchRunReport> reports;
+	reports.resize(runCount);
+	for (BenchRunReport& r : reports)
+		r = BenchJitterRun(threadCount, taskCount, delay, fireCount);
+	if (runCount == 1)
+		return 0;
+	if (runCount < 3)
+		return -1;
+	std::sort(reports.begin(), reports.end());
+	Report("");
+
+	Report("== Aggregated report:");
+	BenchRunReport* rMin = &reports[0];
+	// If the count is even, then intentionally print the lower middle.
+	BenchRunReport* rMed = &reports[runCount / 2];
+	BenchRunReport* rMax = &reports[runCount - 1];
+	Report("Lateness p99 us min:        %12llu", (unsigned long long)rMin->myLateP99);
+	Report("Lateness p99 us median:     %12llu", (unsigned long long)rMed->myLateP99);
+	Report("Lateness p99 us max:        %12llu", (unsigned long long)rMax->myLateP99);
+	Report("");
+
+	Report("== Median report:");
+	rMed->Print();
+	return 0;
+}
@@ -0,0 +1,20 @@
+#include "Bench.h"
+
+#include "mg/sch/TaskScheduler.h"
+
+namespace mg {
+namespace bench {
+
+	template<typename Functor>
+	static inline void
+	BenchOneShotPost(
+		mg::sch::TaskScheduler& aSched,
+		Functor&& aFunc)
+	{
+		aSched.PostOneShot(std::forward<Functor>(aFunc));
+	}
+
+}
+}
+
+#include "BenchOneShotTemplate.hpp"
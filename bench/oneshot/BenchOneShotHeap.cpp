@@ -0,0 +1,56 @@
+#include "Bench.h"
+
+#include "mg/sch/TaskScheduler.h"
+
+#include <functional>
+
+namespace mg {
+namespace bench {
+
+	// The way the one-shot tasks were posted before the pooling. A new task on each post,
+	// and the callback in std::function, which allocates too if the capture doesn't fit
+	// into its small buffer.
+	struct BenchTaskOneShot
+		: public mg::sch::Task
+	{
+		template<typename Functor>
+		BenchTaskOneShot(
+			Functor&& aFunc);
+
+		static void Execute(
+			mg::sch::Task* aTask);
+
+		std::function<void(void)> myCallback;
+	};
+
+	template<typename Functor>
+	inline
+	BenchTaskOneShot::BenchTaskOneShot(
+		Functor&& aFunc)
+		: Task(&BenchTaskOneShot::Execute)
+		, myCallback(std::forward<Functor>(aFunc))
+	{
+	}
+
+	void
+	BenchTaskOneShot::Execute(
+		mg::sch::Task* aTask)
+	{
+		BenchTaskOneShot* self = static_cast<BenchTaskOneShot*>(aTask);
+		self->myCallback();
+		delete self;
+	}
+
+	template<typename Functor>
+	static inline void
+	BenchOneShotPost(
+		mg::sch::TaskScheduler& aSched,
+		Functor&& aFunc)
+	{
+		aSched.Post(new BenchTaskOneShot(std::forward<Functor>(aFunc)));
+	}
+
+}
+}
+
+#include "BenchOneShotTemplate.hpp"
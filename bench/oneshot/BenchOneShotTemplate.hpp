@@ -0,0 +1,243 @@
+#pragma once
+
+#include "Bench.h"
+
+#include "mg/box/Atomic.h"
+#include "mg/box/Time.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////////////////////////
+// All the heap allocations in the process are counted, including the ones in the worker
+// threads.
+
+static mg::box::AtomicU64 theBenchAllocCount(0);
+
+void*
+operator new(
+	size_t aSize)
+{
+	theBenchAllocCount.IncrementRelaxed();
+	void* res = malloc(aSize == 0 ? 1 : aSize);
+	if (res == nullptr)
+		throw std::bad_alloc();
+	return res;
+}
+
+void*
+operator new[](
+	size_t aSize)
+{
+	return operator new(aSize);
+}
+
+void
+operator delete(
+	void* aPtr) noexcept
+{
+	free(aPtr);
+}
+
+void
+operator delete[](
+	void* aPtr) noexcept
+{
+	free(aPtr);
+}
+
+void
+operator delete(
+	void* aPtr,
+	size_t) noexcept
+{
+	free(aPtr);
+}
+
+void
+operator delete[](
+	void* aPtr,
+	size_t) noexcept
+{
+	free(aPtr);
+}
+
+namespace mg {
+namespace bench {
+
+	struct BenchRunReport
+	{
+		BenchRunReport();
+
+		bool operator<(
+			const BenchRunReport& aOther) const;
+
+		void Print() const;
+
+		uint64_t myPostsPerSec;
+		double myMallocsPerPost;
+	};
+
+	// Capture which doesn't fit into std::function's small buffer, but fits into the
+	// task.
+	struct BenchCaptureSmall
+	{
+		uint64_t myData[2];
+	};
+
+	// Capture which doesn't fit even into the task.
+	struct BenchCaptureBig
+	{
+		uint64_t myData[16];
+	};
+
+	//////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename Capture>
+	static void BenchOneShotRound(
+		mg::sch::TaskScheduler& aSched,
+		uint32_t aPostCount);
+
+	template<typename Capture>
+	static BenchRunReport BenchOneShotRun(
+		uint32_t aThreadCount,
+		uint32_t aPostCount);
+
+	//////////////////////////////////////////////////////////////////////////////////////
+
+	BenchRunReport::BenchRunReport()
+		: myPostsPerSec(0)
+		, myMallocsPerPost(0)
+	{
+	}
+
+	inline bool
+	BenchRunReport::operator<(
+		const BenchRunReport& aOther) const
+	{
+		return myPostsPerSec < aOther.myPostsPerSec;
+	}
+
+	void
+	BenchRunReport::Print() const
+	{
+		Report("Posts/sec:                  %12llu",
+			(unsigned long long)myPostsPerSec);
+		Report("Mallocs/post:               %12.3lf", myMallocsPerPost);
+		Report("");
+	}
+
+	//////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename Capture>
+	static void
+	BenchOneShotRound(
+		mg::sch::TaskScheduler& aSched,
+		uint32_t aPostCount)
+	{
+		mg::box::AtomicU32 doneCount(0);
+		mg::box::AtomicU32* doneCountPtr = &doneCount;
+		Capture capture;
+		for (uint64_t& d : capture.myData)
+			d = 1;
+		for (uint32_t i = 0; i < aPostCount; ++i)
+		{
+			BenchOneShotPost(aSched, [doneCountPtr, capture]() {
+				MG_BOX_ASSERT(capture.myData[0] == 1);
+				doneCountPtr->IncrementRelaxed();
+			});
+		}
+		while (doneCount.LoadRelaxed() != aPostCount)
+			mg::box::Sleep(1);
+		aSched.WaitEmpty();
+	}
+
+	template<typename Capture>
+	static BenchRunReport
+	BenchOneShotRun(
+		uint32_t aThreadCount,
+		uint32_t aPostCount)
+	{
+		mg::sch::TaskScheduler sched("bch", 5000);
+		sched.Start(aThreadCount);
+		// Warm up. The scheduler's queues and the task pools get filled, and the next
+		// rounds work in a steady state.
+		for (int i = 0; i < 3; ++i)
+			BenchOneShotRound<Capture>(sched, aPostCount);
+
+		BenchRunReport report;
+		uint64_t allocCount = theBenchAllocCount.LoadRelaxed();
+		TimedGuard timed("Posts");
+		BenchOneShotRound<Capture>(sched, aPostCount);
+		timed.Stop();
+		double durationMs = timed.GetMilliseconds();
+		allocCount = theBenchAllocCount.LoadRelaxed() - allocCount;
+
+		report.myPostsPerSec = (uint64_t)(aPostCount * 1000 / durationMs);
+		report.myMallocsPerPost = (double)allocCount / aPostCount;
+		report.Print();
+		return report;
+	}
+
+}
+}
+
+int
+main(
+	int aArgc,
+	char** aArgv)
+{
+	using namespace mg::bench;
+	mg::tst::CommandLine cmdLine(aArgc - 1, aArgv + 1);
+	uint32_t threadCount = cmdLine.GetU32("threads");
+	uint32_t postCount = cmdLine.GetU32("posts");
+	bool isBig = false;
+	if (cmdLine.IsPresent("capture"))
+	{
+		const std::string& capture = cmdLine.GetStr("capture");
+		if (capture == "big")
+			isBig = true;
+		else
+			MG_BOX_ASSERT(capture == "small");
+	}
+	uint32_t runCount = 1;
+	if (cmdLine.IsPresent("runs"))
+		runCount = cmdLine.GetU32("runs");
+
+	BenchCaseGuard guard("Threads=%u, posts=%u, capture=%s", threadCount, postCount,
+		isBig ? "big" : "small");
+	std::vector<BenchRunReport> reports;
+	reports.resize(runCount);
+	for (BenchRunReport& r : reports)
+	{
+		if (isBig)
+			r = BenchOneShotRun<BenchCaptureBig>(threadCount, postCount);
+		else
+			r = BenchOneShotRun<BenchCaptureSmall>(threadCount, postCount);
+	}
+	if (runCount == 1)
+		return 0;
+	if (runCount < 3)
+		return -1;
+	std::sort(reports.begin(), reports.end());
+	Report("");
+
+	Report("== Aggregated report:");
+	BenchRunReport* rMin = &reports[0];
+	// If the count is even, then intentionally print the lower middle.
+	BenchRunReport* rMed = &reports[runCount / 2];
+	BenchRunReport* rMax = &reports[runCount - 1];
+	Report("Posts/sec min:              %12llu",
+		(unsigned long long)rMin->myPostsPerSec);
+	Report("Posts/sec median:           %12llu",
+		(unsigned long long)rMed->myPostsPerSec);
+	Report("Posts/sec max:              %12llu",
+		(unsigned long long)rMax->myPostsPerSec);
+	Report("");
+
+	Report("== Median report:");
+	rMed->Print();
+	return 0;
+}
@@ -0,0 +1,24 @@
+#include "Bench.h"
+
+#include "mg/sch/TaskSync.h"
+
+namespace mg {
+namespace bench {
+
+	// The waiters are parked in the mutex, and their workers take other tasks.
+	class BenchMutex
+	{
+	public:
+		mg::sch::TaskCoroOpSemaphoreAcquire Lock(
+			mg::sch::Task* aTask) { return myMutex.AsyncLock(aTask); }
+
+		void Unlock() { myMutex.Unlock(); }
+
+	private:
+		mg::sch::TaskMutex myMutex;
+	};
+
+}
+}
+
+#include "BenchTaskMutexTemplate.hpp"
@@ -0,0 +1,28 @@
+#include "Bench.h"
+
+#include "mg/box/Mutex.h"
+#include "mg/sch/Task.h"
+
+#include <coroutine>
+
+namespace mg {
+namespace bench {
+
+	// The waiters block their workers. The mutex is never held across a suspension,
+	// because the task can be resumed in another thread.
+	class BenchMutex
+	{
+	public:
+		std::suspend_never Lock(
+			mg::sch::Task*) { myMutex.Lock(); return {}; }
+
+		void Unlock() { myMutex.Unlock(); }
+
+	private:
+		mg::box::Mutex myMutex;
+	};
+
+}
+}
+
+#include "BenchTaskMutexTemplate.hpp"
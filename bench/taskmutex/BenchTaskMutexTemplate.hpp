@@ -0,0 +1,221 @@
+#pragma once
+
+#include "Bench.h"
+
+#include "mg/box/Atomic.h"
+#include "mg/box/Coro.h"
+#include "mg/box/Time.h"
+#include "mg/sch/TaskScheduler.h"
+
+#include <algorithm>
+#include <vector>
+
+#if !MG_CORO_IS_ENABLED
+#error "Coroutines are not supported by the compiler"
+#endif
+
+namespace mg {
+namespace bench {
+
+	struct BenchTaskMutexParams
+	{
+		uint32_t myThreadCount;
+		uint32_t myTaskCount;
+		uint32_t myOpCount;
+		// Iterations of a dummy loop inside of the critical section.
+		uint32_t myWorkCount;
+		// Iterations of a dummy loop outside of the critical section.
+		uint32_t myOutsideWorkCount;
+	};
+
+	struct BenchTaskMutexCtx
+	{
+		BenchMutex myMutex;
+		// Protected by the mutex.
+		uint64_t myData[16];
+		const BenchTaskMutexParams* myParams;
+		mg::box::AtomicU32 myDoneCount;
+	};
+
+	struct BenchRunReport
+	{
+		BenchRunReport();
+
+		bool operator<(
+			const BenchRunReport& aOther) const;
+
+		void Print() const;
+
+		uint64_t myOpsPerSec;
+	};
+
+	//////////////////////////////////////////////////////////////////////////////////////
+
+	static uint64_t BenchTaskMutexWork(
+		uint64_t* aData,
+		uint32_t aCount);
+
+	static mg::box::Coro BenchTaskMutexBody(
+		mg::sch::Task* aTask,
+		BenchTaskMutexCtx& aCtx);
+
+	static void BenchTaskMutexRound(
+		mg::sch::TaskScheduler& aSched,
+		BenchTaskMutexCtx& aCtx);
+
+	static BenchRunReport BenchTaskMutexRun(
+		const BenchTaskMutexParams& aParams);
+
+	//////////////////////////////////////////////////////////////////////////////////////
+
+	BenchRunReport::BenchRunReport()
+		: myOpsPerSec(0)
+	{
+	}
+
+	inline bool
+	BenchRunReport::operator<(
+		const BenchRunReport& aOther) const
+	{
+		return myOpsPerSec < aOther.myOpsPerSec;
+	}
+
+	void
+	BenchRunReport::Print() const
+	{
+		Report("Ops/sec:                    %12llu", (unsigned long long)myOpsPerSec);
+		Report("");
+	}
+
+	//////////////////////////////////////////////////////////////////////////////////////
+
+	static uint64_t
+	BenchTaskMutexWork(
+		uint64_t* aData,
+		uint32_t aCount)
+	{
+		uint64_t sum = 0;
+		for (uint32_t i = 0; i < aCount; ++i)
+		{
+			aData[i % 16] += i;
+			sum += aData[(i + 7) % 16];
+		}
+		return sum;
+	}
+
+	static mg::box::Coro
+	BenchTaskMutexBody(
+		mg::sch::Task* aTask,
+		BenchTaskMutexCtx& aCtx)
+	{
+		const BenchTaskMutexParams& params = *aCtx.myParams;
+		uint64_t local[16] = {};
+		uint64_t sum = 0;
+		for (uint32_t i = 0; i < params.myOpCount; ++i)
+		{
+			co_await aCtx.myMutex.Lock(aTask);
+			sum += BenchTaskMutexWork(aCtx.myData, params.myWorkCount);
+			aCtx.myMutex.Unlock();
+			sum += BenchTaskMutexWork(local, params.myOutsideWorkCount);
+			co_await aTask->AsyncYield();
+		}
+		// Don't let the compiler drop the work.
+		aCtx.myData[0] += sum == 0;
+		aCtx.myDoneCount.IncrementRelease();
+		co_return;
+	}
+
+	static void
+	BenchTaskMutexRound(
+		mg::sch::TaskScheduler& aSched,
+		BenchTaskMutexCtx& aCtx)
+	{
+		const BenchTaskMutexParams& params = *aCtx.myParams;
+		aCtx.myDoneCount.StoreRelaxed(0);
+		std::vector<mg::sch::Task> tasks(params.myTaskCount);
+		for (mg::sch::Task& t : tasks)
+		{
+			t.SetCallback(BenchTaskMutexBody(&t, aCtx));
+			aSched.Post(&t);
+		}
+		while (aCtx.myDoneCount.LoadAcquire() != params.myTaskCount)
+			mg::box::Sleep(1);
+		aSched.WaitEmpty();
+	}
+
+	static BenchRunReport
+	BenchTaskMutexRun(
+		const BenchTaskMutexParams& aParams)
+	{
+		mg::sch::TaskScheduler sched("bch", 5000);
+		sched.Start(aParams.myThreadCount);
+		BenchTaskMutexCtx ctx;
+		for (uint64_t& d : ctx.myData)
+			d = 0;
+		ctx.myParams = &aParams;
+		// Warm up.
+		BenchTaskMutexRound(sched, ctx);
+
+		BenchRunReport report;
+		TimedGuard timed("Ops");
+		BenchTaskMutexRound(sched, ctx);
+		timed.Stop();
+		double durationMs = timed.GetMilliseconds();
+
+		uint64_t opCount = (uint64_t)aParams.myOpCount * aParams.myTaskCount;
+		report.myOpsPerSec = (uint64_t)(opCount * 1000 / durationMs);
+		report.Print();
+		return report;
+	}
+
+}
+}
+
+int
+main(
+	int aArgc,
+	char** aArgv)
+{
+	using namespace mg::bench;
+	mg::tst::CommandLine cmdLine(aArgc - 1, aArgv + 1);
+	BenchTaskMutexParams params;
+	params.myThreadCount = cmdLine.GetU32("threads");
+	params.myTaskCount = cmdLine.GetU32("tasks");
+	params.myOpCount = cmdLine.GetU32("ops");
+	params.myWorkCount = cmdLine.GetU32("work");
+	params.myOutsideWorkCount = 0;
+	if (cmdLine.IsPresent("outside"))
+		params.myOutsideWorkCount = cmdLine.GetU32("outside");
+	uint32_t runCount = 1;
+	if (cmdLine.IsPresent("runs"))
+		runCount = cmdLine.GetU32("runs");
+	MG_BOX_ASSERT(params.myThreadCount > 0 && params.myTaskCount > 0 &&
+		params.myOpCount > 0);
+
+	BenchCaseGuard guard("Threads=%u, tasks=%u, ops=%u, work=%u, outside=%u",
+		params.myThreadCount, params.myTaskCount, params.myOpCount, params.myWorkCount,
+		params.myOutsideWorkCount);
+	std::vector<BenchRunReport> reports;
+	reports.resize(runCount);
+	for (BenchRunReport& r : reports)
+		r = BenchTaskMutexRun(params);
+	if (runCount == 1)
+		return 0;
+	if (runCount < 3)
+		return -1;
+	std::sort(reports.begin(), reports.end());
+
+	Report("== Aggregated report:");
+	BenchRunReport* rMin = &reports[0];
+	// If the count is even, then intentionally print the lower middle.
+	BenchRunReport* rMed = &reports[runCount / 2];
+	BenchRunReport* rMax = &reports[runCount - 1];
+	Report("Ops/sec min:                %12llu", (unsigned long long)rMin->myOpsPerSec);
+	Report("Ops/sec median:             %12llu", (unsigned long long)rMed->myOpsPerSec);
+	Report("Ops/sec max:                %12llu", (unsigned long long)rMax->myOpsPerSec);
+	Report("");
+
+	Report("== Median report:");
+	rMed->Print();
+	return 0;
+}
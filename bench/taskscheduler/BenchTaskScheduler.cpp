@@ -7,8 +7,33 @@ namespace bench {
 
 	using Task = mg::sch::Task;
 	using TaskScheduler = mg::sch::TaskScheduler;
+	using TaskSchedulerParams = mg::sch::TaskSchedulerParams;
 	using TaskSchedulerThread = mg::sch::TaskSchedulerThread;
 
+	static void
+	BenchTaskSchedulerParamsFromCommandLine(
+		const mg::tst::CommandLine& aCmdLine,
+		TaskSchedulerParams& aOutParams)
+	{
+		if (aCmdLine.IsPresent("spin"))
+			aOutParams.myIdleSpinUs = aCmdLine.GetU32("spin");
+		if (aCmdLine.IsPresent("yield"))
+			aOutParams.myIsIdleYield = aCmdLine.GetU32("yield") != 0;
+		if (aCmdLine.IsPresent("hot"))
+			aOutParams.myIsLatencyCritical = aCmdLine.GetU32("hot") != 0;
+		if (aCmdLine.IsPresent("stat"))
+			aOutParams.myIsStatEnabled = aCmdLine.GetU32("stat") != 0;
+		if (!aCmdLine.IsPresent("mode"))
+			return;
+		const std::string& mode = aCmdLine.GetStr("mode");
+		if (mode == "shared")
+			aOutParams.myQueueMode = mg::sch::TASK_SCHEDULER_QUEUE_MODE_SHARED;
+		else if (mode == "local")
+			aOutParams.myQueueMode = mg::sch::TASK_SCHEDULER_QUEUE_MODE_LOCAL;
+		else
+			MG_BOX_ASSERT_F(false, "Unknown mode %s", mode.c_str());
+	}
+
 }
 }
 
@@ -0,0 +1,187 @@
+#include "Bench.h"
+
+#include "mg/box/Signal.h"
+#include "mg/box/Time.h"
+#include "mg/sch/TaskGraph.h"
+#include "mg/sch/TaskScheduler.h"
+
+#include <vector>
+
+namespace mg {
+namespace bench {
+
+	// The graph is a grid of layers. Each node depends on 2 nodes of the previous layer,
+	// so there is plenty of both fan-in and fan-out.
+	struct BenchGraphShape
+	{
+		uint32_t myWidth;
+		uint32_t myDepth;
+		BenchLoadType myLoad;
+	};
+
+	static void
+	BenchGraphMakeWork(
+		BenchLoadType aLoad)
+	{
+		switch (aLoad)
+		{
+		case BENCH_LOAD_EMPTY:
+			break;
+		case BENCH_LOAD_NANO:
+			BenchMakeNanoWork();
+			break;
+		case BENCH_LOAD_MICRO:
+			BenchMakeMicroWork();
+			break;
+		case BENCH_LOAD_HEAVY:
+			BenchMakeHeavyWork();
+			break;
+		default:
+			MG_BOX_ASSERT(false);
+			break;
+		}
+	}
+
+	// Returns the duration in milliseconds.
+	static double
+	BenchGraphRunTaskGraph(
+		mg::sch::TaskScheduler& aSched,
+		const BenchGraphShape& aShape,
+		uint32_t aLoopCount)
+	{
+		mg::sch::TaskGraph graph(aSched);
+		std::vector<mg::sch::TaskGraphNode*> prev;
+		std::vector<mg::sch::TaskGraphNode*> cur;
+		BenchLoadType load = aShape.myLoad;
+		for (uint32_t i = 0; i < aShape.myDepth; ++i)
+		{
+			cur.clear();
+			for (uint32_t j = 0; j < aShape.myWidth; ++j)
+			{
+				mg::sch::TaskGraphNode* node = graph.AddNode([load]() {
+					BenchGraphMakeWork(load);
+				});
+				if (!prev.empty())
+				{
+					node->DependOn(prev[j]);
+					if (aShape.myWidth > 1)
+						node->DependOn(prev[(j + 1) % aShape.myWidth]);
+				}
+				cur.push_back(node);
+			}
+			prev.swap(cur);
+		}
+		graph.Prepare();
+		double start = mg::box::GetMillisecondsPrecise();
+		for (uint32_t i = 0; i < aLoopCount; ++i)
+			graph.RunBlocking();
+		return mg::box::GetMillisecondsPrecise() - start;
+	}
+
+	struct BenchGraphManualNode
+	{
+		mg::sch::Task myTask;
+		mg::box::AtomicU32 myPendingCount;
+		uint32_t myDependencyCount;
+		std::vector<BenchGraphManualNode*> mySuccessors;
+	};
+
+	// The same graph, but each node is a task waiting for a signal from its last
+	// finished dependency. This is how the dependencies would be done by hand, without
+	// the graph.
+	static double
+	BenchGraphRunManual(
+		mg::sch::TaskScheduler& aSched,
+		const BenchGraphShape& aShape,
+		uint32_t aLoopCount)
+	{
+		uint32_t nodeCount = aShape.myWidth * aShape.myDepth;
+		std::vector<BenchGraphManualNode> nodes(nodeCount);
+		mg::box::AtomicU32 pendingCount(0);
+		mg::box::Signal doneSignal;
+		BenchLoadType load = aShape.myLoad;
+		for (uint32_t i = 0; i < nodeCount; ++i)
+		{
+			BenchGraphManualNode* node = &nodes[i];
+			node->myDependencyCount = 0;
+			node->myTask.SetCallback([&, node, load](mg::sch::Task* aTask) {
+				bool isSignaled = aTask->ReceiveSignal();
+				MG_BOX_ASSERT(isSignaled);
+				BenchGraphMakeWork(load);
+				for (BenchGraphManualNode* succ : node->mySuccessors)
+				{
+					if (succ->myPendingCount.DecrementFetchAcqRel() == 0)
+						succ->myTask.PostSignal();
+				}
+				if (pendingCount.DecrementFetchAcqRel() == 0)
+					doneSignal.Send();
+			});
+			if (i < aShape.myWidth)
+				continue;
+			uint32_t layer = i / aShape.myWidth;
+			uint32_t j = i % aShape.myWidth;
+			uint32_t prevBegin = (layer - 1) * aShape.myWidth;
+			nodes[prevBegin + j].mySuccessors.push_back(node);
+			++node->myDependencyCount;
+			if (aShape.myWidth > 1)
+			{
+				nodes[prevBegin + (j + 1) % aShape.myWidth].mySuccessors.push_back(node);
+				++node->myDependencyCount;
+			}
+		}
+		double start = mg::box::GetMillisecondsPrecise();
+		for (uint32_t i = 0; i < aLoopCount; ++i)
+		{
+			pendingCount.StoreRelaxed(nodeCount);
+			for (BenchGraphManualNode& node : nodes)
+			{
+				node.myPendingCount.StoreRelaxed(node.myDependencyCount);
+				aSched.PostWait(&node.myTask);
+			}
+			for (uint32_t j = 0; j < aShape.myWidth; ++j)
+				nodes[j].myTask.PostSignal();
+			do
+			{
+				doneSignal.ReceiveBlocking();
+			} while (pendingCount.LoadAcquire() != 0);
+		}
+		return mg::box::GetMillisecondsPrecise() - start;
+	}
+
+}
+}
+
+int
+main(
+	int aArgc,
+	char** aArgv)
+{
+	using namespace mg::bench;
+	mg::tst::CommandLine cmdLine(aArgc - 1, aArgv + 1);
+	uint32_t threadCount = cmdLine.GetU32("threads");
+	BenchGraphShape shape;
+	shape.myWidth = cmdLine.GetU32("width");
+	shape.myDepth = cmdLine.GetU32("depth");
+	shape.myLoad = BenchLoadTypeFromString(cmdLine.GetStr("load"));
+	uint32_t loopCount = 1;
+	if (cmdLine.IsPresent("loops"))
+		loopCount = cmdLine.GetU32("loops");
+	MG_BOX_ASSERT(threadCount > 0 && shape.myWidth > 0 && shape.myDepth > 0 &&
+		loopCount > 0);
+
+	BenchCaseGuard guard("Task graph, threads=%u, width=%u, depth=%u, loops=%u, "
+		"load=%s", threadCount, shape.myWidth, shape.myDepth, loopCount,
+		BenchLoadTypeToString(shape.myLoad));
+	mg::sch::TaskScheduler sched("bch", 5000);
+	sched.Start(threadCount);
+	double graphMs = BenchGraphRunTaskGraph(sched, shape, loopCount);
+	double manualMs = BenchGraphRunManual(sched, shape, loopCount);
+	sched.Stop();
+
+	double nodeCount = (double)shape.myWidth * shape.myDepth * loopCount;
+	Report("== Graph report:");
+	Report("  Method |   Duration ms |   Nodes per second");
+	Report("   graph | %13.3lf | %18.0lf", graphMs, nodeCount * 1000 / graphMs);
+	Report("  manual | %13.3lf | %18.0lf", manualMs, nodeCount * 1000 / manualMs);
+	return 0;
+}
@@ -0,0 +1,179 @@
+#include "Bench.h"
+
+#include "mg/box/Time.h"
+#include "mg/sch/TaskScheduler.h"
+
+#include <vector>
+
+namespace mg {
+namespace bench {
+
+	// Long bulk tasks keep all the workers busy, and timer tasks re-post themselves with
+	// a delay. The lateness of the timers from their deadlines to their execution shows
+	// how long the expired deadlines wait to be noticed and dispatched.
+	struct BenchLatenessParams
+	{
+		uint32_t myThreadCount;
+		uint32_t myTaskCount;
+		// Duration of one bulk task in microseconds.
+		uint32_t myWork;
+		uint32_t myTimerCount;
+		// Delay of each timer re-post in microseconds.
+		uint32_t myPeriod;
+		// Of the whole measurement in milliseconds.
+		uint32_t myDuration;
+	};
+
+	struct BenchLatenessReport
+	{
+		uint64_t myLatenessMed;
+		uint64_t myLateness99;
+		uint64_t myLateness999;
+		uint64_t myLatenessMax;
+		uint64_t myTimerCount;
+		double myBulkPerSec;
+	};
+
+	enum BenchLatenessMode
+	{
+		BENCH_LATENESS_MODE_SHARED,
+		BENCH_LATENESS_MODE_DEDICATED,
+		BENCH_LATENESS_MODE_DEDICATED_HOT,
+	};
+
+	static void
+	BenchLatenessMakeWork(
+		uint32_t aWork)
+	{
+		uint64_t end = mg::box::GetMicroseconds() + aWork;
+		while (mg::box::GetMicroseconds() < end)
+			BenchMakeNanoWork();
+	}
+
+	static BenchLatenessReport
+	BenchLatenessRun(
+		const BenchLatenessParams& aParams,
+		BenchLatenessMode aMode)
+	{
+		mg::sch::TaskSchedulerParams schedParams;
+		// The lateness is collected by the scheduler itself.
+		schedParams.myIsStatEnabled = true;
+		schedParams.myIsSchedDedicated = aMode != BENCH_LATENESS_MODE_SHARED;
+		schedParams.myIsLatencyCritical = aMode == BENCH_LATENESS_MODE_DEDICATED_HOT;
+		mg::sch::TaskScheduler sched("bch", 5000, schedParams);
+		sched.Start(aParams.myThreadCount);
+
+		mg::box::AtomicBool isStopped(false);
+		mg::box::AtomicU32 doneCount(0);
+		mg::box::AtomicU64 bulkCount(0);
+		uint32_t work = aParams.myWork;
+		std::vector<mg::sch::Task> tasks(aParams.myTaskCount);
+		for (mg::sch::Task& t : tasks)
+		{
+			t.SetCallback([&, work](mg::sch::Task* aTask) {
+				BenchLatenessMakeWork(work);
+				bulkCount.IncrementRelaxed();
+				if (isStopped.LoadRelaxed())
+				{
+					doneCount.IncrementRelaxed();
+					return;
+				}
+				sched.Post(aTask);
+			});
+		}
+		uint32_t period = aParams.myPeriod;
+		std::vector<mg::sch::Task> timers(aParams.myTimerCount);
+		for (mg::sch::Task& t : timers)
+		{
+			t.SetCallback([&, period](mg::sch::Task* aTask) {
+				if (isStopped.LoadRelaxed())
+				{
+					doneCount.IncrementRelaxed();
+					return;
+				}
+				sched.PostDelayUs(aTask, period);
+			});
+		}
+		double start = mg::box::GetMillisecondsPrecise();
+		for (mg::sch::Task& t : tasks)
+			sched.Post(&t);
+		for (mg::sch::Task& t : timers)
+			sched.PostDelayUs(&t, period);
+		mg::box::Sleep(aParams.myDuration);
+		isStopped.StoreRelaxed(true);
+		double durationMs = mg::box::GetMillisecondsPrecise() - start;
+		uint64_t bulkTotal = bulkCount.LoadRelaxed();
+		while (doneCount.LoadRelaxed() != aParams.myTaskCount + aParams.myTimerCount)
+			mg::box::Sleep(1);
+		mg::sch::TaskSchedulerStat stat;
+		sched.StatSnapshot(stat);
+		sched.Stop();
+
+		BenchLatenessReport report;
+		report.myLatenessMed = stat.myLateness.GetPercentile(50);
+		report.myLateness99 = stat.myLateness.GetPercentile(99);
+		report.myLateness999 = stat.myLateness.GetPercentile(99.9);
+		report.myLatenessMax = stat.myLateness.GetMax();
+		report.myTimerCount = stat.myLateness.GetCount();
+		report.myBulkPerSec = bulkTotal * 1000 / durationMs;
+		return report;
+	}
+
+	static void
+	BenchLatenessPrint(
+		const char* aName,
+		const BenchLatenessReport& aReport)
+	{
+		Report("%9s | %8llu | %8llu | %8llu | %8llu | %10llu | %12.0lf", aName,
+			(unsigned long long)aReport.myLatenessMed,
+			(unsigned long long)aReport.myLateness99,
+			(unsigned long long)aReport.myLateness999,
+			(unsigned long long)aReport.myLatenessMax,
+			(unsigned long long)aReport.myTimerCount, aReport.myBulkPerSec);
+	}
+
+}
+}
+
+int
+main(
+	int aArgc,
+	char** aArgv)
+{
+	using namespace mg::bench;
+	mg::tst::CommandLine cmdLine(aArgc - 1, aArgv + 1);
+	BenchLatenessParams params;
+	params.myThreadCount = cmdLine.GetU32("threads");
+	params.myTaskCount = cmdLine.GetU32("tasks");
+	params.myWork = 1000;
+	if (cmdLine.IsPresent("work"))
+		params.myWork = cmdLine.GetU32("work");
+	params.myTimerCount = 100;
+	if (cmdLine.IsPresent("timers"))
+		params.myTimerCount = cmdLine.GetU32("timers");
+	params.myPeriod = 1000;
+	if (cmdLine.IsPresent("period"))
+		params.myPeriod = cmdLine.GetU32("period");
+	params.myDuration = 3000;
+	if (cmdLine.IsPresent("duration"))
+		params.myDuration = cmdLine.GetU32("duration");
+	MG_BOX_ASSERT(params.myThreadCount > 0 && params.myTaskCount > 0 &&
+		params.myTimerCount > 0 && params.myDuration > 0);
+
+	BenchCaseGuard guard("Deadline lateness, threads=%u, tasks=%u, work=%u, timers=%u, "
+		"period=%u, duration=%u", params.myThreadCount, params.myTaskCount,
+		params.myWork, params.myTimerCount, params.myPeriod, params.myDuration);
+	BenchLatenessReport shared = BenchLatenessRun(params, BENCH_LATENESS_MODE_SHARED);
+	BenchLatenessReport dedicated = BenchLatenessRun(params,
+		BENCH_LATENESS_MODE_DEDICATED);
+	BenchLatenessReport hot = BenchLatenessRun(params,
+		BENCH_LATENESS_MODE_DEDICATED_HOT);
+
+	Report("== Timer lateness report (microseconds):");
+	Report("     Mode |   Median |      p99 |    p99.9 |      Max |     Timers | "
+		"Bulk per sec");
+	BenchLatenessPrint("shared", shared);
+	BenchLatenessPrint("dedicated", dedicated);
+	BenchLatenessPrint("hot", hot);
+	return 0;
+}
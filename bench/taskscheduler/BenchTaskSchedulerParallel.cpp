@@ -0,0 +1,98 @@
+#include "Bench.h"
+
+#include "mg/box/Time.h"
+#include "mg/sch/TaskScheduler.h"
+
+#include <vector>
+
+namespace mg {
+namespace bench {
+
+	// Returns the duration in milliseconds.
+	static double
+	BenchParallelForRun(
+		uint32_t aThreadCount,
+		uint64_t aItemCount,
+		uint64_t aGrain,
+		BenchLoadType aLoad,
+		uint32_t aLoopCount)
+	{
+		mg::sch::TaskScheduler sched("bch", 5000);
+		// The calling thread participates in the loops too. So it is one of the threads.
+		if (aThreadCount > 1)
+			sched.Start(aThreadCount - 1);
+		mg::sch::TaskParallelForCallback body;
+		switch (aLoad)
+		{
+		case BENCH_LOAD_EMPTY:
+			body = [](uint64_t, uint64_t) {};
+			break;
+		case BENCH_LOAD_NANO:
+			body = [](uint64_t aBegin, uint64_t aEnd) {
+				for (uint64_t i = aBegin; i < aEnd; ++i)
+					BenchMakeNanoWork();
+			};
+			break;
+		case BENCH_LOAD_MICRO:
+			body = [](uint64_t aBegin, uint64_t aEnd) {
+				for (uint64_t i = aBegin; i < aEnd; ++i)
+					BenchMakeMicroWork();
+			};
+			break;
+		case BENCH_LOAD_HEAVY:
+			body = [](uint64_t aBegin, uint64_t aEnd) {
+				for (uint64_t i = aBegin; i < aEnd; ++i)
+					BenchMakeHeavyWork();
+			};
+			break;
+		default:
+			MG_BOX_ASSERT(false);
+			break;
+		}
+		double start = mg::box::GetMillisecondsPrecise();
+		for (uint32_t i = 0; i < aLoopCount; ++i)
+			sched.ParallelFor(0, aItemCount, aGrain, body);
+		double duration = mg::box::GetMillisecondsPrecise() - start;
+		sched.Stop();
+		return duration;
+	}
+
+}
+}
+
+int
+main(
+	int aArgc,
+	char** aArgv)
+{
+	using namespace mg::bench;
+	mg::tst::CommandLine cmdLine(aArgc - 1, aArgv + 1);
+	uint32_t threadCount = cmdLine.GetU32("threads");
+	uint64_t itemCount = cmdLine.GetU64("items");
+	uint64_t grain = 1;
+	if (cmdLine.IsPresent("grain"))
+		grain = cmdLine.GetU64("grain");
+	uint32_t loopCount = 1;
+	if (cmdLine.IsPresent("loops"))
+		loopCount = cmdLine.GetU32("loops");
+	BenchLoadType load = BenchLoadTypeFromString(cmdLine.GetStr("load"));
+	MG_BOX_ASSERT(threadCount > 0 && itemCount > 0 && loopCount > 0);
+
+	BenchCaseGuard guard("Parallel for, threads=1..%u, items=%llu, grain=%llu, "
+		"loops=%u, load=%s", threadCount, (unsigned long long)itemCount,
+		(unsigned long long)grain, loopCount, BenchLoadTypeToString(load));
+	std::vector<double> durations;
+	for (uint32_t i = 1; i <= threadCount; ++i)
+		durations.push_back(BenchParallelForRun(i, itemCount, grain, load, loopCount));
+
+	Report("== Scaling report:");
+	Report("Threads |   Duration ms |   Items per second |  Speedup | Efficiency");
+	for (uint32_t i = 1; i <= threadCount; ++i)
+	{
+		double duration = durations[i - 1];
+		double speedup = durations[0] / duration;
+		Report("%7u | %13.3lf | %18.0lf | %8.2lf | %9.0lf%%", i, duration,
+			itemCount * loopCount * 1000.0 / duration, speedup, speedup * 100 / i);
+	}
+	return 0;
+}
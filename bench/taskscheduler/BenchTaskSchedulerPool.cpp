@@ -0,0 +1,191 @@
+#include "Bench.h"
+
+#include "mg/box/Time.h"
+#include "mg/sch/TaskScheduler.h"
+
+#if !IS_PLATFORM_WIN
+#include <sys/resource.h>
+#endif
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+namespace mg {
+namespace bench {
+
+	// Several schedulers are loaded at once, each by own tasks re-posting themselves.
+	// They either have own threads each, or share one pool.
+	struct BenchPoolParams
+	{
+		uint32_t mySchedulerCount;
+		uint32_t myThreadCount;
+		uint32_t myTaskCount;
+		// Of the measurement in milliseconds.
+		uint32_t myDuration;
+		BenchLoadType myLoad;
+	};
+
+	struct BenchPoolReport
+	{
+		double myTasksPerSec;
+		uint64_t myMinCount;
+		uint64_t myMaxCount;
+		uint64_t mySwitchCount;
+	};
+
+	static void
+	BenchPoolMakeWork(
+		BenchLoadType aLoad)
+	{
+		switch (aLoad)
+		{
+		case BENCH_LOAD_EMPTY:
+			break;
+		case BENCH_LOAD_NANO:
+			BenchMakeNanoWork();
+			break;
+		case BENCH_LOAD_MICRO:
+			BenchMakeMicroWork();
+			break;
+		case BENCH_LOAD_HEAVY:
+			BenchMakeHeavyWork();
+			break;
+		default:
+			MG_BOX_ASSERT(false);
+			break;
+		}
+	}
+
+	// Voluntary and involuntary context switches of the whole process.
+	static uint64_t
+	BenchPoolGetSwitchCount()
+	{
+#if IS_PLATFORM_WIN
+		return 0;
+#else
+		struct rusage usage;
+		MG_BOX_ASSERT(getrusage(RUSAGE_SELF, &usage) == 0);
+		return usage.ru_nvcsw + usage.ru_nivcsw;
+#endif
+	}
+
+	static BenchPoolReport
+	BenchPoolRun(
+		const BenchPoolParams& aParams,
+		bool aIsShared)
+	{
+		mg::sch::TaskSchedulerPool pool("bchp");
+		std::vector<std::unique_ptr<mg::sch::TaskScheduler>> scheds;
+		scheds.reserve(aParams.mySchedulerCount);
+		if (aIsShared)
+			pool.Start(aParams.myThreadCount);
+		for (uint32_t i = 0; i < aParams.mySchedulerCount; ++i)
+		{
+			scheds.emplace_back(new mg::sch::TaskScheduler("bch", 5000));
+			if (aIsShared)
+				scheds.back()->Start(pool, 1);
+			else
+				scheds.back()->Start(aParams.myThreadCount);
+		}
+
+		mg::box::AtomicBool isStopped(false);
+		mg::box::AtomicU32 doneCount(0);
+		std::vector<mg::box::AtomicU64> counts(aParams.mySchedulerCount);
+		for (mg::box::AtomicU64& c : counts)
+			c.StoreRelaxed(0);
+		BenchLoadType load = aParams.myLoad;
+		uint32_t totalTaskCount = aParams.myTaskCount * aParams.mySchedulerCount;
+		std::vector<mg::sch::Task> tasks(totalTaskCount);
+		for (uint32_t i = 0; i < totalTaskCount; ++i)
+		{
+			mg::sch::TaskScheduler* sched = scheds[i % aParams.mySchedulerCount].get();
+			mg::box::AtomicU64* count = &counts[i % aParams.mySchedulerCount];
+			tasks[i].SetCallback([&, sched, count, load](mg::sch::Task* aTask) {
+				BenchPoolMakeWork(load);
+				count->IncrementRelaxed();
+				if (isStopped.LoadRelaxed())
+				{
+					doneCount.IncrementRelaxed();
+					return;
+				}
+				sched->Post(aTask);
+			});
+			sched->Post(&tasks[i]);
+		}
+
+		std::vector<uint64_t> starts(aParams.mySchedulerCount);
+		for (uint32_t i = 0; i < aParams.mySchedulerCount; ++i)
+			starts[i] = counts[i].LoadRelaxed();
+		uint64_t switchStart = BenchPoolGetSwitchCount();
+		double start = mg::box::GetMillisecondsPrecise();
+		mg::box::Sleep(aParams.myDuration);
+		double durationMs = mg::box::GetMillisecondsPrecise() - start;
+		uint64_t switchCount = BenchPoolGetSwitchCount() - switchStart;
+		BenchPoolReport report;
+		report.myMinCount = UINT64_MAX;
+		report.myMaxCount = 0;
+		uint64_t total = 0;
+		for (uint32_t i = 0; i < aParams.mySchedulerCount; ++i)
+		{
+			uint64_t count = counts[i].LoadRelaxed() - starts[i];
+			total += count;
+			report.myMinCount = std::min(report.myMinCount, count);
+			report.myMaxCount = std::max(report.myMaxCount, count);
+		}
+		isStopped.StoreRelaxed(true);
+		while (doneCount.LoadRelaxed() != totalTaskCount)
+			mg::box::Sleep(1);
+		for (std::unique_ptr<mg::sch::TaskScheduler>& s : scheds)
+			s->Stop();
+		pool.Stop();
+
+		report.myTasksPerSec = total * 1000 / durationMs;
+		report.mySwitchCount = switchCount;
+		return report;
+	}
+
+	static void
+	BenchPoolPrint(
+		const char* aName,
+		const BenchPoolReport& aReport)
+	{
+		Report("%8s | %16.0lf | %13llu | %13llu | %16llu", aName, aReport.myTasksPerSec,
+			(unsigned long long)aReport.myMinCount,
+			(unsigned long long)aReport.myMaxCount,
+			(unsigned long long)aReport.mySwitchCount);
+	}
+
+}
+}
+
+int
+main(
+	int aArgc,
+	char** aArgv)
+{
+	using namespace mg::bench;
+	mg::tst::CommandLine cmdLine(aArgc - 1, aArgv + 1);
+	BenchPoolParams params;
+	params.mySchedulerCount = cmdLine.GetU32("schedulers");
+	params.myThreadCount = cmdLine.GetU32("threads");
+	params.myTaskCount = cmdLine.GetU32("tasks");
+	params.myLoad = BenchLoadTypeFromString(cmdLine.GetStr("load"));
+	params.myDuration = 3000;
+	if (cmdLine.IsPresent("duration"))
+		params.myDuration = cmdLine.GetU32("duration");
+	MG_BOX_ASSERT(params.mySchedulerCount > 0 && params.myThreadCount > 0 &&
+		params.myTaskCount > 0 && params.myDuration > 0);
+
+	BenchCaseGuard guard("Shared pool, schedulers=%u, threads=%u, tasks=%u, "
+		"duration=%u, load=%s", params.mySchedulerCount, params.myThreadCount,
+		params.myTaskCount, params.myDuration, BenchLoadTypeToString(params.myLoad));
+	BenchPoolReport separate = BenchPoolRun(params, false);
+	BenchPoolReport shared = BenchPoolRun(params, true);
+
+	Report("== Throughput report:");
+	Report("  Method | Tasks per second | Min per sched | Max per sched | Context switches");
+	BenchPoolPrint("separate", separate);
+	BenchPoolPrint("shared", shared);
+	return 0;
+}
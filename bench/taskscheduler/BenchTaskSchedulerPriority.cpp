@@ -0,0 +1,178 @@
+#include "Bench.h"
+
+#include "mg/box/Signal.h"
+#include "mg/box/Time.h"
+#include "mg/sch/TaskScheduler.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace mg {
+namespace bench {
+
+	// Bulk tasks keep all the workers busy, and a heartbeat task is posted from time to
+	// time by an external thread. Its latency shows how long a latency-sensitive task
+	// waits behind the bulk load.
+	struct BenchPriorityParams
+	{
+		uint32_t myThreadCount;
+		uint32_t myTaskCount;
+		uint32_t myBeatCount;
+		// Pause between the heartbeats in milliseconds.
+		uint32_t myInterval;
+		BenchLoadType myLoad;
+	};
+
+	struct BenchPriorityReport
+	{
+		uint64_t myLatencyMed;
+		uint64_t myLatency99;
+		uint64_t myLatencyMax;
+		double myBulkPerSec;
+	};
+
+	static void
+	BenchPriorityMakeWork(
+		BenchLoadType aLoad)
+	{
+		switch (aLoad)
+		{
+		case BENCH_LOAD_EMPTY:
+			break;
+		case BENCH_LOAD_NANO:
+			BenchMakeNanoWork();
+			break;
+		case BENCH_LOAD_MICRO:
+			BenchMakeMicroWork();
+			break;
+		case BENCH_LOAD_HEAVY:
+			BenchMakeHeavyWork();
+			break;
+		default:
+			MG_BOX_ASSERT(false);
+			break;
+		}
+	}
+
+	// Heartbeat weight 0 means the scheduler has one class for everything.
+	static BenchPriorityReport
+	BenchPriorityRun(
+		const BenchPriorityParams& aParams,
+		uint32_t aBeatWeight)
+	{
+		mg::sch::TaskSchedulerParams schedParams;
+		uint32_t bulkClass = 0;
+		if (aBeatWeight > 0)
+		{
+			schedParams.myClassWeights = {aBeatWeight, 1};
+			bulkClass = 1;
+		}
+		mg::sch::TaskScheduler sched("bch", 5000, schedParams);
+		sched.Start(aParams.myThreadCount);
+
+		mg::box::AtomicBool isStopped(false);
+		mg::box::AtomicU32 doneCount(0);
+		mg::box::AtomicU64 bulkCount(0);
+		BenchLoadType load = aParams.myLoad;
+		std::vector<mg::sch::Task> tasks(aParams.myTaskCount);
+		for (mg::sch::Task& t : tasks)
+		{
+			t.SetClass(bulkClass);
+			t.SetCallback([&, load](mg::sch::Task* aTask) {
+				BenchPriorityMakeWork(load);
+				bulkCount.IncrementRelaxed();
+				if (isStopped.LoadRelaxed())
+				{
+					doneCount.IncrementRelaxed();
+					return;
+				}
+				sched.Post(aTask);
+			});
+			sched.Post(&t);
+		}
+
+		std::vector<uint64_t> latencies;
+		latencies.reserve(aParams.myBeatCount);
+		uint64_t postTime = 0;
+		mg::box::Signal beatSignal;
+		mg::sch::Task beat([&](mg::sch::Task*) {
+			uint64_t now = mg::box::GetMicroseconds();
+			latencies.push_back(now > postTime ? now - postTime : 0);
+			beatSignal.Send();
+		});
+		double start = mg::box::GetMillisecondsPrecise();
+		uint64_t bulkStart = bulkCount.LoadRelaxed();
+		for (uint32_t i = 0; i < aParams.myBeatCount; ++i)
+		{
+			mg::box::Sleep(aParams.myInterval);
+			postTime = mg::box::GetMicroseconds();
+			sched.Post(&beat);
+			beatSignal.ReceiveBlocking();
+		}
+		double durationMs = mg::box::GetMillisecondsPrecise() - start;
+		uint64_t bulkTotal = bulkCount.LoadRelaxed() - bulkStart;
+		isStopped.StoreRelaxed(true);
+		while (doneCount.LoadRelaxed() != aParams.myTaskCount)
+			mg::box::Sleep(1);
+		sched.Stop();
+
+		std::sort(latencies.begin(), latencies.end());
+		uint32_t count = (uint32_t)latencies.size();
+		BenchPriorityReport report;
+		report.myLatencyMed = latencies[count / 2];
+		report.myLatency99 = latencies[(uint64_t)count * 99 / 100];
+		report.myLatencyMax = latencies[count - 1];
+		report.myBulkPerSec = bulkTotal * 1000 / durationMs;
+		return report;
+	}
+
+	static void
+	BenchPriorityPrint(
+		const char* aName,
+		const BenchPriorityReport& aReport)
+	{
+		Report("%8s | %10llu | %10llu | %10llu | %16.0lf", aName,
+			(unsigned long long)aReport.myLatencyMed,
+			(unsigned long long)aReport.myLatency99,
+			(unsigned long long)aReport.myLatencyMax, aReport.myBulkPerSec);
+	}
+
+}
+}
+
+int
+main(
+	int aArgc,
+	char** aArgv)
+{
+	using namespace mg::bench;
+	mg::tst::CommandLine cmdLine(aArgc - 1, aArgv + 1);
+	BenchPriorityParams params;
+	params.myThreadCount = cmdLine.GetU32("threads");
+	params.myTaskCount = cmdLine.GetU32("tasks");
+	params.myLoad = BenchLoadTypeFromString(cmdLine.GetStr("load"));
+	params.myBeatCount = 1000;
+	if (cmdLine.IsPresent("beats"))
+		params.myBeatCount = cmdLine.GetU32("beats");
+	params.myInterval = 1;
+	if (cmdLine.IsPresent("interval"))
+		params.myInterval = cmdLine.GetU32("interval");
+	uint32_t weight = 100;
+	if (cmdLine.IsPresent("weight"))
+		weight = cmdLine.GetU32("weight");
+	MG_BOX_ASSERT(params.myThreadCount > 0 && params.myTaskCount > 0 &&
+		params.myBeatCount > 0 && weight > 0);
+
+	BenchCaseGuard guard("Task classes, threads=%u, tasks=%u, beats=%u, interval=%u, "
+		"weight=%u, load=%s", params.myThreadCount, params.myTaskCount,
+		params.myBeatCount, params.myInterval, weight,
+		BenchLoadTypeToString(params.myLoad));
+	BenchPriorityReport single = BenchPriorityRun(params, 0);
+	BenchPriorityReport classes = BenchPriorityRun(params, weight);
+
+	Report("== Heartbeat latency report (microseconds):");
+	Report("  Method |     Median |        p99 |        Max |  Bulk per second");
+	BenchPriorityPrint("single", single);
+	BenchPriorityPrint("classes", classes);
+	return 0;
+}
@@ -4,6 +4,8 @@
 
 #include "mg/box/Atomic.h"
 #include "mg/box/Mutex.h"
+#include "mg/box/ThreadFunc.h"
+#include "mg/box/Time.h"
 
 #include "mg/test/Random.h"
 
@@ -34,6 +36,9 @@ namespace bench {
 
 		void CreateHeavy();
 
+		void CreatePingPong(
+			BenchLoadType aType);
+
 		void WaitAllExecuted();
 
 		void WaitExecuteCount(
@@ -43,9 +48,35 @@ namespace bench {
 
 		void PostAll();
 
+		void PostRange(
+			uint32_t aBegin,
+			uint32_t aEnd);
+
+		void PostAllFromProducers();
+
+		void RunFanOut();
+
+		void RunPingPong();
+
 		BenchTask* myTasks;
 		const uint32_t myTaskCount;
 		const uint32_t myExecuteCount;
+		// Post all the tasks as one list instead of one by one.
+		bool myIsBatch;
+		// The tasks are posted by this many external threads at once. Each of them
+		// posts its own part of the tasks.
+		uint32_t myProducerCount;
+		// The tasks don't re-post themselves. Instead, they all are re-posted together
+		// after each round of execution.
+		bool myIsFanOut;
+		// The tasks are split in pairs. In each round the first task of each pair posts
+		// the second one. The next round starts after a pause, when all the pairs are
+		// done. It shows the latency of picking up new tasks under a low load, when the
+		// workers have time to become idle between the rounds.
+		bool myIsPingPong;
+		uint32_t myPingPongGapUs;
+		BenchLoadType myPingPongLoad;
+		std::vector<uint64_t> myRoundTrips;
 		mg::box::AtomicU32 myStopCount;
 		mg::box::AtomicU64 myTotalExecuteCount;
 		TaskScheduler* myScheduler;
@@ -65,6 +96,10 @@ namespace bench {
 		void CreateHeavy(
 			BenchTaskCtl* aCtx);
 
+		void CreatePingPong(
+			BenchTaskCtl* aCtx,
+			BenchTask* aPeer);
+
 		void ExecuteNano(
 			Task* aTask);
 
@@ -74,10 +109,17 @@ namespace bench {
 		void ExecuteHeavy(
 			Task* aTask);
 
+		void ExecutePingPong(
+			Task* aTask);
+
+		void Finish(
+			Task* aTask);
+
 		void Stop();
 
 		uint32_t myExecuteCount;
 		BenchTaskCtl* myCtx;
+		BenchTask* myPeer;
 	};
 
 	//////////////////////////////////////////////////////////////////////////////////////
@@ -88,6 +130,10 @@ namespace bench {
 
 		uint64_t myExecCount;
 		uint64_t mySchedCount;
+		uint64_t myStealCount;
+		uint64_t mySpinTime;
+		uint64_t mySpinWakeCount;
+		uint64_t myWakeCount;
 	};
 
 	struct BenchRunReport
@@ -103,16 +149,26 @@ namespace bench {
 		uint64_t myExecPerSecPerThread;
 		double myUsPerExec;
 		uint64_t myMutexContentionCount;
+		bool myIsPingPong;
+		uint64_t myRoundTripP50;
+		uint64_t myRoundTripP99;
+		uint64_t myRoundTripMax;
 		std::vector<BenchThreadReport> myThreads;
 	};
 
 	//////////////////////////////////////////////////////////////////////////////////////
 
 	static BenchRunReport BenchTaskSchedulerRun(
+		const TaskSchedulerParams& aParams,
 		BenchLoadType aType,
 		uint32_t aThreadCount,
 		uint32_t aTaskCount,
-		uint32_t aExecuteCount);
+		uint32_t aExecuteCount,
+		bool aIsBatch,
+		bool aIsFanOut,
+		bool aIsPingPong,
+		uint32_t aPingPongGapUs,
+		uint32_t aProducerCount);
 
 	//////////////////////////////////////////////////////////////////////////////////////
 
@@ -123,6 +179,12 @@ namespace bench {
 		: myTasks(new BenchTask[aTaskCount])
 		, myTaskCount(aTaskCount)
 		, myExecuteCount(aExecuteCount)
+		, myIsBatch(false)
+		, myProducerCount(1)
+		, myIsFanOut(false)
+		, myIsPingPong(false)
+		, myPingPongGapUs(0)
+		, myPingPongLoad(BENCH_LOAD_NANO)
 		, myStopCount(0)
 		, myTotalExecuteCount(0)
 		, myScheduler(aScheduler)
@@ -148,6 +210,10 @@ namespace bench {
 		{
 			threads[i]->StatPopExecuteCount();
 			threads[i]->StatPopScheduleCount();
+			threads[i]->StatPopStealCount();
+			threads[i]->StatPopSpinTime();
+			threads[i]->StatPopSpinWakeCount();
+			threads[i]->StatPopWakeCount();
 		}
 	}
 
@@ -172,6 +238,20 @@ namespace bench {
 			myTasks[i].CreateHeavy(this);
 	}
 
+	void
+	BenchTaskCtl::CreatePingPong(
+		BenchLoadType aType)
+	{
+		MG_BOX_ASSERT(myTaskCount % 2 == 0);
+		MG_BOX_ASSERT(aType == BENCH_LOAD_NANO || aType == BENCH_LOAD_MICRO);
+		myPingPongLoad = aType;
+		for (uint32_t i = 0; i < myTaskCount; i += 2)
+		{
+			myTasks[i].CreatePingPong(this, &myTasks[i + 1]);
+			myTasks[i + 1].CreatePingPong(this, nullptr);
+		}
+	}
+
 	void
 	BenchTaskCtl::WaitAllExecuted()
 	{
@@ -184,7 +264,7 @@ namespace bench {
 	BenchTaskCtl::WaitExecuteCount(
 		uint64_t aCount)
 	{
-		while (myTotalExecuteCount.LoadRelaxed() < aCount)
+		while (myTotalExecuteCount.LoadAcquire() < aCount)
 			mg::box::Sleep(1);
 	}
 
@@ -200,8 +280,88 @@ namespace bench {
 	void
 	BenchTaskCtl::PostAll()
 	{
+		if (myProducerCount > 1)
+			return PostAllFromProducers();
+		PostRange(0, myTaskCount);
+	}
+
+	void
+	BenchTaskCtl::PostRange(
+		uint32_t aBegin,
+		uint32_t aEnd)
+	{
+		if (!myIsBatch)
+		{
+			for (uint32_t i = aBegin; i < aEnd; ++i)
+				myScheduler->Post(&myTasks[i]);
+			return;
+		}
+		for (uint32_t i = aBegin + 1; i < aEnd; ++i)
+			myTasks[i - 1].myNext = &myTasks[i];
+		myTasks[aEnd - 1].myNext = nullptr;
+		myScheduler->PostMany(&myTasks[aBegin]);
+	}
+
+	void
+	BenchTaskCtl::PostAllFromProducers()
+	{
+		std::vector<mg::box::ThreadFunc*> producers;
+		producers.reserve(myProducerCount);
+		uint32_t partSize = (myTaskCount + myProducerCount - 1) / myProducerCount;
+		for (uint32_t begin = 0; begin < myTaskCount; begin += partSize)
+		{
+			uint32_t end = std::min(begin + partSize, myTaskCount);
+			producers.push_back(new mg::box::ThreadFunc("mgben.prd",
+				[this, begin, end]() { PostRange(begin, end); }));
+		}
+		for (mg::box::ThreadFunc* t : producers)
+			t->Start();
+		for (mg::box::ThreadFunc* t : producers)
+			delete t;
+	}
+
+	void
+	BenchTaskCtl::RunFanOut()
+	{
+		// Each round starts when all the tasks are executed in the previous one. Then
+		// they are posted all at once, like in a broadcast of some event.
+		for (uint32_t i = 0; i < myExecuteCount; ++i)
+		{
+			WaitExecuteCount((uint64_t)i * myTaskCount);
+			PostAll();
+		}
+	}
+
+	void
+	BenchTaskCtl::RunPingPong()
+	{
+		myRoundTrips.reserve(myExecuteCount);
+		for (uint32_t i = 0; i < myExecuteCount; ++i)
+		{
+			uint64_t start = mg::box::GetMicroseconds();
+			if (!myIsBatch)
+			{
+				for (uint32_t j = 0; j < myTaskCount; j += 2)
+					myScheduler->Post(&myTasks[j]);
+			}
+			else
+			{
+				for (uint32_t j = 2; j < myTaskCount; j += 2)
+					myTasks[j - 2].myNext = &myTasks[j];
+				myTasks[myTaskCount - 2].myNext = nullptr;
+				myScheduler->PostMany(myTasks);
+			}
+			// Busy-wait to measure the latency precisely. Sleep would add its own.
+			uint64_t target = (uint64_t)(i + 1) * myTaskCount;
+			while (myTotalExecuteCount.LoadAcquire() < target);
+			uint64_t end = mg::box::GetMicroseconds();
+			myRoundTrips.push_back(end - start);
+			// The pause is also a busy-wait, so its duration is precise. The workers
+			// still have nothing to do during it.
+			while (mg::box::GetMicroseconds() - end < myPingPongGapUs);
+		}
 		for (uint32_t i = 0; i < myTaskCount; ++i)
-			myScheduler->Post(&myTasks[i]);
+			myTasks[i].Stop();
 	}
 
 	BenchTaskCtl::~BenchTaskCtl()
@@ -213,6 +373,7 @@ namespace bench {
 
 	BenchTask::BenchTask()
 		: myCtx(nullptr)
+		, myPeer(nullptr)
 	{
 	}
 
@@ -249,16 +410,26 @@ namespace bench {
 			std::placeholders::_1));
 	}
 
+	void
+	BenchTask::CreatePingPong(
+		BenchTaskCtl* aCtx,
+		BenchTask* aPeer)
+	{
+		myExecuteCount = 0;
+		myCtx = aCtx;
+		myPeer = aPeer;
+		SetCallback(std::bind(
+			&BenchTask::ExecutePingPong, this,
+			std::placeholders::_1));
+	}
+
 	void
 	BenchTask::ExecuteNano(
 		Task* aTask)
 	{
 		MG_BOX_ASSERT(aTask == this);
 		++myExecuteCount;
-		myCtx->myTotalExecuteCount.IncrementRelaxed();
-		if (myExecuteCount >= myCtx->myExecuteCount)
-			return Stop();
-		return myCtx->myScheduler->Post(aTask);
+		Finish(aTask);
 	}
 
 	void
@@ -267,11 +438,8 @@ namespace bench {
 	{
 		MG_BOX_ASSERT(aTask == this);
 		++myExecuteCount;
-		myCtx->myTotalExecuteCount.IncrementRelaxed();
 		BenchMakeMicroWork();
-		if (myExecuteCount >= myCtx->myExecuteCount)
-			return Stop();
-		return myCtx->myScheduler->Post(aTask);
+		Finish(aTask);
 	}
 
 	void
@@ -304,6 +472,39 @@ namespace bench {
 		return isLast ? Stop() : myCtx->myScheduler->Post(aTask);
 	}
 
+	void
+	BenchTask::ExecutePingPong(
+		Task* aTask)
+	{
+		MG_BOX_ASSERT(aTask == this);
+		++myExecuteCount;
+		if (myCtx->myPingPongLoad == BENCH_LOAD_MICRO)
+			BenchMakeMicroWork();
+		if (myPeer != nullptr)
+			myCtx->myScheduler->Post(myPeer);
+		// Must be the last action. Right after it the task can be re-posted by the next
+		// round.
+		myCtx->myTotalExecuteCount.IncrementRelease();
+	}
+
+	void
+	BenchTask::Finish(
+		Task* aTask)
+	{
+		if (!myCtx->myIsFanOut)
+		{
+			myCtx->myTotalExecuteCount.IncrementRelaxed();
+			if (myExecuteCount >= myCtx->myExecuteCount)
+				return Stop();
+			return myCtx->myScheduler->Post(aTask);
+		}
+		if (myExecuteCount >= myCtx->myExecuteCount)
+			Stop();
+		// Must be the last action. Right after it the task can be re-posted by the
+		// fan-out and executed in another thread.
+		myCtx->myTotalExecuteCount.IncrementRelease();
+	}
+
 	void
 	BenchTask::Stop()
 	{
@@ -315,6 +516,10 @@ namespace bench {
 	BenchThreadReport::BenchThreadReport()
 		: myExecCount(0)
 		, mySchedCount(0)
+		, myStealCount(0)
+		, mySpinTime(0)
+		, mySpinWakeCount(0)
+		, myWakeCount(0)
 	{
 	}
 
@@ -323,6 +528,10 @@ namespace bench {
 		, myExecPerSecPerThread(0)
 		, myUsPerExec(0)
 		, myMutexContentionCount(0)
+		, myIsPingPong(false)
+		, myRoundTripP50(0)
+		, myRoundTripP99(0)
+		, myRoundTripMax(0)
 	{
 	}
 
@@ -347,11 +556,24 @@ namespace bench {
 		}
 		Report("Mutex contention count:     %12llu",
 			(unsigned long long)myMutexContentionCount);
+		if (myIsPingPong)
+		{
+			Report("Round trip us p50:          %12llu",
+				(unsigned long long)myRoundTripP50);
+			Report("Round trip us p99:          %12llu",
+				(unsigned long long)myRoundTripP99);
+			Report("Round trip us max:          %12llu",
+				(unsigned long long)myRoundTripMax);
+		}
 		for (uint32_t i = 0; i < myThreads.size(); ++i)
 		{
 			const BenchThreadReport& tr = myThreads[i];
-			Report("Thread %2u: exec: %12llu, sched: %9llu", i,
-				(unsigned long long)tr.myExecCount, (unsigned long long)tr.mySchedCount);
+			Report("Thread %2u: exec: %12llu, sched: %9llu, steal: %9llu, "
+				"spin us: %9llu, spin wake: %9llu, wake: %9llu", i,
+				(unsigned long long)tr.myExecCount, (unsigned long long)tr.mySchedCount,
+				(unsigned long long)tr.myStealCount, (unsigned long long)tr.mySpinTime,
+				(unsigned long long)tr.mySpinWakeCount,
+				(unsigned long long)tr.myWakeCount);
 		}
 		Report("");
 	}
@@ -360,25 +582,45 @@ namespace bench {
 
 	static BenchRunReport
 	BenchTaskSchedulerRun(
+		const TaskSchedulerParams& aParams,
 		BenchLoadType aType,
 		uint32_t aThreadCount,
 		uint32_t aTaskCount,
-		uint32_t aExecuteCount)
+		uint32_t aExecuteCount,
+		bool aIsBatch,
+		bool aIsFanOut,
+		bool aIsPingPong,
+		uint32_t aPingPongGapUs,
+		uint32_t aProducerCount)
 	{
-		TaskScheduler sched("bench", 5000);
+		TaskScheduler sched("bench", 5000, aParams);
 		sched.Start(aThreadCount);
 		sched.Reserve(aTaskCount);
 		BenchTaskCtl ctl(aTaskCount, aExecuteCount, &sched);
+		ctl.myIsBatch = aIsBatch;
+		ctl.myProducerCount = aProducerCount;
+		ctl.myIsFanOut = aIsFanOut;
+		ctl.myIsPingPong = aIsPingPong;
+		ctl.myPingPongGapUs = aPingPongGapUs;
+		MG_BOX_ASSERT(!aIsPingPong || !aIsFanOut);
+		MG_BOX_ASSERT(aProducerCount > 0 && (aProducerCount == 1 || !aIsPingPong));
 		ctl.Warmup();
 
 		switch (aType) {
 		case BENCH_LOAD_NANO:
-			ctl.CreateNano();
+			if (aIsPingPong)
+				ctl.CreatePingPong(aType);
+			else
+				ctl.CreateNano();
 			break;
 		case BENCH_LOAD_MICRO:
-			ctl.CreateMicro();
+			if (aIsPingPong)
+				ctl.CreatePingPong(aType);
+			else
+				ctl.CreateMicro();
 			break;
 		case BENCH_LOAD_HEAVY:
+			MG_BOX_ASSERT(!aIsFanOut && !aIsPingPong);
 			ctl.CreateHeavy();
 			break;
 		case BENCH_LOAD_EMPTY:
@@ -386,13 +628,20 @@ namespace bench {
 			MG_BOX_ASSERT(!"Unsupported load type");
 			break;
 		}
-		BenchCaseGuard guard("Load %s, thread=%u, task=%u, exec=%u",
-			BenchLoadTypeToString(aType), aThreadCount, aTaskCount, aExecuteCount);
+		BenchCaseGuard guard("Load %s, thread=%u, task=%u, exec=%u, batch=%u, fanout=%u, "
+			"pingpong=%u, gap=%u, producers=%u", BenchLoadTypeToString(aType),
+			aThreadCount, aTaskCount, aExecuteCount, (int)aIsBatch, (int)aIsFanOut,
+			(int)aIsPingPong, aPingPongGapUs, aProducerCount);
 		BenchRunReport report;
 
 		mg::box::MutexStatClear();
 		TimedGuard timed("Post and wait");
-		ctl.PostAll();
+		if (aIsFanOut)
+			ctl.RunFanOut();
+		else if (aIsPingPong)
+			ctl.RunPingPong();
+		else
+			ctl.PostAll();
 		ctl.WaitAllStopped();
 		timed.Stop();
 		report.myMutexContentionCount = mg::box::MutexStatContentionCount();
@@ -403,6 +652,15 @@ namespace bench {
 		report.myExecPerSec = (uint64_t)(totalExecCount * 1000 / durationMs);
 		report.myExecPerSecPerThread = report.myExecPerSec / aThreadCount;
 		report.myUsPerExec = durationMs * 1000 / totalExecCount * aThreadCount;
+		if (aIsPingPong)
+		{
+			std::vector<uint64_t>& rtts = ctl.myRoundTrips;
+			std::sort(rtts.begin(), rtts.end());
+			report.myIsPingPong = true;
+			report.myRoundTripP50 = rtts[rtts.size() / 2];
+			report.myRoundTripP99 = rtts[rtts.size() * 99 / 100];
+			report.myRoundTripMax = rtts.back();
+		}
 
 		TaskSchedulerThread*const* threads = sched.GetThreads(aThreadCount);
 		report.myThreads.resize(aThreadCount);
@@ -411,6 +669,10 @@ namespace bench {
 			BenchThreadReport& tr = report.myThreads[i];
 			tr.myExecCount = threads[i]->StatPopExecuteCount();
 			tr.mySchedCount = threads[i]->StatPopScheduleCount();
+			tr.myStealCount = threads[i]->StatPopStealCount();
+			tr.mySpinTime = threads[i]->StatPopSpinTime();
+			tr.mySpinWakeCount = threads[i]->StatPopSpinWakeCount();
+			tr.myWakeCount = threads[i]->StatPopWakeCount();
 		}
 		report.Print();
 		return report;
@@ -433,11 +695,31 @@ main(
 	uint32_t runCount = 1;
 	if (cmdLine.IsPresent("runs"))
 		runCount = cmdLine.GetU32("runs");
+	bool isBatch = false;
+	if (cmdLine.IsPresent("batch"))
+		isBatch = cmdLine.GetU32("batch") != 0;
+	bool isFanOut = false;
+	if (cmdLine.IsPresent("fanout"))
+		isFanOut = cmdLine.GetU32("fanout") != 0;
+	// Value is the pause between the rounds in microseconds.
+	bool isPingPong = false;
+	uint32_t pingPongGapUs = 0;
+	if (cmdLine.IsPresent("pingpong"))
+	{
+		isPingPong = true;
+		pingPongGapUs = cmdLine.GetU32("pingpong");
+	}
+	uint32_t producerCount = 1;
+	if (cmdLine.IsPresent("producers"))
+		producerCount = cmdLine.GetU32("producers");
+	TaskSchedulerParams params;
+	BenchTaskSchedulerParamsFromCommandLine(cmdLine, params);
 
 	std::vector<BenchRunReport> reports;
 	reports.resize(runCount);
 	for (BenchRunReport& r : reports)
-		r = BenchTaskSchedulerRun(loadType, threadCount, taskCount, exeCount);
+		r = BenchTaskSchedulerRun(params, loadType, threadCount, taskCount, exeCount,
+			isBatch, isFanOut, isPingPong, pingPongGapUs, producerCount);
 	if (runCount == 1)
 		return 0;
 	if (runCount < 3)
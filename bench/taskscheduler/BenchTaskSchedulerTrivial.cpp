@@ -44,6 +44,11 @@ namespace bench {
 
 	using TaskList = mg::box::ForwardList<Task>;
 
+	// The trivial scheduler has nothing to configure.
+	struct TaskSchedulerParams
+	{
+	};
+
 	// Trivial task scheduler takes a mutex lock on each task post and pop. The simplest
 	// possible implementation and the most typical one. For the sake of further
 	// simplicity and speed it doesn't support any features except just task execution:
@@ -59,6 +64,11 @@ namespace bench {
 			const char* aName,
 			uint32_t aSubQueueSize);
 
+		TaskScheduler(
+			const char* aName,
+			uint32_t aSubQueueSize,
+			const TaskSchedulerParams& aParams);
+
 		~TaskScheduler();
 
 		void Start(
@@ -67,6 +77,9 @@ namespace bench {
 		void Post(
 			Task* aTask);
 
+		void PostMany(
+			Task* aFirst);
+
 		template<typename Functor>
 		void PostOneShot(
 			Functor&& aFunc);
@@ -106,6 +119,14 @@ namespace bench {
 
 		uint64_t StatPopScheduleCount();
 
+		uint64_t StatPopStealCount();
+
+		uint64_t StatPopSpinTime();
+
+		uint64_t StatPopSpinWakeCount();
+
+		uint64_t StatPopWakeCount();
+
 	private:
 		void Run() override;
 
@@ -155,6 +176,14 @@ namespace bench {
 	{
 	}
 
+	TaskScheduler::TaskScheduler(
+		const char* aName,
+		uint32_t aSubQueueSize,
+		const TaskSchedulerParams& /*aParams*/)
+		: TaskScheduler(aName, aSubQueueSize)
+	{
+	}
+
 	TaskScheduler::~TaskScheduler()
 	{
 		myMutex.Lock();
@@ -190,6 +219,23 @@ namespace bench {
 		myMutex.Unlock();
 	}
 
+	void
+	TaskScheduler::PostMany(
+		Task* aFirst)
+	{
+		if (aFirst == nullptr)
+			return;
+		Task* last = aFirst;
+		while (last->myNext != nullptr)
+			last = last->myNext;
+		myMutex.Lock();
+		bool wasEmpty = myQueue.IsEmpty();
+		myQueue.Append(aFirst, last);
+		if (wasEmpty)
+			myCond.Broadcast();
+		myMutex.Unlock();
+	}
+
 	template<typename Functor>
 	void
 	TaskScheduler::PostOneShot(
@@ -255,6 +301,30 @@ namespace bench {
 		return 0;
 	}
 
+	uint64_t
+	TaskSchedulerThread::StatPopStealCount()
+	{
+		return 0;
+	}
+
+	uint64_t
+	TaskSchedulerThread::StatPopSpinTime()
+	{
+		return 0;
+	}
+
+	uint64_t
+	TaskSchedulerThread::StatPopSpinWakeCount()
+	{
+		return 0;
+	}
+
+	uint64_t
+	TaskSchedulerThread::StatPopWakeCount()
+	{
+		return 0;
+	}
+
 	void
 	TaskSchedulerThread::Run()
 	{
@@ -283,6 +353,13 @@ namespace bench {
 		mutex.Unlock();
 	}
 
+	static void
+	BenchTaskSchedulerParamsFromCommandLine(
+		const mg::tst::CommandLine& /*aCmdLine*/,
+		TaskSchedulerParams& /*aOutParams*/)
+	{
+	}
+
 }
 }
 
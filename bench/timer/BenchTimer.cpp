@@ -0,0 +1,32 @@
+#include "Bench.h"
+
+#include "mg/box/TimingWheel.h"
+
+namespace mg {
+namespace bench {
+
+	struct BenchTimer
+	{
+		BenchTimer();
+
+		uint64_t myDeadline;
+		BenchTimer* myWaitPrev;
+		BenchTimer* myWaitNext;
+		int32_t myIndex;
+	};
+
+	using BenchTimerQueue = mg::box::TimingWheel<BenchTimer>;
+
+	inline
+	BenchTimer::BenchTimer()
+		: myDeadline(0)
+		, myWaitPrev(nullptr)
+		, myWaitNext(nullptr)
+		, myIndex(-1)
+	{
+	}
+
+}
+}
+
+#include "BenchTimerTemplate.hpp"
@@ -0,0 +1,100 @@
+#include "Bench.h"
+
+#include "mg/box/BinaryHeap.h"
+
+namespace mg {
+namespace bench {
+
+	struct BenchTimer
+	{
+		BenchTimer();
+
+		bool operator<=(
+			const BenchTimer& aOther) const;
+
+		uint64_t myDeadline;
+		int32_t myIndex;
+	};
+
+	// The binary heap which was used as the waiting queue before the timing wheel. Has
+	// logarithmic insertion and removal.
+	//
+	class BenchTimerQueue
+	{
+	public:
+		void SetSlack(
+			uint64_t aSlack);
+
+		void Push(
+			BenchTimer* aTimer);
+
+		void Remove(
+			BenchTimer* aTimer);
+
+		BenchTimer* PopExpired(
+			uint64_t aNow);
+
+		uint32_t Count() const;
+
+	private:
+		mg::box::BinaryHeapMinIntrusive<BenchTimer> myHeap;
+	};
+
+	inline
+	BenchTimer::BenchTimer()
+		: myDeadline(0)
+		, myIndex(-1)
+	{
+	}
+
+	inline bool
+	BenchTimer::operator<=(
+		const BenchTimer& aOther) const
+	{
+		return myDeadline <= aOther.myDeadline;
+	}
+
+	inline void
+	BenchTimerQueue::SetSlack(
+		uint64_t)
+	{
+		// Not supported. The heap is always precise.
+	}
+
+	inline void
+	BenchTimerQueue::Push(
+		BenchTimer* aTimer)
+	{
+		myHeap.Push(aTimer);
+	}
+
+	inline void
+	BenchTimerQueue::Remove(
+		BenchTimer* aTimer)
+	{
+		myHeap.Remove(aTimer);
+	}
+
+	inline BenchTimer*
+	BenchTimerQueue::PopExpired(
+		uint64_t aNow)
+	{
+		if (myHeap.Count() == 0)
+			return nullptr;
+		BenchTimer* res = myHeap.GetTop();
+		if (res->myDeadline > aNow)
+			return nullptr;
+		myHeap.RemoveTop();
+		return res;
+	}
+
+	inline uint32_t
+	BenchTimerQueue::Count() const
+	{
+		return myHeap.Count();
+	}
+
+}
+}
+
+#include "BenchTimerTemplate.hpp"
@@ -0,0 +1,179 @@
+#pragma once
+
+#include "Bench.h"
+
+#include "mg/test/Random.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace mg {
+namespace bench {
+
+	struct BenchRunReport
+	{
+		BenchRunReport();
+
+		bool operator<(
+			const BenchRunReport& aOther) const;
+
+		void Print() const;
+
+		uint64_t myTimersPerSec;
+		double myPushMs;
+		double myCancelMs;
+		double myExpireMs;
+	};
+
+	//////////////////////////////////////////////////////////////////////////////////////
+
+	static BenchRunReport BenchTimerRun(
+		uint32_t aTimerCount,
+		uint32_t aSpread,
+		uint32_t aCancelPercent,
+		uint32_t aStep,
+		uint32_t aSlack);
+
+	//////////////////////////////////////////////////////////////////////////////////////
+
+	BenchRunReport::BenchRunReport()
+		: myTimersPerSec(0)
+		, myPushMs(0)
+		, myCancelMs(0)
+		, myExpireMs(0)
+	{
+	}
+
+	inline bool
+	BenchRunReport::operator<(
+		const BenchRunReport& aOther) const
+	{
+		return myTimersPerSec < aOther.myTimersPerSec;
+	}
+
+	void
+	BenchRunReport::Print() const
+	{
+		Report("Timers/sec:                 %12llu",
+			(unsigned long long)myTimersPerSec);
+		Report("Push ms:                    %12.3lf", myPushMs);
+		Report("Cancel ms:                  %12.3lf", myCancelMs);
+		Report("Expire ms:                  %12.3lf", myExpireMs);
+		Report("");
+	}
+
+	//////////////////////////////////////////////////////////////////////////////////////
+
+	static BenchRunReport
+	BenchTimerRun(
+		uint32_t aTimerCount,
+		uint32_t aSpread,
+		uint32_t aCancelPercent,
+		uint32_t aStep,
+		uint32_t aSlack)
+	{
+		MG_BOX_ASSERT(aStep > 0);
+		MG_BOX_ASSERT(aCancelPercent <= 100);
+		BenchCaseGuard guard("Timers=%u, spread=%u, cancel=%u%%, step=%u, slack=%u",
+			aTimerCount, aSpread, aCancelPercent, aStep, aSlack);
+
+		// Generate everything beforehand to measure only the queue.
+		uint64_t now = 1000;
+		std::vector<BenchTimer> timers(aTimerCount);
+		for (BenchTimer& t : timers)
+			t.myDeadline = now + mg::tst::RandomUniformUInt32(1, aSpread);
+		std::vector<BenchTimer*> toCancel;
+		toCancel.reserve((uint64_t)aTimerCount * aCancelPercent / 100);
+		for (BenchTimer& t : timers)
+		{
+			if (mg::tst::RandomUniformUInt32(1, 100) <= aCancelPercent)
+				toCancel.push_back(&t);
+		}
+		BenchTimerQueue queue;
+		queue.SetSlack(aSlack);
+		MG_BOX_ASSERT(queue.PopExpired(now) == nullptr);
+
+		BenchRunReport report;
+		TimedGuard timedPush("Push");
+		for (BenchTimer& t : timers)
+			queue.Push(&t);
+		timedPush.Stop();
+		report.myPushMs = timedPush.GetMilliseconds();
+
+		TimedGuard timedCancel("Cancel");
+		for (BenchTimer* t : toCancel)
+			queue.Remove(t);
+		timedCancel.Stop();
+		report.myCancelMs = timedCancel.GetMilliseconds();
+
+		TimedGuard timedExpire("Expire");
+		uint64_t expireCount = 0;
+		while (queue.Count() > 0)
+		{
+			now += aStep;
+			while (queue.PopExpired(now) != nullptr)
+				++expireCount;
+		}
+		timedExpire.Stop();
+		report.myExpireMs = timedExpire.GetMilliseconds();
+		MG_BOX_ASSERT(expireCount + toCancel.size() == aTimerCount);
+
+		double durationMs = report.myPushMs + report.myCancelMs + report.myExpireMs;
+		report.myTimersPerSec = (uint64_t)(aTimerCount * 1000 / durationMs);
+		report.Print();
+		return report;
+	}
+
+}
+}
+
+int
+main(
+	int aArgc,
+	char** aArgv)
+{
+	using namespace mg::bench;
+	mg::tst::CommandLine cmdLine(aArgc - 1, aArgv + 1);
+	uint32_t timerCount = cmdLine.GetU32("timers");
+	uint32_t spread = cmdLine.GetU32("spread");
+	uint32_t cancelPercent = 0;
+	if (cmdLine.IsPresent("cancel"))
+		cancelPercent = cmdLine.GetU32("cancel");
+	uint32_t step = 1;
+	if (cmdLine.IsPresent("step"))
+		step = cmdLine.GetU32("step");
+	uint32_t slack = 0;
+	if (cmdLine.IsPresent("slack"))
+		slack = cmdLine.GetU32("slack");
+	uint32_t runCount = 1;
+	if (cmdLine.IsPresent("runs"))
+		runCount = cmdLine.GetU32("runs");
+
+	std::vector<BenchRunReport> reports;
+	reports.resize(runCount);
+	for (BenchRunReport& r : reports)
+		r = BenchTimerRun(timerCount, spread, cancelPercent, step, slack);
+	if (runCount == 1)
+		return 0;
+	if (runCount < 3)
+		return -1;
+	std::sort(reports.begin(), reports.end());
+	Report("");
+
+	Report("== Aggregated report:");
+	BenchRunReport* rMin = &reports[0];
+	// If the count is even, then intentionally print the lower middle.
+	BenchRunReport* rMed = &reports[runCount / 2];
+	BenchRunReport* rMax = &reports[runCount - 1];
+	Report("Timers/sec min:             %12llu",
+		(unsigned long long)rMin->myTimersPerSec);
+	Report("Timers/sec median:          %12llu",
+		(unsigned long long)rMed->myTimersPerSec);
+	Report("Timers/sec max:             %12llu",
+		(unsigned long long)rMax->myTimersPerSec);
+	Report("");
+
+	Report("== Median report:");
+	rMed->Print();
+	return 0;
+}
@@ -25,6 +25,9 @@
 // get the current timestamp, and pop from the heap all the requests whose deadline is
 // less than the current time. They are expired, do anything with them.
 //
+// For the work repeated with a fixed interval there is no need to compute the deadlines
+// manually. A periodic socket (socket->SetPeriod()) wakes up on each tick by itself.
+//
 
 static const int theClientCount = 5;
 static const int theMessageCount = 6;
@@ -135,8 +138,8 @@ public:
 		mg::net::Socket aSock)
 		: myID(aID)
 		, mySock(new mg::aio::TCPSocket(aCore))
+		, mySentCount(0)
 		, mySendSize(0)
-		, mySendDeadline(0)
 	{
 		mySock->Open({});
 		mySock->PostWrap(aSock, this);
@@ -154,6 +157,11 @@ private:
 		// closure. Socket close = read of zero bytes, so we need a pending read to notice
 		// it. Can be of any > 0 size.
 		mySock->Recv(1);
+		// Messages are sent once per second. The period makes the socket wakeup on each
+		// second by itself. Its ticks are on the whole seconds of the clock, so they
+		// don't drift regardless of how long each send takes. The sockets having the
+		// same period share one timer in IOCore.
+		mySock->SetPeriod(1000);
 	}
 
 	// TCPSocketSubscription event.
@@ -166,19 +174,20 @@ private:
 			mySock->PostClose();
 			return;
 		}
-		if (mySendDeadline > mg::box::GetMilliseconds())
+		if (mySock->GetTickCount() == 0)
+		{
+			// Not a tick. A spurious wakeup, or the period is set first time. Anyway,
+			// the next tick is already the socket's deadline.
+			return;
+		}
+		if (mySendSize != 0)
 		{
-			// Not expired yet. A spurious wakeup, or the deadline is set first time.
-			// Anyway, lets wait until it expires.
-			mySock->SetDeadline(mySendDeadline);
+			// The previous message is still being sent. Then this tick is skipped.
+			// Although in such a simple example it is probably sent completely in one
+			// go.
 			return;
 		}
 		MG_LOG_INFO("Peer.OnEvent", "%d: sending next msg", myID);
-		MG_BOX_ASSERT(mySendSize == 0);
-		// Deadline is infinite so a next message is only sent after this one is fully
-		// flushed. Although in such a simple example it is probably sent completely in
-		// one go.
-		mySendDeadline = MG_TIME_INFINITE;
 		std::string msg = mg::box::StringFormat("message %d", ++mySentCount);
 		mySendSize = (uint32_t)msg.size() + 1;
 		// Copy the string, because it is on stack right now.
@@ -201,16 +210,7 @@ private:
 	{
 		MG_BOX_ASSERT(aByteCount <= mySendSize);
 		mySendSize -= aByteCount;
-		if (mySendSize != 0)
-			return;
-
-		// Finally all is sent. Send the next one in 1 second. For that need to actually
-		// do socket->SetDeadline(), but we will do it in OnEvent().
-		mySendDeadline = mg::box::GetMilliseconds() + 1000;
-		// Reschedule() basically means 'reschedule the socket right away'. Same as saying
-		// SetDeadline(0). OnEvent() is going to be executed again ASAP. This way it is
-		// simpler for us to implement all the logic in one function.
-		mySock->Reschedule();
+		// The next message is sent on the next tick, in OnEvent().
 	}
 
 	// TCPSocketSubscription event.
@@ -235,7 +235,6 @@ private:
 	mg::aio::TCPSocket* mySock;
 	int mySentCount;
 	uint32_t mySendSize;
-	uint64_t mySendDeadline;
 };
 
 //////////////////////////////////////////////////////////////////////////////////////////
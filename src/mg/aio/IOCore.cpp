@@ -2,6 +2,9 @@
 
 #include "mg/box/Sysinfo.h"
 #include "mg/box/Thread.h"
+#include "mg/box/Trace.h"
+
+#include <algorithm>
 
 namespace mg {
 namespace aio {
@@ -13,7 +16,8 @@ namespace aio {
 	{
 	public:
 		IOCoreWorker(
-			IOCore& aCore);
+			IOCore& aCore,
+			const std::vector<uint32_t>* aCPUs);
 
 	private:
 		void Run() override;
@@ -24,7 +28,24 @@ namespace aio {
 
 	//////////////////////////////////////////////////////////////////////////////////////
 
+	IOCoreParams::IOCoreParams()
+		: myTimerSlack(0)
+		, myIdleSpinUs(0)
+		, myIsIdleYield(false)
+		, myIsLatencyCritical(false)
+		, myThreadIdleTimeout(1000)
+		, myThreadGrowReadyCount(256)
+		, myIsNUMAAware(false)
+	{
+	}
+
 	IOCore::IOCore()
+		: IOCore(IOCoreParams())
+	{
+	}
+
+	IOCore::IOCore(
+		const IOCoreParams& aParams)
 #if MG_IOCORE_USE_IOCP
 		: myNativeCore(nullptr)
 #elif MG_IOCORE_USE_EPOLL
@@ -41,14 +62,29 @@ namespace aio {
 		, myReadyQueue(MG_IOCORE_READY_BATCH)
 		, myExecBatchSize(MG_IOCORE_READY_BATCH)
 		, mySchedBatchSize(0)
+		, myIdleSpinUs(aParams.myIdleSpinUs)
+		, myIsIdleYield(aParams.myIsIdleYield)
+		, myIsLatencyCritical(aParams.myIsLatencyCritical)
+		, myThreadIdleTimeout(aParams.myThreadIdleTimeout)
+		, myThreadGrowReadyCount(aParams.myThreadGrowReadyCount)
+		, mySchedSpinStart(0)
 		, myIsSchedulerWorking(false)
 		, myDescriptorCount(0)
 		, myState(IOCORE_STATE_STOPPED)
+		, myMinThreadCount(0)
+		, myMaxThreadCount(0)
+		, myThreadCount(0)
+		, myIdleCount(0)
+		, myNodes(!aParams.myIsNUMAAware ? std::vector<mg::box::SysNUMANode>() :
+			!aParams.myNUMANodes.empty() ? aParams.myNUMANodes :
+			mg::box::SysGetNUMANodes())
+		, myNodeNext(0)
 	{
 #if MG_IOCORE_USE_IOURING
 		memset(&myRing, 0, sizeof(myRing));
 		myRing.ring_fd = -1;
 #endif
+		myWaitingQueue.SetSlack(mg::box::TimeMsToUs(aParams.myTimerSlack));
 		PrivPlatformCreate();
 	}
 
@@ -73,16 +109,30 @@ namespace aio {
 	{
 		if (aThreadCount == MG_IOCORE_DEFAULT_THREAD_COUNT)
 			aThreadCount = mg::box::SysGetCPUCoreCount() * 2;
-		MG_BOX_ASSERT(aThreadCount > 0 && aThreadCount < 256);
-		myWorkers.reserve(aThreadCount);
+		Start(aThreadCount, aThreadCount);
+	}
+
+	void
+	IOCore::Start(
+		uint32_t aMinThreadCount,
+		uint32_t aMaxThreadCount)
+	{
+		if (aMaxThreadCount == MG_IOCORE_DEFAULT_THREAD_COUNT)
+			aMaxThreadCount = mg::box::SysGetCPUCoreCount() * 2;
+		MG_BOX_ASSERT(aMinThreadCount > 0 && aMinThreadCount <= aMaxThreadCount);
+		MG_BOX_ASSERT(aMaxThreadCount < 256);
 
 		mg::box::MutexLock lock(myMutex);
 		if (myState.LoadRelaxed() != IOCORE_STATE_STOPPED)
 			return;
+		myWorkers.reserve(aMaxThreadCount);
 		myState.StoreRelaxed(IOCORE_STATE_RUNNING);
-		mySchedBatchSize = myExecBatchSize * aThreadCount;
-		for (uint32_t i = 0; i < aThreadCount; ++i)
-			myWorkers.push_back(new IOCoreWorker(*this));
+		myNodeNext = 0;
+		myMinThreadCount = aMinThreadCount;
+		myMaxThreadCount = aMaxThreadCount;
+		PrivSetThreadCount(aMinThreadCount);
+		for (uint32_t i = 0; i < aMinThreadCount; ++i)
+			myWorkers.push_back(PrivNewWorker());
 	}
 
 	uint32_t
@@ -116,21 +166,39 @@ namespace aio {
 		myReadySignal.Send();
 		for (IOCoreWorker* w : myWorkers)
 			w->StopAndDelete();
+		for (IOCoreWorker* w : myRetiredWorkers)
+			w->StopAndDelete();
 
 		myWorkers.resize(0);
-		mySchedBatchSize = 0;
+		myRetiredWorkers.resize(0);
+		PrivSetThreadCount(0);
 		myState.StoreRelaxed(IOCORE_STATE_STOPPED);
 	}
 
 	bool
 	IOCore::PrivScheduleStart()
 	{
-		return !myIsSchedulerWorking.ExchangeAcqRel(true);
+		if (myIsSchedulerWorking.ExchangeAcqRel(true))
+			return false;
+		MG_TRACE(SCHED_ENTER, this);
+		mySchedSpinStart = 0;
+		return true;
 	}
 
 	void
 	IOCore::PrivScheduleEnd()
 	{
+		// The workers can't keep up with the tasks. Even if the other workers are going
+		// to pick the tasks up soon, there are too many of them for the current workers.
+		// The pending tasks mean the ready queue would be even longer, but it is limited
+		// by the sched batch size.
+		if (myThreadCount.LoadRelaxed() < myMaxThreadCount && myIdleCount.Load() == 0 &&
+			(myReadyQueue.Count() >= myThreadGrowReadyCount ||
+			!myPendingQueue.IsEmpty()))
+		{
+			PrivThreadGrow();
+		}
+		MG_TRACE(SCHED_EXIT, this);
 		bool old = myIsSchedulerWorking.ExchangeRelease(false);
 		MG_DEV_ASSERT(old);
 		// The signal is absolutely vital to have exactly here. If the signal would not be
@@ -157,16 +225,132 @@ namespace aio {
 		myReadySignal.Send();
 	}
 
+	bool
+	IOCore::PrivScheduleSpin()
+	{
+		// Is called by the sched-thread when it has nothing to do and is about to sleep
+		// in the kernel. True means it should rather return and poll everything again
+		// without sleeping.
+		if (!myIsLatencyCritical)
+		{
+			if (myIdleSpinUs == 0)
+				return false;
+			uint64_t now = mg::box::GetMicroseconds();
+			if (mySchedSpinStart == 0)
+			{
+				mySchedSpinStart = now;
+			}
+			else if (now - mySchedSpinStart >= myIdleSpinUs)
+			{
+				mySchedSpinStart = 0;
+				return false;
+			}
+		}
+		if (myIsIdleYield)
+			mg::box::ThreadYield();
+		return true;
+	}
+
 	void
 	IOCore::PrivSignalReady()
 	{
 		myReadySignal.Send();
 	}
 
+	bool
+	IOCore::PrivWaitReady(
+		IOCoreWorker* aWorker)
+	{
+		myIdleCount.Increment();
+		bool isReceived = myIdleSpinUs > 0 &&
+			myReadySignal.ReceiveSpin(myIdleSpinUs, myIsIdleYield);
+		if (!isReceived && myMinThreadCount == myMaxThreadCount)
+		{
+			myReadySignal.ReceiveBlocking();
+			isReceived = true;
+		}
+		else if (!isReceived)
+		{
+			uint64_t timeout = mg::box::TimeMsToUs(myThreadIdleTimeout);
+			uint64_t deadline = mg::box::GetMicroseconds() + timeout;
+			// The timed wait can return earlier than the timeout. Then wait more.
+			while (!(isReceived = myReadySignal.ReceiveTimedUs(timeout)))
+			{
+				uint64_t now = mg::box::GetMicroseconds();
+				if (now >= deadline)
+					break;
+				timeout = deadline - now;
+			}
+		}
+		myIdleCount.Decrement();
+		return isReceived || !PrivThreadTryRetire(aWorker);
+	}
+
+	void
+	IOCore::PrivThreadGrow()
+	{
+		// Is called by the sched-thread. Can't wait for the lock - the stop might be
+		// holding it while waiting for this thread to exit.
+		if (!myMutex.TryLock())
+			return;
+		if (myState.LoadRelaxed() == IOCORE_STATE_RUNNING &&
+			myWorkers.size() < myMaxThreadCount)
+		{
+			for (IOCoreWorker* w : myRetiredWorkers)
+				w->StopAndDelete();
+			myRetiredWorkers.resize(0);
+			PrivSetThreadCount((uint32_t)myWorkers.size() + 1);
+			myWorkers.push_back(PrivNewWorker());
+		}
+		myMutex.Unlock();
+	}
+
+	bool
+	IOCore::PrivThreadTryRetire(
+		IOCoreWorker* aWorker)
+	{
+		// Can't wait for the lock - the stop might be holding it while waiting for this
+		// thread to exit.
+		if (!myMutex.TryLock())
+			return false;
+		bool isRetired = false;
+		if (myState.LoadRelaxed() == IOCORE_STATE_RUNNING &&
+			myWorkers.size() > myMinThreadCount)
+		{
+			auto it = std::find(myWorkers.begin(), myWorkers.end(), aWorker);
+			MG_BOX_ASSERT(it != myWorkers.end());
+			myWorkers.erase(it);
+			myRetiredWorkers.push_back(aWorker);
+			PrivSetThreadCount((uint32_t)myWorkers.size());
+			isRetired = true;
+		}
+		myMutex.Unlock();
+		return isRetired;
+	}
+
 	void
-	IOCore::PrivWaitReady()
+	IOCore::PrivSetThreadCount(
+		uint32_t aCount)
+	{
+		// The batch size is read by the sched-thread without the lock. It is fine to
+		// see the old size for a while.
+		myThreadCount.StoreRelaxed(aCount);
+		mySchedBatchSize.StoreRelaxed(myExecBatchSize * aCount);
+	}
+
+	IOCoreWorker*
+	IOCore::PrivNewWorker()
 	{
-		myReadySignal.ReceiveBlocking();
+		if (myNodes.empty())
+			return new IOCoreWorker(*this, nullptr);
+		const mg::box::SysNUMANode& node = myNodes[myNodeNext++ % myNodes.size()];
+		return new IOCoreWorker(*this, &node.myCPUs);
+	}
+
+	uint32_t
+	IOCore::GetThreadCount() const
+	{
+		return myThreadCount.LoadRelaxed();
 	}
 
 	bool
@@ -184,7 +368,10 @@ namespace aio {
 		IOTaskStatus oldStatus = IOTASK_STATUS_READY;
 		aTask->myStatus.CmpExchgStrongRelaxed(oldStatus, IOTASK_STATUS_PENDING);
 		MG_DEV_ASSERT(oldStatus != IOTASK_STATUS_PENDING);
-		if (aTask->PrivExecute())
+		MG_TRACE(TASK_EXEC_BEGIN, aTask);
+		bool isAlive = aTask->PrivExecute();
+		MG_TRACE(TASK_EXEC_END, aTask);
+		if (isAlive)
 		{
 			// Worker threads never ever can decide what to do with the task. Only the
 			// scheduler can. So if the task is not supposed to end now (also decided by
@@ -219,6 +406,7 @@ namespace aio {
 		IOTask* aTask)
 	{
 		MG_DEV_ASSERT(!aTask->myIsInQueues);
+		MG_TRACE(TASK_POST, aTask);
 		aTask->myIsInQueues = true;
 		PrivRePost(aTask);
 	}
@@ -232,14 +420,26 @@ namespace aio {
 			PrivPlatformSignal();
 	}
 
+	void
+	IOCore::PrivRePostMany(
+		IOTask* aFirst,
+		IOTask* aLast)
+	{
+		if (myFrontQueue.PushManyFastReversed(aFirst, aLast))
+			PrivPlatformSignal();
+	}
+
 	//////////////////////////////////////////////////////////////////////////////////////
 
 	IOCoreWorker::IOCoreWorker(
-		IOCore& aCore)
+		IOCore& aCore,
+		const std::vector<uint32_t>* aCPUs)
 		: Thread("mgaio.iowrk")
 		, myCore(aCore)
 	{
 		myConsumer.Attach(&myCore.myReadyQueue);
+		if (aCPUs != nullptr)
+			SetAffinity(*aCPUs);
 		Start();
 	}
 
@@ -269,7 +469,8 @@ namespace aio {
 				while (core.PrivExecute(myConsumer.Pop()) && ++batch < maxBatch)
 					continue;
 			} while (batch == maxBatch);
-			core.PrivWaitReady();
+			if (!core.PrivWaitReady(this))
+				break;
 		}
 	end:
 		// Wakeup all the workers like a domino when they are terminating. Signal the cond
@@ -1,11 +1,14 @@
 #pragma once
 
 #include "mg/aio/IOTask.h"
-#include "mg/box/BinaryHeap.h"
 #include "mg/box/ForwardList.h"
 #include "mg/box/MultiConsumerQueue.h"
 #include "mg/box/MultiProducerQueueIntrusive.h"
+#include "mg/box/PeriodicTimingWheel.h"
 #include "mg/box/Signal.h"
+#include "mg/box/Sysinfo.h"
+
+#include <vector>
 
 #if MG_IOCORE_USE_IOURING
 #include <liburing.h>
@@ -72,7 +75,9 @@ namespace aio {
 	// Waiting queue is only used by one worker thread at a time, so it has no concurrent
 	// access and is therefore not protected with a lock. Tasks move from the front queue
 	// to the waiting queue only if they have a deadline in the future and no IO events.
-	using IOCoreWaitingQueue = mg::box::BinaryHeapMinIntrusive<IOTask>;
+	// It is a timing wheel, so adding and removing of a task is O(1) regardless of how
+	// many tasks are waiting.
+	using IOCoreWaitingQueue = mg::box::PeriodicTimingWheel<IOTask>;
 
 	// Pending queue is populated from the front queue for further processing. Normally
 	// all its tasks are just handled right away, but if there is a particularly huge wave
@@ -88,15 +93,62 @@ namespace aio {
 		IOCORE_STATE_STOPPED,
 	};
 
+	struct IOCoreParams
+	{
+		IOCoreParams();
+
+		// Allow to wake the tasks up later than their deadlines, but not more than by
+		// this number of milliseconds. Is converted to microseconds and rounded down to
+		// a power of 2. Tasks with close deadlines are then expired together, in
+		// batches, and the kernel waits get longer. 0 = precise.
+		uint32_t myTimerSlack;
+		// An idle worker spins for this many microseconds checking for new tasks before
+		// going to sleep. The sched-thread spins by polling the kernel queue without a
+		// timeout. 0 = sleep right away.
+		uint32_t myIdleSpinUs;
+		// Give the CPU to other threads on each spin iteration.
+		bool myIsIdleYield;
+		// The sched-thread never sleeps in the kernel. It keeps polling the kernel queue
+		// and the front queue all the time. So when there is at least one idle worker,
+		// it is hot and picks up new events right away. It costs one CPU core being
+		// busy all the time.
+		bool myIsLatencyCritical;
+		// Elastic core retires a worker above the minimal count when it was idle for
+		// this many milliseconds.
+		uint32_t myThreadIdleTimeout;
+		// Elastic core starts one more worker when after scheduling the ready queue has
+		// at least this many tasks or the scheduling couldn't drain the pending tasks
+		// in one round, and none of the workers is idle.
+		uint32_t myThreadGrowReadyCount;
+		// Workers are spread between the NUMA nodes evenly and are pinned to their CPUs.
+		// The ready queue stays shared, because the kernel events come from one queue
+		// anyway.
+		bool myIsNUMAAware;
+		// Topology for the NUMA-aware mode. Empty means it is taken from the system.
+		std::vector<mg::box::SysNUMANode> myNUMANodes;
+	};
+
 	class IOCore
 	{
 	public:
 		IOCore();
+		IOCore(
+			const IOCoreParams& aParams);
 		~IOCore();
 
 		void Start(
 			uint32_t aThreadCount = MG_IOCORE_DEFAULT_THREAD_COUNT);
 
+		// Elastic core. Starts with the min number of workers. More of them are started
+		// when the ready queue grows, up to the max number. The idle workers are retired
+		// back to the min number. See the params for the tuning.
+		void Start(
+			uint32_t aMinThreadCount,
+			uint32_t aMaxThreadCount);
+
+		// Number of the currently running workers.
+		uint32_t GetThreadCount() const;
+
 		// Return how many tasks there still are, if didn't get empty after the timeout.
 		uint32_t WaitEmpty(
 			mg::box::TimeLimit aTimeLimit = mg::box::theTimeDurationInf);
@@ -120,9 +172,17 @@ namespace aio {
 		bool PrivScheduleStart();
 		bool PrivScheduleDo();
 		void PrivScheduleEnd();
+		bool PrivScheduleSpin();
 
 		void PrivSignalReady();
-		void PrivWaitReady();
+		bool PrivWaitReady(
+			IOCoreWorker* aWorker);
+		void PrivThreadGrow();
+		bool PrivThreadTryRetire(
+			IOCoreWorker* aWorker);
+		void PrivSetThreadCount(
+			uint32_t aCount);
+		IOCoreWorker* PrivNewWorker();
 		bool PrivExecute(
 			IOTask* aTask);
 
@@ -132,6 +192,10 @@ namespace aio {
 			IOTask* aTask);
 		void PrivRePost(
 			IOTask* aTask);
+		// Re-post a list of tasks linked via their 'next' members in one operation.
+		void PrivRePostMany(
+			IOTask* aFirst,
+			IOTask* aLast);
 
 #if MG_IOCORE_USE_IOCP
 		HANDLE myNativeCore;
@@ -176,7 +240,17 @@ namespace aio {
 		// the bottleneck when the scheduling takes too long time while the other threads
 		// are idle and the ready-queue is empty. For example, processing of a million of
 		// front queue tasks might take ~100-200ms.
-		uint32_t mySchedBatchSize;
+		// Depends on the worker count, which can change while the core works. Hence
+		// atomic.
+		mg::box::AtomicU32 mySchedBatchSize;
+		const uint32_t myIdleSpinUs;
+		const bool myIsIdleYield;
+		const bool myIsLatencyCritical;
+		const uint32_t myThreadIdleTimeout;
+		const uint32_t myThreadGrowReadyCount;
+		// When the sched-thread started spinning. 0 when it is not spinning. Is used
+		// only by the sched-thread.
+		uint64_t mySchedSpinStart;
 		// The pending and waiting tasks must be dispatched somehow to be moved to the
 		// ready queue. For that there is a 'scheduling process'. It is not pinned to any
 		// thread, but instead it migrates between worker threads as soon as one of them
@@ -193,6 +267,19 @@ namespace aio {
 		mg::box::Mutex myMutex;
 		mg::box::Atomic<IOCoreState> myState;
 		std::vector<IOCoreWorker*> myWorkers;
+		// The retired workers can't delete themselves. They are deleted by the next
+		// worker start or by the core stop.
+		std::vector<IOCoreWorker*> myRetiredWorkers;
+		uint32_t myMinThreadCount;
+		uint32_t myMaxThreadCount;
+		mg::box::AtomicU32 myThreadCount;
+		// Number of workers sleeping on the ready-signal. The elastic core doesn't add
+		// workers while there are idle ones.
+		mg::box::AtomicU32 myIdleCount;
+		// Empty when not NUMA-aware.
+		const std::vector<mg::box::SysNUMANode> myNodes;
+		// Node for the next started worker. Is protected by the mutex.
+		uint32_t myNodeNext;
 
 		friend IOCoreWorker;
 		friend IOTask;
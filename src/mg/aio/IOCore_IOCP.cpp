@@ -1,5 +1,7 @@
 #include "IOCore.h"
 
+#include "mg/box/Trace.h"
+
 namespace mg {
 namespace aio {
 
@@ -71,7 +73,7 @@ namespace aio {
 		OVERLAPPED_ENTRY* overEnd;
 		uint64_t timestamp;
 		uint32_t batch;
-		uint32_t maxBatch = mySchedBatchSize;
+		uint32_t maxBatch = mySchedBatchSize.LoadRelaxed();
 
 	retry:
 		// It is important that the kernel events are dispatched on each scheduling step.
@@ -95,7 +97,7 @@ namespace aio {
 			MG_BOX_ASSERT_F(err == WAIT_TIMEOUT, "Unexpected error from IOCP: %d\n", err);
 			overCount = 0;
 		}
-		timestamp = mg::box::GetMilliseconds();
+		timestamp = mg::box::GetMicroseconds();
 		// Popping the front queue takes linear time due to how the multi-producer queue
 		// is implemented. It is not batched so far, but even for millions of tasks it is
 		// a few milliseconds tops.
@@ -120,6 +122,7 @@ namespace aio {
 			event = CONTAINING_RECORD(over->lpOverlapped, IOEvent, myOverlap);
 			task = (IOTask*)over->lpCompletionKey;
 			MG_DEV_ASSERT(&event->myOverlap == over->lpOverlapped);
+			MG_TRACE(IO_EVENT, task);
 			DWORD unusedFlags = 0;
 			if (WSAGetOverlappedResult(task->mySocket, &event->myOverlap, &byteCount,
 				false, &unusedFlags))
@@ -262,14 +265,9 @@ namespace aio {
 		// example when it would be more worse.
 		//
 		batch = 0;
-		while (myWaitingQueue.Count() > 0 && ++batch < maxBatch)
+		while (++batch < maxBatch &&
+			(task = myWaitingQueue.PopExpired(timestamp)) != nullptr)
 		{
-			task = myWaitingQueue.GetTop();
-			// Sorted by deadline. The top is not expired = nothing is expired.
-			if (task->myDeadline > timestamp)
-				break;
-			myWaitingQueue.RemoveTop();
-
 			oldState = IOTASK_STATUS_WAITING;
 			if (task->myStatus.CmpExchgStrongRelaxed(oldState, IOTASK_STATUS_READY))
 			{
@@ -307,6 +305,7 @@ namespace aio {
 			nextTask = task->myNext;
 			task->myNext = nullptr;
 			MG_DEV_ASSERT(task->myIndex == -1);
+			MG_TRACE(TASK_SCHEDULE, task);
 			myReadyQueue.PushPending(task);
 			task = nextTask;
 		}
@@ -321,14 +320,17 @@ namespace aio {
 		// exit from here when the thread is shutting down.
 		if (didWait)
 			return false;
+		if (PrivScheduleSpin())
+			return false;
 
 		if (myWaitingQueue.Count() != 0)
 		{
-			uint64_t deadline = myWaitingQueue.GetTop()->myDeadline;
-			timestamp = mg::box::GetMilliseconds();
+			uint64_t deadline = myWaitingQueue.GetNextDeadline();
+			timestamp = mg::box::GetMicroseconds();
 			if (timestamp >= deadline)
 				goto retry;
-			uint64_t duration = deadline - timestamp;
+			// IOCP takes milliseconds. Round up to not wake up before the deadline.
+			uint64_t duration = (deadline - timestamp + 999) / 1000;
 			// Subtract 1 because this 'infinite' isn't really infinite. It is just 4
 			// bytes unsigned number which is < 50 days. Need to wakeup at when they
 			// expire. Despite it sounds unrealistic, this scenario is theoretically
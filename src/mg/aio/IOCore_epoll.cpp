@@ -1,5 +1,7 @@
 #include "IOCore.h"
 
+#include "mg/box/Trace.h"
+
 #include <poll.h>
 #include <sys/epoll.h>
 #include <sys/eventfd.h>
@@ -112,8 +114,8 @@ namespace aio {
 		bool isExpired;
 		IOTaskStatus oldState;
 		uint32_t batch;
-		uint32_t maxBatch = mySchedBatchSize;
-		uint64_t timestamp = mg::box::GetMilliseconds();
+		uint32_t maxBatch = mySchedBatchSize.LoadRelaxed();
+		uint64_t timestamp = mg::box::GetMicroseconds();
 		// Don't push ready elements to the queue right away. It is possible that the same
 		// task is both in the epoll output and in the front queue output. Firstly, can
 		// merge them to avoid double wakeups. Secondly, a task might need to be closed
@@ -141,6 +143,7 @@ namespace aio {
 			// wakeup this thread. For example, to let it know, that it is time to stop.
 			if (t == nullptr)
 				continue;
+			MG_TRACE(IO_EVENT, t);
 			// It is not documented if epoll will return the full event mask on each
 			// edge-triggered update (EPOLLET), if only some of the events has changed.
 			// Therefore the only safe action here is to merge them in userspace using OR.
@@ -262,14 +265,9 @@ namespace aio {
 		// example when it would be more worse.
 		//
 		batch = 0;
-		while (myWaitingQueue.Count() > 0 && ++batch < maxBatch)
+		while (++batch < maxBatch &&
+			(t = myWaitingQueue.PopExpired(timestamp)) != nullptr)
 		{
-			t = myWaitingQueue.GetTop();
-			// Sorted by deadline. The top is not expired = nothing is expired.
-			if (t->myDeadline > timestamp)
-				break;
-			myWaitingQueue.RemoveTop();
-
 			oldState = IOTASK_STATUS_WAITING;
 			if (t->myStatus.CmpExchgStrongRelaxed(oldState, IOTASK_STATUS_READY))
 			{
@@ -307,6 +305,7 @@ namespace aio {
 			next = t->myNext;
 			t->myNext = nullptr;
 			MG_DEV_ASSERT(t->myIndex == -1);
+			MG_TRACE(TASK_SCHEDULE, t);
 			myReadyQueue.PushPending(t);
 			t = next;
 		}
@@ -331,21 +330,27 @@ namespace aio {
 		// If poll() returns, it means either a timeout, or that the next epoll_wait()
 		// will return something immediately.
 
+		if (PrivScheduleSpin())
+			return false;
+
 		pollfd pfd;
 		memset(&pfd, 0, sizeof(pfd));
 		pfd.fd = myNativeCore;
 		pfd.events = POLLIN;
-		int pollTimeout = -1;
+		// ppoll() takes the timeout with nanoseconds precision, so the sub-millisecond
+		// deadlines don't turn into a busy loop or into 1ms sleeps.
+		timespec pollTimeoutTs;
+		timespec* pollTimeout = nullptr;
 		if (myWaitingQueue.Count() != 0)
 		{
-			uint64_t deadline = myWaitingQueue.GetTop()->myDeadline;
-			timestamp = mg::box::GetMilliseconds();
+			uint64_t deadline = myWaitingQueue.GetNextDeadline();
+			timestamp = mg::box::GetMicroseconds();
 			if (timestamp >= deadline)
 				return false;
 			uint64_t duration = deadline - timestamp;
-			if (duration > INT_MAX)
-				duration = INT_MAX;
-			pollTimeout = (int)duration;
+			pollTimeoutTs.tv_sec = (time_t)(duration / 1000000);
+			pollTimeoutTs.tv_nsec = (long)(duration % 1000000 * 1000);
+			pollTimeout = &pollTimeoutTs;
 		}
 		else if (myState.LoadRelaxed() != IOCORE_STATE_RUNNING)
 		{
@@ -353,7 +358,7 @@ namespace aio {
 			// Need to exit instead of going into the infinite sleep.
 			return false;
 		}
-		poll(&pfd, 1, pollTimeout);
+		ppoll(&pfd, 1, pollTimeout, nullptr);
 		return false;
 	}
 
@@ -1,5 +1,7 @@
 #include "IOCore.h"
 
+#include "mg/box/Trace.h"
+
 #include <poll.h>
 #include <sys/eventfd.h>
 
@@ -112,8 +114,8 @@ namespace aio {
 		bool isExpired;
 		IOTaskStatus oldState;
 		uint32_t batch;
-		uint32_t maxBatch = mySchedBatchSize;
-		uint64_t timestamp = mg::box::GetMilliseconds();
+		uint32_t maxBatch = mySchedBatchSize.LoadRelaxed();
+		uint64_t timestamp = mg::box::GetMicroseconds();
 		// Don't push ready elements to the queue right away. It is possible that the same
 		// task is both in the io_uring output and in the front queue output. Firstly, can
 		// merge them to avoid double wakeups. Secondly, a task might need to be closed
@@ -152,6 +154,7 @@ namespace aio {
 				myToSubmitEvents.Prepend(&mySignalEvent);
 				continue;
 			}
+			MG_TRACE(IO_EVENT, task);
 			if (cqe->res >= 0)
 				event->ReturnBytes(cqe->res);
 			else
@@ -338,14 +341,9 @@ namespace aio {
 		// example when it would be worse.
 		//
 		batch = 0;
-		while (myWaitingQueue.Count() > 0 && ++batch < maxBatch)
+		while (++batch < maxBatch &&
+			(task = myWaitingQueue.PopExpired(timestamp)) != nullptr)
 		{
-			task = myWaitingQueue.GetTop();
-			// Sorted by deadline. The top is not expired = nothing is expired.
-			if (task->myDeadline > timestamp)
-				break;
-			myWaitingQueue.RemoveTop();
-
 			oldState = IOTASK_STATUS_WAITING;
 			if (task->myStatus.CmpExchgStrongRelaxed(oldState, IOTASK_STATUS_READY))
 			{
@@ -383,6 +381,7 @@ namespace aio {
 			next = task->myNext;
 			task->myNext = nullptr;
 			MG_DEV_ASSERT(task->myIndex == -1);
+			MG_TRACE(TASK_SCHEDULE, task);
 			myReadyQueue.PushPending(task);
 			task = next;
 		}
@@ -481,21 +480,27 @@ namespace aio {
 		// If poll() returns, it means either a timeout, or that the next
 		// io_uring_peek_batch_cqe() is going to return some new events.
 
+		if (PrivScheduleSpin())
+			return false;
+
 		pollfd pfd;
 		memset(&pfd, 0, sizeof(pfd));
 		pfd.fd = myRingEventFd;
 		pfd.events = POLLIN;
-		int pollTimeout = -1;
+		// ppoll() takes the timeout with nanoseconds precision, so the sub-millisecond
+		// deadlines don't turn into a busy loop or into 1ms sleeps.
+		timespec pollTimeoutTs;
+		timespec* pollTimeout = nullptr;
 		if (myWaitingQueue.Count() != 0)
 		{
-			uint64_t deadline = myWaitingQueue.GetTop()->myDeadline;
-			timestamp = mg::box::GetMilliseconds();
+			uint64_t deadline = myWaitingQueue.GetNextDeadline();
+			timestamp = mg::box::GetMicroseconds();
 			if (timestamp >= deadline)
 				return false;
 			uint64_t duration = deadline - timestamp;
-			if (duration > INT_MAX)
-				duration = INT_MAX;
-			pollTimeout = (int)duration;
+			pollTimeoutTs.tv_sec = (time_t)(duration / 1000000);
+			pollTimeoutTs.tv_nsec = (long)(duration % 1000000 * 1000);
+			pollTimeout = &pollTimeoutTs;
 		}
 		else if (myState.LoadRelaxed() != IOCORE_STATE_RUNNING)
 		{
@@ -503,7 +508,7 @@ namespace aio {
 			// Need to exit instead of going into the infinite sleep.
 			return false;
 		}
-		if (poll(&pfd, 1, pollTimeout) > 0)
+		if (ppoll(&pfd, 1, pollTimeout, nullptr) > 0)
 		{
 			uint64_t num;
 			ssize_t rc = read(myRingEventFd, &num, sizeof(num));
@@ -1,5 +1,7 @@
 #include "IOCore.h"
 
+#include "mg/box/Trace.h"
+
 #include <poll.h>
 #include <sys/event.h>
 #include <unistd.h>
@@ -112,8 +114,8 @@ namespace aio {
 		bool isExpired;
 		IOTaskStatus oldState;
 		uint32_t batch;
-		uint32_t maxBatch = mySchedBatchSize;
-		uint64_t timestamp = mg::box::GetMilliseconds();
+		uint32_t maxBatch = mySchedBatchSize.LoadRelaxed();
+		uint64_t timestamp = mg::box::GetMicroseconds();
 		// Don't push ready elements to the queue right away. It is possible that the same
 		// task is both in the kqueue output and in the front queue output. Firstly, can
 		// merge them to avoid double wakeups. Secondly, a task might need to be closed
@@ -143,6 +145,7 @@ namespace aio {
 			// time to stop.
 			if (t == nullptr)
 				continue;
+			MG_TRACE(IO_EVENT, t);
 			if (ev.filter == EVFILT_READ)
 				t->myPendingEvents.myHasRead = true;
 			else if (ev.filter == EVFILT_WRITE)
@@ -272,14 +275,9 @@ namespace aio {
 		// example when it would be more worse.
 		//
 		batch = 0;
-		while (myWaitingQueue.Count() > 0 && ++batch < maxBatch)
+		while (++batch < maxBatch &&
+			(t = myWaitingQueue.PopExpired(timestamp)) != nullptr)
 		{
-			t = myWaitingQueue.GetTop();
-			// Sorted by deadline. The top is not expired = nothing is expired.
-			if (t->myDeadline > timestamp)
-				break;
-			myWaitingQueue.RemoveTop();
-
 			oldState = IOTASK_STATUS_WAITING;
 			if (t->myStatus.CmpExchgStrongRelaxed(oldState, IOTASK_STATUS_READY))
 			{
@@ -317,6 +315,7 @@ namespace aio {
 			next = t->myNext;
 			t->myNext = nullptr;
 			MG_DEV_ASSERT(t->myIndex == -1);
+			MG_TRACE(TASK_SCHEDULE, t);
 			myReadyQueue.PushPending(t);
 			t = next;
 		}
@@ -341,6 +340,9 @@ namespace aio {
 		// If poll() returns, it means either a timeout, or that the next kevent() will
 		// return something immediately.
 
+		if (PrivScheduleSpin())
+			return false;
+
 		pollfd pfd;
 		memset(&pfd, 0, sizeof(pfd));
 		pfd.fd = myNativeCore;
@@ -348,11 +350,12 @@ namespace aio {
 		int pollTimeout = -1;
 		if (myWaitingQueue.Count() != 0)
 		{
-			uint64_t deadline = myWaitingQueue.GetTop()->myDeadline;
-			timestamp = mg::box::GetMilliseconds();
+			uint64_t deadline = myWaitingQueue.GetNextDeadline();
+			timestamp = mg::box::GetMicroseconds();
 			if (timestamp >= deadline)
 				return false;
-			uint64_t duration = deadline - timestamp;
+			// poll() takes milliseconds. Round up to not wake up before the deadline.
+			uint64_t duration = (deadline - timestamp + 999) / 1000;
 			if (duration > INT_MAX)
 				duration = INT_MAX;
 			pollTimeout = (int)duration;
@@ -4,6 +4,7 @@
 #include "mg/box/IOVec.h"
 #include "mg/box/Log.h"
 #include "mg/box/Thread.h"
+#include "mg/box/Trace.h"
 #include "mg/net/Buffer.h"
 
 namespace mg {
@@ -18,9 +19,16 @@ namespace aio {
 		: myStatus(IOTASK_STATUS_PENDING)
 		, mySocket(mg::net::theInvalidSocket)
 		, myNext(nullptr)
+		, myWaitPrev(nullptr)
+		, myWaitNext(nullptr)
 		, myIndex(-1)
 		, myCloseGuard(false)
 		, myDeadline(MG_TIME_INFINITE)
+		, myPeriod(0)
+		, myPeriodTick(0)
+		, myTickCount(0)
+		, myPeriodPolicy(mg::box::PERIOD_MISS_SKIP)
+		, myCancelWaiter(PrivOnCancel, this)
 		, myIsClosed(false)
 		, myIsInQueues(false)
 		, myIsExpired(false)
@@ -32,6 +40,8 @@ namespace aio {
 	IOTask::~IOTask()
 	{
 		PrivTouch();
+		// Must be first. The cancellation might be waking the task up right now.
+		myCancelWaiter.Unsubscribe();
 		// Can't destroy the task which is being kept by the worker. In case it would be
 		// freed and another task would be allocated in the same memory, it might think it
 		// is being executed, which is untrue.
@@ -116,14 +126,44 @@ namespace aio {
 
 	void
 	IOTask::PostWakeup()
+	{
+		MG_TRACE(TASK_WAKEUP, this);
+		if (PrivWakeup())
+			myCore.PrivRePost(this);
+	}
+
+	bool
+	IOTask::IsInWorkerNow() const
+	{
+		return theCurrentIOTask == this;
+	}
+
+	void
+	IOTask::SetCancellation(
+		mg::box::CancellationToken* aToken)
+	{
+		MG_DEV_ASSERT(!myIsInQueues || IsInWorkerNow());
+		myCancelWaiter.Unsubscribe();
+		if (aToken != nullptr)
+			myCancelWaiter.Subscribe(aToken);
+	}
+
+	bool
+	IOTask::IsCancelled() const
+	{
+		return myCancelWaiter.IsCancelled();
+	}
+
+	bool
+	IOTask::PrivWakeup()
 	{
 		// Fast path.
 		IOTaskStatus oldStatus = IOTASK_STATUS_WAITING;
 		if (myStatus.CmpExchgStrongRelaxed(oldStatus, IOTASK_STATUS_READY))
-			return myCore.PrivRePost(this);
+			return true;
 		// Fail, but the task was awake anyway.
 		if (oldStatus == IOTASK_STATUS_READY)
-			return;
+			return false;
 
 		// Slow path. If meet CLOSED then nothing to wakeup anymore. If meet CLOSING, then
 		// it is same as READY - the task is already awake.
@@ -139,17 +179,59 @@ namespace aio {
 			}
 			// Success.
 			if (oldStatus == IOTASK_STATUS_PENDING)
-				return;
+				return false;
 			if (oldStatus == IOTASK_STATUS_WAITING)
-				return myCore.PrivRePost(this);
+				return true;
 			MG_BOX_ASSERT_F(false, "status: %d", (int)oldStatus);
 		}
+		return false;
 	}
 
-	bool
-	IOTask::IsInWorkerNow() const
+	void
+	IOTask::PrivOnCancel(
+		mg::box::CancellationWaiter* aFirst)
 	{
-		return theCurrentIOTask == this;
+		// The same as PostWakeup() of each task, but the waiting ones are re-pushed into
+		// the front queue together. Usually all the tasks are in one core. When the core
+		// changes, the collected tasks are flushed.
+		IOCore* core = nullptr;
+		IOTask* first = nullptr;
+		IOTask* last = nullptr;
+		for (mg::box::CancellationWaiter* w = aFirst; w != nullptr; w = w->myNext)
+		{
+			IOTask* t = w->GetOwner<IOTask>();
+			MG_TRACE(TASK_WAKEUP, t);
+			if (!t->PrivWakeup())
+				continue;
+			if (core != &t->myCore)
+			{
+				if (first != nullptr)
+					core->PrivRePostMany(first, last);
+				core = &t->myCore;
+				first = nullptr;
+				last = t;
+			}
+			// Waiting task is not in the front queue. Its link is free.
+			t->myNext = first;
+			first = t;
+		}
+		if (first != nullptr)
+			core->PrivRePostMany(first, last);
+	}
+
+	void
+	IOTask::SetPeriodUs(
+		uint64_t aPeriod,
+		mg::box::PeriodMissPolicy aPolicy)
+	{
+		PrivTouch();
+		myPeriod = aPeriod;
+		myPeriodPolicy = aPolicy;
+		myTickCount = 0;
+		if (aPeriod == 0)
+			return;
+		myPeriodTick = mg::box::PeriodFirstTick(aPeriod, mg::box::GetMicroseconds());
+		SetDeadlineUs(myPeriodTick);
 	}
 
 	void
@@ -233,8 +315,17 @@ namespace aio {
 		PrivDumpReadyEvents(args);
 		// Need to reset the deadline to prevent infinite rescheduling. It is safe to do
 		// here, because the value is always owned by one thread, and can only be changed
-		// by OnEvent() call below.
-		myDeadline = MG_TIME_INFINITE;
+		// by OnEvent() call below. A periodic task gets its next tick instead.
+		if (myPeriod == 0)
+		{
+			myDeadline = MG_TIME_INFINITE;
+		}
+		else
+		{
+			myPeriodTick = mg::box::PeriodNextTick(myPeriodTick, myPeriod,
+				myPeriodPolicy, mg::box::GetMicroseconds(), myTickCount);
+			myDeadline = myPeriodTick;
+		}
 		theCurrentIOTask = this;
 		if (myIsClosed)
 		{
@@ -26,8 +26,10 @@
 #if MG_IOCORE_USE_IOCP || MG_IOCORE_USE_IOURING
 #include "mg/box/ForwardList.h"
 #endif
+#include "mg/box/CancellationToken.h"
 #include "mg/box/IOVec.h"
 #include "mg/box/SharedPtr.h"
+#include "mg/box/Time.h"
 #include "mg/net/Socket.h"
 
 #if MG_IOCORE_USE_IOCP
@@ -39,6 +41,15 @@ F_DECLARE_CLASS(mg, net, Buffer)
 F_DECLARE_CLASS(mg, net, BufferLink)
 
 namespace mg {
+namespace box {
+
+	template<typename T>
+	class PeriodicTimingWheel;
+
+	template<typename T>
+	class TimingWheel;
+
+}
 namespace aio {
 
 	class IOCore;
@@ -377,6 +388,26 @@ namespace aio {
 		// allows to use the deadline from multiple independent parts of the task owner.
 		void SetDeadline(
 			uint64_t aDeadline);
+		// The same but the deadline is in microseconds, compared with GetMicroseconds().
+		// IOCore keeps all deadlines in microseconds anyway.
+		void SetDeadlineUs(
+			uint64_t aDeadline);
+
+		// Make the task periodic. Then on each wakeup the deadline is reset to the next
+		// tick instead of infinity. The ticks are on the multiples of the period, so they
+		// don't drift, and the tasks of the same period share one timer entry in IOCore.
+		// The policy defines what happens with the ticks missed by a late task. Period 0
+		// makes the task non-periodic again. A lower deadline can still be set during an
+		// execution, the cadence isn't affected by it.
+		void SetPeriod(
+			uint32_t aPeriod,
+			mg::box::PeriodMissPolicy aPolicy = mg::box::PERIOD_MISS_SKIP);
+		void SetPeriodUs(
+			uint64_t aPeriod,
+			mg::box::PeriodMissPolicy aPolicy = mg::box::PERIOD_MISS_SKIP);
+		// Number of the period ticks reached by the current execution. 0 means the task
+		// is executed before its tick, for example due to IO. See PeriodNextTick().
+		uint32_t GetTickCount() const;
 
 		// Fast analogue of a wakeup. It can be used only from an IO worker thread. But is
 		// incomparably faster, because does not use any atomics.
@@ -420,6 +451,17 @@ namespace aio {
 #else
 		#error "Unknown backend"
 #endif
+		// Attach the task to a cancellation token. When the token or any of its parents
+		// is cancelled, the task is woken up, and IsCancelled() becomes true. The
+		// wakeups of all the tasks of the token's tree are pushed into the front queue of
+		// each core in one batch. The owner decides what to do then. For example,
+		// TCPSocketIFace aborts the connect, or closes the socket. Null detaches the
+		// task. Can be called before the task is posted or from its worker.
+		void SetCancellation(
+			mg::box::CancellationToken* aToken);
+		// Can be called anytime.
+		bool IsCancelled() const;
+
 		// Check if the task is in the current thread, and this thread is an IO worker.
 		// When it is in a worker, IO functions can be called right away. This helps to
 		// reduce latency (no need to re-schedule the task), and save CPU (no need to
@@ -510,16 +552,16 @@ namespace aio {
 			const IOArgs& aArgs,
 			mg::box::Error::Ptr& aOutErr);
 
-	public:
-		// Comparison operator is public because is used by the waiting queue's binary
-		// heap.
-		bool operator<=(
-			const IOTask& aTask) const;
 	private:
 		void PrivDumpReadyEvents(
 			IOArgs& aOutArgs);
 		void PrivTouch() const;
 		bool PrivExecute();
+		// Status change of wakeup. Returns true if the task was waiting and must be
+		// re-pushed to the core.
+		bool PrivWakeup();
+		static void PrivOnCancel(
+			mg::box::CancellationWaiter* aFirst);
 		bool PrivCloseStart();
 		void PrivCloseDo();
 		void PrivCloseEnd();
@@ -606,19 +648,33 @@ namespace aio {
 	public:
 		// 'Next' is public because is used by intrusive lists.
 		IOTask* myNext;
-		// Index is public because is used by the binary heap.
+		// Links and index are public because are used by the waiting queue. The links
+		// are separate from 'next', because a waiting task can be in the front queue at
+		// the same time.
+		IOTask* myWaitPrev;
+		IOTask* myWaitNext;
 		int32_t myIndex;
 	private:
 		// Atomic flag whether close was requested. It filters out all non-first close
 		// requests.
 		mg::box::AtomicBool myCloseGuard;
+		// In microseconds.
 		uint64_t myDeadline;
+		// Period of a periodic task and its next tick, in microseconds. The period is
+		// also used by the waiting queue to group the tasks.
+		uint64_t myPeriod;
+		uint64_t myPeriodTick;
+		uint32_t myTickCount;
+		mg::box::PeriodMissPolicy myPeriodPolicy;
+		mg::box::CancellationWaiter myCancelWaiter;
 		bool myIsClosed;
 		bool myIsInQueues;
 		bool myIsExpired;
 		IOCore& myCore;
 
 		friend class IOCore;
+		template<typename> friend class mg::box::PeriodicTimingWheel;
+		template<typename> friend class mg::box::TimingWheel;
 	};
 
 	mg::net::Socket SocketCreate(
@@ -829,6 +885,13 @@ namespace aio {
 	inline void
 	IOTask::SetDeadline(
 		uint64_t aDeadline)
+	{
+		SetDeadlineUs(mg::box::TimeMsToUs(aDeadline));
+	}
+
+	inline void
+	IOTask::SetDeadlineUs(
+		uint64_t aDeadline)
 	{
 		PrivTouch();
 		if (aDeadline < myDeadline)
@@ -836,17 +899,25 @@ namespace aio {
 	}
 
 	inline void
-	IOTask::Reschedule()
+	IOTask::SetPeriod(
+		uint32_t aPeriod,
+		mg::box::PeriodMissPolicy aPolicy)
 	{
-		MG_DEV_ASSERT(IsInWorkerNow());
-		myDeadline = 0;
+		SetPeriodUs(mg::box::TimeMsToUs(aPeriod), aPolicy);
 	}
 
-	inline bool
-	IOTask::operator<=(
-		const IOTask& aTask) const
+	inline uint32_t
+	IOTask::GetTickCount() const
 	{
-		return myDeadline <= aTask.myDeadline;
+		PrivTouch();
+		return myTickCount;
+	}
+
+	inline void
+	IOTask::Reschedule()
+	{
+		MG_DEV_ASSERT(IsInWorkerNow());
+		myDeadline = 0;
 	}
 
 	inline void
@@ -31,6 +31,8 @@ namespace aio {
 		mg::box::Error::Ptr err;
 		if (!myTask.ProcessArgs(aArgs, err))
 			return ProtCloseError(mg::box::ErrorRaise(err, "io"));
+		if (myTask.IsCancelled())
+			return ProtCancel();
 
 		ProtOnEvent();
 		PrivRecv();
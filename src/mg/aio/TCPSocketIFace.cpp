@@ -454,6 +454,20 @@ namespace aio {
 		ProtClose();
 	}
 
+	void
+	TCPSocketIFace::ProtCancel()
+	{
+		MG_BOX_ASSERT(myTask.IsInWorkerNow());
+		myMutex.Lock();
+		bool isConnecting = myState == TCP_SOCKET_STATE_CONNECTING;
+		myMutex.Unlock();
+		// Both do nothing but close when the socket is already closing.
+		if (isConnecting)
+			PrivConnectAbort(mg::box::ErrorRaise(mg::box::ERR_BOX_CANCEL, "connect"));
+		else
+			ProtCloseError(mg::box::ErrorRaise(mg::box::ERR_BOX_CANCEL, "cancel"));
+	}
+
 	void
 	TCPSocketIFace::ProtOnSend(
 		uint32_t aByteCount)
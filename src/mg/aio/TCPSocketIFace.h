@@ -152,12 +152,26 @@ namespace aio {
 		void SetDeadline(
 			uint64_t aDeadline);
 
+		// See IOTask::SetPeriod().
+		void SetPeriod(
+			uint32_t aPeriod,
+			mg::box::PeriodMissPolicy aPolicy = mg::box::PERIOD_MISS_SKIP);
+
 		void Reschedule();
 
+		// See IOTask::SetCancellation(). When the token is cancelled, the socket is
+		// closed with ERR_BOX_CANCEL. If it is connecting, the error comes to
+		// OnConnectError(). Pending domain resolution is cancelled too. Can be called
+		// before the socket is posted, or from its worker.
+		void SetCancellation(
+			mg::box::CancellationToken* aToken);
+
 		void Connect(
 			const TCPSocketConnectParams& aParams);
 
 		bool IsExpired() const;
+		uint32_t GetTickCount() const;
+		bool IsCancelled() const;
 
 		// Socket options. The internal socket must not be exposed by value to prevent its
 		// mis-usage.
@@ -188,6 +202,9 @@ namespace aio {
 		void ProtClose();
 		void ProtCloseError(
 			mg::box::Error* aError);
+		// Close the cancelled socket. Is called by the children when they see the
+		// cancellation before handling the events.
+		void ProtCancel();
 
 		void ProtOnSend(
 			uint32_t aByteCount);
@@ -258,6 +275,22 @@ namespace aio {
 		myTask.SetDeadline(aDeadline);
 	}
 
+	inline void
+	TCPSocketIFace::SetPeriod(
+		uint32_t aPeriod,
+		mg::box::PeriodMissPolicy aPolicy)
+	{
+		MG_DEV_ASSERT(myTask.IsInWorkerNow());
+		myTask.SetPeriod(aPeriod, aPolicy);
+	}
+
+	inline void
+	TCPSocketIFace::SetCancellation(
+		mg::box::CancellationToken* aToken)
+	{
+		myTask.SetCancellation(aToken);
+	}
+
 	inline bool
 	TCPSocketIFace::IsExpired() const
 	{
@@ -265,6 +298,19 @@ namespace aio {
 		return myTask.IsExpired();
 	}
 
+	inline uint32_t
+	TCPSocketIFace::GetTickCount() const
+	{
+		MG_DEV_ASSERT(myTask.IsInWorkerNow());
+		return myTask.GetTickCount();
+	}
+
+	inline bool
+	TCPSocketIFace::IsCancelled() const
+	{
+		return myTask.IsCancelled();
+	}
+
 	inline void
 	TCPSocketIFace::Reschedule()
 	{
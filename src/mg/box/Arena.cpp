@@ -0,0 +1,75 @@
+#include "Arena.h"
+
+#include "mg/box/Assert.h"
+#include "mg/box/ThreadLocalPool.h"
+
+namespace mg {
+namespace box {
+
+	struct ArenaChunk
+		: public ThreadPooled<ArenaChunk>
+	{
+		ArenaChunk* myNext;
+		alignas(std::max_align_t) char myData[theArenaChunkSize];
+	};
+
+	// Header of a separately allocated big block. The payload follows it.
+	struct alignas(std::max_align_t) ArenaBlock
+	{
+		ArenaBlock* myNext;
+	};
+
+	void*
+	Arena::PrivAllocateSlow(
+		size_t aSize,
+		size_t aAlignment)
+	{
+		MG_DEV_ASSERT(aAlignment > 0 && (aAlignment & (aAlignment - 1)) == 0);
+		MG_DEV_ASSERT(aAlignment <= alignof(std::max_align_t));
+		if (aSize > theArenaChunkSize)
+		{
+			ArenaBlock* block = (ArenaBlock*)::operator new(sizeof(ArenaBlock) + aSize);
+			block->myNext = myBlocks;
+			myBlocks = block;
+			return block + 1;
+		}
+		ArenaChunk* chunk = new ArenaChunk();
+		if (aSize >= theArenaBigSize && myChunks != nullptr)
+		{
+			// The current chunk stays current. Its tail is still good for the small
+			// allocations.
+			chunk->myNext = myChunks->myNext;
+			myChunks->myNext = chunk;
+			return chunk->myData;
+		}
+		// The rest of the current chunk is abandoned. It is smaller than the new
+		// allocation anyway.
+		chunk->myNext = myChunks;
+		myChunks = chunk;
+		uintptr_t pos = (uintptr_t)chunk->myData;
+		myPos = pos + aSize;
+		myEnd = pos + theArenaChunkSize;
+		return (void*)pos;
+	}
+
+	void
+	Arena::PrivReset()
+	{
+		while (myChunks != nullptr)
+		{
+			ArenaChunk* next = myChunks->myNext;
+			delete myChunks;
+			myChunks = next;
+		}
+		while (myBlocks != nullptr)
+		{
+			ArenaBlock* next = myBlocks->myNext;
+			::operator delete(myBlocks);
+			myBlocks = next;
+		}
+		myPos = 0;
+		myEnd = 0;
+	}
+
+}
+}
@@ -0,0 +1,169 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace mg {
+namespace box {
+
+	struct ArenaBlock;
+	struct ArenaChunk;
+
+	// Payload of one arena chunk. Together with the chunk header it fits into a page.
+	static constexpr size_t theArenaChunkSize = 4096 - 2 * sizeof(void*);
+	// Allocations at least that big get a whole chunk each, so as not to waste the tail
+	// of the current chunk. The ones bigger than a chunk are separate heap blocks.
+	static constexpr size_t theArenaBigSize = theArenaChunkSize / 4;
+
+	// Bump allocator for many small objects dying all together. The memory is taken from
+	// chunks one after another, and nothing is freed until Reset(), which drops all the
+	// chunks at once. The chunks are pooled per thread, so an arena being filled and
+	// reset again and again doesn't touch the heap at all in the steady state.
+	//
+	// Is not thread-safe. The destructors of the objects in the arena are not called by
+	// it. Only the memory is released.
+	//
+	class Arena
+	{
+	public:
+		Arena();
+
+		Arena(
+			const Arena&) = delete;
+
+		Arena& operator=(
+			const Arena&) = delete;
+
+		~Arena();
+
+		// The alignment must be a power of 2, not bigger than of std::max_align_t.
+		void* Allocate(
+			size_t aSize,
+			size_t aAlignment = alignof(std::max_align_t));
+
+		template<typename T>
+		T* AllocateT(
+			size_t aCount = 1);
+
+		// Free all the memory of the arena. It can be used again right away.
+		void Reset();
+
+		bool IsEmpty() const;
+
+	private:
+		void* PrivAllocateSlow(
+			size_t aSize,
+			size_t aAlignment);
+
+		void PrivReset();
+
+		ArenaChunk* myChunks;
+		ArenaBlock* myBlocks;
+		uintptr_t myPos;
+		uintptr_t myEnd;
+	};
+
+	// STL-compatible allocator taking the memory from an arena. The deallocation does
+	// nothing, the memory is freed when the arena is reset. Hence it is good for the
+	// containers which are filled once and die together with the arena. The members are
+	// named the way STL expects them.
+	template<typename T>
+	class ArenaAllocator
+	{
+	public:
+		using value_type = T;
+
+		ArenaAllocator(
+			Arena& aArena) : myArena(&aArena) {}
+
+		template<typename U>
+		ArenaAllocator(
+			const ArenaAllocator<U>& aOther) : myArena(aOther.myArena) {}
+
+		T* allocate(
+			size_t aCount) { return myArena->AllocateT<T>(aCount); }
+
+		void deallocate(
+			T*,
+			size_t) {}
+
+		template<typename U>
+		bool operator==(
+			const ArenaAllocator<U>& aOther) const { return myArena == aOther.myArena; }
+
+		template<typename U>
+		bool operator!=(
+			const ArenaAllocator<U>& aOther) const { return myArena != aOther.myArena; }
+
+	private:
+		Arena* myArena;
+
+		template<typename U>
+		friend class ArenaAllocator;
+	};
+
+	using ArenaString = std::basic_string<char, std::char_traits<char>,
+		ArenaAllocator<char>>;
+
+	template<typename T>
+	using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+	//////////////////////////////////////////////////////////////////////////////////////
+
+	inline
+	Arena::Arena()
+		: myChunks(nullptr)
+		, myBlocks(nullptr)
+		, myPos(0)
+		, myEnd(0)
+	{
+	}
+
+	inline
+	Arena::~Arena()
+	{
+		Reset();
+	}
+
+	inline void*
+	Arena::Allocate(
+		size_t aSize,
+		size_t aAlignment)
+	{
+		uintptr_t pos = (myPos + aAlignment - 1) & ~(uintptr_t)(aAlignment - 1);
+		// An empty arena has no space at all, and goes to the slow path too.
+		if (pos < myEnd && aSize <= myEnd - pos)
+		{
+			myPos = pos + aSize;
+			return (void*)pos;
+		}
+		return PrivAllocateSlow(aSize, aAlignment);
+	}
+
+	template<typename T>
+	inline T*
+	Arena::AllocateT(
+		size_t aCount)
+	{
+		static_assert(alignof(T) <= alignof(std::max_align_t),
+			"Over-aligned types are not supported");
+		return (T*)Allocate(sizeof(T) * aCount, alignof(T));
+	}
+
+	inline void
+	Arena::Reset()
+	{
+		if (myChunks != nullptr || myBlocks != nullptr)
+			PrivReset();
+	}
+
+	inline bool
+	Arena::IsEmpty() const
+	{
+		return myChunks == nullptr && myBlocks == nullptr;
+	}
+
+}
+}
@@ -0,0 +1,170 @@
+#include "CancellationToken.h"
+
+#include "mg/box/ForwardList.h"
+#include "mg/box/Thread.h"
+
+namespace mg {
+namespace box {
+
+	bool
+	CancellationWaiter::Subscribe(
+		CancellationToken* aToken)
+	{
+		MG_BOX_ASSERT(!myToken.IsSet());
+		MG_DEV_ASSERT(myState.LoadRelaxed() == CANCELLATION_WAITER_STATE_IDLE);
+		myToken.Set(aToken);
+		return aToken->PrivSubscribe(this);
+	}
+
+	bool
+	CancellationWaiter::Unsubscribe()
+	{
+		if (!myToken.IsSet())
+			return true;
+		bool res = myToken->PrivUnsubscribe(this);
+		myToken.Clear();
+		return res;
+	}
+
+	//////////////////////////////////////////////////////////////////////////////////////
+
+	CancellationToken::CancellationToken()
+		: myIsCancelled(false)
+		, myParentWaiter(PrivOnParentCancel, this)
+	{
+	}
+
+	CancellationToken::CancellationToken(
+		CancellationToken* aParent)
+		: myIsCancelled(false)
+		, myParentWaiter(PrivOnParentCancel, this)
+	{
+		// Nobody else sees the token yet. The parent's cancellation, if it happens
+		// right after the subscription, would find no waiters here.
+		if (!myParentWaiter.Subscribe(aParent))
+			myIsCancelled.StoreRelease(true);
+	}
+
+	CancellationToken::~CancellationToken()
+	{
+		// Must be first. The parent's cancellation might be walking this token now.
+		myParentWaiter.Unsubscribe();
+		// The waiters reference the token. It can't die with them.
+		MG_BOX_ASSERT(myWaiters.IsEmpty());
+	}
+
+	CancellationToken::Ptr
+	CancellationToken::NewChild()
+	{
+		return Ptr::Wrap(new CancellationToken(this));
+	}
+
+	void
+	CancellationToken::Cancel()
+	{
+		CancellationWaiterList todo;
+		if (!PrivCancelStart(todo))
+			return;
+		// Flatten the tree. The children's waiters are collected into the same list,
+		// so the waiters of one kind get into one batch regardless of their tokens.
+		CancellationWaiterList waiters;
+		while (!todo.IsEmpty())
+		{
+			CancellationWaiter* w = todo.PopFirst();
+			if (w->myHandler != PrivOnParentCancel)
+			{
+				waiters.Append(w);
+				continue;
+			}
+			CancellationWaiterList sub;
+			w->GetOwner<CancellationToken>()->PrivCancelStart(sub);
+			todo.Append(std::move(sub));
+			// The child is not used after this. It can be deleted now.
+			w->myState.StoreRelease(CANCELLATION_WAITER_STATE_DONE);
+		}
+		while (!waiters.IsEmpty())
+		{
+			CancellationHandler handler = waiters.GetFirst()->myHandler;
+			mg::box::ForwardList<CancellationWaiter> batch;
+			CancellationWaiter* w = waiters.GetFirst();
+			while (w != nullptr)
+			{
+				CancellationWaiter* next = w->myNext;
+				if (w->myHandler == handler)
+				{
+					waiters.Remove(w);
+					batch.Append(w);
+				}
+				w = next;
+			}
+			handler(batch.GetFirst());
+			w = batch.GetFirst();
+			while (w != nullptr)
+			{
+				// Read the link before the state is published. Then the waiter might be
+				// deleted right away.
+				CancellationWaiter* next = w->myNext;
+				w->myState.StoreRelease(CANCELLATION_WAITER_STATE_DONE);
+				w = next;
+			}
+		}
+	}
+
+	bool
+	CancellationToken::PrivSubscribe(
+		CancellationWaiter* aWaiter)
+	{
+		mg::box::MutexLock lock(myMutex);
+		if (myIsCancelled.LoadRelaxed())
+		{
+			aWaiter->myState.StoreRelaxed(CANCELLATION_WAITER_STATE_DONE);
+			return false;
+		}
+		aWaiter->myState.StoreRelaxed(CANCELLATION_WAITER_STATE_SUBSCRIBED);
+		myWaiters.Append(aWaiter);
+		return true;
+	}
+
+	bool
+	CancellationToken::PrivUnsubscribe(
+		CancellationWaiter* aWaiter)
+	{
+		myMutex.Lock();
+		if (aWaiter->myState.LoadRelaxed() == CANCELLATION_WAITER_STATE_SUBSCRIBED)
+		{
+			myWaiters.Remove(aWaiter);
+			aWaiter->myState.StoreRelaxed(CANCELLATION_WAITER_STATE_IDLE);
+			myMutex.Unlock();
+			return true;
+		}
+		myMutex.Unlock();
+		// The handler is short and never blocks. Not worth a condition variable.
+		while (aWaiter->myState.LoadAcquire() != CANCELLATION_WAITER_STATE_DONE)
+			mg::box::ThreadYield();
+		aWaiter->myState.StoreRelaxed(CANCELLATION_WAITER_STATE_IDLE);
+		return false;
+	}
+
+	bool
+	CancellationToken::PrivCancelStart(
+		CancellationWaiterList& aOutWaiters)
+	{
+		mg::box::MutexLock lock(myMutex);
+		if (myIsCancelled.LoadRelaxed())
+			return false;
+		myIsCancelled.StoreRelease(true);
+		for (CancellationWaiter* w : myWaiters)
+			w->myState.StoreRelaxed(CANCELLATION_WAITER_STATE_FIRING);
+		aOutWaiters = std::move(myWaiters);
+		return true;
+	}
+
+	void
+	CancellationToken::PrivOnParentCancel(
+		CancellationWaiter*)
+	{
+		MG_BOX_ASSERT(!"Must not be called");
+	}
+
+}
+}
@@ -0,0 +1,176 @@
+#pragma once
+
+#include "mg/box/Atomic.h"
+#include "mg/box/DoublyList.h"
+#include "mg/box/Mutex.h"
+#include "mg/box/SharedPtr.h"
+
+namespace mg {
+namespace box {
+
+	class CancellationToken;
+	struct CancellationWaiter;
+
+	// Handler of the cancelled waiters of one kind. Gets them all at once, as a
+	// null-terminated list linked via their 'next' members. The links must not be changed
+	// by the handler. It must not block, and must not unsubscribe the given waiters.
+	using CancellationHandler = void(*)(CancellationWaiter* aFirst);
+
+	enum CancellationWaiterState : uint32_t
+	{
+		CANCELLATION_WAITER_STATE_IDLE,
+		CANCELLATION_WAITER_STATE_SUBSCRIBED,
+		// The token is cancelled, and the waiter's handler is being called right now.
+		CANCELLATION_WAITER_STATE_FIRING,
+		// The handler is done.
+		CANCELLATION_WAITER_STATE_DONE,
+	};
+
+	// Intrusive subscription to a cancellation token. Is supposed to be a member of the
+	// object which wants to know about the cancellation, like a task. The handler and
+	// the owner pointer are given by the object. The handler can find the owner of each
+	// waiter via GetOwner().
+	//
+	// Not thread-safe. Must be subscribed and unsubscribed by one thread at a time. But
+	// the token can be cancelled in parallel from any thread.
+	//
+	struct CancellationWaiter
+	{
+		CancellationWaiter(
+			CancellationHandler aHandler,
+			void* aOwner);
+
+		~CancellationWaiter();
+
+		// Returns false if the token is already cancelled. Then the handler is not
+		// called, the owner must handle the cancellation right away. The token is
+		// referenced by the waiter anyway, until unsubscribe.
+		bool Subscribe(
+			CancellationToken* aToken);
+
+		// Returns false if the token is cancelled. If it is being cancelled right now,
+		// waits until the handler is done. Hence the owner can be safely deleted after
+		// that. Nop when there is no token.
+		bool Unsubscribe();
+
+		CancellationToken* GetToken() { return myToken.GetPointer(); }
+
+		bool IsCancelled() const;
+
+		template<typename T>
+		T* GetOwner() const { return (T*)myOwner; }
+
+		CancellationWaiter* myPrev;
+		CancellationWaiter* myNext;
+
+	private:
+		CancellationWaiter(
+			const CancellationWaiter&) = delete;
+		CancellationWaiter& operator=(
+			const CancellationWaiter&) = delete;
+
+		const CancellationHandler myHandler;
+		void* const myOwner;
+		mg::box::Atomic<CancellationWaiterState> myState;
+		mg::box::SharedPtrIntrusive<CancellationToken> myToken;
+
+		friend class CancellationToken;
+	};
+
+	using CancellationWaiterList = mg::box::DoublyList<CancellationWaiter>;
+
+	// Cancellation flag shared by a tree of work, like all the tasks, IO operations, and
+	// domain resolutions of one request. Cancel() sets the flag and calls the handlers of
+	// all the waiters subscribed to the token and to all its children, recursively. The
+	// waiters of the same kind from the whole tree are given to their handler in one
+	// batch. For example, the tasks are woken up with one push into the front queue of
+	// their scheduler instead of one push per task.
+	//
+	// A child is cancelled together with its parent, but can also be cancelled alone.
+	// It keeps the parent alive. The cancellation can't be undone. The flag check is a
+	// single atomic load.
+	//
+	class CancellationToken
+	{
+		SHARED_PTR_API(CancellationToken, myRef)
+	private:
+		CancellationToken();
+		CancellationToken(
+			CancellationToken* aParent);
+		~CancellationToken();
+
+	public:
+		// Is cancelled right away if the parent is already cancelled.
+		Ptr NewChild();
+
+		// Can be called any number of times from any thread. Only the first call has an
+		// effect.
+		void Cancel();
+
+		bool IsCancelled() const;
+
+	private:
+		CancellationToken(
+			const CancellationToken&) = delete;
+		CancellationToken& operator=(
+			const CancellationToken&) = delete;
+
+		bool PrivSubscribe(
+			CancellationWaiter* aWaiter);
+
+		bool PrivUnsubscribe(
+			CancellationWaiter* aWaiter);
+
+		// Mark the token cancelled and take its waiters. They are marked as firing.
+		// Returns false if the token was already cancelled.
+		bool PrivCancelStart(
+			CancellationWaiterList& aOutWaiters);
+
+		// The handler of the children subscribed to their parents. Is never called
+		// actually. Is used to tell the children from the other waiters.
+		static void PrivOnParentCancel(
+			CancellationWaiter* aFirst);
+
+		mg::box::AtomicBool myIsCancelled;
+		mg::box::Mutex myMutex;
+		CancellationWaiterList myWaiters;
+		CancellationWaiter myParentWaiter;
+		mg::box::RefCount myRef;
+
+		friend struct CancellationWaiter;
+	};
+
+	//////////////////////////////////////////////////////////////////////////////////////
+
+	inline
+	CancellationWaiter::CancellationWaiter(
+		CancellationHandler aHandler,
+		void* aOwner)
+		: myPrev(nullptr)
+		, myNext(nullptr)
+		, myHandler(aHandler)
+		, myOwner(aOwner)
+		, myState(CANCELLATION_WAITER_STATE_IDLE)
+	{
+	}
+
+	inline
+	CancellationWaiter::~CancellationWaiter()
+	{
+		Unsubscribe();
+	}
+
+	inline bool
+	CancellationWaiter::IsCancelled() const
+	{
+		return myToken.IsSet() && myToken->IsCancelled();
+	}
+
+	inline bool
+	CancellationToken::IsCancelled() const
+	{
+		return myIsCancelled.LoadAcquire();
+	}
+
+}
+}
@@ -46,5 +46,32 @@ namespace box {
 		return ok;
 	}
 
+	bool
+	ConditionVariable::TimedWaitUs(
+		Mutex& aMutex,
+		uint64_t aTimeoutUs)
+	{
+		if (aTimeoutUs == MG_TIME_INFINITE)
+		{
+			Wait(aMutex);
+			return true;
+		}
+		MG_BOX_ASSERT(aMutex.IsOwnedByThisThread());
+		MG_BOX_ASSERT(aMutex.myCount == 1);
+		uint32_t tid = aMutex.myOwner;
+		aMutex.myOwner = 0;
+		aMutex.myCount = 0;
+
+		bool ok = myHandle.wait_for(aMutex.myHandle,
+			std::chrono::microseconds(aTimeoutUs)) != std::cv_status::timeout;
+
+		MG_BOX_ASSERT(aMutex.myOwner == 0);
+		MG_BOX_ASSERT(aMutex.myCount == 0);
+		aMutex.myOwner = tid;
+		aMutex.myCount = 1;
+
+		return ok;
+	}
+
 }
 }
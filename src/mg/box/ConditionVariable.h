@@ -33,6 +33,10 @@ namespace box {
 		bool TimedWait(
 			Mutex& aMutex,
 			mg::box::TimeLimit aTimeLimit);
+		// Timeout is in microseconds. The precision depends on the platform.
+		bool TimedWaitUs(
+			Mutex& aMutex,
+			uint64_t aTimeoutUs);
 
 		void Signal() { myHandle.notify_one(); }
 		void Broadcast() { myHandle.notify_all(); }
@@ -2,11 +2,72 @@
 
 #include "mg/box/Assert.h"
 
+#if MG_CORO_IS_ENABLED
+#include "mg/box/Atomic.h"
+#include "mg/box/Mutex.h"
+#include "mg/box/ThreadLocalPool.h"
+
+#include <new>
+#include <vector>
+#endif
+
 namespace mg {
 namespace box {
 
 #if MG_CORO_IS_ENABLED
 
+	// Frame size classes are powers of 2 from the min to the max size. A frame takes
+	// the smallest class it fits into.
+	static constexpr uint32_t theCoroFrameMinSize = 128;
+	static constexpr uint32_t theCoroFrameClassCount = 5;
+	static constexpr uint32_t theCoroFrameMaxSize =
+		theCoroFrameMinSize << (theCoroFrameClassCount - 1);
+
+	template<uint32_t Size>
+	struct CoroFrameBlock
+	{
+		alignas(__STDCPP_DEFAULT_NEW_ALIGNMENT__) unsigned char myBytes[Size];
+	};
+
+	template<uint32_t Size>
+	using CoroFramePool = ThreadLocalPool<CoroFrameBlock<Size>, theThreadLocalBatchSize>;
+
+	// Each thread has own counters, so they are updated without contention. When a
+	// thread exits, its counters are reused by a next thread, so the totals are never
+	// lost. The exiting thread can still update them meanwhile, so the increments are
+	// atomic.
+	struct CoroFrameThreadStat
+	{
+		CoroFrameThreadStat();
+
+		AtomicU64 myPoolAllocCount;
+		AtomicU64 myPoolFreeCount;
+		AtomicU64 myHeapAllocCount;
+		AtomicU64 myHeapFreeCount;
+		bool myIsFree;
+	};
+
+	struct CoroFrameThreadStatOwner
+	{
+		CoroFrameThreadStatOwner();
+		~CoroFrameThreadStatOwner();
+
+		CoroFrameThreadStat* myStat;
+	};
+
+	struct CoroFrameStatRegistry
+	{
+		Mutex myMutex;
+		std::vector<CoroFrameThreadStat*> myStats;
+	};
+
+	static AtomicBool theCoroFramePoolIsEnabled(true);
+	static thread_local CoroFrameThreadStatOwner theCoroFrameStatOwner;
+
+	static CoroFrameStatRegistry& CoroFrameGetStatRegistry();
+	static inline void CoroFrameStatInc(
+		AtomicU64& aCounter);
+
 	static void
 	CoroHandleUnref(
 		CoroHandle aCoro)
@@ -83,6 +144,144 @@ namespace box {
 		MG_BOX_ASSERT(!"Unhandled exception from a coroutine");
 	}
 
+	void*
+	CoroPromise::operator new(
+		size_t aSize)
+	{
+		CoroFrameThreadStat* stat = theCoroFrameStatOwner.myStat;
+		if (aSize > theCoroFrameMaxSize || !theCoroFramePoolIsEnabled.LoadRelaxed())
+		{
+			CoroFrameStatInc(stat->myHeapAllocCount);
+			return ::operator new(aSize);
+		}
+		CoroFrameStatInc(stat->myPoolAllocCount);
+		if (aSize <= theCoroFrameMinSize)
+			return CoroFramePool<theCoroFrameMinSize>::GetInstance().AllocateT();
+		if (aSize <= theCoroFrameMinSize * 2)
+			return CoroFramePool<theCoroFrameMinSize * 2>::GetInstance().AllocateT();
+		if (aSize <= theCoroFrameMinSize * 4)
+			return CoroFramePool<theCoroFrameMinSize * 4>::GetInstance().AllocateT();
+		if (aSize <= theCoroFrameMinSize * 8)
+			return CoroFramePool<theCoroFrameMinSize * 8>::GetInstance().AllocateT();
+		return CoroFramePool<theCoroFrameMaxSize>::GetInstance().AllocateT();
+	}
+
+	void
+	CoroPromise::operator delete(
+		void* aPtr,
+		size_t aSize) noexcept
+	{
+		// The frame can be freed in another thread. It goes to the pool of that thread
+		// then.
+		CoroFrameThreadStat* stat = theCoroFrameStatOwner.myStat;
+		if (aSize > theCoroFrameMaxSize || !theCoroFramePoolIsEnabled.LoadRelaxed())
+		{
+			CoroFrameStatInc(stat->myHeapFreeCount);
+			::operator delete(aPtr);
+			return;
+		}
+		CoroFrameStatInc(stat->myPoolFreeCount);
+		if (aSize <= theCoroFrameMinSize)
+			return CoroFramePool<theCoroFrameMinSize>::GetInstance().FreeT(aPtr);
+		if (aSize <= theCoroFrameMinSize * 2)
+			return CoroFramePool<theCoroFrameMinSize * 2>::GetInstance().FreeT(aPtr);
+		if (aSize <= theCoroFrameMinSize * 4)
+			return CoroFramePool<theCoroFrameMinSize * 4>::GetInstance().FreeT(aPtr);
+		if (aSize <= theCoroFrameMinSize * 8)
+			return CoroFramePool<theCoroFrameMinSize * 8>::GetInstance().FreeT(aPtr);
+		return CoroFramePool<theCoroFrameMaxSize>::GetInstance().FreeT(aPtr);
+	}
+
+	//////////////////////////////////////////////////////////////////////////////////////
+
+	CoroFrameStat::CoroFrameStat()
+		: myPoolAllocCount(0)
+		, myPoolFreeCount(0)
+		, myHeapAllocCount(0)
+		, myHeapFreeCount(0)
+	{
+	}
+
+	void
+	CoroFrameStatSnapshot(
+		CoroFrameStat& aOutStat)
+	{
+		aOutStat = CoroFrameStat();
+		CoroFrameStatRegistry& reg = CoroFrameGetStatRegistry();
+		MutexLock lock(reg.myMutex);
+		for (const CoroFrameThreadStat* s : reg.myStats)
+		{
+			aOutStat.myPoolAllocCount += s->myPoolAllocCount.LoadRelaxed();
+			aOutStat.myPoolFreeCount += s->myPoolFreeCount.LoadRelaxed();
+			aOutStat.myHeapAllocCount += s->myHeapAllocCount.LoadRelaxed();
+			aOutStat.myHeapFreeCount += s->myHeapFreeCount.LoadRelaxed();
+		}
+	}
+
+	void
+	CoroFramePoolSetEnabled(
+		bool aIsEnabled)
+	{
+		theCoroFramePoolIsEnabled.StoreRelaxed(aIsEnabled);
+	}
+
+	//////////////////////////////////////////////////////////////////////////////////////
+
+	CoroFrameThreadStat::CoroFrameThreadStat()
+		: myPoolAllocCount(0)
+		, myPoolFreeCount(0)
+		, myHeapAllocCount(0)
+		, myHeapFreeCount(0)
+		, myIsFree(false)
+	{
+	}
+
+	CoroFrameThreadStatOwner::CoroFrameThreadStatOwner()
+		: myStat(nullptr)
+	{
+		CoroFrameStatRegistry& reg = CoroFrameGetStatRegistry();
+		MutexLock lock(reg.myMutex);
+		for (CoroFrameThreadStat* s : reg.myStats)
+		{
+			if (s->myIsFree)
+			{
+				s->myIsFree = false;
+				myStat = s;
+				return;
+			}
+		}
+		myStat = new CoroFrameThreadStat();
+		reg.myStats.push_back(myStat);
+	}
+
+	CoroFrameThreadStatOwner::~CoroFrameThreadStatOwner()
+	{
+		// The counters stay in the registry. The pointer is kept too, in case the
+		// thread still frees some frames in its other thread-local destructors.
+		CoroFrameStatRegistry& reg = CoroFrameGetStatRegistry();
+		MutexLock lock(reg.myMutex);
+		myStat->myIsFree = true;
+	}
+
+	static CoroFrameStatRegistry&
+	CoroFrameGetStatRegistry()
+	{
+		// Never deleted, because the thread-local objects can use it even after the
+		// static objects are destroyed.
+		static CoroFrameStatRegistry* ourInstance = new CoroFrameStatRegistry();
+		return *ourInstance;
+	}
+
+	static inline void
+	CoroFrameStatInc(
+		AtomicU64& aCounter)
+	{
+		// A new thread can get the counters while the old one still frees the frames in
+		// its thread-local destructors. Then both write them. The cache line is not
+		// contended anyway.
+		aCounter.IncrementRelaxed();
+	}
+
 	//////////////////////////////////////////////////////////////////////////////////////
 
 	CoroOpCall::CoroOpCall(
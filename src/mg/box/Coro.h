@@ -4,6 +4,8 @@
 
 #if IS_CPP_AT_LEAST_20
 #include <coroutine>
+#include <cstddef>
+#include <cstdint>
 #define MG_CORO_IS_ENABLED 1
 #else
 #define MG_CORO_IS_ENABLED 0
@@ -104,6 +106,15 @@ namespace box {
 		static constexpr void return_void() noexcept {}
 		void unhandled_exception() noexcept;
 
+		// The frames are allocated from thread-local pools of a few size classes, so
+		// creation of a coroutine, including a nested call, usually doesn't touch the
+		// heap. The frames bigger than the biggest class go to the heap.
+		static void* operator new(
+			size_t aSize);
+		static void operator delete(
+			void* aPtr,
+			size_t aSize) noexcept;
+
 		// Coroutines can be stacked on each other, like a normal callstack. If the
 		// coroutine gets destroyed, then its entire callstack is destroyed as well, in
 		// reversed order, from the top.
@@ -123,6 +134,31 @@ namespace box {
 
 	//////////////////////////////////////////////////////////////////////////////////////
 
+	// Coroutine frame allocation counters of all the threads in the process.
+	struct CoroFrameStat
+	{
+		CoroFrameStat();
+
+		// Frames taken from the pools and returned there.
+		uint64_t myPoolAllocCount;
+		uint64_t myPoolFreeCount;
+		// Frames which didn't fit into the pools, or were created with the pools
+		// disabled.
+		uint64_t myHeapAllocCount;
+		uint64_t myHeapFreeCount;
+	};
+
+	void CoroFrameStatSnapshot(
+		CoroFrameStat& aOutStat);
+
+	// Pooling is enabled by default. Disabling is useful for memory debugging tools,
+	// which can't see use-after-free in the pooled memory, and for comparisons. Can
+	// only be changed when no coroutines exist.
+	void CoroFramePoolSetEnabled(
+		bool aIsEnabled);
+
+	//////////////////////////////////////////////////////////////////////////////////////
+
 	struct CoroOpCall
 		: public CoroOp
 		, public CoroOpIsNotReady
@@ -0,0 +1,96 @@
+#include "Histogram.h"
+
+#include "mg/box/Assert.h"
+
+namespace mg {
+namespace box {
+
+	Histogram::Histogram()
+		: myCount(0)
+		, mySum(0)
+		, myMax(0)
+	{
+		for (AtomicU64& b : myBuckets)
+			b.StoreRelaxed(0);
+	}
+
+	void
+	Histogram::Merge(
+		const Histogram& aOther)
+	{
+		uint64_t count = 0;
+		for (uint32_t i = 0; i < theHistogramBucketCount; ++i)
+		{
+			uint64_t value = aOther.myBuckets[i].LoadRelaxed();
+			if (value == 0)
+				continue;
+			myBuckets[i].StoreRelaxed(myBuckets[i].LoadRelaxed() + value);
+			count += value;
+		}
+		// The count is taken from the buckets, not from the other's counter. Then the
+		// merged histogram is consistent even if the other one was being updated.
+		myCount.StoreRelaxed(myCount.LoadRelaxed() + count);
+		mySum.StoreRelaxed(mySum.LoadRelaxed() + aOther.mySum.LoadRelaxed());
+		uint64_t max = aOther.myMax.LoadRelaxed();
+		if (max > myMax.LoadRelaxed())
+			myMax.StoreRelaxed(max);
+	}
+
+	void
+	Histogram::Clear()
+	{
+		for (AtomicU64& b : myBuckets)
+			b.StoreRelaxed(0);
+		myCount.StoreRelaxed(0);
+		mySum.StoreRelaxed(0);
+		myMax.StoreRelaxed(0);
+	}
+
+	double
+	Histogram::GetAverage() const
+	{
+		uint64_t count = myCount.LoadRelaxed();
+		if (count == 0)
+			return 0;
+		return (double)mySum.LoadRelaxed() / count;
+	}
+
+	uint64_t
+	Histogram::GetPercentile(
+		double aPercentile) const
+	{
+		MG_BOX_ASSERT(aPercentile >= 0 && aPercentile <= 100);
+		uint64_t count = myCount.LoadRelaxed();
+		if (count == 0)
+			return 0;
+		uint64_t rank = (uint64_t)(count * aPercentile / 100);
+		if (rank == 0)
+			rank = 1;
+		uint64_t max = myMax.LoadRelaxed();
+		uint64_t sum = 0;
+		for (uint32_t i = 0; i < theHistogramBucketCount; ++i)
+		{
+			sum += myBuckets[i].LoadRelaxed();
+			if (sum < rank)
+				continue;
+			uint64_t res = GetBucketMax(i);
+			// The bucket might be wider than the real values in it.
+			return res < max ? res : max;
+		}
+		return max;
+	}
+
+	uint64_t
+	Histogram::GetBucketMax(
+		uint32_t aIndex)
+	{
+		MG_BOX_ASSERT(aIndex < theHistogramBucketCount);
+		if (aIndex < theHistogramSubBucketCount)
+			return aIndex;
+		uint32_t shift = aIndex / theHistogramSubBucketCount - 1;
+		uint64_t sub = aIndex % theHistogramSubBucketCount + theHistogramSubBucketCount;
+		return (sub << shift) + ((1ULL << shift) - 1);
+	}
+
+}
+}
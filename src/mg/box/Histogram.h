@@ -0,0 +1,124 @@
+#pragma once
+
+#include "mg/box/Atomic.h"
+
+namespace mg {
+namespace box {
+
+	// Log-linear histogram of unsigned values. Each power-of-2 range of values is split
+	// into the same number of linear buckets. So the relative error of any returned
+	// value is at most 1 / theHistogramSubBucketCount, regardless of the magnitude. The
+	// values below theHistogramSubBucketCount are stored precisely.
+	//
+	// Add() is lock-free and can be called by one thread while the others read the
+	// histogram or merge it into theirs. The readers can see a histogram being
+	// updated, so the count, the sum, and the buckets might be off by the last few
+	// values. That is the price of not stopping the writer.
+	static constexpr uint32_t theHistogramSubBucketBits = 4;
+	static constexpr uint32_t theHistogramSubBucketCount = 1 << theHistogramSubBucketBits;
+	static constexpr uint32_t theHistogramBucketCount =
+		(64 - theHistogramSubBucketBits + 1) * theHistogramSubBucketCount;
+
+	class Histogram
+	{
+	public:
+		Histogram();
+
+		Histogram(
+			const Histogram&) = delete;
+
+		Histogram& operator=(
+			const Histogram&) = delete;
+
+		// Only one thread can add at a time.
+		void Add(
+			uint64_t aValue);
+
+		void Merge(
+			const Histogram& aOther);
+
+		// Not safe to call while another thread adds.
+		void Clear();
+
+		uint64_t GetCount() const;
+
+		uint64_t GetSum() const;
+
+		uint64_t GetMax() const;
+
+		double GetAverage() const;
+
+		// Approximate value below which the given percentage of the values is. The
+		// percentage is from 0 to 100. Returns 0 if the histogram is empty.
+		uint64_t GetPercentile(
+			double aPercentile) const;
+
+		static uint32_t GetBucketIndex(
+			uint64_t aValue);
+
+		// The biggest value fitting into the bucket.
+		static uint64_t GetBucketMax(
+			uint32_t aIndex);
+
+	private:
+		mg::box::AtomicU64 myCount;
+		mg::box::AtomicU64 mySum;
+		mg::box::AtomicU64 myMax;
+		mg::box::AtomicU64 myBuckets[theHistogramBucketCount];
+	};
+
+	//////////////////////////////////////////////////////////////////////////////////////
+
+	inline void
+	Histogram::Add(
+		uint64_t aValue)
+	{
+		// No read-modify-write operations. There is just one writer, so the plain
+		// relaxed stores are enough. They are much cheaper than the locked increments.
+		AtomicU64& bucket = myBuckets[GetBucketIndex(aValue)];
+		bucket.StoreRelaxed(bucket.LoadRelaxed() + 1);
+		mySum.StoreRelaxed(mySum.LoadRelaxed() + aValue);
+		if (aValue > myMax.LoadRelaxed())
+			myMax.StoreRelaxed(aValue);
+		myCount.StoreRelaxed(myCount.LoadRelaxed() + 1);
+	}
+
+	inline uint64_t
+	Histogram::GetCount() const
+	{
+		return myCount.LoadRelaxed();
+	}
+
+	inline uint64_t
+	Histogram::GetSum() const
+	{
+		return mySum.LoadRelaxed();
+	}
+
+	inline uint64_t
+	Histogram::GetMax() const
+	{
+		return myMax.LoadRelaxed();
+	}
+
+	inline uint32_t
+	Histogram::GetBucketIndex(
+		uint64_t aValue)
+	{
+		if (aValue < theHistogramSubBucketCount)
+			return (uint32_t)aValue;
+#if IS_COMPILER_MSVC
+		unsigned long highest;
+		_BitScanReverse64(&highest, aValue);
+#else
+		uint32_t highest = 63 - (uint32_t)__builtin_clzll(aValue);
+#endif
+		uint32_t shift = (uint32_t)highest - theHistogramSubBucketBits;
+		// The shifted value is in [SubBucketCount, 2 * SubBucketCount), because its
+		// highest bit is set. The rest are the sub-bucket index.
+		return (shift + 1) * theHistogramSubBucketCount +
+			(uint32_t)(aValue >> shift) - theHistogramSubBucketCount;
+	}
+
+}
+}
@@ -0,0 +1,241 @@
+#pragma once
+
+#include "mg/box/Assert.h"
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace mg {
+namespace box {
+
+	template<typename Signature, size_t Capacity>
+	class InlineFunction;
+
+	//
+	// A callable wrapper like std::function, but the callable is always stored inside of
+	// the wrapper object. There is no heap usage ever. If the callable doesn't fit into
+	// the given capacity, it is a compile error. Then either the capture must be reduced,
+	// or the data should be allocated by the user and captured by a pointer.
+	//
+	// Same as std::function, the callable must be copyable. Moved-from object becomes
+	// empty.
+	//
+	template<typename R, typename... Args, size_t Capacity>
+	class InlineFunction<R(Args...), Capacity>
+	{
+	public:
+		InlineFunction() : myOps(nullptr) {}
+
+		InlineFunction(
+			std::nullptr_t) : myOps(nullptr) {}
+
+		InlineFunction(
+			const InlineFunction& aOther);
+
+		InlineFunction(
+			InlineFunction&& aOther);
+
+		template<typename Functor, typename = typename std::enable_if<
+			!std::is_same<typename std::decay<Functor>::type,
+				InlineFunction>::value>::type>
+		InlineFunction(
+			Functor&& aFunc);
+
+		~InlineFunction() { Clear(); }
+
+		InlineFunction& operator=(
+			const InlineFunction& aOther);
+
+		InlineFunction& operator=(
+			InlineFunction&& aOther);
+
+		InlineFunction& operator=(
+			std::nullptr_t);
+
+		template<typename Functor, typename = typename std::enable_if<
+			!std::is_same<typename std::decay<Functor>::type,
+				InlineFunction>::value>::type>
+		InlineFunction& operator=(
+			Functor&& aFunc);
+
+		R operator()(
+			Args... aArgs) const;
+
+		explicit operator bool() const { return myOps != nullptr; }
+
+		void Clear();
+
+		// Check at compile time if the callable would fit.
+		template<typename Functor>
+		static constexpr bool
+		Fits() { return sizeof(Functor) <= Capacity &&
+			alignof(Functor) <= alignof(std::max_align_t); }
+
+	private:
+		struct Ops
+		{
+			R (*myInvoke)(void*, Args&&...);
+			void (*myCopy)(void*, const void*);
+			void (*myMove)(void*, void*);
+			void (*myDestroy)(void*);
+		};
+
+		template<typename Functor>
+		struct OpsOf
+		{
+			static R Invoke(void* aFunc, Args&&... aArgs)
+				{ return (*(Functor*)aFunc)(std::forward<Args>(aArgs)...); }
+			static void Copy(void* aDst, const void* aSrc)
+				{ new (aDst) Functor(*(const Functor*)aSrc); }
+			static void Move(void* aDst, void* aSrc)
+				{ new (aDst) Functor(std::move(*(Functor*)aSrc)); }
+			static void Destroy(void* aFunc)
+				{ ((Functor*)aFunc)->~Functor(); }
+
+			static constexpr Ops ourOps = {&Invoke, &Copy, &Move, &Destroy};
+		};
+
+		template<typename Functor>
+		void PrivCreate(
+			Functor&& aFunc);
+
+		alignas(std::max_align_t) mutable unsigned char myStorage[Capacity];
+		const Ops* myOps;
+	};
+
+	//////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename R, typename... Args, size_t Capacity>
+	template<typename Functor>
+	constexpr typename InlineFunction<R(Args...), Capacity>::Ops
+	InlineFunction<R(Args...), Capacity>::OpsOf<Functor>::ourOps;
+
+	template<typename R, typename... Args, size_t Capacity>
+	inline
+	InlineFunction<R(Args...), Capacity>::InlineFunction(
+		const InlineFunction& aOther)
+		: myOps(aOther.myOps)
+	{
+		if (myOps != nullptr)
+			myOps->myCopy(myStorage, aOther.myStorage);
+	}
+
+	template<typename R, typename... Args, size_t Capacity>
+	inline
+	InlineFunction<R(Args...), Capacity>::InlineFunction(
+		InlineFunction&& aOther)
+		: myOps(aOther.myOps)
+	{
+		if (myOps == nullptr)
+			return;
+		myOps->myMove(myStorage, aOther.myStorage);
+		aOther.Clear();
+	}
+
+	template<typename R, typename... Args, size_t Capacity>
+	template<typename Functor, typename>
+	inline
+	InlineFunction<R(Args...), Capacity>::InlineFunction(
+		Functor&& aFunc)
+		: myOps(nullptr)
+	{
+		PrivCreate(std::forward<Functor>(aFunc));
+	}
+
+	template<typename R, typename... Args, size_t Capacity>
+	inline InlineFunction<R(Args...), Capacity>&
+	InlineFunction<R(Args...), Capacity>::operator=(
+		const InlineFunction& aOther)
+	{
+		if (this == &aOther)
+			return *this;
+		Clear();
+		if (aOther.myOps != nullptr)
+		{
+			aOther.myOps->myCopy(myStorage, aOther.myStorage);
+			myOps = aOther.myOps;
+		}
+		return *this;
+	}
+
+	template<typename R, typename... Args, size_t Capacity>
+	inline InlineFunction<R(Args...), Capacity>&
+	InlineFunction<R(Args...), Capacity>::operator=(
+		InlineFunction&& aOther)
+	{
+		if (this == &aOther)
+			return *this;
+		Clear();
+		if (aOther.myOps != nullptr)
+		{
+			aOther.myOps->myMove(myStorage, aOther.myStorage);
+			myOps = aOther.myOps;
+			aOther.Clear();
+		}
+		return *this;
+	}
+
+	template<typename R, typename... Args, size_t Capacity>
+	inline InlineFunction<R(Args...), Capacity>&
+	InlineFunction<R(Args...), Capacity>::operator=(
+		std::nullptr_t)
+	{
+		Clear();
+		return *this;
+	}
+
+	template<typename R, typename... Args, size_t Capacity>
+	template<typename Functor, typename>
+	inline InlineFunction<R(Args...), Capacity>&
+	InlineFunction<R(Args...), Capacity>::operator=(
+		Functor&& aFunc)
+	{
+		// The new callable might own the current one, or be owned by it. Build it aside
+		// first.
+		InlineFunction tmp(std::forward<Functor>(aFunc));
+		return *this = std::move(tmp);
+	}
+
+	template<typename R, typename... Args, size_t Capacity>
+	inline R
+	InlineFunction<R(Args...), Capacity>::operator()(
+		Args... aArgs) const
+	{
+		MG_DEV_ASSERT(myOps != nullptr);
+		return myOps->myInvoke(myStorage, std::forward<Args>(aArgs)...);
+	}
+
+	template<typename R, typename... Args, size_t Capacity>
+	inline void
+	InlineFunction<R(Args...), Capacity>::Clear()
+	{
+		if (myOps == nullptr)
+			return;
+		const Ops* ops = myOps;
+		myOps = nullptr;
+		ops->myDestroy(myStorage);
+	}
+
+	template<typename R, typename... Args, size_t Capacity>
+	template<typename Functor>
+	inline void
+	InlineFunction<R(Args...), Capacity>::PrivCreate(
+		Functor&& aFunc)
+	{
+		using FunctorT = typename std::decay<Functor>::type;
+		static_assert(sizeof(FunctorT) <= Capacity,
+			"The callable is too big for the inline storage. Reduce the capture or "
+			"capture a pointer at heap-allocated data");
+		static_assert(alignof(FunctorT) <= alignof(std::max_align_t),
+			"The callable is over-aligned");
+		static_assert(std::is_copy_constructible<FunctorT>::value,
+			"The callable must be copyable");
+		MG_DEV_ASSERT(myOps == nullptr);
+		new (myStorage) FunctorT(std::forward<Functor>(aFunc));
+		myOps = &OpsOf<FunctorT>::ourOps;
+	}
+
+}
+}
@@ -0,0 +1,369 @@
+#pragma once
+
+#include "mg/box/Time.h"
+#include "mg/box/TimingWheel.h"
+
+#include <vector>
+
+namespace mg {
+namespace box {
+
+	//
+	// Timing wheel which keeps the periodic elements of the same period and the same
+	// deadline in one group. The groups are in a separate timing wheel, so it has one
+	// entry per group instead of one per element. The periodic elements of the same
+	// period get the same deadlines when they follow the ticks of PeriodFirstTick() and
+	// PeriodNextTick() from Time.h.
+	//
+	// Only the deadlines on the ticks of their period are grouped, i.e. the multiples of
+	// the period. Each such (period, tick) pair has its own group, found via an
+	// intrusive hash table. So the ticks don't compete for a group, and the elements
+	// popped from a group and pushed back for the next tick are grouped again, even
+	// while the old group is not empty yet. The elements off the ticks go to the usual
+	// wheel. For example, the ones catching up after being late, or having a custom
+	// deadline.
+	//
+	// The interface is the same as of TimingWheel, and all the operations are O(1) too.
+	// Only the growth of the group pool and of the hash table allocates memory. Besides,
+	// the elements must have uint64_t myPeriod member. 0 means the element is not
+	// periodic. It must not change while the element is in the wheel. The grouped
+	// elements have the index >= 0 like the ones in the wheel.
+	//
+	template<typename T>
+	class PeriodicTimingWheel
+	{
+	public:
+		PeriodicTimingWheel();
+
+		~PeriodicTimingWheel();
+
+		void SetSlack(
+			uint64_t aSlack);
+
+		void Push(
+			T* aItem);
+
+		void Remove(
+			T* aItem);
+
+		T* PopExpired(
+			uint64_t aNow);
+
+		uint64_t GetNextDeadline() const;
+
+		uint32_t Count() const;
+
+		// Number of the groups having elements.
+		uint32_t GetGroupCount() const;
+
+	private:
+		PeriodicTimingWheel(
+			const PeriodicTimingWheel&) = delete;
+
+		using List = mg::box::DoublyList<T, &T::myWaitPrev, &T::myWaitNext>;
+
+		struct Group
+		{
+			uint64_t myDeadline;
+			uint64_t myPeriod;
+			// Links and index in the wheel of the groups.
+			Group* myWaitPrev;
+			Group* myWaitNext;
+			int32_t myIndex;
+			int32_t myID;
+			// Link in the hash table bucket.
+			Group* myHashNext;
+			List myItems;
+		};
+
+		Group* PrivGroupFind(
+			uint64_t aPeriod,
+			uint64_t aDeadline);
+
+		Group* PrivGroupOpen(
+			uint64_t aPeriod,
+			uint64_t aDeadline);
+
+		// Remove the group from the hash table. The new elements of its period and tick
+		// then go to a new group.
+		void PrivGroupUnlink(
+			Group* aGroup);
+
+		void PrivGroupFree(
+			Group* aGroup);
+
+		void PrivTableGrow();
+
+		static uint64_t PrivHash(
+			uint64_t aPeriod,
+			uint64_t aDeadline);
+
+		// Is bigger than any index of TimingWheel. The grouped elements have the index
+		// equal to this + their group ID.
+		static constexpr int32_t theGroupIndexFirst = 1 << 20;
+		static constexpr uint32_t theTableSizeMin = 16;
+
+		TimingWheel<T> myWheel;
+		TimingWheel<Group> myGroups;
+		// The expired group being popped. It is not in the groups wheel nor in the table
+		// anymore.
+		Group* myGroupExpired;
+		// All the groups ever created, by their IDs. They are reused, so their number
+		// is defined by how many periods and ticks are in the wheel at once.
+		std::vector<Group*> myGroupByID;
+		Group* myGroupFree;
+		// The buckets of the not expired groups. Size is a power of 2, not less than the
+		// number of such groups.
+		std::vector<Group*> myTable;
+		uint32_t myTableCount;
+		uint32_t myGroupCount;
+		uint32_t myGroupedCount;
+	};
+
+	//////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename T>
+	PeriodicTimingWheel<T>::PeriodicTimingWheel()
+		: myGroupExpired(nullptr)
+		, myGroupFree(nullptr)
+		, myTableCount(0)
+		, myGroupCount(0)
+		, myGroupedCount(0)
+	{
+	}
+
+	template<typename T>
+	PeriodicTimingWheel<T>::~PeriodicTimingWheel()
+	{
+		MG_BOX_ASSERT(myGroupedCount == 0);
+		MG_BOX_ASSERT(myGroupCount == 0);
+		for (Group* g : myGroupByID)
+			delete g;
+	}
+
+	template<typename T>
+	inline void
+	PeriodicTimingWheel<T>::SetSlack(
+		uint64_t aSlack)
+	{
+		myWheel.SetSlack(aSlack);
+		myGroups.SetSlack(aSlack);
+	}
+
+	template<typename T>
+	inline void
+	PeriodicTimingWheel<T>::Push(
+		T* aItem)
+	{
+		MG_DEV_ASSERT(aItem->myIndex == -1);
+		uint64_t period = aItem->myPeriod;
+		uint64_t deadline = aItem->myDeadline;
+		if (period == 0 || deadline % period != 0)
+		{
+			myWheel.Push(aItem);
+			return;
+		}
+		Group* group = PrivGroupFind(period, deadline);
+		if (group == nullptr)
+			group = PrivGroupOpen(period, deadline);
+		aItem->myIndex = theGroupIndexFirst + group->myID;
+		group->myItems.Append(aItem);
+		++myGroupedCount;
+	}
+
+	template<typename T>
+	inline void
+	PeriodicTimingWheel<T>::Remove(
+		T* aItem)
+	{
+		if (aItem->myIndex < theGroupIndexFirst)
+		{
+			myWheel.Remove(aItem);
+			return;
+		}
+		Group* group = myGroupByID[aItem->myIndex - theGroupIndexFirst];
+		group->myItems.Remove(aItem);
+		aItem->myIndex = -1;
+		--myGroupedCount;
+		if (!group->myItems.IsEmpty())
+			return;
+		if (group == myGroupExpired)
+		{
+			myGroupExpired = nullptr;
+		}
+		else
+		{
+			myGroups.Remove(group);
+			PrivGroupUnlink(group);
+		}
+		PrivGroupFree(group);
+	}
+
+	template<typename T>
+	T*
+	PeriodicTimingWheel<T>::PopExpired(
+		uint64_t aNow)
+	{
+		Group* group = myGroupExpired;
+		if (group == nullptr)
+		{
+			group = myGroups.PopExpired(aNow);
+			if (group == nullptr)
+				return myWheel.PopExpired(aNow);
+			PrivGroupUnlink(group);
+			myGroupExpired = group;
+		}
+		T* res = group->myItems.PopFirst();
+		res->myIndex = -1;
+		--myGroupedCount;
+		if (group->myItems.IsEmpty())
+		{
+			myGroupExpired = nullptr;
+			PrivGroupFree(group);
+		}
+		return res;
+	}
+
+	template<typename T>
+	inline uint64_t
+	PeriodicTimingWheel<T>::GetNextDeadline() const
+	{
+		if (myGroupExpired != nullptr)
+			return myGroupExpired->myDeadline;
+		uint64_t res = myWheel.GetNextDeadline();
+		uint64_t groupNext = myGroups.GetNextDeadline();
+		return groupNext < res ? groupNext : res;
+	}
+
+	template<typename T>
+	inline uint32_t
+	PeriodicTimingWheel<T>::Count() const
+	{
+		return myWheel.Count() + myGroupedCount;
+	}
+
+	template<typename T>
+	inline uint32_t
+	PeriodicTimingWheel<T>::GetGroupCount() const
+	{
+		return myGroupCount;
+	}
+
+	template<typename T>
+	inline typename PeriodicTimingWheel<T>::Group*
+	PeriodicTimingWheel<T>::PrivGroupFind(
+		uint64_t aPeriod,
+		uint64_t aDeadline)
+	{
+		if (myTableCount == 0)
+			return nullptr;
+		uint64_t mask = myTable.size() - 1;
+		Group* res = myTable[PrivHash(aPeriod, aDeadline) & mask];
+		while (res != nullptr && (res->myPeriod != aPeriod ||
+			res->myDeadline != aDeadline))
+		{
+			res = res->myHashNext;
+		}
+		return res;
+	}
+
+	template<typename T>
+	typename PeriodicTimingWheel<T>::Group*
+	PeriodicTimingWheel<T>::PrivGroupOpen(
+		uint64_t aPeriod,
+		uint64_t aDeadline)
+	{
+		Group* res = myGroupFree;
+		if (res != nullptr)
+		{
+			myGroupFree = res->myHashNext;
+		}
+		else
+		{
+			res = new Group();
+			res->myWaitPrev = nullptr;
+			res->myWaitNext = nullptr;
+			res->myIndex = -1;
+			res->myID = (int32_t)myGroupByID.size();
+			MG_BOX_ASSERT(res->myID < INT32_MAX - theGroupIndexFirst);
+			myGroupByID.push_back(res);
+		}
+		res->myDeadline = aDeadline;
+		res->myPeriod = aPeriod;
+		++myGroupCount;
+		if (++myTableCount > myTable.size())
+			PrivTableGrow();
+		Group*& bucket = myTable[PrivHash(aPeriod, aDeadline) & (myTable.size() - 1)];
+		res->myHashNext = bucket;
+		bucket = res;
+		myGroups.Push(res);
+		return res;
+	}
+
+	template<typename T>
+	void
+	PeriodicTimingWheel<T>::PrivGroupUnlink(
+		Group* aGroup)
+	{
+		Group** pos = &myTable[PrivHash(aGroup->myPeriod, aGroup->myDeadline) &
+			(myTable.size() - 1)];
+		while (*pos != aGroup)
+		{
+			MG_DEV_ASSERT(*pos != nullptr);
+			pos = &(*pos)->myHashNext;
+		}
+		*pos = aGroup->myHashNext;
+		aGroup->myHashNext = nullptr;
+		--myTableCount;
+	}
+
+	template<typename T>
+	inline void
+	PeriodicTimingWheel<T>::PrivGroupFree(
+		Group* aGroup)
+	{
+		MG_DEV_ASSERT(aGroup->myItems.IsEmpty());
+		MG_DEV_ASSERT(aGroup->myIndex == -1);
+		--myGroupCount;
+		aGroup->myHashNext = myGroupFree;
+		myGroupFree = aGroup;
+	}
+
+	template<typename T>
+	void
+	PeriodicTimingWheel<T>::PrivTableGrow()
+	{
+		size_t size = myTable.size() * 2;
+		if (size < theTableSizeMin)
+			size = theTableSizeMin;
+		std::vector<Group*> table(size, nullptr);
+		for (Group* head : myTable)
+		{
+			while (head != nullptr)
+			{
+				Group* next = head->myHashNext;
+				Group*& bucket = table[PrivHash(head->myPeriod, head->myDeadline) &
+					(size - 1)];
+				head->myHashNext = bucket;
+				bucket = head;
+				head = next;
+			}
+		}
+		myTable.swap(table);
+	}
+
+	template<typename T>
+	inline uint64_t
+	PeriodicTimingWheel<T>::PrivHash(
+		uint64_t aPeriod,
+		uint64_t aDeadline)
+	{
+		// The ticks of one period differ in the high bits of the deadline mostly. They
+		// are mixed down into the low bits used by the bucket index.
+		uint64_t res = (aDeadline ^ (aPeriod * 0x9E3779B97F4A7C15ULL)) *
+			0xFF51AFD7ED558CCDULL;
+		return res ^ (res >> 32);
+	}
+
+}
+}
@@ -2,6 +2,8 @@
 
 #include "mg/box/Assert.h"
 #include "mg/box/Atomic.h"
+#include "mg/box/Thread.h"
+#include "mg/box/Time.h"
 
 namespace mg {
 namespace box {
@@ -114,5 +116,47 @@ namespace box {
 		return rc;
 	}
 
+	bool
+	Signal::ReceiveTimedUs(
+		uint64_t aTimeoutUs)
+	{
+		if (Receive())
+			return true;
+
+		myLock.Lock();
+		bool rc = Receive();
+		if (!rc)
+		{
+			myCond.TimedWaitUs(myLock, aTimeoutUs);
+			rc = Receive();
+		}
+		myLock.Unlock();
+		return rc;
+	}
+
+	bool
+	Signal::ReceiveSpin(
+		uint64_t aDurationUs,
+		bool aIsYield)
+	{
+		if (Receive())
+			return true;
+		uint64_t deadline = MG_TIME_INFINITE;
+		if (aDurationUs != MG_TIME_INFINITE)
+			deadline = mg::box::GetMicroseconds() + aDurationUs;
+		do
+		{
+			if (aIsYield)
+				mg::box::ThreadYield();
+			// Plain load first. A failed CAS would still take the
+			// cache line in exclusive mode and would slow down the
+			// sender.
+			if (myState.LoadRelaxed() == SIGNAL_STATE_SIGNALED && Receive())
+				return true;
+		} while (deadline == MG_TIME_INFINITE ||
+			mg::box::GetMicroseconds() < deadline);
+		return Receive();
+	}
+
 }
 }
@@ -50,6 +50,19 @@ namespace box {
 		bool ReceiveTimed(
 			mg::box::TimeLimit aTimeLimit);
 
+		// The same but the timeout is in microseconds.
+		bool ReceiveTimedUs(
+			uint64_t aTimeoutUs);
+
+		// Busy-loop trying to receive the signal for the given
+		// number of microseconds. Never blocks in the kernel,
+		// but can optionally yield the CPU to other threads on
+		// each iteration. Infinite duration spins until the
+		// signal is received.
+		bool ReceiveSpin(
+			uint64_t aDurationUs,
+			bool aIsYield);
+
 	private:
 		// State of the signal is a protection against the case
 		// when Send() is done, it appears to be the first Send(),
@@ -2,12 +2,23 @@
 
 #include "mg/box/Definitions.h"
 
+#include <vector>
+
 namespace mg {
 namespace box {
 
+	struct SysNUMANode
+	{
+		std::vector<uint32_t> myCPUs;
+	};
+
 	uint32_t SysGetCPUCoreCount();
 
 	bool SysIsWSL();
 
+	// NUMA nodes having at least one CPU. A machine without NUMA or a platform where
+	// the topology is not known is seen as a single node with all the CPUs.
+	const std::vector<SysNUMANode>& SysGetNUMANodes();
+
 }
 }
@@ -11,6 +11,8 @@ namespace box {
 
 	static uint32_t SysCalcCPUCoreCount();
 
+	static std::vector<SysNUMANode> SysCalcNUMANodes();
+
 	////////////////////////////////////////////////////////////////////////////
 
 	uint32_t
@@ -26,6 +28,13 @@ namespace box {
 		return false;
 	}
 
+	const std::vector<SysNUMANode>&
+	SysGetNUMANodes()
+	{
+		static std::vector<SysNUMANode> nodes = SysCalcNUMANodes();
+		return nodes;
+	}
+
 	////////////////////////////////////////////////////////////////////////////
 
 	static uint32_t
@@ -40,5 +49,16 @@ namespace box {
 		return val;
 	}
 
+	static std::vector<SysNUMANode>
+	SysCalcNUMANodes()
+	{
+		// Apple machines are not NUMA.
+		std::vector<SysNUMANode> nodes(1);
+		uint32_t count = SysGetCPUCoreCount();
+		for (uint32_t i = 0; i < count; ++i)
+			nodes[0].myCPUs.push_back(i);
+		return nodes;
+	}
+
 }
 }
@@ -2,7 +2,11 @@
 
 #include "mg/box/Error.h"
 
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
 #include <cstring>
+#include <dirent.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/sysinfo.h>
@@ -14,6 +18,12 @@ namespace box {
 
 	static bool SysCheckIsWSL();
 
+	static std::vector<SysNUMANode> SysCalcNUMANodes();
+
+	static bool SysReadNUMANodeCPUs(
+		uint32_t aNodeIndex,
+		std::vector<uint32_t>& aOutCPUs);
+
 	//////////////////////////////////////////////////////////////////////////////////////
 
 	uint32_t
@@ -30,6 +40,13 @@ namespace box {
 		return isWSL;
 	}
 
+	const std::vector<SysNUMANode>&
+	SysGetNUMANodes()
+	{
+		static std::vector<SysNUMANode> nodes = SysCalcNUMANodes();
+		return nodes;
+	}
+
 	//////////////////////////////////////////////////////////////////////////////////////
 
 	static bool
@@ -94,6 +111,86 @@ namespace box {
 		MG_BOX_ASSERT_F(false, "failed to check WSL: %s", err->myMessage.c_str());
 		return false;
 	}
+	static std::vector<SysNUMANode>
+	SysCalcNUMANodes()
+	{
+		// The node indexes are not necessarily contiguous. Hence the scan instead of
+		// probing node0, node1, etc until the first missing one.
+		std::vector<uint32_t> indexes;
+		DIR* dir = opendir("/sys/devices/system/node");
+		if (dir != nullptr)
+		{
+			struct dirent* entry;
+			while ((entry = readdir(dir)) != nullptr)
+			{
+				const char* name = entry->d_name;
+				if (strncmp(name, "node", 4) != 0 || name[4] < '0' || name[4] > '9')
+					continue;
+				indexes.push_back((uint32_t)strtoul(name + 4, nullptr, 10));
+			}
+			closedir(dir);
+		}
+		std::sort(indexes.begin(), indexes.end());
+
+		std::vector<SysNUMANode> nodes;
+		for (uint32_t index : indexes)
+		{
+			SysNUMANode node;
+			// Memory-only nodes have no CPUs. Nobody could run on them.
+			if (SysReadNUMANodeCPUs(index, node.myCPUs) && !node.myCPUs.empty())
+				nodes.push_back(std::move(node));
+		}
+		if (!nodes.empty())
+			return nodes;
+
+		// The kernel is built without NUMA, or /sys is not mounted. Like in some
+		// containers.
+		nodes.resize(1);
+		uint32_t count = SysGetCPUCoreCount();
+		for (uint32_t i = 0; i < count; ++i)
+			nodes[0].myCPUs.push_back(i);
+		return nodes;
+	}
+
+	static bool
+	SysReadNUMANodeCPUs(
+		uint32_t aNodeIndex,
+		std::vector<uint32_t>& aOutCPUs)
+	{
+		constexpr int bufSize = MG_SYSINFO_BUFFER_SIZE;
+		char buf[bufSize];
+		snprintf(buf, bufSize, "/sys/devices/system/node/node%u/cpulist", aNodeIndex);
+		int fd = open(buf, O_RDONLY, 0);
+		if (fd < 0)
+			return false;
+		ssize_t rc = read(fd, buf, bufSize - 1);
+		close(fd);
+		if (rc < 0)
+			return false;
+		buf[rc] = 0;
+
+		// The format is a list of ranges like "0-3,8-11,16".
+		const char* pos = buf;
+		while (*pos >= '0' && *pos <= '9')
+		{
+			char* end;
+			uint32_t first = (uint32_t)strtoul(pos, &end, 10);
+			uint32_t last = first;
+			pos = end;
+			if (*pos == '-')
+			{
+				last = (uint32_t)strtoul(pos + 1, &end, 10);
+				if (end == pos + 1 || last < first)
+					return false;
+				pos = end;
+			}
+			for (uint32_t cpu = first; cpu <= last; ++cpu)
+				aOutCPUs.push_back(cpu);
+			if (*pos == ',')
+				++pos;
+		}
+		return true;
+	}
 
 }
 }
@@ -20,5 +20,41 @@ namespace box {
 		return false;
 	}
 
+	const std::vector<SysNUMANode>&
+	SysGetNUMANodes()
+	{
+		static std::vector<SysNUMANode> nodes = []() {
+			std::vector<SysNUMANode> res;
+			ULONG highest = 0;
+			if (GetNumaHighestNodeNumber(&highest))
+			{
+				// Only the first processor group is visible here. It covers up to 64
+				// CPUs.
+				for (ULONG i = 0; i <= highest; ++i)
+				{
+					ULONGLONG mask = 0;
+					if (!GetNumaNodeProcessorMask((UCHAR)i, &mask) || mask == 0)
+						continue;
+					SysNUMANode node;
+					for (uint32_t cpu = 0; cpu < 64; ++cpu)
+					{
+						if ((mask & (1ULL << cpu)) != 0)
+							node.myCPUs.push_back(cpu);
+					}
+					res.push_back(std::move(node));
+				}
+			}
+			if (res.empty())
+			{
+				res.resize(1);
+				uint32_t count = SysGetCPUCoreCount();
+				for (uint32_t i = 0; i < count; ++i)
+					res[0].myCPUs.push_back(i);
+			}
+			return res;
+		}();
+		return nodes;
+	}
+
 }
 }
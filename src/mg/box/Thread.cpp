@@ -2,6 +2,7 @@
 
 #include "mg/box/Assert.h"
 #include "mg/box/StringFunctions.h"
+#include "mg/box/Trace.h"
 
 namespace mg {
 namespace box {
@@ -44,6 +45,14 @@ namespace box {
 		BlockingStop();
 	}
 
+	void
+	Thread::SetAffinity(
+		const std::vector<uint32_t>& aCPUs)
+	{
+		MG_BOX_ASSERT(!myWasStarted);
+		myAffinity = aCPUs;
+	}
+
 	void
 	Thread::Start()
 	{
@@ -102,6 +111,12 @@ namespace box {
 	Thread::PrivTrampoline()
 	{
 		ThreadSetCurrentName(myName.c_str());
+		MG_TRACE_THREAD_NAME(myName.c_str());
+		if (!myAffinity.empty())
+		{
+			bool ok = ThreadSetCurrentAffinity(myAffinity);
+			MG_BOX_ASSERT_F(ok, "Couldn't set affinity of thread %s", myName.c_str());
+		}
 		Run();
 		myLock.Lock();
 		MG_BOX_ASSERT(myIsRunning.ExchangeRelease(false));
@@ -6,6 +6,7 @@
 
 #include <string>
 #include <thread>
+#include <vector>
 
 #define MG_THREADLOCAL thread_local
 
@@ -24,6 +25,11 @@ namespace box {
 		Thread(
 			const char*	aName = "anon_thread");
 
+		// Pin the thread to the given CPUs. Must be called before the start. Is
+		// ignored on the platforms not supporting the hard affinity (Apple).
+		void SetAffinity(
+			const std::vector<uint32_t>& aCPUs);
+
 		void Start();
 
 		void Stop();
@@ -48,6 +54,7 @@ namespace box {
 		ConditionVariable myCond;
 		std::thread* myHandle;
 		std::string myName;
+		std::vector<uint32_t> myAffinity;
 		mg::box::AtomicBool myIsStopRequested;
 		mg::box::AtomicBool myIsRunning;
 		bool myWasStarted;
@@ -58,7 +65,15 @@ namespace box {
 
 	void SleepInfinite();
 
+	// Give the rest of the current time slice to other ready threads, if there are any.
+	void ThreadYield();
+
 	ThreadId GetCurrentThreadId();
 
+	// Pin the current thread to the given CPUs. Returns false if the system rejected
+	// the CPU set. On Apple does nothing and returns true.
+	bool ThreadSetCurrentAffinity(
+		const std::vector<uint32_t>& aCPUs);
+
 }
 }
@@ -2,6 +2,8 @@
 
 #include "mg/box/Time.h"
 
+#include <pthread.h>
+#include <sched.h>
 #include <sys/syscall.h>
 #include <unistd.h>
 
@@ -63,6 +65,28 @@ namespace box {
 		return theThreadID;
 	}
 
+	bool
+	ThreadSetCurrentAffinity(
+		const std::vector<uint32_t>& aCPUs)
+	{
+#if IS_PLATFORM_APPLE
+		// Mach only has affinity tags, which are hints about which threads should share
+		// the L2 cache. There is no way to pin a thread to a specific CPU.
+		MG_UNUSED(aCPUs);
+		return true;
+#else
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		for (uint32_t cpu : aCPUs)
+		{
+			if (cpu >= CPU_SETSIZE)
+				return false;
+			CPU_SET(cpu, &set);
+		}
+		return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#endif
+	}
+
 	void
 	Sleep(
 		uint64_t aDuration)
@@ -79,5 +103,11 @@ namespace box {
 		usleep((aDuration % 1000) * 1000);
 	}
 
+	void
+	ThreadYield()
+	{
+		sched_yield();
+	}
+
 }
 }
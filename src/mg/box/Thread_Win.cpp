@@ -48,6 +48,21 @@ namespace box {
 		return (ThreadId) ::GetCurrentThreadId();
 	}
 
+	bool
+	ThreadSetCurrentAffinity(
+		const std::vector<uint32_t>& aCPUs)
+	{
+		// Only the first processor group is supported. It covers up to 64 CPUs.
+		DWORD_PTR mask = 0;
+		for (uint32_t cpu : aCPUs)
+		{
+			if (cpu >= sizeof(mask) * 8)
+				return false;
+			mask |= (DWORD_PTR)1 << cpu;
+		}
+		return SetThreadAffinityMask(GetCurrentThread(), mask) != 0;
+	}
+
 	void
 	Sleep(
 		uint64_t aTimeMillis)
@@ -61,5 +76,11 @@ namespace box {
 		::Sleep((DWORD)aTimeMillis);
 	}
 
+	void
+	ThreadYield()
+	{
+		SwitchToThread();
+	}
+
 }
 }
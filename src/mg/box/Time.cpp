@@ -0,0 +1,29 @@
+#include "Time.h"
+
+namespace mg {
+namespace box {
+
+	static double
+	TimeCalibrateTicks()
+	{
+		uint64_t startNs = GetNanoseconds();
+		uint64_t startTicks = GetTicks();
+		uint64_t endNs;
+		do
+		{
+			endNs = GetNanoseconds();
+		} while (endNs - startNs < 1000 * 1000);
+		uint64_t endTicks = GetTicks();
+		double res = (double)(endTicks - startTicks) * 1000 / (endNs - startNs);
+		return res > 0 ? res : 1;
+	}
+
+	double
+	GetTicksPerMicrosecond()
+	{
+		static const double res = TimeCalibrateTicks();
+		return res;
+	}
+
+}
+}
@@ -2,6 +2,12 @@
 
 #include "mg/box/Assert.h"
 
+#if IS_COMPILER_MSVC
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
 namespace mg {
 namespace box {
 
@@ -12,6 +18,20 @@ namespace box {
 		TIME_LIMIT_POINT,
 	};
 
+	// What a periodic timer does when it fires late, after more than one period since
+	// its previous tick.
+	enum PeriodMissPolicy : uint8_t
+	{
+		// The missed ticks are dropped. The timer fires once, and then on the next tick
+		// in the future.
+		PERIOD_MISS_SKIP,
+		// Each tick fires. A late timer fires again right away until it catches up.
+		PERIOD_MISS_CATCH_UP,
+		// The missed ticks are merged into one firing, which reports how many ticks it
+		// covers. Then the timer continues from the next tick in the future.
+		PERIOD_MISS_COALESCE,
+	};
+
 	struct TimePoint
 	{
 		explicit constexpr TimePoint(
@@ -70,11 +90,118 @@ namespace box {
 	// Same but with higher precision.
 	double GetMillisecondsPrecise();
 
+	// Same but with microseconds precision. The same clock as GetMilliseconds(), so the
+	// values can be converted between each other.
+	uint64_t GetMicroseconds();
+
 	// Same but with nanoseconds precision (might be less precise, depending on platform).
 	uint64_t GetNanoseconds();
 
+	// Cheapest monotonic clock available - the CPU timestamp counter where it is
+	// possible. Not in any real time units. Use GetTicksPerMicrosecond() to convert.
+	static inline uint64_t GetTicks();
+
+	// Is measured once on the first call, which then takes a millisecond.
+	double GetTicksPerMicrosecond();
+
+	// Convert a time point or a duration between milliseconds and microseconds. Infinity
+	// stays infinity.
+	static inline uint64_t TimeMsToUs(
+		uint64_t aMs);
+
+	static inline uint64_t TimeUsToMs(
+		uint64_t aUs);
+
+	// The ticks of a period are on the multiples of it, so all the timers of the same
+	// period tick at the same time. The first tick is the nearest one after now.
+	static inline uint64_t PeriodFirstTick(
+		uint64_t aPeriod,
+		uint64_t aNow);
+
+	// Tick after the given one, when the timer fires at the given time. The number of the
+	// ticks covered by this firing is returned via the out parameter. It is 0 if the
+	// timer fires before the tick. Then the tick stays the same.
+	static inline uint64_t PeriodNextTick(
+		uint64_t aTick,
+		uint64_t aPeriod,
+		PeriodMissPolicy aPolicy,
+		uint64_t aNow,
+		uint32_t& aOutTickCount);
+
 	////////////////////////////////////////////////////////////////////////////
 
+	static inline uint64_t
+	GetTicks()
+	{
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+		return __rdtsc();
+#elif defined(__aarch64__)
+		uint64_t res;
+		asm volatile("mrs %0, cntvct_el0" : "=r"(res));
+		return res;
+#else
+		return GetNanoseconds();
+#endif
+	}
+
+	static inline uint64_t
+	TimeMsToUs(
+		uint64_t aMs)
+	{
+		if (aMs >= MG_TIME_INFINITE / 1000)
+			return MG_TIME_INFINITE;
+		return aMs * 1000;
+	}
+
+	static inline uint64_t
+	TimeUsToMs(
+		uint64_t aUs)
+	{
+		if (aUs == MG_TIME_INFINITE)
+			return MG_TIME_INFINITE;
+		return aUs / 1000;
+	}
+
+	static inline uint64_t
+	PeriodFirstTick(
+		uint64_t aPeriod,
+		uint64_t aNow)
+	{
+		MG_DEV_ASSERT(aPeriod > 0);
+		return (aNow / aPeriod + 1) * aPeriod;
+	}
+
+	static inline uint64_t
+	PeriodNextTick(
+		uint64_t aTick,
+		uint64_t aPeriod,
+		PeriodMissPolicy aPolicy,
+		uint64_t aNow,
+		uint32_t& aOutTickCount)
+	{
+		MG_DEV_ASSERT(aPeriod > 0);
+		if (aNow < aTick)
+		{
+			aOutTickCount = 0;
+			return aTick;
+		}
+		uint64_t missed = (aNow - aTick) / aPeriod;
+		switch (aPolicy)
+		{
+		case PERIOD_MISS_CATCH_UP:
+			aOutTickCount = 1;
+			return aTick + aPeriod;
+		case PERIOD_MISS_COALESCE:
+			aOutTickCount = missed >= UINT32_MAX ? UINT32_MAX : (uint32_t)missed + 1;
+			break;
+		default:
+			MG_DEV_ASSERT(aPolicy == PERIOD_MISS_SKIP);
+			aOutTickCount = 1;
+			break;
+		}
+		return aTick + (missed + 1) * aPeriod;
+	}
+
 	inline TimePoint
 	TimeDuration::ToPointFromNow() const
 	{
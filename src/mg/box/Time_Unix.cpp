@@ -35,6 +35,13 @@ namespace box {
 		return ts.tv_sec * 1000 + ts.tv_nsec / 1000000.0;
 	}
 
+	uint64_t
+	GetMicroseconds()
+	{
+		timespec ts = TimeGetTimespec();
+		return ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+	}
+
 	uint64_t
 	GetNanoseconds()
 	{
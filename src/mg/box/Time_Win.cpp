@@ -29,10 +29,21 @@ namespace box {
 		return res;
 	}
 
+	static double
+	TimeGetUnitsPerUs()
+	{
+		// Calculate it just once when request it first time.
+		static double res = 1000000.0 / TimeCalcFrequency();
+		return res;
+	}
+
 	uint64_t
 	GetMilliseconds()
 	{
-		return ::GetTickCount64();
+		// Not GetTickCount64(). Must be the same clock as GetMicroseconds().
+		LARGE_INTEGER ts;
+		::QueryPerformanceCounter(&ts);
+		return (uint64_t)(ts.QuadPart * TimeGetUnitsPerMs());
 	}
 
 	double
@@ -43,6 +54,14 @@ namespace box {
 		return ts.QuadPart * TimeGetUnitsPerMs();
 	}
 
+	uint64_t
+	GetMicroseconds()
+	{
+		LARGE_INTEGER ts;
+		::QueryPerformanceCounter(&ts);
+		return (uint64_t)(ts.QuadPart * TimeGetUnitsPerUs());
+	}
+
 	uint64_t
 	GetNanoseconds()
 	{
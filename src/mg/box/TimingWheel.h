@@ -0,0 +1,328 @@
+#pragma once
+
+#include "mg/box/Assert.h"
+#include "mg/box/DoublyList.h"
+
+#include <utility>
+
+#if IS_COMPILER_MSVC
+#include <intrin.h>
+#endif
+
+namespace mg {
+namespace box {
+
+	//
+	// Hierarchical timing wheel is a priority queue specialized for deadlines. It gives
+	// the following complexity estimations:
+	//
+	// - Insertion: O(1).
+	//
+	// - Delete any element: O(1).
+	//
+	// - Pop an expired element: O(1) amortized. Each element is moved between the levels
+	//   at most once per level on its way to the expiration.
+	//
+	// The wheel consists of levels, each has 64 slots. A slot on the level N covers 64^N
+	// time units. Elements are put into a slot according to how far their deadlines are
+	// from the current wheel time. When the time reaches a slot on a higher level, its
+	// elements are cascaded down to the lower levels. On the lowest level all elements of
+	// a slot have the same deadline and expire together. All the 64 bits of the time are
+	// covered by the levels, so any deadline can be stored.
+	//
+	// The elements must have the following members accessible for the wheel (the wheel
+	// can be made a friend):
+	//
+	// - uint64_t myDeadline. Must not change while the element is in the wheel;
+	// - T* myWaitPrev, T* myWaitNext. Intrusive links;
+	// - int32_t myIndex. Slot of the element. Is -1 when the element is not in the wheel.
+	//
+	// Optional slack allows the wheel to expire the elements later than their deadlines,
+	// but not more than by the slack. The deadlines are rounded up then, and the close
+	// ones get into the same slots. They expire together, and are cascaded in groups.
+	//
+	template<typename T>
+	class TimingWheel
+	{
+	public:
+		TimingWheel();
+
+		~TimingWheel();
+
+		// The slack is rounded down to a power of 2. Can be changed only when the wheel
+		// is empty.
+		void SetSlack(
+			uint64_t aSlack);
+
+		void Push(
+			T* aItem);
+
+		void Remove(
+			T* aItem);
+
+		// Pop one element having the deadline <= the given time. Null if there are no
+		// such elements. Moves the wheel time forward.
+		T* PopExpired(
+			uint64_t aNow);
+
+		// Time when the next element might expire. The real deadline might be later. That
+		// happens when the closest elements are on the higher levels. Then at the
+		// returned time they are going to be cascaded down, and the next deadline is
+		// going to be more precise. MG_TIME_INFINITE if empty.
+		uint64_t GetNextDeadline() const;
+
+		uint32_t Count() const;
+
+	private:
+		TimingWheel(
+			const TimingWheel&) = delete;
+
+		using List = mg::box::DoublyList<T, &T::myWaitPrev, &T::myWaitNext>;
+
+		void PrivPlace(
+			T* aItem);
+
+		bool PrivFindNext(
+			uint32_t& aOutLevel,
+			uint32_t& aOutSlot) const;
+
+		uint64_t PrivSlotStart(
+			uint32_t aLevel,
+			uint32_t aSlot) const;
+
+		static uint32_t PrivBitLowest(
+			uint64_t aValue);
+
+		static uint32_t PrivBitHighest(
+			uint64_t aValue);
+
+		static constexpr uint32_t theLevelBits = 6;
+		static constexpr uint32_t theSlotCount = 1 << theLevelBits;
+		static constexpr uint64_t theSlotMask = theSlotCount - 1;
+		static constexpr uint32_t theLevelCount =
+			(64 + theLevelBits - 1) / theLevelBits;
+		static constexpr int32_t theExpiredIndex = theLevelCount * theSlotCount;
+
+		uint64_t myNow;
+		uint64_t mySlackMask;
+		uint32_t myCount;
+		uint64_t myOccupied[theLevelCount];
+		List myExpired;
+		List mySlots[theLevelCount][theSlotCount];
+	};
+
+	//////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename T>
+	TimingWheel<T>::TimingWheel()
+		: myNow(0)
+		, mySlackMask(0)
+		, myCount(0)
+	{
+		for (uint64_t& bits : myOccupied)
+			bits = 0;
+	}
+
+	template<typename T>
+	TimingWheel<T>::~TimingWheel()
+	{
+		MG_BOX_ASSERT(myCount == 0);
+	}
+
+	template<typename T>
+	inline void
+	TimingWheel<T>::SetSlack(
+		uint64_t aSlack)
+	{
+		MG_BOX_ASSERT(myCount == 0);
+		if (aSlack == 0)
+			mySlackMask = 0;
+		else if (aSlack == UINT64_MAX)
+			mySlackMask = UINT64_MAX;
+		else
+			mySlackMask = (1ULL << PrivBitHighest(aSlack + 1)) - 1;
+	}
+
+	template<typename T>
+	inline void
+	TimingWheel<T>::Push(
+		T* aItem)
+	{
+		MG_DEV_ASSERT(aItem->myIndex == -1);
+		++myCount;
+		PrivPlace(aItem);
+	}
+
+	template<typename T>
+	inline void
+	TimingWheel<T>::Remove(
+		T* aItem)
+	{
+		int32_t index = aItem->myIndex;
+		MG_DEV_ASSERT(index >= 0 && index <= theExpiredIndex);
+		aItem->myIndex = -1;
+		--myCount;
+		if (index == theExpiredIndex)
+		{
+			myExpired.Remove(aItem);
+			return;
+		}
+		uint32_t level = (uint32_t)index / theSlotCount;
+		uint32_t slot = (uint32_t)index % theSlotCount;
+		List& list = mySlots[level][slot];
+		list.Remove(aItem);
+		if (list.IsEmpty())
+			myOccupied[level] &= ~(1ULL << slot);
+	}
+
+	template<typename T>
+	T*
+	TimingWheel<T>::PopExpired(
+		uint64_t aNow)
+	{
+		uint32_t level;
+		uint32_t slot;
+		while (true)
+		{
+			if (!myExpired.IsEmpty())
+			{
+				T* res = myExpired.PopFirst();
+				res->myIndex = -1;
+				--myCount;
+				return res;
+			}
+			if (!PrivFindNext(level, slot))
+				break;
+			uint64_t start = PrivSlotStart(level, slot);
+			if (start > aNow)
+				break;
+			List list(std::move(mySlots[level][slot]));
+			myOccupied[level] &= ~(1ULL << slot);
+			myNow = start;
+			// On the lowest level all the elements of one slot have the same deadline.
+			// Others are cascaded down. Some of them might be expired right away.
+			while (!list.IsEmpty())
+				PrivPlace(list.PopFirst());
+		}
+		// It is safe to move the time forward when no slots are reached. All the elements
+		// stay in the same slots regardless of the time, as long as it is before the
+		// start of the nearest slot.
+		if (aNow > myNow)
+			myNow = aNow;
+		return nullptr;
+	}
+
+	template<typename T>
+	inline uint64_t
+	TimingWheel<T>::GetNextDeadline() const
+	{
+		if (!myExpired.IsEmpty())
+			return myNow;
+		uint32_t level;
+		uint32_t slot;
+		if (!PrivFindNext(level, slot))
+			return MG_TIME_INFINITE;
+		return PrivSlotStart(level, slot);
+	}
+
+	template<typename T>
+	inline uint32_t
+	TimingWheel<T>::Count() const
+	{
+		return myCount;
+	}
+
+	template<typename T>
+	inline void
+	TimingWheel<T>::PrivPlace(
+		T* aItem)
+	{
+		uint64_t key = aItem->myDeadline;
+		if ((key & mySlackMask) != 0)
+		{
+			// Round up, but don't overflow.
+			uint64_t rounded = (key | mySlackMask) + 1;
+			key = rounded == 0 ? MG_TIME_INFINITE : rounded;
+		}
+		if (key <= myNow)
+		{
+			aItem->myIndex = theExpiredIndex;
+			myExpired.Append(aItem);
+			return;
+		}
+		// The level is defined by the highest bit differing between the key and the
+		// current time. Lower bits are covered by the lower levels.
+		uint32_t level = PrivBitHighest((key ^ myNow) | theSlotMask) / theLevelBits;
+		uint32_t slot = (uint32_t)((key >> (level * theLevelBits)) & theSlotMask);
+		aItem->myIndex = (int32_t)(level * theSlotCount + slot);
+		mySlots[level][slot].Append(aItem);
+		myOccupied[level] |= 1ULL << slot;
+	}
+
+	template<typename T>
+	inline bool
+	TimingWheel<T>::PrivFindNext(
+		uint32_t& aOutLevel,
+		uint32_t& aOutSlot) const
+	{
+		// Any element on a lower level expires earlier than any element on a higher
+		// level. Within a level the slots before the current time are always empty.
+		for (uint32_t level = 0; level < theLevelCount; ++level)
+		{
+			uint64_t bits = myOccupied[level];
+			if (bits == 0)
+				continue;
+			uint32_t pos = (uint32_t)((myNow >> (level * theLevelBits)) & theSlotMask);
+			bits &= ~0ULL << pos;
+			MG_DEV_ASSERT(bits != 0);
+			aOutLevel = level;
+			aOutSlot = PrivBitLowest(bits);
+			return true;
+		}
+		return false;
+	}
+
+	template<typename T>
+	inline uint64_t
+	TimingWheel<T>::PrivSlotStart(
+		uint32_t aLevel,
+		uint32_t aSlot) const
+	{
+		uint32_t shift = aLevel * theLevelBits;
+		uint32_t levelEnd = shift + theLevelBits;
+		uint64_t base = levelEnd >= 64 ? 0 : myNow & ~((1ULL << levelEnd) - 1);
+		return base + ((uint64_t)aSlot << shift);
+	}
+
+	template<typename T>
+	inline uint32_t
+	TimingWheel<T>::PrivBitLowest(
+		uint64_t aValue)
+	{
+		MG_DEV_ASSERT(aValue != 0);
+#if IS_COMPILER_MSVC
+		unsigned long res;
+		_BitScanForward64(&res, aValue);
+		return (uint32_t)res;
+#else
+		return (uint32_t)__builtin_ctzll(aValue);
+#endif
+	}
+
+	template<typename T>
+	inline uint32_t
+	TimingWheel<T>::PrivBitHighest(
+		uint64_t aValue)
+	{
+		MG_DEV_ASSERT(aValue != 0);
+#if IS_COMPILER_MSVC
+		unsigned long res;
+		_BitScanReverse64(&res, aValue);
+		return (uint32_t)res;
+#else
+		return 63 - (uint32_t)__builtin_clzll(aValue);
+#endif
+	}
+
+}
+}
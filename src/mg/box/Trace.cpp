@@ -0,0 +1,354 @@
+#include "Trace.h"
+
+#include "mg/box/Assert.h"
+#include "mg/box/Mutex.h"
+#include "mg/box/StringFunctions.h"
+#include "mg/box/Thread.h"
+
+#include <stdio.h>
+#include <unordered_map>
+#include <vector>
+
+namespace mg {
+namespace box {
+
+	struct TraceThread
+	{
+		TraceRing myRing;
+		// Events before this position are dropped.
+		uint64_t myStartPos;
+		mg::box::ThreadId myThreadId;
+		std::string myName;
+		bool myIsFree;
+	};
+
+	// A thread's ring is returned to the global registry when the thread exits. Then it
+	// is reused by a next thread. It means the traces of the exited threads are lost
+	// eventually, but the memory doesn't grow with each new thread.
+	struct TraceThreadOwner
+	{
+		TraceThreadOwner() : myThread(nullptr) {}
+		~TraceThreadOwner();
+
+		TraceThread* myThread;
+	};
+
+	struct TraceRegistry
+	{
+		TraceRegistry();
+
+		mg::box::Mutex myMutex;
+		std::vector<TraceThread*> myThreads;
+		std::unordered_map<const void*, const char*> myLabels;
+		uint64_t myStartTicks;
+		uint64_t myStartNs;
+	};
+
+	static TraceRegistry& TraceGetRegistry();
+	static void TraceAppendJSONString(
+		std::string& aDst,
+		const char* aStr);
+
+	thread_local TraceRing* theTraceRing = nullptr;
+	static thread_local TraceThreadOwner theTraceOwner;
+
+	void
+	TraceSetLabel(
+		const void* aObject,
+		const char* aLabel)
+	{
+		TraceRegistry& reg = TraceGetRegistry();
+		mg::box::MutexLock lock(reg.myMutex);
+		if (aLabel == nullptr)
+			reg.myLabels.erase(aObject);
+		else
+			reg.myLabels[aObject] = aLabel;
+	}
+
+	void
+	TraceSetThreadName(
+		const char* aName)
+	{
+		if (theTraceRing == nullptr)
+			TracePrivGetRing();
+		TraceRegistry& reg = TraceGetRegistry();
+		mg::box::MutexLock lock(reg.myMutex);
+		theTraceOwner.myThread->myName = aName;
+	}
+
+	void
+	TraceClear()
+	{
+		TraceRegistry& reg = TraceGetRegistry();
+		mg::box::MutexLock lock(reg.myMutex);
+		for (TraceThread* t : reg.myThreads)
+			t->myStartPos = t->myRing.myWritePos.LoadAcquire();
+	}
+
+	std::string
+	TraceExportChrome()
+	{
+		struct Event
+		{
+			uint64_t myTimestamp;
+			const void* myObject;
+			TraceEventType myType;
+		};
+		TraceRegistry& reg = TraceGetRegistry();
+		mg::box::MutexLock lock(reg.myMutex);
+
+		// Calibrate the ticks against the real clock. The longer the interval, the more
+		// precise the conversion.
+		uint64_t ticks = TraceGetTimestamp();
+		uint64_t ns = mg::box::GetNanoseconds();
+		if (ns - reg.myStartNs < 10 * 1000 * 1000)
+		{
+			mg::box::Sleep(10);
+			ticks = TraceGetTimestamp();
+			ns = mg::box::GetNanoseconds();
+		}
+		double ticksPerUs = (double)(ticks - reg.myStartTicks) * 1000 /
+			(ns - reg.myStartNs);
+
+		std::string res = "{\"traceEvents\":[";
+		bool isFirst = true;
+		std::vector<Event> events;
+		for (TraceThread* t : reg.myThreads)
+		{
+			uint32_t tid = t->myThreadId;
+			if (!isFirst)
+				res += ',';
+			isFirst = false;
+			res += mg::box::StringFormat("{\"name\":\"thread_name\",\"ph\":\"M\","
+				"\"pid\":1,\"tid\":%u,\"args\":{\"name\":", tid);
+			if (t->myName.empty())
+				res += mg::box::StringFormat("\"thread %u\"", tid);
+			else
+				TraceAppendJSONString(res, t->myName.c_str());
+			res += "}}";
+
+			// Copy the events first, and only then check which of them could have been
+			// overwritten during the copying.
+			const TraceRing& ring = t->myRing;
+			uint64_t end = ring.myWritePos.LoadAcquire();
+			uint64_t begin = t->myStartPos;
+			if (end - begin > theTraceRingSize)
+				begin = end - theTraceRingSize;
+			events.clear();
+			for (uint64_t pos = begin; pos < end; ++pos)
+			{
+				const TraceEvent& e = ring.myEvents[pos & (theTraceRingSize - 1)];
+				events.push_back({e.myTimestamp.LoadRelaxed(), e.myObject.LoadRelaxed(),
+					e.myType.LoadRelaxed()});
+			}
+			std::atomic_thread_fence(std::memory_order_acquire);
+			uint64_t newEnd = ring.myWritePos.LoadRelaxed();
+			// The writer might be writing the event at newEnd right now. It overwrites
+			// the slot of the event at newEnd - size. Such a torn event would only have
+			// wrong fields, nothing worse, so it is not worth a heavier synchronization.
+			uint64_t skip = 0;
+			if (newEnd - begin >= theTraceRingSize)
+				skip = newEnd - begin - theTraceRingSize + 1;
+			if (skip > events.size())
+				skip = events.size();
+
+			uint32_t depth = 0;
+			for (uint64_t i = skip; i < events.size(); ++i)
+			{
+				const Event& e = events[i];
+				double ts = 0;
+				if (e.myTimestamp > reg.myStartTicks)
+					ts = (e.myTimestamp - reg.myStartTicks) / ticksPerUs;
+				const char* ph;
+				const char* name;
+				switch (e.myType)
+				{
+				case TRACE_EVENT_TASK_POST:
+					ph = "i";
+					name = "post";
+					break;
+				case TRACE_EVENT_TASK_SCHEDULE:
+					ph = "i";
+					name = "schedule";
+					break;
+				case TRACE_EVENT_TASK_EXEC_BEGIN:
+					ph = "B";
+					name = "task";
+					break;
+				case TRACE_EVENT_TASK_EXEC_END:
+					ph = "E";
+					name = "task";
+					break;
+				case TRACE_EVENT_TASK_WAKEUP:
+					ph = "i";
+					name = "wakeup";
+					break;
+				case TRACE_EVENT_TASK_SIGNAL:
+					ph = "i";
+					name = "signal";
+					break;
+				case TRACE_EVENT_IO_EVENT:
+					ph = "i";
+					name = "io event";
+					break;
+				case TRACE_EVENT_SCHED_ENTER:
+					ph = "B";
+					name = "sched";
+					break;
+				case TRACE_EVENT_SCHED_EXIT:
+					ph = "E";
+					name = "sched";
+					break;
+				default:
+					MG_BOX_ASSERT_F(false, "Unknown trace event %u", (uint32_t)e.myType);
+					ph = nullptr;
+					name = nullptr;
+					break;
+				}
+				if (ph[0] == 'B')
+				{
+					++depth;
+				}
+				else if (ph[0] == 'E')
+				{
+					// The beginning could be overwritten in the ring.
+					if (depth == 0)
+						continue;
+					--depth;
+				}
+				if (e.myType == TRACE_EVENT_TASK_EXEC_BEGIN)
+				{
+					auto it = reg.myLabels.find(e.myObject);
+					if (it != reg.myLabels.end())
+						name = it->second;
+				}
+				res += ",{\"name\":";
+				TraceAppendJSONString(res, name);
+				res += mg::box::StringFormat(",\"ph\":\"%s\",\"ts\":%.3f,\"pid\":1,"
+					"\"tid\":%u", ph, ts, tid);
+				if (ph[0] == 'i')
+					res += ",\"s\":\"t\"";
+				if (ph[0] != 'E')
+				{
+					res += mg::box::StringFormat(",\"args\":{\"object\":\"%p\"}",
+						e.myObject);
+				}
+				res += '}';
+				// Flow arrows from the task's post to its execution.
+				if (e.myType == TRACE_EVENT_TASK_POST)
+				{
+					res += mg::box::StringFormat(",{\"name\":\"post\",\"cat\":\"flow\","
+						"\"ph\":\"s\",\"id\":\"%p\",\"ts\":%.3f,\"pid\":1,\"tid\":%u}",
+						e.myObject, ts, tid);
+				}
+				else if (e.myType == TRACE_EVENT_TASK_EXEC_BEGIN)
+				{
+					res += mg::box::StringFormat(",{\"name\":\"post\",\"cat\":\"flow\","
+						"\"ph\":\"f\",\"bp\":\"e\",\"id\":\"%p\",\"ts\":%.3f,\"pid\":1,"
+						"\"tid\":%u}", e.myObject, ts, tid);
+				}
+			}
+		}
+		res += "]}";
+		return res;
+	}
+
+	bool
+	TraceExportChromeFile(
+		const char* aPath)
+	{
+		std::string data = TraceExportChrome();
+		FILE* f = fopen(aPath, "wb");
+		if (f == nullptr)
+			return false;
+		bool ok = fwrite(data.data(), 1, data.size(), f) == data.size();
+		ok = fclose(f) == 0 && ok;
+		return ok;
+	}
+
+	TraceRing*
+	TracePrivGetRing()
+	{
+		MG_DEV_ASSERT(theTraceRing == nullptr);
+		TraceRegistry& reg = TraceGetRegistry();
+		TraceThread* res = nullptr;
+		{
+			mg::box::MutexLock lock(reg.myMutex);
+			for (TraceThread* t : reg.myThreads)
+			{
+				if (!t->myIsFree)
+					continue;
+				res = t;
+				break;
+			}
+			if (res == nullptr)
+			{
+				res = new TraceThread();
+				res->myRing.myWritePos.StoreRelaxed(0);
+				reg.myThreads.push_back(res);
+			}
+			res->myStartPos = res->myRing.myWritePos.LoadRelaxed();
+			res->myThreadId = mg::box::GetCurrentThreadId();
+			res->myName.clear();
+			res->myIsFree = false;
+		}
+		theTraceOwner.myThread = res;
+		theTraceRing = &res->myRing;
+		return theTraceRing;
+	}
+
+	//////////////////////////////////////////////////////////////////////////////////////
+
+	TraceThreadOwner::~TraceThreadOwner()
+	{
+		if (myThread == nullptr)
+			return;
+		TraceRegistry& reg = TraceGetRegistry();
+		mg::box::MutexLock lock(reg.myMutex);
+		myThread->myIsFree = true;
+		theTraceRing = nullptr;
+	}
+
+	TraceRegistry::TraceRegistry()
+		: myStartTicks(TraceGetTimestamp())
+		, myStartNs(mg::box::GetNanoseconds())
+	{
+	}
+
+	static TraceRegistry&
+	TraceGetRegistry()
+	{
+		// Never deleted, because the threads can exit after the static objects are
+		// destroyed.
+		static TraceRegistry* res = new TraceRegistry();
+		return *res;
+	}
+
+	static void
+	TraceAppendJSONString(
+		std::string& aDst,
+		const char* aStr)
+	{
+		aDst += '"';
+		for (; *aStr != 0; ++aStr)
+		{
+			char c = *aStr;
+			if (c == '"' || c == '\\')
+			{
+				aDst += '\\';
+				aDst += c;
+			}
+			else if ((unsigned char)c < 0x20)
+			{
+				aDst += mg::box::StringFormat("\\u%04x", (uint32_t)c);
+			}
+			else
+			{
+				aDst += c;
+			}
+		}
+		aDst += '"';
+	}
+
+}
+}
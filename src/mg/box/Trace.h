@@ -0,0 +1,126 @@
+#pragma once
+
+#include "mg/box/Atomic.h"
+#include "mg/box/Time.h"
+
+#include <string>
+
+// The tracing hooks in the library are compiled out unless MG_ENABLE_TRACE is defined
+// to 1 (the same-named CMake option). The functions below are always available, so the
+// user's code can record its own events even in a default build.
+#ifndef MG_ENABLE_TRACE
+#define MG_ENABLE_TRACE 0
+#endif
+
+#if MG_ENABLE_TRACE
+#define MG_TRACE(aType, aObject) mg::box::TraceAdd(mg::box::TRACE_EVENT_##aType, aObject)
+#define MG_TRACE_LABEL(aObject, aLabel) mg::box::TraceSetLabel(aObject, aLabel)
+#define MG_TRACE_THREAD_NAME(aName) mg::box::TraceSetThreadName(aName)
+#else
+#define MG_TRACE(aType, aObject) ((void)0)
+#define MG_TRACE_LABEL(aObject, aLabel) ((void)0)
+#define MG_TRACE_THREAD_NAME(aName) ((void)0)
+#endif
+
+namespace mg {
+namespace box {
+
+	enum TraceEventType : uint32_t
+	{
+		// A task is posted into a scheduler.
+		TRACE_EVENT_TASK_POST,
+		// A task is pushed into a ready queue.
+		TRACE_EVENT_TASK_SCHEDULE,
+		TRACE_EVENT_TASK_EXEC_BEGIN,
+		TRACE_EVENT_TASK_EXEC_END,
+		TRACE_EVENT_TASK_WAKEUP,
+		TRACE_EVENT_TASK_SIGNAL,
+		// A kernel event is delivered to an IO task.
+		TRACE_EVENT_IO_EVENT,
+		// A thread took the scheduler role.
+		TRACE_EVENT_SCHED_ENTER,
+		TRACE_EVENT_SCHED_EXIT,
+	};
+
+	// Each thread records the events into its own ring buffer of this size. When the
+	// ring is full, the oldest events are overwritten.
+	static constexpr uint32_t theTraceRingSize = 1 << 16;
+
+	struct TraceEvent
+	{
+		// CPU ticks, converted into the real time on export.
+		mg::box::AtomicU64 myTimestamp;
+		mg::box::Atomic<const void*> myObject;
+		mg::box::Atomic<TraceEventType> myType;
+	};
+
+	struct TraceRing
+	{
+		// Only the owner thread writes. The position is published after the event, so a
+		// reader never sees an unfinished event. Unless it is overwritten during the
+		// reading, which the reader detects via the position.
+		mg::box::AtomicU64 myWritePos;
+		TraceEvent myEvents[theTraceRingSize];
+	};
+
+	// Record an event in the current thread's ring. Lock-free, except for the very first
+	// event in each thread. The object is usually a task pointer. The ring of an exited
+	// thread is given to the next new thread, without the old events and name. So there
+	// are not more rings than threads ever alive at once.
+	void TraceAdd(
+		TraceEventType aType,
+		const void* aObject);
+
+	// Give a name to the object. It is used on export instead of the pointer. The label
+	// is not copied and must outlive the trace (a string literal, for example).
+	void TraceSetLabel(
+		const void* aObject,
+		const char* aLabel);
+
+	void TraceSetThreadName(
+		const char* aName);
+
+	// Drop all the events recorded so far. Safe to call while the threads are tracing.
+	void TraceClear();
+
+	// Export the events of all the threads in Chrome trace event JSON format, which is
+	// understood by chrome://tracing and Perfetto UI. The threads are not stopped, so the
+	// newest events might be not visible.
+	std::string TraceExportChrome();
+
+	bool TraceExportChromeFile(
+		const char* aPath);
+
+	// Cheapest monotonic clock available. Not necessarily in any real time units.
+	uint64_t TraceGetTimestamp();
+
+	TraceRing* TracePrivGetRing();
+
+	extern thread_local TraceRing* theTraceRing;
+
+	//////////////////////////////////////////////////////////////////////////////////////
+
+	inline void
+	TraceAdd(
+		TraceEventType aType,
+		const void* aObject)
+	{
+		TraceRing* ring = theTraceRing;
+		if (ring == nullptr)
+			ring = TracePrivGetRing();
+		uint64_t pos = ring->myWritePos.LoadRelaxed();
+		TraceEvent& e = ring->myEvents[pos & (theTraceRingSize - 1)];
+		e.myTimestamp.StoreRelaxed(TraceGetTimestamp());
+		e.myObject.StoreRelaxed(aObject);
+		e.myType.StoreRelaxed(aType);
+		ring->myWritePos.StoreRelease(pos + 1);
+	}
+
+	inline uint64_t
+	TraceGetTimestamp()
+	{
+		return mg::box::GetTicks();
+	}
+
+}
+}
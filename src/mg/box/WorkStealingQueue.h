@@ -0,0 +1,189 @@
+#pragma once
+
+#include "mg/box/Assert.h"
+#include "mg/box/Atomic.h"
+
+namespace mg {
+namespace box {
+
+	//
+	// Bounded lock-free queue with a single producer (the owner) and multiple consumers.
+	// The owner pushes to the tail and pops from the head. Any other thread can pop from
+	// the head as well, or steal a half of the queue at once into its own queue. That is
+	// a classic building block for work-stealing schedulers.
+	//
+	// The queue is a cyclic buffer with two counters. The tail is written only by the
+	// owner. The head is advanced by the consumers (including the owner) via
+	// compare-exchange. The counters are never wrapped to the buffer size explicitly,
+	// they simply overflow, and the difference between them is always the item count.
+	//
+	// Push never blocks and never allocates. When the queue is full, the push fails and
+	// the owner is supposed to put the item somewhere else (like a global queue).
+	//
+	template<typename T>
+	class WorkStealingQueue
+	{
+	public:
+		// Capacity must be a power of 2.
+		WorkStealingQueue(
+			uint32_t aCapacity);
+
+		~WorkStealingQueue();
+
+		// Only the owner can push.
+		bool Push(
+			T* aItem);
+
+		// Can be called by any thread.
+		T* Pop();
+
+		// Take about a half of the items from this queue and move them into the
+		// destination queue owned by the caller. One of the stolen items is returned
+		// right away and not put into the destination. The destination must be empty.
+		T* StealHalf(
+			WorkStealingQueue& aDst);
+
+		// The count is approximate when the queue is used concurrently.
+		uint32_t Count() const;
+
+		bool IsEmpty() const;
+
+		uint32_t GetCapacity() const;
+
+	private:
+		WorkStealingQueue(
+			const WorkStealingQueue&) = delete;
+
+		mg::box::AtomicU32 myHead;
+		// Consumers and the producer work on different sides of the queue. Don't let
+		// them invalidate each other's cache.
+		MG_UNUSED_MEMBER char myFalseSharingProtection[MG_CACHE_LINE_SIZE];
+		mg::box::AtomicU32 myTail;
+		const uint32_t myMask;
+		mg::box::Atomic<T*>* myItems;
+	};
+
+	//////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename T>
+	inline
+	WorkStealingQueue<T>::WorkStealingQueue(
+		uint32_t aCapacity)
+		: myHead(0)
+		, myTail(0)
+		, myMask(aCapacity - 1)
+		, myItems(new mg::box::Atomic<T*>[aCapacity])
+	{
+		MG_BOX_ASSERT(aCapacity >= 2 && (aCapacity & myMask) == 0);
+	}
+
+	template<typename T>
+	inline
+	WorkStealingQueue<T>::~WorkStealingQueue()
+	{
+		MG_BOX_ASSERT(IsEmpty());
+		delete[] myItems;
+	}
+
+	template<typename T>
+	inline bool
+	WorkStealingQueue<T>::Push(
+		T* aItem)
+	{
+		uint32_t tail = myTail.LoadRelaxed();
+		// Acquire to make sure the consumers are done reading the slot which is going to
+		// be overwritten.
+		uint32_t head = myHead.LoadAcquire();
+		if (tail - head > myMask)
+			return false;
+		myItems[tail & myMask].StoreRelaxed(aItem);
+		// Release to publish the item to the consumers.
+		myTail.StoreRelease(tail + 1);
+		return true;
+	}
+
+	template<typename T>
+	inline T*
+	WorkStealingQueue<T>::Pop()
+	{
+		uint32_t head = myHead.LoadAcquire();
+		while (true)
+		{
+			uint32_t tail = myTail.LoadAcquire();
+			if (head == tail)
+				return nullptr;
+			// The slot might be overwritten by the owner right after the read, if the
+			// head was already moved by another consumer. But then the cmpxchg below
+			// fails and the value is not used.
+			T* res = myItems[head & myMask].LoadRelaxed();
+			if (myHead.CmpExchgWeakAcqRel(head, head + 1))
+				return res;
+		}
+	}
+
+	template<typename T>
+	T*
+	WorkStealingQueue<T>::StealHalf(
+		WorkStealingQueue& aDst)
+	{
+		MG_DEV_ASSERT(aDst.IsEmpty());
+		MG_DEV_ASSERT(aDst.myMask >= myMask / 2);
+		uint32_t dstTail = aDst.myTail.LoadRelaxed();
+		uint32_t head = myHead.LoadAcquire();
+		uint32_t count;
+		while (true)
+		{
+			uint32_t tail = myTail.LoadAcquire();
+			count = tail - head;
+			count -= count / 2;
+			if (count == 0)
+				return nullptr;
+			if (count > (myMask + 1) / 2)
+			{
+				// The head was read a while ago and is too old. Can't trust the size.
+				head = myHead.LoadAcquire();
+				continue;
+			}
+			// Copy before the cmpxchg. After it the owner might overwrite the slots.
+			for (uint32_t i = 0; i < count; ++i)
+			{
+				aDst.myItems[(dstTail + i) & aDst.myMask].StoreRelaxed(
+					myItems[(head + i) & myMask].LoadRelaxed());
+			}
+			if (myHead.CmpExchgWeakAcqRel(head, head + count))
+				break;
+		}
+		--count;
+		T* res = aDst.myItems[(dstTail + count) & aDst.myMask].LoadRelaxed();
+		if (count > 0)
+			aDst.myTail.StoreRelease(dstTail + count);
+		return res;
+	}
+
+	template<typename T>
+	inline uint32_t
+	WorkStealingQueue<T>::Count() const
+	{
+		uint32_t head = myHead.LoadAcquire();
+		uint32_t tail = myTail.LoadAcquire();
+		uint32_t res = tail - head;
+		// Head could be read when it was already too old.
+		return res <= myMask + 1 ? res : 0;
+	}
+
+	template<typename T>
+	inline bool
+	WorkStealingQueue<T>::IsEmpty() const
+	{
+		return Count() == 0;
+	}
+
+	template<typename T>
+	inline uint32_t
+	WorkStealingQueue<T>::GetCapacity() const
+	{
+		return myMask + 1;
+	}
+
+}
+}
@@ -17,6 +17,9 @@ namespace net {
 	static mg::box::ErrorCode theDebugErrorCode = mg::box::ERR_BOX_NONE;
 #endif
 
+	static void DomainToIPOnCancel(
+		mg::box::CancellationWaiter* aFirst);
+
 	class DomainToIPContext
 	{
 	public:
@@ -43,6 +46,13 @@ namespace net {
 		uint64_t myDeadline;
 		int32_t myIndex;
 		bool myIsCancelled;
+		// The context is in the front cancel queue, or was there. It can get there from
+		// the request owner and from the token, but only once. Is protected by the
+		// worker's mutex.
+		bool myIsCancelQueued;
+		// Is unsubscribed by the worker when the request is finished. Hence the token
+		// never sees a deleted context.
+		mg::box::CancellationWaiter myCancelWaiter;
 		mg::box::RefCount myRef;
 		std::string myDomain;
 		DomainToIPCallback myCallback;
@@ -68,12 +78,20 @@ namespace net {
 			DomainToIPRequest& aOutRequest,
 			const char* aDomain,
 			mg::box::TimeLimit aTimeLimit,
+			mg::box::CancellationToken* aToken,
 			const DomainToIPCallback& aCallback);
 
 		void Cancel(
 			DomainToIPRequest& aRequest);
 
+		void CancelMany(
+			mg::box::CancellationWaiter* aFirst);
+
 	private:
+		// Is called under the mutex.
+		void PrivCancelPush(
+			DomainToIPContext* aCtx);
+
 		void Run() override;
 		void PrivProcessMain();
 		void PrivProcessFront();
@@ -142,7 +160,20 @@ namespace net {
 		mg::box::TimeLimit aTimeLimit,
 		const DomainToIPCallback& aCallback)
 	{
-		DomainToIPGetInstance().Post(aOutRequest, aDomain, aTimeLimit, aCallback);
+		DomainToIPGetInstance().Post(aOutRequest, aDomain, aTimeLimit, nullptr,
+			aCallback);
+	}
+
+	void
+	DomainToIPAsync(
+		DomainToIPRequest& aOutRequest,
+		const char* aDomain,
+		mg::box::TimeLimit aTimeLimit,
+		mg::box::CancellationToken* aToken,
+		const DomainToIPCallback& aCallback)
+	{
+		DomainToIPGetInstance().Post(aOutRequest, aDomain, aTimeLimit, aToken,
+			aCallback);
 	}
 
 	void
@@ -211,16 +242,21 @@ namespace net {
 		DomainToIPRequest& aOutRequest,
 		const char* aDomain,
 		mg::box::TimeLimit aTimeLimit,
+		mg::box::CancellationToken* aToken,
 		const DomainToIPCallback& aCallback)
 	{
 		DomainToIPContext* ctx = new DomainToIPContext(aDomain, aTimeLimit, aCallback);
 		aOutRequest = DomainToIPRequest(ctx);
 		// +1 for being in the worker's queues.
 		ctx->PrivRef();
+		// Subscribe before the worker can see the context. It unsubscribes when done.
+		bool isCancelled = aToken != nullptr && !ctx->myCancelWaiter.Subscribe(aToken);
 
 		myMutex.Lock();
 		bool wasEmpty = myFront.IsEmpty();
 		myFront.Append(ctx);
+		if (isCancelled)
+			PrivCancelPush(ctx);
 		if (wasEmpty)
 			myCond.Signal();
 		myMutex.Unlock();
@@ -236,13 +272,49 @@ namespace net {
 		ctx->myIsCancelled = true;
 
 		myMutex.Lock();
+		if (ctx->myIsCancelQueued)
+		{
+			// Already cancelled by the token. Only the request's ref is dropped. Not the
+			// last one, the queue has one too.
+			myMutex.Unlock();
+			ctx->PrivUnref();
+			return;
+		}
 		bool wasEmpty = myFrontCancel.IsEmpty();
+		// The request's ref goes to the queue.
+		ctx->myIsCancelQueued = true;
 		myFrontCancel.Append(ctx);
 		if (wasEmpty)
 			myCond.Signal();
 		myMutex.Unlock();
 	}
 
+	void
+	DomainToIPWorker::CancelMany(
+		mg::box::CancellationWaiter* aFirst)
+	{
+		myMutex.Lock();
+		bool wasEmpty = myFrontCancel.IsEmpty();
+		for (mg::box::CancellationWaiter* w = aFirst; w != nullptr; w = w->myNext)
+			PrivCancelPush(w->GetOwner<DomainToIPContext>());
+		if (wasEmpty && !myFrontCancel.IsEmpty())
+			myCond.Signal();
+		myMutex.Unlock();
+	}
+
+	void
+	DomainToIPWorker::PrivCancelPush(
+		DomainToIPContext* aCtx)
+	{
+		if (aCtx->myIsCancelQueued)
+			return;
+		aCtx->myIsCancelQueued = true;
+		// +1 for being in the cancel queue. The context is alive here, because the
+		// worker can't finish it until the token's cancellation is done.
+		aCtx->PrivRef();
+		myFrontCancel.Append(aCtx);
+	}
+
 	void
 	DomainToIPWorker::Run()
 	{
@@ -348,6 +420,8 @@ namespace net {
 		, myDeadline(aTimeLimit.ToPointFromNow().myValue)
 		, myIndex(-1)
 		, myIsCancelled(false)
+		, myIsCancelQueued(false)
+		, myCancelWaiter(DomainToIPOnCancel, this)
 		, myDomain(aDomain)
 		, myCallback(aCallback)
 	{
@@ -370,6 +444,7 @@ namespace net {
 		mg::box::Error* aError)
 	{
 		MG_DEV_ASSERT(myIndex < 0);
+		myCancelWaiter.Unsubscribe();
 		myCallback(myDomain.c_str(), {}, aError);
 	}
 
@@ -378,6 +453,7 @@ namespace net {
 		const std::vector<DomainEndpoint>& aEndpoints)
 	{
 		MG_DEV_ASSERT(myIndex < 0);
+		myCancelWaiter.Unsubscribe();
 		myCallback(myDomain.c_str(), aEndpoints, nullptr);
 	}
 
@@ -462,6 +538,13 @@ namespace net {
 	}
 #endif
 
+	static void
+	DomainToIPOnCancel(
+		mg::box::CancellationWaiter* aFirst)
+	{
+		DomainToIPGetInstance().CancelMany(aFirst);
+	}
+
 	static DomainToIPWorker&
 	DomainToIPGetInstance()
 	{
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "mg/box/CancellationToken.h"
 #include "mg/box/Error.h"
 #include "mg/box/Time.h"
 #include "mg/net/Host.h"
@@ -47,6 +48,16 @@ namespace net {
 		mg::box::TimeLimit aTimeLimit,
 		const DomainToIPCallback& aCallback);
 
+	// The same, but the request is also cancelled when the token is. The callback gets
+	// ERR_BOX_CANCEL then. The cancellations of many requests by one token go to the
+	// resolver in one batch. DomainToIPCancel() works as well.
+	void DomainToIPAsync(
+		DomainToIPRequest& aOutRequest,
+		const char* aDomain,
+		mg::box::TimeLimit aTimeLimit,
+		mg::box::CancellationToken* aToken,
+		const DomainToIPCallback& aCallback);
+
 	void DomainToIPCancel(
 		DomainToIPRequest& aRequest);
 
@@ -1,7 +1,10 @@
 #include "Task.h"
 
 #include "mg/box/Assert.h"
+#include "mg/box/ThreadLocalPool.h"
 #include "mg/box/Time.h"
+#include "mg/box/Trace.h"
+#include "mg/sch/TaskFuture.h"
 #include "mg/sch/TaskScheduler.h"
 
 #if MG_CORO_IS_ENABLED
@@ -11,6 +14,32 @@
 namespace mg {
 namespace sch {
 
+	struct TaskExtra
+		: public mg::box::ThreadPooled<TaskExtra>
+	{
+		TaskExtra(
+			Task* aTask);
+
+		// Next tick of a periodic task, in microseconds.
+		uint64_t myPeriodTick;
+		uint32_t myTickCount;
+		mg::box::PeriodMissPolicy myPeriodPolicy;
+		// Subscription to the cancellation token. Is unsubscribed by its destructor,
+		// which waits for the cancellation being in progress, if any.
+		mg::box::CancellationWaiter myCancelWaiter;
+		mg::box::Arena myArena;
+	};
+
+	inline
+	TaskExtra::TaskExtra(
+		Task* aTask)
+		: myPeriodTick(0)
+		, myTickCount(0)
+		, myPeriodPolicy(mg::box::PERIOD_MISS_SKIP)
+		, myCancelWaiter(Task::PrivOnCancel, aTask)
+	{
+	}
+
 #if MG_CORO_IS_ENABLED
 	//////////////////////////////////////////////////////////////////////////////////////
 
@@ -25,6 +54,24 @@ namespace sch {
 
 	//////////////////////////////////////////////////////////////////////////////////////
 
+	bool
+	TaskCoroOpYieldIfNeeded::await_ready() const noexcept
+	{
+		return !myTask->ShouldYield();
+	}
+
+	bool
+	TaskCoroOpYieldIfNeeded::await_suspend(
+		mg::box::CoroHandle) noexcept
+	{
+		myTask->PrivTouch();
+		myTask->myDeadline = 0;
+		mySched.Post(myTask);
+		return true;
+	}
+
+	//////////////////////////////////////////////////////////////////////////////////////
+
 	bool
 	TaskCoroOpReceiveSignal::await_suspend(
 		mg::box::CoroHandle) noexcept
@@ -90,44 +137,53 @@ namespace sch {
 	}
 
 	//////////////////////////////////////////////////////////////////////////////////////
+
+	bool
+	TaskCoroOpParallelFor::await_suspend(
+		mg::box::CoroHandle) noexcept
+	{
+		myTask->PrivTouch();
+		// The task can be resumed by the loop's last chunk even before this call
+		// returns. Then this operation object is already destroyed, so it can't be
+		// touched after the call.
+		mySched.ParallelForAsync(myBegin, myEnd, myGrain, std::move(myCallback),
+			myTask);
+		return true;
+	}
+
+	//////////////////////////////////////////////////////////////////////////////////////
 #endif
 
+	Task::~Task()
+	{
+		PrivTouch();
+		if (myExtra == nullptr)
+			return;
+		// The callback's captures and coroutine can have data in the arena, so the
+		// callback is destroyed first.
+		myCallback = {};
+		delete myExtra;
+	}
+
 	void
 	Task::PostWakeup()
 	{
-		// Don't do the load inside of the loop. It is needed only first time. On next
-		// iterations the cmpxchg returns the old value anyway.
-		TaskStatus old = myStatus.LoadRelaxed();
-		// Note, that the loop is not a busy loop nor a spin-lock. Because it would mean
-		// the thread couldn't progress until some other thread does something. Here, on
-		// the contrary, the thread does progress always, and even better if other threads
-		// don't do anything. Should be one iteration in like 99.9999% cases.
-		do
-		{
-			// Signal and ready mean the task will be executed ASAP anyway. Also can't
-			// override the signal, because it is stronger than a wakeup.
-			if (old == TASK_STATUS_SIGNALED || old == TASK_STATUS_READY)
-				return;
-			// Relaxed is fine. The memory sync will happen via the scheduler queues if
-			// the wakeup succeeds.
-		} while (!myStatus.CmpExchgWeakRelaxed(old, TASK_STATUS_READY));
-
+		MG_TRACE(TASK_WAKEUP, this);
+		MG_DEV_ASSERT_F(myIsWakeable.LoadRelaxed(), "The task can't be woken up");
 		// If the task was in the waiting queue. Need to re-push it to let the scheduler
 		// know the task must be removed from the queue earlier.
-		if (old == TASK_STATUS_WAITING)
+		if (PrivWakeup())
 			myScheduler->PrivPost(this);
 	}
 
 	void
 	Task::PostSignal()
 	{
-		// Release-barrier to sync with the acquire-barrier on the signal receipt. Can't
-		// be relaxed, because the task might send and receive the signal without the
-		// scheduler's participation and can't count on synchronizing any memory via it.
-		TaskStatus old = myStatus.ExchangeRelease(TASK_STATUS_SIGNALED);
+		MG_TRACE(TASK_SIGNAL, this);
+		MG_DEV_ASSERT_F(myIsWakeable.LoadRelaxed(), "The task can't be signaled");
 		// WAITING - the task was in the waiting queue. Need to re-push it to let the
 		// scheduler know the task must be removed from the queue earlier.
-		if (old == TASK_STATUS_WAITING)
+		if (PrivSignal())
 			myScheduler->PrivPost(this);
 	}
 
@@ -138,12 +194,29 @@ namespace sch {
 		return AsyncYield(TaskScheduler::This());
 	}
 
+	TaskCoroOpYieldIfNeeded
+	Task::AsyncYieldIfNeeded()
+	{
+		return AsyncYieldIfNeeded(TaskScheduler::This());
+	}
+
 	TaskCoroOpReceiveSignal
 	Task::AsyncReceiveSignal()
 	{
 		return AsyncReceiveSignal(TaskScheduler::This());
 	}
 
+	TaskCoroOpParallelFor
+	Task::AsyncParallelFor(
+		uint64_t aBegin,
+		uint64_t aEnd,
+		uint64_t aGrain,
+		TaskParallelForCallback&& aCallback)
+	{
+		return AsyncParallelFor(TaskScheduler::This(), aBegin, aEnd, aGrain,
+			std::move(aCallback));
+	}
+
 	void
 	Task::SetCallback(
 		mg::box::Coro&& aCoro)
@@ -158,27 +231,55 @@ namespace sch {
 	Task::SetDelay(
 		uint32_t aDelay)
 	{
-		PrivTouch();
-		myDeadline = mg::box::GetMilliseconds() + aDelay;
+		SetDelayUs(mg::box::TimeMsToUs(aDelay));
 	}
 
 	void
 	Task::AdjustDelay(
 		uint32_t aDelay)
 	{
-		AdjustDeadline(mg::box::GetMilliseconds() + aDelay);
+		AdjustDelayUs(mg::box::TimeMsToUs(aDelay));
 	}
 
 	void
 	Task::SetDeadline(
 		uint64_t aDeadline)
+	{
+		SetDeadlineUs(mg::box::TimeMsToUs(aDeadline));
+	}
+
+	void
+	Task::AdjustDeadline(
+		uint64_t aDeadline)
+	{
+		AdjustDeadlineUs(mg::box::TimeMsToUs(aDeadline));
+	}
+
+	void
+	Task::SetDelayUs(
+		uint64_t aDelay)
+	{
+		PrivTouch();
+		myDeadline = mg::box::GetMicroseconds() + aDelay;
+	}
+
+	void
+	Task::AdjustDelayUs(
+		uint64_t aDelay)
+	{
+		AdjustDeadlineUs(mg::box::GetMicroseconds() + aDelay);
+	}
+
+	void
+	Task::SetDeadlineUs(
+		uint64_t aDeadline)
 	{
 		PrivTouch();
 		myDeadline = aDeadline;
 	}
 
 	void
-	Task::AdjustDeadline(
+	Task::AdjustDeadlineUs(
 		uint64_t aDeadline)
 	{
 		PrivTouch();
@@ -186,6 +287,65 @@ namespace sch {
 			myDeadline = aDeadline;
 	}
 
+	void
+	Task::SetPeriod(
+		uint32_t aPeriod,
+		mg::box::PeriodMissPolicy aPolicy)
+	{
+		SetPeriodUs(mg::box::TimeMsToUs(aPeriod), aPolicy);
+	}
+
+	void
+	Task::SetPeriodUs(
+		uint64_t aPeriod,
+		mg::box::PeriodMissPolicy aPolicy)
+	{
+		PrivTouch();
+		myPeriod = aPeriod;
+		if (aPeriod == 0)
+		{
+			if (myExtra != nullptr)
+				myExtra->myTickCount = 0;
+			return;
+		}
+		TaskExtra& extra = PrivExtra();
+		extra.myPeriodPolicy = aPolicy;
+		extra.myTickCount = 0;
+		extra.myPeriodTick = mg::box::PeriodFirstTick(aPeriod,
+			mg::box::GetMicroseconds());
+		myDeadline = extra.myPeriodTick;
+	}
+
+	uint32_t
+	Task::GetTickCount() const
+	{
+		PrivTouch();
+		if (myExtra == nullptr)
+			return 0;
+		return myExtra->myTickCount;
+	}
+
+	void
+	Task::SetClass(
+		uint32_t aClass)
+	{
+		PrivTouch();
+		MG_BOX_ASSERT(aClass < theTaskClassMax);
+		myClass = (uint8_t)aClass;
+	}
+
+	uint32_t
+	Task::GetClass() const
+	{
+		return myClass;
+	}
+
+	bool
+	Task::ShouldYield() const
+	{
+		return TaskScheduler::PrivShouldYield();
+	}
+
 	bool
 	Task::IsExpired() const
 	{
@@ -195,6 +355,12 @@ namespace sch {
 
 	uint64_t
 	Task::GetDeadline() const
+	{
+		return mg::box::TimeUsToMs(GetDeadlineUs());
+	}
+
+	uint64_t
+	Task::GetDeadlineUs() const
 	{
 		PrivTouch();
 		return myDeadline;
@@ -212,28 +378,157 @@ namespace sch {
 		return myStatus.CmpExchgStrongAcquire(oldStatus, TASK_STATUS_PENDING);
 	}
 
+	mg::box::Arena&
+	Task::GetArena()
+	{
+		PrivTouch();
+		return PrivExtra().myArena;
+	}
+
+	void
+	Task::SetCancellation(
+		mg::box::CancellationToken* aToken)
+	{
+		PrivTouch();
+		if (myExtra != nullptr)
+			myExtra->myCancelWaiter.Unsubscribe();
+		if (aToken != nullptr)
+			PrivExtra().myCancelWaiter.Subscribe(aToken);
+	}
+
+	mg::box::CancellationToken*
+	Task::GetCancellation()
+	{
+		PrivTouch();
+		if (myExtra == nullptr)
+			return nullptr;
+		return myExtra->myCancelWaiter.GetToken();
+	}
+
+	bool
+	Task::IsCancelled() const
+	{
+		return myExtra != nullptr && myExtra->myCancelWaiter.IsCancelled();
+	}
+
 	void
 	Task::PrivExecute()
 	{
 		PrivTouch();
+		if (myWait != TASK_WAIT_NONE && !PrivWaitEnd())
+		{
+			// Not the awaited event. The coroutine can't be resumed, it would have to
+			// suspend right away. The periodic tick isn't consumed either.
+			myDeadline = MG_TIME_INFINITE;
+			TaskScheduler::This().Post(this);
+			return;
+		}
 		// Deadline is reset so as the task wouldn't use it again
 		// if re-posted. Next post should specify a new deadline
 		// or omit it. In that way when Post, you can always be
 		// sure the old task deadline won't affect the next
-		// execution.
-		myDeadline = 0;
+		// execution. A periodic task gets its next tick instead.
+		if (myPeriod == 0)
+		{
+			myDeadline = 0;
+		}
+		else
+		{
+			TaskExtra* extra = myExtra;
+			extra->myPeriodTick = mg::box::PeriodNextTick(extra->myPeriodTick,
+				myPeriod, extra->myPeriodPolicy, mg::box::GetMicroseconds(),
+				extra->myTickCount);
+			myDeadline = extra->myPeriodTick;
+		}
 		myCallback(this);
 	}
 
+	bool
+	Task::PrivWaitEnd()
+	{
+#if MG_CORO_IS_ENABLED
+		if (myWait == TASK_WAIT_FUTURES && TaskFutureBase::PrivStopWait(this))
+		{
+			// Satisfied by a promise, and it owes the signal. Usually it is already
+			// here, because it has woken the task up. But if the task was woken up by
+			// something else, the signal can be still on its way. The task waits for it
+			// then.
+			myWait = TASK_WAIT_SIGNAL;
+		}
+		if (myWait == TASK_WAIT_SIGNAL && !ReceiveSignal())
+			return false;
+#endif
+		myWait = TASK_WAIT_NONE;
+		return true;
+	}
+
 	void
 	Task::PrivCreate()
 	{
 		myNext = nullptr;
+		myWaitPrev = nullptr;
+		myWaitNext = nullptr;
 		myIndex = -1;
+		mySyncNext = nullptr;
 		myStatus.StoreRelease(TASK_STATUS_PENDING);
+		myIsWakeable.StoreRelaxed(true);
 		myScheduler = nullptr;
 		myDeadline = 0;
+		myPeriod = 0;
+		myFutureState.StoreRelaxed(0);
+		myFutureSlots = 0;
+		myNodeIndex = -1;
+		myPostTime = 0;
+		myExtra = nullptr;
 		myIsExpired = false;
+		myIsAdmitted = false;
+		myClass = 0;
+		myWait = TASK_WAIT_NONE;
+	}
+
+	TaskExtra&
+	Task::PrivExtra()
+	{
+		if (myExtra == nullptr)
+			myExtra = new TaskExtra(this);
+		return *myExtra;
+	}
+
+	void
+	Task::PrivArenaReset()
+	{
+		myExtra->myArena.Reset();
+	}
+
+	bool
+	Task::PrivWakeup()
+	{
+		// Don't do the load inside of the loop. It is needed only first time. On next
+		// iterations the cmpxchg returns the old value anyway.
+		TaskStatus old = myStatus.LoadRelaxed();
+		// Note, that the loop is not a busy loop nor a spin-lock. Because it would mean
+		// the thread couldn't progress until some other thread does something. Here, on
+		// the contrary, the thread does progress always, and even better if other threads
+		// don't do anything. Should be one iteration in like 99.9999% cases.
+		do
+		{
+			// Signal and ready mean the task will be executed ASAP anyway. Also can't
+			// override the signal, because it is stronger than a wakeup.
+			if (old == TASK_STATUS_SIGNALED || old == TASK_STATUS_READY)
+				return false;
+			// Relaxed is fine. The memory sync will happen via the scheduler queues if
+			// the wakeup succeeds.
+		} while (!myStatus.CmpExchgWeakRelaxed(old, TASK_STATUS_READY));
+		return old == TASK_STATUS_WAITING;
+	}
+
+	bool
+	Task::PrivSignal()
+	{
+		// Release-barrier to sync with the acquire-barrier on the signal receipt. Can't
+		// be relaxed, because the task might send and receive the signal without the
+		// scheduler's participation and can't count on synchronizing any memory via it.
+		return myStatus.ExchangeRelease(TASK_STATUS_SIGNALED) == TASK_STATUS_WAITING;
 	}
 
 	void
@@ -243,5 +538,56 @@ namespace sch {
 			"An attempt to modify a task while it is in scheduler");
 	}
 
+	void
+	Task::PrivOnCancel(
+		mg::box::CancellationWaiter* aFirst)
+	{
+		// The waiting tasks are collected per scheduler and re-pushed with one
+		// operation into each. Usually the tasks of one token tree are all in one or
+		// just a few schedulers. The rare tasks not fitting are pushed one by one.
+		struct Batch
+		{
+			TaskScheduler* mySched;
+			Task* myFirst;
+			Task* myLast;
+		};
+		static constexpr uint32_t theBatchCountMax = 8;
+		Batch batches[theBatchCountMax];
+		uint32_t batchCount = 0;
+		for (mg::box::CancellationWaiter* w = aFirst; w != nullptr; w = w->myNext)
+		{
+			Task* t = w->GetOwner<Task>();
+			MG_TRACE(TASK_WAKEUP, t);
+			// The task of a scheduler without deadlines never waits, so it is never
+			// re-pushed here. It only sees the cancellation when checks it.
+			if (!t->PrivWakeup())
+				continue;
+			TaskScheduler* sched = t->myScheduler;
+			Batch* b = nullptr;
+			for (uint32_t i = 0; i < batchCount && b == nullptr; ++i)
+			{
+				if (batches[i].mySched == sched)
+					b = &batches[i];
+			}
+			if (b == nullptr)
+			{
+				if (batchCount == theBatchCountMax)
+				{
+					sched->PrivPost(t);
+					continue;
+				}
+				b = &batches[batchCount++];
+				b->mySched = sched;
+				b->myFirst = nullptr;
+				b->myLast = t;
+			}
+			// Waiting task is not in the front queue. Its link is free.
+			t->myNext = b->myFirst;
+			b->myFirst = t;
+		}
+		for (uint32_t i = 0; i < batchCount; ++i)
+			batches[i].mySched->PrivPostMany(batches[i].myFirst, batches[i].myLast);
+	}
+
 }
 }
@@ -1,7 +1,11 @@
 #pragma once
 
+#include "mg/box/Arena.h"
 #include "mg/box/Atomic.h"
+#include "mg/box/CancellationToken.h"
 #include "mg/box/Coro.h"
+#include "mg/box/InlineFunction.h"
+#include "mg/box/Time.h"
 #include "mg/box/TypeTraits.h"
 
 #include <functional>
@@ -9,9 +13,19 @@
 F_DECLARE_CLASS(mg, box, Signal)
 
 namespace mg {
+namespace box {
+
+	template<typename T>
+	class PeriodicTimingWheel;
+
+	template<typename T>
+	class TimingWheel;
+
+}
 namespace sch {
 
 	class Task;
+	struct TaskExtra;
 	class TaskScheduler;
 	class TaskSchedulerThread;
 
@@ -37,7 +51,30 @@ namespace sch {
 		TASK_STATUS_SIGNALED,
 	};
 
-	using TaskCallback = std::function<void(Task*)>;
+	// What a suspended coroutine of the task waits for, when not any wakeup can resume
+	// it. Is checked before the coroutine is resumed, so the task can go back to sleep
+	// without resuming it. Is internal, like the status.
+	enum TaskWait : uint8_t
+	{
+		TASK_WAIT_NONE,
+		// Only the signal ends the wait.
+		TASK_WAIT_SIGNAL,
+		// Any wakeup ends the wait, but if it is satisfied by the futures, then not
+		// before their signal is received. See TaskFuture.h.
+		TASK_WAIT_FUTURES,
+	};
+
+	// Task callback is stored right inside of the task, so creation and change of the
+	// callback never use the heap. If a callback's capture doesn't fit, it is a compile
+	// error. Then the capture must be reduced, or the data must be captured by a pointer.
+	static constexpr size_t theTaskCallbackCapacity = 48;
+	// Max number of task classes in a scheduler. See TaskSchedulerParams::myClassWeights.
+	static constexpr uint32_t theTaskClassMax = 64;
+	using TaskCallback = mg::box::InlineFunction<void(Task*), theTaskCallbackCapacity>;
+	// Body of a parallel loop. Is called on subranges [aBegin, aEnd) of the loop's range.
+	// Is given the ranges instead of single indexes, so the per-index overhead is just
+	// the loop inside of the callback.
+	using TaskParallelForCallback = std::function<void(uint64_t aBegin, uint64_t aEnd)>;
 
 #if MG_CORO_IS_ENABLED
 	//////////////////////////////////////////////////////////////////////////////////////
@@ -59,6 +96,22 @@ namespace sch {
 		TaskScheduler& mySched;
 	};
 
+	struct TaskCoroOpYieldIfNeeded
+		: public mg::box::CoroOp
+		, public mg::box::CoroOpIsEmptyReturn
+	{
+		TaskCoroOpYieldIfNeeded(
+			Task* aTask,
+			TaskScheduler& aSched) : myTask(aTask), mySched(aSched) {}
+		bool await_ready() const noexcept;
+		bool await_suspend(
+			mg::box::CoroHandle aThisCoro) noexcept;
+
+	private:
+		Task* const myTask;
+		TaskScheduler& mySched;
+	};
+
 	struct TaskCoroOpReceiveSignal
 		: public mg::box::CoroOp
 		, public mg::box::CoroOpIsNotReady
@@ -123,6 +176,32 @@ namespace sch {
 		mg::box::Signal& mySignal;
 	};
 
+	struct TaskCoroOpParallelFor
+		: public mg::box::CoroOp
+		, public mg::box::CoroOpIsNotReady
+		, public mg::box::CoroOpIsEmptyReturn
+	{
+		TaskCoroOpParallelFor(
+			Task* aTask,
+			TaskScheduler& aSched,
+			uint64_t aBegin,
+			uint64_t aEnd,
+			uint64_t aGrain,
+			TaskParallelForCallback&& aCallback)
+			: myTask(aTask), mySched(aSched), myBegin(aBegin), myEnd(aEnd)
+			, myGrain(aGrain), myCallback(std::move(aCallback)) {}
+		bool await_suspend(
+			mg::box::CoroHandle aThisCoro) noexcept;
+
+	private:
+		Task* const myTask;
+		TaskScheduler& mySched;
+		const uint64_t myBegin;
+		const uint64_t myEnd;
+		const uint64_t myGrain;
+		TaskParallelForCallback myCallback;
+	};
+
 	//////////////////////////////////////////////////////////////////////////////////////
 #endif
 
@@ -298,6 +377,22 @@ namespace sch {
 		TaskCoroOpYield AsyncYield(
 			TaskScheduler& aSched);
 
+		// Yield only if ShouldYield() says so. Otherwise continue right away. Any deadline
+		// set before is ignored, the task is re-scheduled instantly.
+		//
+		//     Coro
+		//     TaskBody(Task* aTask)
+		//     {
+		//         for (Item& item : items) {
+		//             Process(item);
+		//             co_await aTask->AsyncYieldIfNeeded();
+		//         }
+		//     }
+		//
+		TaskCoroOpYieldIfNeeded AsyncYieldIfNeeded();
+		TaskCoroOpYieldIfNeeded AsyncYieldIfNeeded(
+			TaskScheduler& aSched);
+
 		// Sleep until the task is woken up due to any reason + try to receive a signal.
 		// Returns whether it was received.
 		//
@@ -336,7 +431,8 @@ namespace sch {
 		TaskCoroOpExitDelete AsyncExitDelete();
 
 		// Switch the task's body from a coroutine to a plain non-coroutine callback.
-		// Whatever is after this call, it will not be executed.
+		// Whatever is after this call, it will not be executed. The task's arena is
+		// reset, the same as in SetCallback().
 		//
 		//     Coro
 		//     TaskBody(Task* aTask)
@@ -414,6 +510,33 @@ namespace sch {
 		//
 		TaskCoroOpExitSendSignal AsyncExitSendSignal(
 			mg::box::Signal& aSignal);
+
+		// Run a parallel loop on the workers and sleep until it is finished. The worker
+		// is not blocked meanwhile, it executes other tasks. See
+		// TaskScheduler::ParallelFor().
+		//
+		//     Coro
+		//     TaskBody(Task* aTask)
+		//     {
+		//         co_await aTask->AsyncParallelFor(0, count, 64,
+		//             [&](uint64_t aBegin, uint64_t aEnd) {
+		//                 for (uint64_t i = aBegin; i < aEnd; ++i)
+		//                     Process(i);
+		//             });
+		//         // All the indexes are processed here.
+		//     }
+		//
+		TaskCoroOpParallelFor AsyncParallelFor(
+			uint64_t aBegin,
+			uint64_t aEnd,
+			uint64_t aGrain,
+			TaskParallelForCallback&& aCallback);
+		TaskCoroOpParallelFor AsyncParallelFor(
+			TaskScheduler& aSched,
+			uint64_t aBegin,
+			uint64_t aEnd,
+			uint64_t aGrain,
+			TaskParallelForCallback&& aCallback);
 #endif
 
 		//////////////////////////////////////////////////////////////////////////////////
@@ -422,7 +545,8 @@ namespace sch {
 		//
 
 		// Can set from an existing callback object, or create a
-		// callback in-place.
+		// callback in-place. The task's arena is reset, because
+		// the new callback is a new job for the task.
 		// Can't be called when the task has been posted to the
 		// scheduler waiting for execution.
 		template<typename Functor>
@@ -471,12 +595,84 @@ namespace sch {
 		void AdjustDeadline(
 			uint64_t aDeadline);
 
+		// The same as the millisecond versions above, but the
+		// time is in microseconds. Deadlines are compared with
+		// GetMicroseconds(). The scheduler keeps all deadlines in
+		// microseconds anyway, so both versions can be mixed.
+		// Can't be called when the task has been posted to the
+		// scheduler waiting for execution.
+		void SetDelayUs(
+			uint64_t aDelay);
+
+		void AdjustDelayUs(
+			uint64_t aDelay);
+
+		void SetDeadlineUs(
+			uint64_t aDeadline);
+
+		void AdjustDeadlineUs(
+			uint64_t aDeadline);
+
 		// The task won't be executed again until an explicit
 		// wakeup or signal.
 		// Can't be called when the task has been posted to the
 		// scheduler waiting for execution.
 		void SetWait();
 
+		// Make the task periodic. Then on each execution start
+		// its deadline is set to the next tick instead of being
+		// dropped to 0, and a simple re-post makes the task wait
+		// for that tick. The ticks are on the multiples of the
+		// period, not counted from the previous execution, so
+		// they don't drift. The first one is the nearest tick
+		// after now. The tasks of the same period share one
+		// timer entry in the scheduler. The policy defines what
+		// happens with the ticks missed by a late task. Period
+		// 0 makes the task non-periodic again.
+		// A deadline set during the execution replaces the tick,
+		// but the tick isn't lost. The next execution continues
+		// the cadence.
+		// Can't be called when the task has been posted to the
+		// scheduler waiting for execution.
+		void SetPeriod(
+			uint32_t aPeriod,
+			mg::box::PeriodMissPolicy aPolicy = mg::box::PERIOD_MISS_SKIP);
+
+		void SetPeriodUs(
+			uint64_t aPeriod,
+			mg::box::PeriodMissPolicy aPolicy = mg::box::PERIOD_MISS_SKIP);
+
+		// Number of the period ticks reached by the current
+		// execution of a periodic task. 0 means it is executed
+		// before its tick, for example due to a wakeup or a
+		// signal. It is 1 for a task being on time. A late task
+		// with the coalesce policy gets all the missed ticks
+		// here at once.
+		// Can't be called when the task has been posted to the
+		// scheduler waiting for execution.
+		uint32_t GetTickCount() const;
+
+		// Class of the task in the schedulers having several of them (see
+		// TaskSchedulerParams::myClassWeights). Each class has own ready queues. By
+		// default the task is of class 0. The class stays with the task for all the
+		// next posts. It must be less than the scheduler's class count, unless the
+		// scheduler has just one class. Then it is ignored.
+		// Can't be called when the task has been posted to the
+		// scheduler waiting for execution.
+		void SetClass(
+			uint32_t aClass);
+
+		uint32_t GetClass() const;
+
+		// Check if the task has run longer than the time slice of its scheduler (see
+		// TaskSchedulerParams::myTimeSliceUs) while other tasks are waiting. Then it
+		// should let them go first - re-post itself and return. Or use
+		// AsyncYieldIfNeeded() in a coroutine. Is cheap, most of the time it is one read
+		// of the CPU timestamp counter.
+		// Can be called only from the task's callback. Outside of a scheduler's worker
+		// thread it is always false.
+		bool ShouldYield() const;
+
 		// Check if the task has a signal emitted.
 		// Can be called anytime.
 		bool IsSignaled();
@@ -499,6 +695,8 @@ namespace sch {
 		// scheduler waiting for execution.
 		uint64_t GetDeadline() const;
 
+		uint64_t GetDeadlineUs() const;
+
 		// Atomically try to receive a signal. In case of success
 		// the signal is cleared, and true is returned. If the
 		// task is signaled but ReceiveSignal is not used, it will
@@ -509,39 +707,129 @@ namespace sch {
 		// Can be called anytime.
 		bool ReceiveSignal();
 
+		// Memory for the temporary data of the task's job, like parsed fields of a
+		// request, or strings. Is freed all at once when the task is deleted or gets a
+		// new callback. Use mg::box::ArenaAllocator for the containers. The objects
+		// stored in the arena must not outlive the callback, the task would destroy the
+		// callback first and only then the arena.
+		// Can't be called when the task has been posted to the
+		// scheduler waiting for execution.
+		mg::box::Arena& GetArena();
+
+		// Attach the task to a cancellation token. When the token or any of its parents
+		// is cancelled, the task is woken up, and IsCancelled() becomes true. The
+		// wakeups of all the tasks of the token's tree are pushed into the front queue
+		// of each scheduler in one batch. The token stays attached for all the next
+		// posts and callbacks, until another one is set, or null, or the task is
+		// deleted. An already cancelled token doesn't wake the task up. So the task
+		// should check IsCancelled() before going to infinite wait. A coroutine waiting
+		// for a single future or in a synchronization object isn't resumed by it.
+		// Can't be called when the task has been posted to the
+		// scheduler waiting for execution.
+		void SetCancellation(
+			mg::box::CancellationToken* aToken);
+
+		// The token to make children from for the sub-work of the task.
+		// Can't be called when the task has been posted to the
+		// scheduler waiting for execution.
+		mg::box::CancellationToken* GetCancellation();
+
+		// Can be called anytime.
+		bool IsCancelled() const;
+
 	private:
 		void PrivExecute();
 
+		// Try to end the wait of the suspended coroutine. Returns false if the task must
+		// go back to sleep.
+		bool PrivWaitEnd();
+
 		void PrivCreate();
 
+		TaskExtra& PrivExtra();
+
+		void PrivArenaReset();
+
+		// Status change of wakeup and signal. Returns true if the task was waiting in
+		// the scheduler and must be re-pushed to it.
+		bool PrivWakeup();
+
+		bool PrivSignal();
+
 		void PrivTouch() const;
-	public:
-		// The comparator is public so as it could be used by the
-		// waiting queue.
-		bool operator<=(
-			const Task& aTask) const;
 
+		static void PrivOnCancel(
+			mg::box::CancellationWaiter* aFirst);
+	public:
 		// Next is public so as it could be used by the intrusive
 		// front queue.
 		Task* myNext;
-		// Index is public so as it could be used by the intrusive
+		// Link for the waiter queues of the synchronization objects (see TaskSync.h).
+		// Separate from the front queue link, because the task is posted to the
+		// scheduler while it is in such a queue.
+		Task* mySyncNext;
+		// Links and index are public so as they could be used by
+		// the intrusive waiting queue. They are separate from the
+		// front queue link, because a waiting task can be woken up
+		// and pushed into the front queue while still being in the
 		// waiting queue.
+		Task* myWaitPrev;
+		Task* myWaitNext;
 		int32_t myIndex;
 	private:
 		mg::box::Atomic<TaskStatus> myStatus;
 		// Is set to the scheduler the task is right now inside of. The task can't be
 		// altered anyhow while it is in there.
 		TaskScheduler* myScheduler;
+		// In microseconds.
 		uint64_t myDeadline;
-		TaskCallback myCallback;
+		// Period of a periodic task in microseconds. Is used by the waiting queue to
+		// group the tasks. The rest of the period state is in the extra part.
+		uint64_t myPeriod;
+		// Futures of this task: which of them are ready, which ones the task waits for,
+		// and how. See TaskFuture.h. Are declared before the callback, because the
+		// futures can live in the callback's coroutine and are destroyed together with
+		// it.
+		mg::box::AtomicU64 myFutureState;
+		// Slots taken by the futures bound to this task.
+		uint32_t myFutureSlots;
+		// NUMA node where the task was executed last time. -1 = none yet.
+		int32_t myNodeIndex;
+		// When the task was posted last time, in microseconds. Is set only if the
+		// scheduler collects the stats.
+		uint64_t myPostTime;
+		// The rarely used features: the period state, the cancellation subscription, and
+		// the arena. Is allocated on the first use of any of them, so the tasks not using
+		// them stay small.
+		TaskExtra* myExtra;
+		// False when the last scheduler of the task can't have sleeping tasks, so the
+		// wakeups and signals are not allowed. See TaskSchedulerPolicyNoDeadlines. Is
+		// maintained only in the debug build, for the asserts.
+		mg::box::AtomicBool myIsWakeable;
 		bool myIsExpired;
+		// The task took an admission slot of the scheduler's limit. The slot is freed
+		// when the task starts execution.
+		bool myIsAdmitted;
+		uint8_t myClass;
+		TaskWait myWait;
+		TaskCallback myCallback;
 
+		friend void TaskCoroSyncWait(
+			Task* aTask) noexcept;
+		friend struct TaskExtra;
+		friend class TaskFutureBase;
 		friend class TaskScheduler;
+		friend class TaskSchedulerThread;
+		template<typename> friend class mg::box::PeriodicTimingWheel;
+		template<typename> friend class mg::box::TimingWheel;
+		friend struct TaskCoroOpAwaitFutures;
 		friend struct TaskCoroOpExitDelete;
 		friend struct TaskCoroOpExitExec;
 		friend struct TaskCoroOpExitSendSignal;
+		friend struct TaskCoroOpParallelFor;
 		friend struct TaskCoroOpReceiveSignal;
 		friend struct TaskCoroOpYield;
+		friend struct TaskCoroOpYieldIfNeeded;
 	};
 
 	inline
@@ -569,12 +857,6 @@ namespace sch {
 	}
 #endif
 
-	inline
-	Task::~Task()
-	{
-		PrivTouch();
-	}
-
 #if MG_CORO_IS_ENABLED
 	inline TaskCoroOpYield
 	Task::AsyncYield(
@@ -583,6 +865,13 @@ namespace sch {
 		return TaskCoroOpYield(this, aSched);
 	}
 
+	inline TaskCoroOpYieldIfNeeded
+	Task::AsyncYieldIfNeeded(
+		TaskScheduler& aSched)
+	{
+		return TaskCoroOpYieldIfNeeded(this, aSched);
+	}
+
 	inline TaskCoroOpReceiveSignal
 	Task::AsyncReceiveSignal(
 		TaskScheduler& aSched)
@@ -609,6 +898,18 @@ namespace sch {
 	{
 		return TaskCoroOpExitSendSignal(this, aSignal);
 	}
+
+	inline TaskCoroOpParallelFor
+	Task::AsyncParallelFor(
+		TaskScheduler& aSched,
+		uint64_t aBegin,
+		uint64_t aEnd,
+		uint64_t aGrain,
+		TaskParallelForCallback&& aCallback)
+	{
+		return TaskCoroOpParallelFor(this, aSched, aBegin, aEnd, aGrain,
+			std::move(aCallback));
+	}
 #endif
 
 	template<typename Functor>
@@ -618,6 +919,8 @@ namespace sch {
 	{
 		PrivTouch();
 		myCallback = std::forward<Functor>(aFunc);
+		if (myExtra != nullptr)
+			PrivArenaReset();
 	}
 
 	inline void
@@ -632,12 +935,5 @@ namespace sch {
 		return myStatus.LoadAcquire() == TASK_STATUS_SIGNALED;
 	}
 
-	inline bool
-	Task::operator<=(
-		const Task& aTask) const
-	{
-		return myDeadline <= aTask.myDeadline;
-	}
-
 }
 }
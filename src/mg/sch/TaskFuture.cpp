@@ -0,0 +1,226 @@
+#include "TaskFuture.h"
+
+#include "mg/sch/TaskScheduler.h"
+
+namespace mg {
+namespace sch {
+
+	// The task's future state is a 64 bit word. The lower half is a mask of the ready
+	// futures. The upper half is a mask of the futures the task waits for, and the
+	// highest bit tells if it waits for all of them or for any.
+	//
+	// The promise sets its future's ready bit with a single atomic operation. If the
+	// result satisfies the wait, while the previous state didn't, the promise sends the
+	// task signal. That happens exactly once per wait, so the task knows there is a
+	// signal to receive when it finds the wait satisfied. Other promises don't touch
+	// the task after their bit is set.
+	static constexpr uint32_t theTaskFutureMask = (1U << theTaskFutureMaxCount) - 1;
+	static constexpr uint32_t theTaskFutureAwaitedShift = 32;
+	static constexpr uint64_t theTaskFutureIsAllBit = 1ULL << 63;
+	static constexpr uint64_t theTaskFutureAwaitBits = theTaskFutureIsAllBit |
+		((uint64_t)theTaskFutureMask << theTaskFutureAwaitedShift);
+
+	static inline uint32_t
+	TaskFutureStateGetReady(
+		uint64_t aState)
+	{
+		return (uint32_t)aState & theTaskFutureMask;
+	}
+
+	static inline uint32_t
+	TaskFutureStateGetAwaited(
+		uint64_t aState)
+	{
+		return (uint32_t)(aState >> theTaskFutureAwaitedShift) & theTaskFutureMask;
+	}
+
+	static inline bool
+	TaskFutureStateIsDone(
+		uint64_t aState)
+	{
+		uint32_t ready = TaskFutureStateGetReady(aState);
+		uint32_t awaited = TaskFutureStateGetAwaited(aState);
+		if ((aState & theTaskFutureIsAllBit) != 0)
+			return (awaited & ~ready) == 0;
+		return (awaited & ready) != 0;
+	}
+
+	//////////////////////////////////////////////////////////////////////////////////////
+
+	bool
+	TaskFutureBase::IsReady() const
+	{
+		return (TaskFutureStateGetReady(myTask->myFutureState.LoadAcquire()) &
+			(1U << mySlot)) != 0;
+	}
+
+	uint32_t
+	TaskFutureBase::PrivTakeSlot(
+		Task* aTask)
+	{
+		uint32_t slots = aTask->myFutureSlots;
+		for (uint32_t i = 0; i < theTaskFutureMaxCount; ++i)
+		{
+			if ((slots & (1U << i)) == 0)
+				return i;
+		}
+		MG_BOX_ASSERT_F(false, "Too many futures in one task");
+		return 0;
+	}
+
+	TaskFutureBase::TaskFutureBase(
+		Task* aTask)
+		: myTask(aTask)
+		, mySlot(PrivTakeSlot(aTask))
+		, myIsArmed(false)
+	{
+		myTask->myFutureSlots |= 1U << mySlot;
+		// The slot could have a ready bit left from a previous future.
+		myTask->myFutureState.BitAndRelaxed(~(uint64_t)(1U << mySlot));
+	}
+
+	TaskFutureBase::~TaskFutureBase()
+	{
+		MG_BOX_ASSERT_F(!myIsArmed || IsReady(), "A pending task future is deleted");
+		myTask->myFutureSlots &= ~(1U << mySlot);
+	}
+
+	bool
+	TaskFutureBase::PrivArm()
+	{
+		bool hadValue = myIsArmed;
+		if (hadValue)
+		{
+			MG_BOX_ASSERT_F(IsReady(), "A promise is already given");
+			myTask->myFutureState.BitAndRelaxed(~(uint64_t)(1U << mySlot));
+		}
+		myIsArmed = true;
+		return hadValue;
+	}
+
+	void
+	TaskFutureBase::PrivComplete()
+	{
+		Task* task = myTask;
+		uint64_t bit = 1U << mySlot;
+		// Release-barrier to publish the value. After this the future can be deleted.
+		uint64_t old = task->myFutureState.FetchBitOrRelease(bit);
+		if (TaskFutureStateGetAwaited(old) != 0 && !TaskFutureStateIsDone(old) &&
+			TaskFutureStateIsDone(old | bit))
+		{
+			task->PostSignal();
+		}
+	}
+
+#if MG_CORO_IS_ENABLED
+	bool
+	TaskFutureBase::PrivStopWait(
+		Task* aTask)
+	{
+		// After this the promises don't send the signal anymore.
+		uint64_t old = aTask->myFutureState.FetchBitAndRelaxed(~theTaskFutureAwaitBits);
+		MG_DEV_ASSERT(TaskFutureStateGetAwaited(old) != 0);
+		return TaskFutureStateIsDone(old);
+	}
+#endif
+
+	//////////////////////////////////////////////////////////////////////////////////////
+
+#if MG_CORO_IS_ENABLED
+	TaskCoroOpAwaitFutures::TaskCoroOpAwaitFutures(
+		TaskFutureBase* aFuture)
+		: myTask(aFuture->myTask)
+		, mySched(TaskScheduler::This())
+		, myDeadline(MG_TIME_INFINITE)
+		, myMask(1U << aFuture->mySlot)
+		, myIsAll(true)
+		, myIsStrict(true)
+		, myCount(1)
+	{
+		mySlots[0] = (uint8_t)aFuture->mySlot;
+	}
+
+	TaskCoroOpAwaitFutures::TaskCoroOpAwaitFutures(
+		TaskFutureBase* const* aFutures,
+		uint32_t aCount,
+		bool aIsAll,
+		uint64_t aDeadline)
+		: myTask(aCount > 0 ? aFutures[0]->myTask : nullptr)
+		, mySched(TaskScheduler::This())
+		, myDeadline(aDeadline)
+		, myMask(0)
+		, myIsAll(aIsAll)
+		, myIsStrict(false)
+		, myCount(aCount)
+	{
+		MG_BOX_ASSERT(aCount > 0 && aCount <= theTaskFutureMaxCount);
+		for (uint32_t i = 0; i < aCount; ++i)
+		{
+			const TaskFutureBase* f = aFutures[i];
+			uint32_t bit = 1U << f->mySlot;
+			MG_BOX_ASSERT_F(f->myTask == myTask, "The futures belong to different tasks");
+			MG_BOX_ASSERT_F(f->myIsArmed, "A future without a promise is awaited");
+			MG_BOX_ASSERT((myMask & bit) == 0);
+			myMask |= bit;
+			mySlots[i] = (uint8_t)f->mySlot;
+		}
+	}
+
+	bool
+	TaskCoroOpAwaitFutures::await_suspend(
+		mg::box::CoroHandle) noexcept
+	{
+		myTask->PrivTouch();
+		uint64_t wait = (uint64_t)myMask << theTaskFutureAwaitedShift;
+		if (myIsAll)
+			wait |= theTaskFutureIsAllBit;
+		uint64_t old = myTask->myFutureState.LoadRelaxed();
+		MG_DEV_ASSERT(TaskFutureStateGetAwaited(old) == 0);
+		uint64_t state;
+		do
+		{
+			state = old | wait;
+			// Already satisfied. Don't suspend at all.
+			if (TaskFutureStateIsDone(state))
+				return false;
+		} while (!myTask->myFutureState.CmpExchgWeakRelaxed(old, state));
+		// The task can be woken up and even finished before this call returns. This
+		// operation object can't be touched after it.
+		// The strict wait ends only by the promise's signal.
+		myTask->myWait = myIsStrict ? TASK_WAIT_SIGNAL : TASK_WAIT_FUTURES;
+		myTask->SetDeadline(myDeadline);
+		mySched.Post(myTask);
+		return true;
+	}
+
+	uint32_t
+	TaskCoroOpAwaitFutures::PrivResume() noexcept
+	{
+		// The non-strict wait is already stopped by the task before the resume. The
+		// strict one is stopped here. Acquire-barrier to see the values written by the
+		// promises.
+		uint64_t old = myTask->myFutureState.FetchBitAndAcquire(~theTaskFutureAwaitBits);
+		return TaskFutureStateGetReady(old) & myMask;
+	}
+
+	bool
+	TaskCoroOpWhenAll::await_resume() noexcept
+	{
+		return PrivResume() == myMask;
+	}
+
+	int32_t
+	TaskCoroOpWhenAny::await_resume() noexcept
+	{
+		uint32_t ready = PrivResume();
+		for (uint32_t i = 0; i < myCount; ++i)
+		{
+			if ((ready & (1U << mySlots[i])) != 0)
+				return (int32_t)i;
+		}
+		return -1;
+	}
+#endif
+
+}
+}
@@ -0,0 +1,459 @@
+#pragma once
+
+#include "mg/box/Assert.h"
+#include "mg/sch/Task.h"
+
+#include <new>
+#include <utility>
+
+namespace mg {
+namespace sch {
+
+	// A task can have this many futures bound to it at the same time.
+	static constexpr uint32_t theTaskFutureMaxCount = 31;
+
+	class TaskFutureBase;
+
+	template<typename T>
+	class TaskFuture;
+
+	template<typename T>
+	class TaskPromise;
+
+#if MG_CORO_IS_ENABLED
+	//////////////////////////////////////////////////////////////////////////////////////
+	// C++20 coroutine operations.
+
+	struct TaskCoroOpAwaitFutures
+		: public mg::box::CoroOp
+		, public mg::box::CoroOpIsNotReady
+	{
+		TaskCoroOpAwaitFutures(
+			TaskFutureBase* aFuture);
+		TaskCoroOpAwaitFutures(
+			TaskFutureBase* const* aFutures,
+			uint32_t aCount,
+			bool aIsAll,
+			uint64_t aDeadline);
+		bool await_suspend(
+			mg::box::CoroHandle aThisCoro) noexcept;
+
+	protected:
+		// Returns a mask of the awaited futures which are ready. The wait is already
+		// stopped by the task before the coroutine is resumed.
+		uint32_t PrivResume() noexcept;
+
+		Task* myTask;
+		TaskScheduler& mySched;
+		const uint64_t myDeadline;
+		uint32_t myMask;
+		const bool myIsAll;
+		// Only the futures can end the wait. Otherwise any wakeup ends it.
+		const bool myIsStrict;
+		// Slot of each future in the order they were given.
+		uint8_t mySlots[theTaskFutureMaxCount];
+		uint32_t myCount;
+	};
+
+	struct TaskCoroOpWhenAll
+		: public TaskCoroOpAwaitFutures
+	{
+		TaskCoroOpWhenAll(
+			TaskFutureBase* const* aFutures,
+			uint32_t aCount,
+			uint64_t aDeadline)
+			: TaskCoroOpAwaitFutures(aFutures, aCount, true, aDeadline) {}
+		bool await_resume() noexcept;
+	};
+
+	struct TaskCoroOpWhenAny
+		: public TaskCoroOpAwaitFutures
+	{
+		TaskCoroOpWhenAny(
+			TaskFutureBase* const* aFutures,
+			uint32_t aCount,
+			uint64_t aDeadline)
+			: TaskCoroOpAwaitFutures(aFutures, aCount, false, aDeadline) {}
+		int32_t await_resume() noexcept;
+	};
+
+	template<typename T>
+	struct TaskCoroOpAwaitFuture
+		: public TaskCoroOpAwaitFutures
+	{
+		TaskCoroOpAwaitFuture(
+			TaskFuture<T>* aFuture);
+		typename TaskFuture<T>::ValueRef await_resume() noexcept;
+
+	private:
+		TaskFuture<T>* myFuture;
+	};
+
+	//////////////////////////////////////////////////////////////////////////////////////
+#endif
+
+	// Future is a result of some work, which a task can wait for without blocking a
+	// thread. The future belongs to the task which waits for it, and the result is
+	// delivered by a promise. The promise can be used from any thread.
+	//
+	// There are no allocations. The result is stored right in the future, and the
+	// future's state is a bit in its task. Completion of a promise is a single atomic
+	// operation on the task. When it makes the task's wait satisfied, the task is
+	// signaled, so it is woken up via the usual front queue. Hence while the task waits
+	// for futures, its signal belongs to them and mustn't be used for anything else.
+	//
+	// The future must stay alive until its promise is completed. The same about the
+	// task. The future can be reused when it is ready, by getting a new promise.
+	//
+	//     Coro
+	//     TaskBody(Task* aTask)
+	//     {
+	//         TaskFuture<int> future(aTask);
+	//         StartSomeWork(future.GetPromise());
+	//         int result = co_await future;
+	//     }
+	//
+	//     void
+	//     SomeWorkIsDone(TaskPromise<int>& aPromise)
+	//     {
+	//         aPromise.SetValue(123);
+	//     }
+	//
+	class TaskFutureBase
+	{
+	public:
+		// The value is there. Can be called only by the owner of the future.
+		bool IsReady() const;
+
+		Task* GetTask() const { return myTask; }
+
+	protected:
+		TaskFutureBase(
+			Task* aTask);
+		~TaskFutureBase();
+
+		// Prepare for a new promise. Returns true if the previous value needs to be
+		// destroyed.
+		bool PrivArm();
+
+		// Called by the promise when the value is there. The future mustn't be used
+		// after this call. It can be already deleted by its task.
+		void PrivComplete();
+
+		Task* const myTask;
+		const uint32_t mySlot;
+		// The promise was given out. Is used only by the owner of the future.
+		bool myIsArmed;
+
+		TaskFutureBase(
+			const TaskFutureBase&) = delete;
+		TaskFutureBase& operator=(
+			const TaskFutureBase&) = delete;
+
+	private:
+		static uint32_t PrivTakeSlot(
+			Task* aTask);
+
+#if MG_CORO_IS_ENABLED
+		// Stop the task's wait for the futures. Returns true if the wait was satisfied,
+		// so the task has a signal to receive.
+		static bool PrivStopWait(
+			Task* aTask);
+
+		friend class Task;
+		friend struct TaskCoroOpAwaitFutures;
+#endif
+	};
+
+	template<typename T>
+	class TaskFuture
+		: public TaskFutureBase
+	{
+	public:
+		using ValueRef = T&;
+
+		// The future can be created by the task's own code, or before the task is
+		// posted.
+		TaskFuture(
+			Task* aTask) : TaskFutureBase(aTask) {}
+		~TaskFuture();
+
+		// Start a new wait. The future must be either new or ready.
+		TaskPromise<T> GetPromise();
+
+		T& GetValue();
+
+#if MG_CORO_IS_ENABLED
+		// Sleep until the value is there. The task is not woken up by anything else, the
+		// wakeups and the cancellation are ignored.
+		TaskCoroOpAwaitFuture<T> operator co_await() { return TaskCoroOpAwaitFuture<T>(this); }
+#endif
+
+	private:
+		template<typename... Args>
+		void PrivSet(
+			Args&&... aArgs);
+
+		alignas(T) unsigned char myValue[sizeof(T)];
+
+		friend class TaskPromise<T>;
+	};
+
+	template<>
+	class TaskFuture<void>
+		: public TaskFutureBase
+	{
+	public:
+		using ValueRef = void;
+
+		TaskFuture(
+			Task* aTask) : TaskFutureBase(aTask) {}
+
+		TaskPromise<void> GetPromise();
+
+		void GetValue() const { MG_BOX_ASSERT(IsReady()); }
+
+#if MG_CORO_IS_ENABLED
+		TaskCoroOpAwaitFuture<void> operator co_await();
+#endif
+
+	private:
+		void PrivSet() { PrivComplete(); }
+
+		friend class TaskPromise<void>;
+	};
+
+	// The producer's side of a future. Can be moved between threads. Must be completed
+	// exactly once.
+	template<typename T>
+	class TaskPromise
+	{
+	public:
+		TaskPromise() : myFuture(nullptr) {}
+		TaskPromise(
+			TaskPromise&& aOther) : myFuture(aOther.myFuture) { aOther.myFuture = nullptr; }
+		~TaskPromise() { MG_BOX_ASSERT_F(myFuture == nullptr, "Broken task promise"); }
+
+		TaskPromise& operator=(
+			TaskPromise&& aOther);
+
+		bool IsValid() const { return myFuture != nullptr; }
+
+		// Deliver the value into the future and wake up its task if it was waiting.
+		template<typename... Args>
+		void SetValue(
+			Args&&... aArgs);
+
+	private:
+		TaskPromise(
+			TaskFuture<T>* aFuture) : myFuture(aFuture) {}
+
+		TaskPromise(
+			const TaskPromise&) = delete;
+		TaskPromise& operator=(
+			const TaskPromise&) = delete;
+
+		TaskFuture<T>* myFuture;
+
+		friend class TaskFuture<T>;
+	};
+
+#if MG_CORO_IS_ENABLED
+	// Sleep until all the given futures are ready, or until the deadline. Returns true
+	// if all of them are ready. The futures must belong to the current task. They don't
+	// stop being pending after a timeout, and can be awaited again. A wakeup of the task,
+	// for example by its cancellation token, ends the wait the same as the deadline.
+	//
+	//     Coro
+	//     TaskBody(Task* aTask)
+	//     {
+	//         TaskFuture<int> a(aTask);
+	//         TaskFuture<int> b(aTask);
+	//         StartWorkA(a.GetPromise());
+	//         StartWorkB(b.GetPromise());
+	//         if (!co_await TaskWhenAllUntil(mg::box::GetMilliseconds() + 100, a, b))
+	//             HandleTimeout();
+	//     }
+	//
+	template<typename... Futures>
+	TaskCoroOpWhenAll TaskWhenAll(
+		Futures&... aFutures);
+	template<typename... Futures>
+	TaskCoroOpWhenAll TaskWhenAllUntil(
+		uint64_t aDeadline,
+		Futures&... aFutures);
+	TaskCoroOpWhenAll TaskWhenAll(
+		TaskFutureBase* const* aFutures,
+		uint32_t aCount,
+		uint64_t aDeadline = MG_TIME_INFINITE);
+
+	// Sleep until any of the given futures is ready, or until the deadline. Returns the
+	// index of the first ready future in the given list, or -1 on a timeout or a wakeup.
+	template<typename... Futures>
+	TaskCoroOpWhenAny TaskWhenAny(
+		Futures&... aFutures);
+	template<typename... Futures>
+	TaskCoroOpWhenAny TaskWhenAnyUntil(
+		uint64_t aDeadline,
+		Futures&... aFutures);
+	TaskCoroOpWhenAny TaskWhenAny(
+		TaskFutureBase* const* aFutures,
+		uint32_t aCount,
+		uint64_t aDeadline = MG_TIME_INFINITE);
+#endif
+
+	//////////////////////////////////////////////////////////////////////////////////////
+
+#if MG_CORO_IS_ENABLED
+	template<typename T>
+	inline
+	TaskCoroOpAwaitFuture<T>::TaskCoroOpAwaitFuture(
+		TaskFuture<T>* aFuture)
+		: TaskCoroOpAwaitFutures(aFuture)
+		, myFuture(aFuture)
+	{
+	}
+
+	template<typename T>
+	inline typename TaskFuture<T>::ValueRef
+	TaskCoroOpAwaitFuture<T>::await_resume() noexcept
+	{
+		uint32_t ready = PrivResume();
+		MG_BOX_ASSERT_F(ready != 0, "The task was woken up while waiting for a future");
+		return myFuture->GetValue();
+	}
+
+	inline TaskCoroOpAwaitFuture<void>
+	TaskFuture<void>::operator co_await()
+	{
+		return TaskCoroOpAwaitFuture<void>(this);
+	}
+
+	// The list of futures is copied by the operation. It can't be kept as a pointer
+	// into a temporary array, because GCC fails to put such arrays into the coroutine
+	// frame.
+	template<typename... Futures>
+	inline TaskCoroOpWhenAll
+	TaskWhenAll(
+		Futures&... aFutures)
+	{
+		return TaskWhenAllUntil(MG_TIME_INFINITE, aFutures...);
+	}
+
+	template<typename... Futures>
+	inline TaskCoroOpWhenAll
+	TaskWhenAllUntil(
+		uint64_t aDeadline,
+		Futures&... aFutures)
+	{
+		TaskFutureBase* list[] = {&aFutures...};
+		return TaskCoroOpWhenAll(list, sizeof...(Futures), aDeadline);
+	}
+
+	inline TaskCoroOpWhenAll
+	TaskWhenAll(
+		TaskFutureBase* const* aFutures,
+		uint32_t aCount,
+		uint64_t aDeadline)
+	{
+		return TaskCoroOpWhenAll(aFutures, aCount, aDeadline);
+	}
+
+	template<typename... Futures>
+	inline TaskCoroOpWhenAny
+	TaskWhenAny(
+		Futures&... aFutures)
+	{
+		return TaskWhenAnyUntil(MG_TIME_INFINITE, aFutures...);
+	}
+
+	template<typename... Futures>
+	inline TaskCoroOpWhenAny
+	TaskWhenAnyUntil(
+		uint64_t aDeadline,
+		Futures&... aFutures)
+	{
+		TaskFutureBase* list[] = {&aFutures...};
+		return TaskCoroOpWhenAny(list, sizeof...(Futures), aDeadline);
+	}
+
+	inline TaskCoroOpWhenAny
+	TaskWhenAny(
+		TaskFutureBase* const* aFutures,
+		uint32_t aCount,
+		uint64_t aDeadline)
+	{
+		return TaskCoroOpWhenAny(aFutures, aCount, aDeadline);
+	}
+#endif
+
+	template<typename T>
+	inline
+	TaskFuture<T>::~TaskFuture()
+	{
+		if (myIsArmed)
+		{
+			MG_BOX_ASSERT_F(IsReady(), "A pending task future is deleted");
+			((T*)myValue)->~T();
+		}
+	}
+
+	template<typename T>
+	inline TaskPromise<T>
+	TaskFuture<T>::GetPromise()
+	{
+		if (PrivArm())
+			((T*)myValue)->~T();
+		return TaskPromise<T>(this);
+	}
+
+	template<typename T>
+	inline T&
+	TaskFuture<T>::GetValue()
+	{
+		MG_BOX_ASSERT(IsReady());
+		return *(T*)myValue;
+	}
+
+	template<typename T>
+	template<typename... Args>
+	inline void
+	TaskFuture<T>::PrivSet(
+		Args&&... aArgs)
+	{
+		new (myValue) T(std::forward<Args>(aArgs)...);
+		PrivComplete();
+	}
+
+	inline TaskPromise<void>
+	TaskFuture<void>::GetPromise()
+	{
+		PrivArm();
+		return TaskPromise<void>(this);
+	}
+
+	template<typename T>
+	inline TaskPromise<T>&
+	TaskPromise<T>::operator=(
+		TaskPromise&& aOther)
+	{
+		MG_BOX_ASSERT_F(myFuture == nullptr, "Broken task promise");
+		myFuture = aOther.myFuture;
+		aOther.myFuture = nullptr;
+		return *this;
+	}
+
+	template<typename T>
+	template<typename... Args>
+	inline void
+	TaskPromise<T>::SetValue(
+		Args&&... aArgs)
+	{
+		MG_BOX_ASSERT(myFuture != nullptr);
+		TaskFuture<T>* future = myFuture;
+		myFuture = nullptr;
+		future->PrivSet(std::forward<Args>(aArgs)...);
+	}
+
+}
+}
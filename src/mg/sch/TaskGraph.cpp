@@ -0,0 +1,222 @@
+#include "TaskGraph.h"
+
+#include "mg/box/Assert.h"
+#include "mg/sch/TaskScheduler.h"
+
+#include <algorithm>
+
+namespace mg {
+namespace sch {
+
+	static bool
+	TaskGraphNodeIsLonger(
+		const TaskGraphNode* aLeft,
+		const TaskGraphNode* aRight)
+	{
+		return aLeft->GetCriticalPath() > aRight->GetCriticalPath();
+	}
+
+	void
+	TaskGraphNode::DependOn(
+		TaskGraphNode* aNode)
+	{
+		MG_BOX_ASSERT(aNode->myGraph == myGraph && aNode != this);
+		MG_BOX_ASSERT(myGraph->myPendingCount.LoadRelaxed() == 0);
+		aNode->mySuccessors.push_back(this);
+		++myDependencyCount;
+		myGraph->myIsPrepared = false;
+	}
+
+	TaskGraphNode::TaskGraphNode(
+		TaskGraph* aGraph,
+		TaskGraphCallback&& aCallback,
+		uint64_t aCost)
+		: Task(&TaskGraphNode::PrivExecute)
+		, myGraph(aGraph)
+		, myCallback(std::move(aCallback))
+		, myDependencyCount(0)
+		, myPendingCount(0)
+		, myCost(aCost)
+		, myCriticalPath(0)
+	{
+	}
+
+	void
+	TaskGraphNode::PrivExecute(
+		Task* aTask)
+	{
+		TaskGraphNode* self = (TaskGraphNode*)aTask;
+		self->myCallback();
+		TaskGraph* graph = self->myGraph;
+		// The successors are posted before this node is counted as done. Otherwise the
+		// graph could be seen finished and be restarted before they are posted.
+		TaskGraphNode* const* succs = self->mySuccessors.data();
+		uint32_t succCount = (uint32_t)self->mySuccessors.size();
+		// Fan-out is posted in batches to save on the front queue operations. The ready
+		// nodes keep the order of the critical paths.
+		TaskGraphNode* ready[32];
+		uint32_t readyCount = 0;
+		for (uint32_t i = 0; i < succCount; ++i)
+		{
+			TaskGraphNode* succ = succs[i];
+			if (succ->myPendingCount.DecrementFetchAcqRel() != 0)
+				continue;
+			ready[readyCount++] = succ;
+			if (readyCount == sizeof(ready) / sizeof(ready[0]))
+			{
+				graph->PrivPostReady(ready, readyCount);
+				readyCount = 0;
+			}
+		}
+		graph->PrivPostReady(ready, readyCount);
+		// The node must not be touched after this. The graph can be restarted or
+		// deleted right away.
+		graph->PrivNodeDone();
+	}
+
+	//////////////////////////////////////////////////////////////////////////////////////
+
+	TaskGraph::TaskGraph(
+		TaskScheduler& aScheduler)
+		: myScheduler(aScheduler)
+		, myPendingCount(0)
+		, myDoneTask(nullptr)
+		, myIsPrepared(false)
+	{
+	}
+
+	TaskGraph::~TaskGraph()
+	{
+		MG_BOX_ASSERT(myPendingCount.LoadAcquire() == 0);
+		for (TaskGraphNode* node : myNodes)
+			delete node;
+	}
+
+	TaskGraphNode*
+	TaskGraph::AddNode(
+		TaskGraphCallback&& aCallback,
+		uint64_t aCost)
+	{
+		MG_BOX_ASSERT(myPendingCount.LoadRelaxed() == 0);
+		TaskGraphNode* res = new TaskGraphNode(this, std::move(aCallback), aCost);
+		myNodes.push_back(res);
+		myIsPrepared = false;
+		return res;
+	}
+
+	void
+	TaskGraph::Prepare()
+	{
+		MG_BOX_ASSERT(myPendingCount.LoadRelaxed() == 0);
+		if (myIsPrepared)
+			return;
+		// Topological order via Kahn's algorithm. The pending counters are used as
+		// the in-degrees, they are reset by each run anyway.
+		std::vector<TaskGraphNode*> order;
+		order.reserve(myNodes.size());
+		myRoots.clear();
+		for (TaskGraphNode* node : myNodes)
+		{
+			node->myPendingCount.StoreRelaxed(node->myDependencyCount);
+			if (node->myDependencyCount == 0)
+			{
+				order.push_back(node);
+				myRoots.push_back(node);
+			}
+		}
+		for (size_t i = 0; i < order.size(); ++i)
+		{
+			for (TaskGraphNode* succ : order[i]->mySuccessors)
+			{
+				uint32_t count = succ->myPendingCount.LoadRelaxed() - 1;
+				succ->myPendingCount.StoreRelaxed(count);
+				if (count == 0)
+					order.push_back(succ);
+			}
+		}
+		MG_BOX_ASSERT_F(order.size() == myNodes.size(), "The task graph has a cycle");
+		// The critical paths are computed from the end.
+		for (size_t i = order.size(); i > 0; --i)
+		{
+			TaskGraphNode* node = order[i - 1];
+			uint64_t longest = 0;
+			for (TaskGraphNode* succ : node->mySuccessors)
+			{
+				if (succ->myCriticalPath > longest)
+					longest = succ->myCriticalPath;
+			}
+			node->myCriticalPath = node->myCost + longest;
+		}
+		for (TaskGraphNode* node : myNodes)
+		{
+			std::stable_sort(node->mySuccessors.begin(), node->mySuccessors.end(),
+				TaskGraphNodeIsLonger);
+		}
+		std::stable_sort(myRoots.begin(), myRoots.end(), TaskGraphNodeIsLonger);
+		myIsPrepared = true;
+	}
+
+	void
+	TaskGraph::Run(
+		Task* aDoneTask)
+	{
+		MG_DEV_ASSERT(aDoneTask != nullptr);
+		myDoneTask = aDoneTask;
+		if (myNodes.empty())
+			return myScheduler.Post(aDoneTask);
+		PrivStart();
+	}
+
+	void
+	TaskGraph::RunBlocking()
+	{
+		myDoneTask = nullptr;
+		if (myNodes.empty())
+			return;
+		PrivStart();
+		// The signal is received at least once, even if the graph is already done.
+		// Otherwise the last node could still be sending it when the graph is deleted.
+		do
+		{
+			mySignal.ReceiveBlocking();
+		} while (myPendingCount.LoadAcquire() != 0);
+	}
+
+	void
+	TaskGraph::PrivStart()
+	{
+		Prepare();
+		for (TaskGraphNode* node : myNodes)
+			node->myPendingCount.StoreRelaxed(node->myDependencyCount);
+		myPendingCount.StoreRelaxed((uint32_t)myNodes.size());
+		// The counters are published by the front queue together with the roots.
+		PrivPostReady(myRoots.data(), (uint32_t)myRoots.size());
+	}
+
+	void
+	TaskGraph::PrivPostReady(
+		TaskGraphNode* const* aNodes,
+		uint32_t aCount)
+	{
+		if (aCount == 0)
+			return;
+		if (aCount == 1)
+			return myScheduler.Post(aNodes[0]);
+		for (uint32_t i = 0; i < aCount; ++i)
+			aNodes[i]->myNext = i + 1 < aCount ? aNodes[i + 1] : nullptr;
+		myScheduler.PostMany(aNodes[0]);
+	}
+
+	void
+	TaskGraph::PrivNodeDone()
+	{
+		if (myPendingCount.DecrementFetchAcqRel() != 0)
+			return;
+		if (myDoneTask != nullptr)
+			myScheduler.Post(myDoneTask);
+		else
+			mySignal.Send();
+	}
+
+}
+}
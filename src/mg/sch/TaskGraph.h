@@ -0,0 +1,131 @@
+#pragma once
+
+#include "mg/box/Atomic.h"
+#include "mg/box/Signal.h"
+#include "mg/sch/Task.h"
+
+#include <vector>
+
+namespace mg {
+namespace sch {
+
+	class TaskGraph;
+	class TaskScheduler;
+
+	// Body of a graph node. Is stored right in the node, like the task callbacks.
+	using TaskGraphCallback = mg::box::InlineFunction<void(void), theTaskCallbackCapacity>;
+
+	// Node of a task graph. Is a task itself, which is posted when all the nodes it
+	// depends on are done. Is created and owned by the graph.
+	class TaskGraphNode
+		: private Task
+	{
+	public:
+		// The node can't start before the given one is finished.
+		void DependOn(
+			TaskGraphNode* aNode);
+
+		// Length of the longest path from this node to the end of the graph, including
+		// the node itself, in the units of the node costs. Is valid after the graph is
+		// prepared.
+		uint64_t GetCriticalPath() const { return myCriticalPath; }
+
+	private:
+		TaskGraphNode(
+			TaskGraph* aGraph,
+			TaskGraphCallback&& aCallback,
+			uint64_t aCost);
+
+		static void PrivExecute(
+			Task* aTask);
+
+		TaskGraph* const myGraph;
+		TaskGraphCallback myCallback;
+		// Are sorted by the critical path, the longest first.
+		std::vector<TaskGraphNode*> mySuccessors;
+		// Nodes this one depends on. Constant between the graph runs.
+		uint32_t myDependencyCount;
+		// Dependencies not finished yet in the current run. When drops to zero, the node
+		// is posted by the node which finished last.
+		mg::box::AtomicU32 myPendingCount;
+		const uint64_t myCost;
+		uint64_t myCriticalPath;
+
+		friend class TaskGraph;
+	};
+
+	// Graph of tasks with dependencies between them. The nodes are executed in the given
+	// scheduler as soon as all their dependencies are done. There are no locks, each
+	// node only has an atomic counter of the unfinished dependencies.
+	//
+	// The graph can be run many times. All the memory is allocated when the graph is
+	// built, so the runs themselves don't allocate anything.
+	//
+	// When many nodes are ready at once, they are posted in the order of their critical
+	// paths, longest first. So the chains which take the longest start the earliest, and
+	// the whole graph ends sooner. The critical path is counted in the node costs given
+	// by the user, 1 by default.
+	//
+	// The nodes can be added and linked only while the graph is not running.
+	//
+	//     TaskGraph graph(sched);
+	//     TaskGraphNode* parse = graph.AddNode([]() { Parse(); });
+	//     TaskGraphNode* check = graph.AddNode([]() { Check(); });
+	//     TaskGraphNode* store = graph.AddNode([]() { Store(); });
+	//     check->DependOn(parse);
+	//     store->DependOn(parse);
+	//     graph.RunBlocking();
+	//
+	class TaskGraph
+	{
+	public:
+		TaskGraph(
+			TaskScheduler& aScheduler);
+
+		~TaskGraph();
+
+		TaskGraphNode* AddNode(
+			TaskGraphCallback&& aCallback,
+			uint64_t aCost = 1);
+
+		// Sort the nodes and compute their critical paths. Is done automatically by the
+		// first run after a change, but can be called in advance to keep the run fast.
+		// Crashes if the graph has a cycle.
+		void Prepare();
+
+		// Start the graph and return right away. The given task is posted when all the
+		// nodes are done. It must not be in the scheduler at the moment of the call.
+		void Run(
+			Task* aDoneTask);
+
+		// Start the graph and wait until all the nodes are done. Shouldn't be called
+		// from a worker of the same scheduler, because then it blocks the worker.
+		void RunBlocking();
+
+		uint32_t GetNodeCount() const { return (uint32_t)myNodes.size(); }
+
+	private:
+		void PrivStart();
+
+		void PrivPostReady(
+			TaskGraphNode* const* aNodes,
+			uint32_t aCount);
+
+		void PrivNodeDone();
+
+		TaskScheduler& myScheduler;
+		std::vector<TaskGraphNode*> myNodes;
+		// Nodes without dependencies, sorted by the critical path, the longest first.
+		std::vector<TaskGraphNode*> myRoots;
+		// Nodes not finished yet in the current run.
+		mg::box::AtomicU32 myPendingCount;
+		// Is posted when the run is done. Without it the runner waits on the signal.
+		Task* myDoneTask;
+		mg::box::Signal mySignal;
+		bool myIsPrepared;
+
+		friend class TaskGraphNode;
+	};
+
+}
+}
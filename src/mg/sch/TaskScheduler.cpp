@@ -2,20 +2,219 @@
 
 #include "mg/box/StringFunctions.h"
 #include "mg/box/Time.h"
+#include "mg/box/Trace.h"
+
+#include "mg/sch/TaskSync.h"
+
+#include <algorithm>
 
 namespace mg {
 namespace sch {
 
+	// Local queue capacity of each worker. When it is full, the new tasks go to the front
+	// queue.
+	static constexpr uint32_t theTaskSchedulerLocalQueueSize = 256;
+	// How many tasks in a row the LIFO slot can provide. Without the limit two tasks
+	// waking each other could occupy the worker forever, while the local queue starves.
+	static constexpr uint32_t theTaskSchedulerLifoStreakMax = 3;
+	// Each N-th task of a worker is taken from the shared ready queue first, even if the
+	// local queue is not empty. Otherwise the local tasks could starve the shared ones.
+	static constexpr uint32_t theTaskSchedulerLocalStreakMax = 61;
+	// Max number of the free admission slots a worker takes into its cache at once.
+	static constexpr uint32_t theTaskSchedulerAdmitChunkMax = 64;
+	// Max sum of the task class weights. It is the length of the order of the class
+	// turns.
+	static constexpr uint32_t theTaskSchedulerClassWeightSumMax = 4096;
+	// How often a worker waiting in a parallel loop join looks for the new tasks when
+	// it has nothing to execute.
+	static constexpr uint64_t theTaskSchedulerParallelJoinPollUs = 100;
+	// How many parallel loop joins can be nested on one worker while it executes the
+	// other tasks in them. A deeper join just waits, so the stack depth stays bounded
+	// when many of the tasks run their own loops.
+	static constexpr uint32_t theTaskSchedulerParallelJoinDepthMax = 4;
+
+	// Shared state of one parallel loop. The helper tasks can start after the loop is
+	// finished and its caller is gone. Then they find no work and just leave. The last
+	// one to leave deletes the state.
+	struct TaskParallelFor
+	{
+		TaskParallelFor(
+			TaskScheduler* aScheduler,
+			uint64_t aBegin,
+			uint64_t aEnd,
+			uint64_t aGrain,
+			uint32_t aParticipantCount);
+
+		bool Claim(
+			uint64_t& aOutBegin,
+			uint64_t& aOutEnd);
+
+		void Run();
+
+		void Unref();
+
+		mg::box::AtomicU64 myNext;
+		mg::box::AtomicU64 myDoneCount;
+		mg::box::AtomicU32 myRefCount;
+		const uint64_t myEnd;
+		const uint64_t myTotal;
+		const uint64_t myGrain;
+		const uint64_t myParticipantCount;
+		TaskScheduler* const myScheduler;
+		// Points at the caller's callback when the caller waits for the loop. Otherwise
+		// at the own copy. Is never used after the last chunk is claimed.
+		const TaskParallelForCallback* myCallback;
+		TaskParallelForCallback myCallbackOwned;
+		// Is posted when the loop is done. Without it the caller waits on the signal.
+		Task* myDoneTask;
+		mg::box::Signal mySignal;
+	};
+
 	thread_local TaskScheduler* TaskScheduler::ourCurrent = nullptr;
+	thread_local TaskSchedulerThread* TaskScheduler::ourCurrentThread = nullptr;
+
+	TaskSchedulerParams::TaskSchedulerParams()
+		: myQueueMode(TASK_SCHEDULER_QUEUE_MODE_SHARED)
+		, myTimerSlack(0)
+		, myIdleSpinUs(0)
+		, myIsIdleYield(false)
+		, myIsLatencyCritical(false)
+		, myIsSchedDedicated(false)
+		, myThreadIdleTimeout(1000)
+		, myThreadGrowReadyCount(256)
+		, myIsNUMAAware(false)
+		, myIsStatEnabled(false)
+		, myAdmitCapacity(0)
+		, myAdmitHighWatermark(0)
+		, myAdmitLowWatermark(0)
+		, myTimeSliceUs(0)
+	{
+	}
+
+	TaskSchedulerStat::TaskSchedulerStat()
+		: myFrontDepth(0)
+		, myPendingDepth(0)
+		, myWaitingDepth(0)
+		, myReadyDepth(0)
+	{
+	}
 
 	TaskScheduler::TaskScheduler(
 		const char* aName,
 		uint32_t aSubQueueSize)
+		: TaskScheduler(aName, aSubQueueSize, TaskSchedulerParams())
+	{
+	}
+
+	TaskScheduler::TaskScheduler(
+		const char* aName,
+		uint32_t aSubQueueSize,
+		const TaskSchedulerParams& aParams)
 		: myExecBatchSize(aSubQueueSize)
 		, mySchedBatchSize(myExecBatchSize)
-		, myQueueReady(aSubQueueSize)
+		, myQueueMode(aParams.myQueueMode)
+		, myIdleSpinUs(aParams.myIdleSpinUs)
+		, myIsIdleYield(aParams.myIsIdleYield)
+		, myIsLatencyCritical(aParams.myIsLatencyCritical)
+		, myIsSchedDedicated(aParams.myIsSchedDedicated)
+		, myThreadIdleTimeout(aParams.myThreadIdleTimeout)
+		, myThreadGrowReadyCount(aParams.myThreadGrowReadyCount)
+		, myIsStatEnabled(aParams.myIsStatEnabled)
+		, myAdmitCapacity(aParams.myAdmitCapacity)
+		, myAdmitHighWatermark(aParams.myAdmitHighWatermark)
+		, myAdmitLowWatermark(aParams.myAdmitLowWatermark)
+		, myOnAdmitHigh(aParams.myOnAdmitHigh)
+		, myOnAdmitLow(aParams.myOnAdmitLow)
+		, myAdmitHasWatermarks(aParams.myOnAdmitHigh || aParams.myOnAdmitLow)
+		, myTimeSliceTicks(0)
+		, myScheduleRound(&TaskScheduler::PrivScheduleRound<TaskSchedulerPolicyDefault>)
+		, myExecuteBatch(&TaskScheduler::PrivExecuteBatch<TaskSchedulerPolicyDefault>)
+		, myHasDeadlines(TaskSchedulerPolicyDefault::theHasDeadlines)
+		, myClassCount(aParams.myClassWeights.empty() ? 1 :
+			(uint32_t)aParams.myClassWeights.size())
+		, myClassWeights(aParams.myClassWeights.empty() ? std::vector<uint32_t>(1, 1) :
+			aParams.myClassWeights)
+		, myClassWeightSum(0)
+		, myAdmitChunk(1)
+		, myStatFrontDepth(0)
+		, myStatPendingDepth(0)
+		, myStatWaitingDepth(0)
+		, myStatReadyDepth(0)
+		, myQueuePendingCount(0)
+		, myNodeNext(0)
+		, myFrontShardNext(0)
+		, myIdleCount(0)
+		, mySchedThread(nullptr)
+		, myThreadCount(0)
+		, myMinThreadCount(0)
+		, myMaxThreadCount(0)
+		, myIsStopping(false)
 		, myName(aName)
+		, myPool(nullptr)
+		, myPoolIsRetry(false)
+		, myAdmitFree(aParams.myAdmitCapacity)
+		, myAdmitWaitCount(0)
+		, myAdmitIsHigh(false)
 	{
+		MG_BOX_ASSERT(!myAdmitHasWatermarks || (myAdmitCapacity > 0 &&
+			myAdmitLowWatermark < myAdmitHighWatermark &&
+			myAdmitHighWatermark <= myAdmitCapacity));
+		MG_BOX_ASSERT(myClassCount <= theTaskClassMax);
+		for (uint32_t w : myClassWeights)
+		{
+			MG_BOX_ASSERT(w > 0);
+			myClassWeightSum += w;
+		}
+		MG_BOX_ASSERT(myClassWeightSum <= theTaskSchedulerClassWeightSumMax);
+		// Smooth weighted round-robin. On each step every class gains its weight, and
+		// the richest one takes the turn and pays the weight sum back.
+		std::vector<int64_t> current(myClassCount, 0);
+		myClassOrder.reserve(myClassWeightSum);
+		for (uint32_t i = 0; i < myClassWeightSum; ++i)
+		{
+			uint32_t best = 0;
+			for (uint32_t c = 0; c < myClassCount; ++c)
+			{
+				current[c] += myClassWeights[c];
+				if (current[c] > current[best])
+					best = c;
+			}
+			current[best] -= myClassWeightSum;
+			myClassOrder.push_back(best);
+		}
+		myClassByWeight.resize(myClassCount);
+		for (uint32_t c = 0; c < myClassCount; ++c)
+			myClassByWeight[c] = c;
+		std::stable_sort(myClassByWeight.begin(), myClassByWeight.end(),
+			[this](uint32_t aLeft, uint32_t aRight) {
+				return myClassWeights[aLeft] > myClassWeights[aRight];
+			});
+		myQueuesPending.resize(myClassCount);
+		if (aParams.myTimeSliceUs > 0)
+		{
+			myTimeSliceTicks = (uint64_t)(aParams.myTimeSliceUs *
+				mg::box::GetTicksPerMicrosecond());
+			if (myTimeSliceTicks == 0)
+				myTimeSliceTicks = 1;
+		}
+
+		myQueueWaiting.SetSlack(mg::box::TimeMsToUs(aParams.myTimerSlack));
+		if (!aParams.myIsNUMAAware)
+		{
+			myNodes.push_back(new TaskSchedulerNode(aSubQueueSize, myClassCount));
+			return;
+		}
+		const std::vector<mg::box::SysNUMANode>& nodes = aParams.myNUMANodes.empty() ?
+			mg::box::SysGetNUMANodes() : aParams.myNUMANodes;
+		MG_BOX_ASSERT(!nodes.empty());
+		myNodes.reserve(nodes.size());
+		for (const mg::box::SysNUMANode& n : nodes)
+		{
+			MG_BOX_ASSERT(!n.myCPUs.empty());
+			TaskSchedulerNode* node = new TaskSchedulerNode(aSubQueueSize, myClassCount);
+			node->myCPUs = n.myCPUs;
+			myNodes.push_back(node);
+		}
 	}
 
 	TaskScheduler::~TaskScheduler()
@@ -23,26 +222,99 @@ namespace sch {
 		MG_BOX_ASSERT(WaitEmpty());
 		Stop();
 		MG_BOX_ASSERT(myThreads.empty());
-		MG_BOX_ASSERT(myQueuePending.IsEmpty());
+		MG_BOX_ASSERT(PrivPendingIsEmpty());
 		MG_BOX_ASSERT(myQueueFront.PopAllFastReversed() == nullptr);
 		MG_BOX_ASSERT(myQueueWaiting.Count() == 0);
-		MG_BOX_ASSERT(myQueueReady.Count() == 0);
+		MG_BOX_ASSERT(PrivReadyCount() == 0);
+		MG_BOX_ASSERT(myAdmitWaiters.IsEmpty());
+		MG_BOX_ASSERT(myAdmitFree.LoadRelaxed() == myAdmitCapacity);
+		for (TaskSchedulerNode* node : myNodes)
+			delete node;
 	}
 
 	void
 	TaskScheduler::Start(
 		uint32_t aThreadCount)
 	{
+		Start(aThreadCount, aThreadCount);
+	}
+
+	void
+	TaskScheduler::Start(
+		uint32_t aMinThreadCount,
+		uint32_t aMaxThreadCount)
+	{
+		PrivStart(aMinThreadCount, aMaxThreadCount, nullptr, 0);
+	}
+
+	void
+	TaskScheduler::Start(
+		TaskSchedulerPool& aPool,
+		uint32_t aShare)
+	{
+		MG_BOX_ASSERT(aShare > 0);
+		uint32_t threadCount = aPool.GetThreadCount();
+		MG_BOX_ASSERT(threadCount > 0);
+		PrivStart(threadCount, threadCount, &aPool, aShare);
+	}
+
+	void
+	TaskScheduler::PrivStart(
+		uint32_t aMinThreadCount,
+		uint32_t aMaxThreadCount,
+		TaskSchedulerPool* aPool,
+		uint32_t aShare)
+	{
+		MG_BOX_ASSERT(aMinThreadCount <= aMaxThreadCount);
+		MG_BOX_ASSERT(aPool == nullptr || !myIsSchedDedicated);
 		PrivSchedulerLock();
-		mySchedBatchSize = myExecBatchSize * aThreadCount;
 		MG_BOX_ASSERT(myThreads.empty());
-		myThreads.resize(aThreadCount);
-		for (TaskSchedulerThread*& t : myThreads)
+		myThreads.resize(aMaxThreadCount);
+		// Create all the workers before starting any. They look at each other when steal
+		// tasks from the local queues, so the list must be complete and not changing.
+		// The workers are spread between the nodes evenly. Including when the scheduler
+		// is elastic and only a part of them is running.
+		uint32_t nodeCount = (uint32_t)myNodes.size();
+		for (uint32_t i = 0; i < aMaxThreadCount; ++i)
 		{
-			t = new TaskSchedulerThread(myName.c_str(), this);
-			t->Start();
+			TaskSchedulerThread* t = new TaskSchedulerThread(myName.c_str(), this,
+				i % nodeCount);
+			t->myStealIndex = i + 1;
+			myThreads[i] = t;
 		}
+		myMinThreadCount = aMinThreadCount;
+		myMaxThreadCount = aMaxThreadCount;
+		// The slots cached by all the workers together can't take more than a quarter
+		// of the limit. Otherwise the external posters could starve while the slots sit
+		// in the caches of the busy workers.
+		myAdmitChunk = std::min(theTaskSchedulerAdmitChunkMax,
+			myAdmitCapacity / (8 * std::max(aMaxThreadCount, 1U)));
+		myAdmitChunk = std::max(myAdmitChunk, 1U);
+		myThreadsMutex.Lock();
+		PrivSetThreadCount(aMinThreadCount);
+		if (aPool == nullptr)
+		{
+			for (uint32_t i = 0; i < aMinThreadCount; ++i)
+				myThreads[i]->PrivStart();
+			if (myIsSchedDedicated)
+			{
+				// It will wait for the sched-role until the start is finished.
+				mySchedThread = new TaskSchedulerThread(myName.c_str(), this, 0, true);
+				mySchedThread->PrivStart();
+			}
+		}
+		else
+		{
+			// The slots get no threads. The pool threads step into them.
+			for (TaskSchedulerThread* t : myThreads)
+				t->myIsActive.StoreRelaxed(true);
+			myPoolIsRetry.StoreRelaxed(false);
+			myPool.StoreRelaxed(aPool);
+		}
+		myThreadsMutex.Unlock();
 		PrivSchedulerUnlock();
+		if (aPool != nullptr)
+			aPool->PrivAttach(this, aShare);
 	}
 
 	bool
@@ -55,17 +327,18 @@ namespace sch {
 			// empty, it doesn't mean there are no tasks and won't be new ones. Because
 			// the currently running tasks might produce new tasks, and then the scheduler
 			// isn't empty.
-			if (worker->GetState() != TASK_SCHEDULER_WORKER_STATE_IDLE)
+			if (worker->GetState() != TASK_SCHEDULER_WORKER_STATE_IDLE ||
+				worker->PrivHasLocal())
 			{
 				PrivSchedulerUnlock();
 				return false;
 			}
 		}
 		bool isEmpty =
-			myQueueFront.IsEmpty() &&
+			PrivFrontIsEmpty() &&
 			myQueueWaiting.Count() == 0 &&
-			myQueuePending.IsEmpty() &&
-			myQueueReady.Count() == 0;
+			PrivPendingIsEmpty() &&
+			PrivReadyCount() == 0;
 		PrivSchedulerUnlock();
 		return isEmpty;
 	}
@@ -90,21 +363,68 @@ namespace sch {
 	void
 	TaskScheduler::Stop()
 	{
+		// The pool threads must leave before the worker slots are deleted.
+		TaskSchedulerPool* pool = myPool.LoadRelaxed();
+		if (pool != nullptr)
+		{
+			pool->PrivDetach(this);
+			myPool.StoreRelaxed(nullptr);
+		}
+		if (mySchedThread != nullptr)
+		{
+			// The dedicated sched-thread would wait for the role forever otherwise.
+			// The front signal interrupts its sleep, if it is sleeping.
+			mySchedThread->PrivStop();
+			mySignalFront.Send();
+			mySchedThread->PrivBlockingStop();
+			delete mySchedThread;
+			mySchedThread = nullptr;
+		}
 		PrivSchedulerLock();
 		if (myThreads.empty())
 		{
 			PrivSchedulerUnlock();
 			return;
 		}
-		mySchedBatchSize = myExecBatchSize;
+		// The workers can't retire anymore. And can't be added, because the sched-role is
+		// taken.
+		myThreadsMutex.Lock();
+		myIsStopping = true;
 		for (TaskSchedulerThread* t : myThreads)
-			t->Stop();
+		{
+			t->PrivStop();
+			t->mySignalWake.Send();
+		}
+		myThreadsMutex.Unlock();
 		PrivSignalReady();
 		// Yes, keep holding the lock while stopping the threads. They don't need to enter
-		// the scheduler-role anyway.
+		// the scheduler-role anyway. The deletion is done only when all of them are
+		// stopped, because the workers might be stealing from each other until the end.
+		for (TaskSchedulerThread* t : myThreads)
+			t->PrivBlockingStop();
 		for (TaskSchedulerThread* t : myThreads)
-			t->StopAndDelete();
+		{
+			if (pool != nullptr)
+			{
+				// The pool threads don't return the local tasks and the cached
+				// admission slots when leave the scheduler. It is done here instead.
+				Task* task;
+				while ((task = t->PrivPopLocal()) != nullptr)
+					PrivPost(task);
+				PrivAdmitFlush(t);
+			}
+			// The front shards go away together with the workers. Their tasks are kept
+			// for the next start, still in front of the newer ones.
+			Task* tail;
+			Task* first = t->myQueueFront.PopAll(tail);
+			PrivPendingAppend(first, tail);
+			delete t;
+		}
 		myThreads.clear();
+		myThreadsMutex.Lock();
+		myIsStopping = false;
+		PrivSetThreadCount(0);
+		myThreadsMutex.Unlock();
 		PrivSchedulerUnlock();
 	}
 
@@ -112,7 +432,11 @@ namespace sch {
 	TaskScheduler::Reserve(
 		uint32_t aCount)
 	{
-		myQueueReady.Reserve(aCount);
+		for (TaskSchedulerNode* node : myNodes)
+		{
+			for (TaskSchedulerQueueReady* queue : node->myQueuesReady)
+				queue->Reserve(aCount);
+		}
 	}
 
 	void
@@ -120,17 +444,268 @@ namespace sch {
 		Task* aTask)
 	{
 		MG_DEV_ASSERT(aTask->myScheduler == nullptr);
+		MG_TRACE(TASK_POST, aTask);
 		aTask->myScheduler = this;
+#if IS_BUILD_DEBUG
+		aTask->myIsWakeable.StoreRelaxed(myHasDeadlines);
+#endif
+		if (myIsStatEnabled)
+			aTask->myPostTime = mg::box::GetMicroseconds();
+		TaskSchedulerThread* worker = ourCurrentThread;
+		if (worker == nullptr || worker->myScheduler != this)
+			return PrivPost(aTask);
+		// A new task most likely has its data allocated by the posting worker, on its
+		// node.
+		if (aTask->myNodeIndex < 0)
+			aTask->myNodeIndex = (int32_t)worker->myNodeIndex;
+		// The local queues don't know the task classes. So only the default class can
+		// use them. A task which has run out of its time slice is most likely yielding.
+		// It must not get into the LIFO slot and be executed again right away.
+		if (myQueueMode == TASK_SCHEDULER_QUEUE_MODE_LOCAL && aTask->myDeadline == 0 &&
+			aTask->myClass == 0 && (myTimeSliceTicks == 0 ||
+			mg::box::GetTicks() <= worker->mySliceEnd))
+		{
+			return worker->PrivPostLocal(aTask);
+		}
 		PrivPost(aTask);
 	}
 
+	void
+	TaskScheduler::PostMany(
+		Task* aFirst)
+	{
+		if (aFirst == nullptr)
+			return;
+		// The front queue reverses a list pushed in one operation. The list is reversed
+		// here too, on the way, so the tasks are dispatched in the given order.
+		Task* first = nullptr;
+		Task* t = aFirst;
+		uint64_t now = myIsStatEnabled ? mg::box::GetMicroseconds() : 0;
+		do
+		{
+			MG_DEV_ASSERT(t->myScheduler == nullptr);
+			MG_TRACE(TASK_POST, t);
+			t->myScheduler = this;
+#if IS_BUILD_DEBUG
+			t->myIsWakeable.StoreRelaxed(myHasDeadlines);
+#endif
+			t->myPostTime = now;
+			Task* next = t->myNext;
+			t->myNext = first;
+			first = t;
+			t = next;
+		} while (t != nullptr);
+		PrivPostMany(first, aFirst);
+	}
+
+	void
+	TaskScheduler::PostWakeupMany(
+		Task* const* aTasks,
+		uint32_t aCount)
+	{
+		MG_DEV_ASSERT_F(myHasDeadlines, "The scheduler's tasks can't be woken up");
+		Task* first = nullptr;
+		Task* last = nullptr;
+		for (uint32_t i = 0; i < aCount; ++i)
+		{
+			Task* t = aTasks[i];
+			MG_TRACE(TASK_WAKEUP, t);
+			if (!t->PrivWakeup())
+				continue;
+			MG_DEV_ASSERT(t->myScheduler == this);
+			// Waiting task is not in the front queue. Its link is free.
+			t->myNext = first;
+			first = t;
+			if (last == nullptr)
+				last = t;
+		}
+		if (first != nullptr)
+			PrivPostMany(first, last);
+	}
+
+	void
+	TaskScheduler::PostSignalMany(
+		Task* const* aTasks,
+		uint32_t aCount)
+	{
+		MG_DEV_ASSERT_F(myHasDeadlines, "The scheduler's tasks can't be woken up");
+		Task* first = nullptr;
+		Task* last = nullptr;
+		for (uint32_t i = 0; i < aCount; ++i)
+		{
+			Task* t = aTasks[i];
+			MG_TRACE(TASK_SIGNAL, t);
+			if (!t->PrivSignal())
+				continue;
+			MG_DEV_ASSERT(t->myScheduler == this);
+			t->myNext = first;
+			first = t;
+			if (last == nullptr)
+				last = t;
+		}
+		if (first != nullptr)
+			PrivPostMany(first, last);
+	}
+
+	bool
+	TaskScheduler::TryPost(
+		Task* aTask)
+	{
+		if (myAdmitCapacity == 0)
+		{
+			Post(aTask);
+			return true;
+		}
+		if (!PrivAdmitTake())
+			return false;
+		PrivPostAdmitted(aTask);
+		return true;
+	}
+
+	void
+	TaskScheduler::PostWithBackpressure(
+		Task* aTask)
+	{
+		TaskSchedulerThread* worker = ourCurrentThread;
+		MG_BOX_ASSERT(worker == nullptr || worker->myScheduler != this);
+		if (myAdmitCapacity == 0)
+			return Post(aTask);
+		if (PrivAdmitTake())
+			return PrivPostAdmitted(aTask);
+		mg::box::Signal signal;
+		TaskSchedulerAdmitWaiter waiter;
+		waiter.myTask = aTask;
+		waiter.myWaiterTask = nullptr;
+		waiter.myWaiterSignal = &signal;
+		waiter.myNext = nullptr;
+		if (PrivAdmitTakeOrEnqueue(&waiter))
+			return PrivPostAdmitted(aTask);
+		// The task is posted by the thread which has freed the slot.
+		signal.ReceiveBlocking();
+	}
+
+	void
+	TaskScheduler::ParallelFor(
+		uint64_t aBegin,
+		uint64_t aEnd,
+		uint64_t aGrain,
+		const TaskParallelForCallback& aCallback)
+	{
+		if (aBegin >= aEnd)
+			return;
+		if (aGrain == 0)
+			aGrain = 1;
+		uint32_t helperCount = PrivParallelHelperCount(aEnd - aBegin, aGrain, true);
+		if (helperCount == 0)
+			return aCallback(aBegin, aEnd);
+
+		TaskParallelFor* loop = new TaskParallelFor(this, aBegin, aEnd, aGrain,
+			helperCount + 1);
+		loop->myCallback = &aCallback;
+		loop->myRefCount.StoreRelaxed(helperCount + 1);
+		for (uint32_t i = 0; i < helperCount; ++i)
+		{
+			PostOneShot([loop]() {
+				loop->Run();
+				loop->Unref();
+			});
+		}
+		loop->Run();
+		// Only the chunks being executed by the others are waited for. They are already
+		// running, so it can't deadlock.
+		TaskSchedulerThread* worker = ourCurrentThread;
+		if (worker == nullptr || worker->myScheduler != this ||
+			worker->myJoinDepth >= theTaskSchedulerParallelJoinDepthMax)
+		{
+			while (loop->myDoneCount.LoadAcquire() != loop->myTotal)
+				loop->mySignal.ReceiveBlocking();
+			loop->Unref();
+			return;
+		}
+		// A worker doesn't sleep meanwhile. Otherwise a few nested loops would occupy
+		// all the workers while the rest of the tasks wait in the queues. The nested
+		// tasks are executed the same as in the worker's own loop. Only the time slice
+		// must be restored for the calling task.
+		uint64_t sliceEnd = worker->mySliceEnd;
+		++worker->myJoinDepth;
+		while (loop->myDoneCount.LoadAcquire() != loop->myTotal)
+		{
+			if ((this->*myExecuteBatch)(worker, 1) != 0)
+			{
+				worker->myExecuteCount.IncrementRelaxed();
+				continue;
+			}
+			if (!myIsSchedDedicated && PrivSchedule(false))
+			{
+				worker->myScheduleCount.IncrementRelaxed();
+				continue;
+			}
+			// Nothing to do. The new tasks are checked from time to time, but mostly
+			// it is waiting for the last chunks.
+			loop->mySignal.ReceiveTimedUs(theTaskSchedulerParallelJoinPollUs);
+		}
+		--worker->myJoinDepth;
+		worker->mySliceEnd = sliceEnd;
+		loop->Unref();
+	}
+
+	void
+	TaskScheduler::ParallelForAsync(
+		uint64_t aBegin,
+		uint64_t aEnd,
+		uint64_t aGrain,
+		TaskParallelForCallback&& aCallback,
+		Task* aDoneTask)
+	{
+		MG_DEV_ASSERT(aDoneTask != nullptr);
+		if (aBegin >= aEnd)
+			return Post(aDoneTask);
+		if (aGrain == 0)
+			aGrain = 1;
+		uint32_t helperCount = PrivParallelHelperCount(aEnd - aBegin, aGrain, false);
+		TaskParallelFor* loop = new TaskParallelFor(this, aBegin, aEnd, aGrain,
+			helperCount);
+		loop->myCallbackOwned = std::move(aCallback);
+		loop->myCallback = &loop->myCallbackOwned;
+		loop->myDoneTask = aDoneTask;
+		loop->myRefCount.StoreRelaxed(helperCount);
+		// The loop can be finished and deleted before the last post returns.
+		for (uint32_t i = 0; i < helperCount; ++i)
+		{
+			PostOneShot([loop]() {
+				loop->Run();
+				loop->Unref();
+			});
+		}
+	}
+
+	void
+	TaskScheduler::ForkJoin(
+		std::initializer_list<std::function<void()>> aFuncs)
+	{
+		const std::function<void()>* funcs = aFuncs.begin();
+		ParallelFor(0, aFuncs.size(), 1, [funcs](uint64_t aBegin, uint64_t aEnd) {
+			for (uint64_t i = aBegin; i < aEnd; ++i)
+				funcs[i]();
+		});
+	}
+
 	void
 	TaskScheduler::PrivPost(
 		Task* aTask)
 	{
 		MG_DEV_ASSERT(aTask->myScheduler == this);
-		if (myQueueFront.Push(aTask))
-			mySignalFront.Send();
+		if (PrivFrontShard().Push(aTask))
+			PrivSignalFront();
+	}
+
+	void
+	TaskScheduler::PrivPostMany(
+		Task* aFirst,
+		Task* aLast)
+	{
+		if (PrivFrontShard().PushManyFastReversed(aFirst, aLast))
+			PrivSignalFront();
 	}
 
 	inline void
@@ -146,10 +721,34 @@ namespace sch {
 	}
 
 	bool
-	TaskScheduler::PrivSchedule()
+	TaskScheduler::PrivSchedule(
+		bool aCanWait)
 	{
 		if (!PrivSchedulerTryLock())
-			return false;
+		{
+			// A pool thread can't wait for the role. But it might have been woken up
+			// for the tasks the current sched-thread already missed. Then the
+			// sched-thread is asked to wake the pool up again. The flag is exchanged by
+			// both sides, so either the sched-thread sees it, or this thread sees the
+			// role free.
+			if (myPool.LoadRelaxed() == nullptr)
+				return false;
+			myPoolIsRetry.ExchangeAcqRel(true);
+			if (!PrivSchedulerTryLock())
+				return false;
+		}
+		MG_TRACE(SCHED_ENTER, this);
+		(this->*myScheduleRound)(aCanWait);
+		MG_TRACE(SCHED_EXIT, this);
+		PrivSchedulerUnlock();
+		return true;
+	}
+
+	template<typename Policy>
+	void
+	TaskScheduler::PrivScheduleRound(
+		bool aCanWait)
+	{
 		// Task status operations can all be relaxed inside the
 		// scheduler. Syncing writes and reads between producers and
 		// workers anyway happens via acquire-release of the front
@@ -160,21 +759,21 @@ namespace sch {
 		Task* tail;
 		TaskSchedulerQueuePending ready;
 		uint64_t deadline;
-		uint64_t timestamp = mg::box::GetMilliseconds();
+		// Without deadlines the time is needed only for the stats.
+		uint64_t timestamp = 0;
+		if (Policy::theHasDeadlines || myIsStatEnabled)
+			timestamp = mg::box::GetMicroseconds();
 		uint32_t batch;
-		uint32_t maxBatch = mySchedBatchSize;
+		uint32_t maxBatch = mySchedBatchSize.LoadRelaxed();
 
 		// -------------------------------------------------------
 		// Handle waiting tasks. They are older than the ones in
 		// the front queue, so must be handled first.
 
 		batch = 0;
-		while (myQueueWaiting.Count() > 0 && ++batch < maxBatch)
+		while (Policy::theHasDeadlines && ++batch < maxBatch &&
+			(t = myQueueWaiting.PopExpired(timestamp)) != nullptr)
 		{
-			t = myQueueWaiting.GetTop();
-			if (t->myDeadline > timestamp)
-				break;
-			myQueueWaiting.RemoveTop();
 			t->myIsExpired = true;
 
 			old = TASK_STATUS_WAITING;
@@ -211,107 +810,274 @@ namespace sch {
 		// rarely expected to be empty. So receiving this signal would be pointless. At
 		// the same time, if the queue does become empty for a while, the front signal is
 		// received when the scheduler has nothing to do and goes to sleep on that signal.
-		t = myQueueFront.PopAll(tail);
-		myQueuePending.Append(t, tail);
-		batch = 0;
-		while (!myQueuePending.IsEmpty() && ++batch < maxBatch)
+		// The shards are drained round-robin. Each of them is in FIFO order, but there
+		// is no order between them, the same as there is none between the producers.
+		// An empty shard is only read, so its cache line isn't taken away from the
+		// producer for nothing.
+		uint32_t shardCount = PrivFrontShardCount();
+		uint32_t frontCount = 0;
+		for (uint32_t i = 0; i < shardCount; ++i)
+		{
+			TaskSchedulerQueueFront& shard =
+				PrivFrontShard((myFrontShardNext + i) % shardCount);
+			if (shard.IsEmpty())
+				continue;
+			t = shard.PopAll(tail);
+			if (myIsStatEnabled)
+			{
+				for (Task* pos = t; pos != nullptr; pos = pos->myNext)
+					++frontCount;
+			}
+			PrivPendingAppend(t, tail);
+		}
+		myFrontShardNext = (myFrontShardNext + 1) % shardCount;
+		if (myIsStatEnabled)
+		{
+			myStatFrontDepth.StoreRelaxed(frontCount);
+			myQueuePendingCount += frontCount;
+		}
+		// Each class firstly gets a share of the batch by its weight, but at least one
+		// task. Then what is left goes to the classes still having pending tasks, in
+		// the order of their weights.
+		uint32_t pendingPopCount = 0;
+		for (uint32_t i = 0; i < 2 * myClassCount && pendingPopCount < maxBatch; ++i)
 		{
-			t = myQueuePending.PopFirst();
-			t->myNext = nullptr;
-			if (timestamp < t->myDeadline)
+			uint32_t cls = myClassByWeight[i % myClassCount];
+			TaskSchedulerQueuePending& pending = myQueuesPending[cls];
+			uint32_t limit = maxBatch - pendingPopCount;
+			if (i < myClassCount && myClassCount > 1)
+			{
+				uint32_t share = (uint32_t)((uint64_t)maxBatch * myClassWeights[cls] /
+					myClassWeightSum);
+				limit = std::min(limit, std::max(share, 1U));
+			}
+			batch = 0;
+			while (!pending.IsEmpty() && batch < limit)
 			{
-				t->myIsExpired = false;
-				old = TASK_STATUS_PENDING;
-				if (t->myStatus.CmpExchgStrongRelaxed(old, TASK_STATUS_WAITING))
+				t = pending.PopFirst();
+				++batch;
+				++pendingPopCount;
+				t->myNext = nullptr;
+				if (!Policy::theHasDeadlines)
 				{
-					// The task is not added to the heap in case
-					// it is put to sleep until explicit wakeup or
-					// a signal. Because anyway it won't be popped
-					// ever. And signal/wakeup work fine even if
-					// the task is waiting but not in the waiting
-					// queue. Only status matters.
-					if (t->myDeadline != MG_TIME_INFINITE)
-						myQueueWaiting.Push(t);
-					else
-						MG_DEV_ASSERT(t->myIndex == -1);
-					// Even if the task is woken right now, it is
-					// ok to add it to the waiting queue. Because
-					// it is also added to the front queue by the
-					// wakeup, and the scheduler handles this case
-					// below.
+					// Only a cancellation can change the status then. Its wakeup makes
+					// the task ready, which it is going to be anyway.
+					MG_DEV_ASSERT(t->myDeadline == 0 && t->myIndex == -1);
+					MG_DEV_ASSERT(t->myStatus.LoadRelaxed() == TASK_STATUS_PENDING ||
+						t->myStatus.LoadRelaxed() == TASK_STATUS_READY);
+					t->myIsExpired = true;
+					t->myStatus.StoreRelaxed(TASK_STATUS_READY);
+					ready.Append(t);
 					continue;
 				}
-				MG_DEV_ASSERT(
-					// The task was woken up or signaled
-					// specifically to ignore the deadline.
-					old == TASK_STATUS_READY ||
-					old == TASK_STATUS_SIGNALED);
-			}
-			else
-			{
-				t->myIsExpired = true;
-				old = TASK_STATUS_PENDING;
-				t->myStatus.CmpExchgStrongRelaxed(old, TASK_STATUS_READY);
-				MG_DEV_ASSERT(
-					// Normal task reached its dispatch.
-					old == TASK_STATUS_PENDING ||
-					// The task was woken up or signaled
-					// explicitly.
-					old == TASK_STATUS_READY ||
-					old == TASK_STATUS_SIGNALED);
+				if (timestamp < t->myDeadline)
+				{
+					t->myIsExpired = false;
+					old = TASK_STATUS_PENDING;
+					if (t->myStatus.CmpExchgStrongRelaxed(old, TASK_STATUS_WAITING))
+					{
+						// The task is not added to the heap in case
+						// it is put to sleep until explicit wakeup or
+						// a signal. Because anyway it won't be popped
+						// ever. And signal/wakeup work fine even if
+						// the task is waiting but not in the waiting
+						// queue. Only status matters.
+						if (t->myDeadline != MG_TIME_INFINITE)
+							myQueueWaiting.Push(t);
+						else
+							MG_DEV_ASSERT(t->myIndex == -1);
+						// Even if the task is woken right now, it is
+						// ok to add it to the waiting queue. Because
+						// it is also added to the front queue by the
+						// wakeup, and the scheduler handles this case
+						// below.
+						continue;
+					}
+					MG_DEV_ASSERT(
+						// The task was woken up or signaled
+						// specifically to ignore the deadline.
+						old == TASK_STATUS_READY ||
+						old == TASK_STATUS_SIGNALED);
+				}
+				else
+				{
+					t->myIsExpired = true;
+					old = TASK_STATUS_PENDING;
+					t->myStatus.CmpExchgStrongRelaxed(old, TASK_STATUS_READY);
+					MG_DEV_ASSERT(
+						// Normal task reached its dispatch.
+						old == TASK_STATUS_PENDING ||
+						// The task was woken up or signaled
+						// explicitly.
+						old == TASK_STATUS_READY ||
+						old == TASK_STATUS_SIGNALED);
+				}
+				// The task can be also stored in the waiting queue
+				// and then pushed to the front queue to wake it up or
+				// signal earlier. In this case it must be removed
+				// from the waiting queue. A task never should be in
+				// two queues simultaneously.
+				if (t->myIndex >= 0)
+					myQueueWaiting.Remove(t);
+				ready.Append(t);
 			}
-			// The task can be also stored in the waiting queue
-			// and then pushed to the front queue to wake it up or
-			// signal earlier. In this case it must be removed
-			// from the waiting queue. A task never should be in
-			// two queues simultaneously.
-			if (t->myIndex >= 0)
-				myQueueWaiting.Remove(t);
-			ready.Append(t);
 		}
 
 		// End of tasks polling.
 		// -------------------------------------------------------
 
 		t = ready.PopAll();
-		while (t != nullptr)
+		uint32_t nodeCount = (uint32_t)myNodes.size();
+		if (nodeCount == 1 && myClassCount == 1)
 		{
-			next = t->myNext;
-			t->myNext = nullptr;
-			myQueueReady.PushPending(t);
-			t = next;
+			TaskSchedulerQueueReady& queue = *myNodes[0]->myQueuesReady[0];
+			while (t != nullptr)
+			{
+				next = t->myNext;
+				t->myNext = nullptr;
+				MG_TRACE(TASK_SCHEDULE, t);
+				queue.PushPending(t);
+				t = next;
+			}
+			queue.FlushPending();
+		}
+		else
+		{
+			while (t != nullptr)
+			{
+				next = t->myNext;
+				t->myNext = nullptr;
+				// The task prefers the node where it was executed last time. Its data
+				// is likely to be there. The tasks without a node are spread evenly.
+				uint32_t nodeIndex = (uint32_t)t->myNodeIndex;
+				if (nodeIndex >= nodeCount)
+					nodeIndex = myNodeNext++ % nodeCount;
+				// With one class the tasks' classes are ignored.
+				uint32_t cls = myClassCount == 1 ? 0 : t->myClass;
+				MG_TRACE(TASK_SCHEDULE, t);
+				myNodes[nodeIndex]->myQueuesReady[cls]->PushPending(t);
+				t = next;
+			}
+			for (TaskSchedulerNode* node : myNodes)
+			{
+				for (TaskSchedulerQueueReady* queue : node->myQueuesReady)
+					queue->FlushPending();
+			}
+		}
+		uint32_t readyCount = PrivReadyCount();
+		if (myIsStatEnabled)
+		{
+			myQueuePendingCount -= pendingPopCount;
+			myStatPendingDepth.StoreRelaxed(myQueuePendingCount);
+			myStatWaitingDepth.StoreRelaxed(myQueueWaiting.Count());
+			myStatReadyDepth.StoreRelaxed(readyCount);
+			// The sched-role is taken only by the workers or by the dedicated
+			// sched-thread. Both have a slot.
+			uint64_t now = mg::box::GetMicroseconds();
+			ourCurrentThread->myStatSchedHoldTime.Add(
+				now > timestamp ? now - timestamp : 0);
+		}
+
+		// The workers can't keep up with the tasks. Even if the other workers are going
+		// to pick the tasks up soon, there are too many of them for the current workers.
+		// The pending tasks mean the ready queue would be even longer, but it is limited
+		// by the sched batch size.
+		if (myThreadCount.LoadRelaxed() < myMaxThreadCount && myIdleCount.Load() == 0 &&
+			(readyCount >= myThreadGrowReadyCount || !PrivPendingIsEmpty()))
+		{
+			PrivThreadGrow();
 		}
-		myQueueReady.FlushPending();
 
-		if (myQueueReady.Count() == 0 && myQueuePending.IsEmpty())
+		TaskSchedulerPool* pool = myPool.LoadRelaxed();
+		if (pool != nullptr)
+		{
+			// The pool threads are shared with the other schedulers, so they never sleep
+			// in the sched-role. Instead the pool thread sleeps not longer than until
+			// the next waiting task expires. And the other pool threads are woken up
+			// when there is work for them.
+			ourCurrentThread->myPoolDeadline = Policy::theHasDeadlines &&
+				myQueueWaiting.Count() > 0 ? myQueueWaiting.GetNextDeadline() :
+				MG_TIME_INFINITE;
+			if (readyCount > 0 || !PrivPendingIsEmpty())
+				pool->PrivSignal();
+			return;
+		}
+		if (myIsSchedDedicated)
+		{
+			// The workers don't come here, so they must be woken up explicitly. While
+			// they are busy, the ready tasks wait for them, not for the sched-thread.
+			if (readyCount > 0)
+				PrivWakeWorkers(readyCount);
+		}
+		else if (readyCount > 0)
+		{
+			return;
+		}
+		if (PrivPendingIsEmpty() && aCanWait)
 		{
 			// No ready tasks means the other workers already sleep on ready-signal. Or
 			// are going to start sleeping any moment. So the sched can't quit. It must
 			// try to wait until something new happens which would require processing.
-			if (myQueueWaiting.Count() > 0)
+			//
+			// With the local queues the sched is also counted as idle. Then it gets
+			// woken up by the workers having local tasks to steal. Unless it is
+			// dedicated and never steals.
+			bool isLocal = myQueueMode == TASK_SCHEDULER_QUEUE_MODE_LOCAL &&
+				!myIsSchedDedicated;
+			if (isLocal)
+				myIdleCount.Increment();
+			if (Policy::theHasDeadlines && myQueueWaiting.Count() > 0)
 			{
-				deadline = myQueueWaiting.GetTop()->myDeadline;
-				timestamp = mg::box::GetMilliseconds();
+				// The wheel might return an earlier deadline than the real one. Then the
+				// sched wakes up a bit earlier to cascade the tasks closer to expiration.
+				deadline = myQueueWaiting.GetNextDeadline();
+				timestamp = mg::box::GetMicroseconds();
 				if (deadline > timestamp)
 				{
-					mySignalFront.ReceiveTimed(
-						mg::box::TimeDuration(deadline - timestamp));
+					PrivWaitSignal(mySignalFront, deadline - timestamp,
+						myIsLatencyCritical);
 				}
 			}
 			else
 			{
-				mySignalFront.ReceiveBlocking();
+				PrivWaitSignal(mySignalFront, MG_TIME_INFINITE, myIsLatencyCritical);
 			}
+			if (isLocal)
+				myIdleCount.Decrement();
 		}
+	}
 
-		PrivSchedulerUnlock();
-		return true;
+	template<typename Policy>
+	void
+	TaskScheduler::PrivSetPolicy()
+	{
+		MG_BOX_ASSERT(myThreads.empty());
+		myScheduleRound = &TaskScheduler::PrivScheduleRound<Policy>;
+		myExecuteBatch = &TaskScheduler::PrivExecuteBatch<Policy>;
+		myHasDeadlines = Policy::theHasDeadlines;
 	}
 
+	template void TaskScheduler::PrivSetPolicy<TaskSchedulerPolicyDefault>();
+	template void TaskScheduler::PrivSetPolicy<TaskSchedulerPolicyNoDeadlines>();
+
 	inline void
 	TaskScheduler::PrivSchedulerUnlock()
 	{
 		mySchedulerMutex.Unlock();
+		// The dedicated sched-thread wakes up the workers itself, and is the only one
+		// to take the role after that.
+		if (myIsSchedDedicated)
+			return;
+		TaskSchedulerPool* pool = myPool.LoadRelaxed();
+		if (pool != nullptr)
+		{
+			// The pool threads don't wait on the ready-signal. They are woken up by the
+			// sched-thread when it leaves ready tasks, and by the new tasks. Only a pool
+			// thread which failed to take the role needs one more wakeup.
+			if (myPoolIsRetry.ExchangeAcqRel(false))
+				pool->PrivSignal();
+			return;
+		}
 		// The signal is absolutely vital to have exactly here.
 		// If the signal would not be emitted here, all the
 		// workers could block on ready tasks in their loops.
@@ -343,89 +1109,1303 @@ namespace sch {
 		PrivSignalReady();
 	}
 
+	template<typename Policy>
 	bool
 	TaskScheduler::PrivExecute(
-		Task* aTask)
+		Task* aTask,
+		TaskSchedulerThread* aWorker)
 	{
 		if (aTask == nullptr)
 			return false;
 		MG_DEV_ASSERT(aTask->myScheduler == this);
 		aTask->myScheduler = nullptr;
-		TaskStatus old = TASK_STATUS_READY;
-		aTask->myStatus.CmpExchgStrongRelaxed(old, TASK_STATUS_PENDING);
-		MG_DEV_ASSERT(old == TASK_STATUS_READY || old == TASK_STATUS_SIGNALED);
-		// The task object shall not be accessed anyhow after
-		// execution. It may be deleted inside.
+		aTask->myNodeIndex = (int32_t)aWorker->myNodeIndex;
+		if (myClassCount > 1)
+			aWorker->myClassExecuteCount[aTask->myClass].IncrementRelaxed();
+		if (aTask->myIsAdmitted)
+		{
+			aTask->myIsAdmitted = false;
+			PrivAdmitRelease(aWorker);
+		}
+		// The tasks from the worker's local queue are still pending. The sched didn't
+		// see them.
+		if (Policy::theHasDeadlines)
+		{
+			TaskStatus old = TASK_STATUS_READY;
+			aTask->myStatus.CmpExchgStrongRelaxed(old, TASK_STATUS_PENDING);
+			MG_DEV_ASSERT(old == TASK_STATUS_READY || old == TASK_STATUS_SIGNALED ||
+				old == TASK_STATUS_PENDING);
+		}
+		else
+		{
+			MG_DEV_ASSERT(aTask->myStatus.LoadRelaxed() == TASK_STATUS_READY ||
+				aTask->myStatus.LoadRelaxed() == TASK_STATUS_PENDING);
+			aTask->myStatus.StoreRelaxed(TASK_STATUS_PENDING);
+		}
+		MG_TRACE(TASK_EXEC_BEGIN, aTask);
+		if (myTimeSliceTicks != 0)
+			aWorker->mySliceEnd = mg::box::GetTicks() + myTimeSliceTicks;
+		if (!myIsStatEnabled)
+		{
+			// The task object shall not be accessed anyhow after
+			// execution. It may be deleted inside. The tracing only
+			// needs the pointer value.
+			aTask->PrivExecute();
+			MG_TRACE(TASK_EXEC_END, aTask);
+			if (myTimeSliceTicks != 0 && mg::box::GetTicks() > aWorker->mySliceEnd)
+				aWorker->mySliceOverrunCount.IncrementRelaxed();
+			return true;
+		}
+		uint64_t start = mg::box::GetMicroseconds();
+		uint64_t deadline = aTask->myDeadline;
+		uint64_t postTime = aTask->myPostTime;
+		if (deadline <= postTime)
+		{
+			uint64_t delay = start > postTime ? start - postTime : 0;
+			aWorker->myStatReadyDelay.Add(delay);
+			if (myClassCount > 1)
+				aWorker->myStatClassReadyDelay[aTask->myClass].Add(delay);
+		}
+		else if (aTask->myIsExpired && deadline != MG_TIME_INFINITE)
+			aWorker->myStatLateness.Add(start > deadline ? start - deadline : 0);
 		aTask->PrivExecute();
+		MG_TRACE(TASK_EXEC_END, aTask);
+		if (myTimeSliceTicks != 0 && mg::box::GetTicks() > aWorker->mySliceEnd)
+			aWorker->mySliceOverrunCount.IncrementRelaxed();
+		uint64_t end = mg::box::GetMicroseconds();
+		aWorker->myStatRunTime.Add(end > start ? end - start : 0);
 		return true;
 	}
 
-	inline void
-	TaskScheduler::PrivWaitReady()
+	template<typename Policy>
+	uint64_t
+	TaskScheduler::PrivExecuteBatch(
+		TaskSchedulerThread* aWorker,
+		uint64_t aMaxCount)
 	{
-		mySignalReady.ReceiveBlocking();
+		uint64_t count = 0;
+		while (count < aMaxCount && PrivExecute<Policy>(aWorker->PrivPop(), aWorker))
+			++count;
+		return count;
 	}
 
-	inline void
-	TaskScheduler::PrivSignalReady()
+	bool
+	TaskScheduler::PrivPoolExecute(
+		TaskSchedulerThread* aWorker,
+		uint32_t aShare,
+		uint64_t& aInOutDeadline)
 	{
-		mySignalReady.Send();
+		MG_DEV_ASSERT(ourCurrent == nullptr && ourCurrentThread == nullptr);
+		ourCurrent = this;
+		ourCurrentThread = aWorker;
+		aWorker->myState.StoreRelaxed(TASK_SCHEDULER_WORKER_STATE_RUNNING);
+		uint64_t maxBatch = myExecBatchSize;
+		uint64_t batch = 0;
+		// The same as the worker's own loop, but limited by the share.
+		for (uint32_t i = 0; i < aShare; ++i)
+		{
+			if (PrivSchedule(false))
+			{
+				aWorker->myScheduleCount.IncrementRelaxed();
+				if (aWorker->myPoolDeadline < aInOutDeadline)
+					aInOutDeadline = aWorker->myPoolDeadline;
+			}
+			batch = (this->*myExecuteBatch)(aWorker, maxBatch);
+			aWorker->myExecuteCount.AddRelaxed(batch);
+			if (batch < maxBatch)
+				break;
+		}
+		bool isBusy = batch == maxBatch;
+		// The local tasks stay in the slot until the next turn. The admission slots
+		// must not be stuck in the cache of a thread being busy with other schedulers.
+		if (!isBusy)
+			PrivAdmitFlush(aWorker);
+		aWorker->myState.StoreRelaxed(TASK_SCHEDULER_WORKER_STATE_IDLE);
+		ourCurrent = nullptr;
+		ourCurrentThread = nullptr;
+		return isBusy;
 	}
 
-	TaskSchedulerThread::TaskSchedulerThread(
-		const char* aSchedulerName,
-		TaskScheduler* aScheduler)
-		: Thread(mg::box::StringFormat(
-			"mgsch.wrk%s", aSchedulerName).c_str())
-		, myScheduler(aScheduler)
-		, myState(TASK_SCHEDULER_WORKER_STATE_IDLE)
-		, myExecuteCount(0)
-		, myScheduleCount(0)
+	inline bool
+	TaskScheduler::PrivWaitReady()
 	{
-		myConsumer.Attach(&myScheduler->myQueueReady);
+		myIdleCount.Increment();
+		mg::box::Signal* signal = &mySignalReady;
+		if (myIsSchedDedicated)
+		{
+			// The sched-thread might have seen this worker busy and didn't wake it up.
+			// But then this worker sees the new tasks. The idle count is changed by both
+			// sides with read-modify-write, which orders them.
+			if (PrivReadyCount() > 0)
+			{
+				myIdleCount.Decrement();
+				return true;
+			}
+			signal = &ourCurrentThread->mySignalWake;
+		}
+		if (myMinThreadCount == myMaxThreadCount)
+		{
+			PrivWaitSignal(*signal, MG_TIME_INFINITE, false);
+			myIdleCount.Decrement();
+			return true;
+		}
+		uint64_t timeout = mg::box::TimeMsToUs(myThreadIdleTimeout);
+		uint64_t deadline = mg::box::GetMicroseconds() + timeout;
+		// The timed wait can return earlier than the timeout. Then wait more.
+		bool isReceived;
+		while (!(isReceived = PrivWaitSignal(*signal, timeout, false)))
+		{
+			uint64_t now = mg::box::GetMicroseconds();
+			if (now >= deadline)
+				break;
+			timeout = deadline - now;
+		}
+		myIdleCount.Decrement();
+		return isReceived || !PrivThreadTryRetire(ourCurrentThread);
 	}
 
-	inline TaskSchedulerWorkerState
-	TaskSchedulerThread::GetState() const
+	bool
+	TaskScheduler::PrivWaitSignal(
+		mg::box::Signal& aSignal,
+		uint64_t aTimeoutUs,
+		bool aIsHot)
 	{
-		return myState.LoadRelaxed();
+		TaskSchedulerThread* worker = ourCurrentThread;
+		MG_DEV_ASSERT(worker != nullptr && worker->myScheduler == this);
+		// Hot wait never goes to the kernel. Spinning lasts the whole timeout.
+		uint64_t spinUs = aIsHot ? aTimeoutUs : myIdleSpinUs;
+		if (spinUs > 0)
+		{
+			if (spinUs > aTimeoutUs)
+				spinUs = aTimeoutUs;
+			uint64_t startTime = mg::box::GetMicroseconds();
+			bool isReceived = aSignal.ReceiveSpin(spinUs, myIsIdleYield);
+			uint64_t spinTime = mg::box::GetMicroseconds() - startTime;
+			worker->mySpinTime.AddRelaxed(spinTime);
+			if (isReceived)
+			{
+				worker->mySpinWakeCount.IncrementRelaxed();
+				return true;
+			}
+			if (spinTime >= aTimeoutUs)
+				return false;
+			if (aTimeoutUs != MG_TIME_INFINITE)
+				aTimeoutUs -= spinTime;
+		}
+		bool isReceived = true;
+		if (aTimeoutUs == MG_TIME_INFINITE)
+			aSignal.ReceiveBlocking();
+		else
+			isReceived = aSignal.ReceiveTimedUs(aTimeoutUs);
+		worker->myWakeCount.IncrementRelaxed();
+		return isReceived;
 	}
 
 	void
-	TaskSchedulerThread::Run()
+	TaskScheduler::PrivThreadGrow()
+	{
+		// Is called by the sched-thread. Stop() can't happen meanwhile, because it
+		// needs the sched-role.
+		mg::box::MutexLock lock(myThreadsMutex);
+		MG_DEV_ASSERT(!myIsStopping);
+		uint32_t count = myThreadCount.LoadRelaxed();
+		if (count >= myMaxThreadCount)
+			return;
+		for (TaskSchedulerThread* t : myThreads)
+		{
+			if (t->myIsActive.LoadRelaxed())
+				continue;
+			// The slot might have a retired thread. It is already out of its main loop,
+			// so the join is quick.
+			t->PrivBlockingStop();
+			PrivSetThreadCount(count + 1);
+			t->PrivStart();
+			return;
+		}
+		MG_BOX_ASSERT(!"No free worker slot");
+	}
+
+	bool
+	TaskScheduler::PrivThreadTryRetire(
+		TaskSchedulerThread* aWorker)
+	{
+		mg::box::MutexLock lock(myThreadsMutex);
+		if (myIsStopping)
+			return false;
+		uint32_t count = myThreadCount.LoadRelaxed();
+		if (count <= myMinThreadCount)
+			return false;
+		MG_DEV_ASSERT(aWorker->myIsActive.LoadRelaxed());
+		aWorker->myIsActive.StoreRelaxed(false);
+		PrivSetThreadCount(count - 1);
+		return true;
+	}
+
+	void
+	TaskScheduler::PrivSetThreadCount(
+		uint32_t aCount)
+	{
+		// The batch size is read by the sched-thread without the lock. It is fine to
+		// see the old size for a while.
+		myThreadCount.StoreRelaxed(aCount);
+		mySchedBatchSize.StoreRelaxed(myExecBatchSize * (aCount > 0 ? aCount : 1));
+	}
+
+	inline void
+	TaskScheduler::PrivSignalFront()
+	{
+		TaskSchedulerPool* pool = myPool.LoadRelaxed();
+		if (pool != nullptr)
+			pool->PrivSignal();
+		else
+			mySignalFront.Send();
+	}
+
+	inline void
+	TaskScheduler::PrivSignalReady()
+	{
+		TaskSchedulerPool* pool = myPool.LoadRelaxed();
+		if (pool != nullptr)
+			pool->PrivSignal();
+		else if (myIsSchedDedicated)
+			PrivWakeWorkers(1);
+		else
+			mySignalReady.Send();
+	}
+
+	void
+	TaskScheduler::PrivWakeWorkers(
+		uint32_t aCount)
+	{
+		// Read-modify-write. Either this thread sees the worker idle, or the worker
+		// sees the tasks pushed before this call. See PrivWaitReady().
+		if (myIdleCount.FetchAddAcqRel(0) == 0)
+			return;
+		// The worker slots don't change between start and stop. The state is changed
+		// to running right here, so the same worker isn't woken up twice while the
+		// other ones keep sleeping.
+		for (TaskSchedulerThread* t : myThreads)
+		{
+			TaskSchedulerWorkerState old = TASK_SCHEDULER_WORKER_STATE_IDLE;
+			if (!t->myIsActive.LoadRelaxed() ||
+				!t->myState.CmpExchgStrongRelaxed(old,
+					TASK_SCHEDULER_WORKER_STATE_RUNNING))
+			{
+				continue;
+			}
+			t->mySignalWake.Send();
+			if (--aCount == 0)
+				return;
+		}
+	}
+
+	inline bool
+	TaskScheduler::PrivHasIdle()
+	{
+		TaskSchedulerPool* pool = myPool.LoadRelaxed();
+		if (pool != nullptr)
+			return pool->myIdleCount.Load() > 0;
+		return myIdleCount.Load() > 0;
+	}
+
+	bool
+	TaskScheduler::PrivShouldYield()
+	{
+		TaskSchedulerThread* worker = ourCurrentThread;
+		if (worker == nullptr)
+			return false;
+		return worker->PrivShouldYield();
+	}
+
+	void
+	TaskScheduler::StatSnapshot(
+		TaskSchedulerStat& aOutStat) const
+	{
+		// The worker slots are constant while the scheduler is running.
+		for (const TaskSchedulerThread* t : myThreads)
+			t->StatSnapshot(aOutStat);
+		if (mySchedThread != nullptr)
+			mySchedThread->StatSnapshot(aOutStat);
+		aOutStat.myFrontDepth = myStatFrontDepth.LoadRelaxed();
+		aOutStat.myPendingDepth = myStatPendingDepth.LoadRelaxed();
+		aOutStat.myWaitingDepth = myStatWaitingDepth.LoadRelaxed();
+		aOutStat.myReadyDepth = myStatReadyDepth.LoadRelaxed();
+		if (myClassCount == 1)
+			return;
+		aOutStat.myClassReadyDepth.assign(myClassCount, 0);
+		for (const TaskSchedulerNode* node : myNodes)
+		{
+			for (uint32_t i = 0; i < myClassCount; ++i)
+				aOutStat.myClassReadyDepth[i] += node->myQueuesReady[i]->Count();
+		}
+	}
+
+	uint32_t
+	TaskScheduler::PrivReadyCount()
+	{
+		uint32_t res = 0;
+		for (TaskSchedulerNode* node : myNodes)
+		{
+			for (TaskSchedulerQueueReady* queue : node->myQueuesReady)
+				res += queue->Count();
+		}
+		return res;
+	}
+
+	void
+	TaskScheduler::PrivPendingAppend(
+		Task* aFirst,
+		Task* aLast)
+	{
+		if (myClassCount == 1)
+		{
+			myQueuesPending[0].Append(aFirst, aLast);
+			return;
+		}
+		// The order within each class is kept.
+		Task* next;
+		for (Task* t = aFirst; t != nullptr; t = next)
+		{
+			next = t->myNext;
+			MG_BOX_ASSERT(t->myClass < myClassCount);
+			myQueuesPending[t->myClass].Append(t);
+		}
+	}
+
+	bool
+	TaskScheduler::PrivPendingIsEmpty() const
+	{
+		for (const TaskSchedulerQueuePending& pending : myQueuesPending)
+		{
+			if (!pending.IsEmpty())
+				return false;
+		}
+		return true;
+	}
+
+	inline TaskSchedulerQueueFront&
+	TaskScheduler::PrivFrontShard()
+	{
+		TaskSchedulerThread* worker = ourCurrentThread;
+		if (worker == nullptr || worker->myScheduler != this)
+			return myQueueFront;
+		return worker->myQueueFront;
+	}
+
+	inline TaskSchedulerQueueFront&
+	TaskScheduler::PrivFrontShard(
+		uint32_t aIndex)
+	{
+		// The worker slots don't change between start and stop, and both are done with
+		// the sched-role taken.
+		if (aIndex == 0)
+			return myQueueFront;
+		return myThreads[aIndex - 1]->myQueueFront;
+	}
+
+	inline uint32_t
+	TaskScheduler::PrivFrontShardCount() const
+	{
+		return (uint32_t)myThreads.size() + 1;
+	}
+
+	bool
+	TaskScheduler::PrivFrontIsEmpty()
+	{
+		uint32_t shardCount = PrivFrontShardCount();
+		for (uint32_t i = 0; i < shardCount; ++i)
+		{
+			if (!PrivFrontShard(i).IsEmpty())
+				return false;
+		}
+		return true;
+	}
+
+	void
+	TaskScheduler::PrivPostAdmitted(
+		Task* aTask)
+	{
+		MG_DEV_ASSERT(!aTask->myIsAdmitted);
+		aTask->myIsAdmitted = true;
+		Post(aTask);
+	}
+
+	uint32_t
+	TaskScheduler::PrivAdmitTakeFree(
+		uint32_t aCount)
+	{
+		uint32_t old = myAdmitFree.LoadRelaxed();
+		uint32_t count;
+		do
+		{
+			if (old == 0)
+				return 0;
+			count = std::min(old, aCount);
+		} while (!myAdmitFree.CmpExchgWeak(old, old - count));
+		if (myAdmitHasWatermarks && !myAdmitIsHigh.Load() &&
+			myAdmitCapacity - (old - count) >= myAdmitHighWatermark)
+		{
+			PrivAdmitCheckWatermarks();
+		}
+		return count;
+	}
+
+	bool
+	TaskScheduler::PrivAdmitTake()
+	{
+		TaskSchedulerThread* worker = ourCurrentThread;
+		if (worker == nullptr || worker->myScheduler != this)
+			return PrivAdmitTakeFree(1) == 1;
+		if (worker->myAdmitCredit > 0)
+		{
+			--worker->myAdmitCredit;
+			return true;
+		}
+		uint32_t count = PrivAdmitTakeFree(myAdmitChunk);
+		if (count == 0)
+			return false;
+		worker->myAdmitCredit = count - 1;
+		return true;
+	}
+
+	bool
+	TaskScheduler::PrivAdmitTakeOrEnqueue(
+		TaskSchedulerAdmitWaiter* aWaiter)
+	{
+		// The counter is incremented before the check. Then the thread freeing a slot
+		// either is seen by the check, or sees the counter and serves the waiter.
+		myAdmitWaitCount.Increment();
+		{
+			mg::box::MutexLock lock(myAdmitMutex);
+			// The newcomer can't overtake the waiters queued earlier.
+			if (!myAdmitWaiters.IsEmpty() || PrivAdmitTakeFree(1) == 0)
+			{
+				myAdmitWaiters.Append(aWaiter);
+				return false;
+			}
+		}
+		myAdmitWaitCount.Decrement();
+		return true;
+	}
+
+	void
+	TaskScheduler::PrivAdmitGive(
+		uint32_t aCount)
+	{
+		uint32_t free = myAdmitFree.AddFetch(aCount);
+		MG_DEV_ASSERT(free <= myAdmitCapacity);
+		if (myAdmitHasWatermarks && myAdmitIsHigh.Load() &&
+			myAdmitCapacity - free <= myAdmitLowWatermark)
+		{
+			PrivAdmitCheckWatermarks();
+		}
+		if (myAdmitWaitCount.Load() > 0)
+			PrivAdmitWakeup();
+	}
+
+	void
+	TaskScheduler::PrivAdmitRelease(
+		TaskSchedulerThread* aWorker)
+	{
+		// The slot stays in the worker's cache for its next posts. Only the slots above
+		// 2 chunks go back. Unless somebody waits, then all of them.
+		uint32_t credit = ++aWorker->myAdmitCredit;
+		if (credit <= 2 * myAdmitChunk && myAdmitWaitCount.LoadRelaxed() == 0)
+			return;
+		uint32_t keep = myAdmitWaitCount.LoadRelaxed() == 0 ? myAdmitChunk : 0;
+		aWorker->myAdmitCredit = keep;
+		PrivAdmitGive(credit - keep);
+	}
+
+	void
+	TaskScheduler::PrivAdmitFlush(
+		TaskSchedulerThread* aWorker)
+	{
+		uint32_t credit = aWorker->myAdmitCredit;
+		if (credit == 0)
+			return;
+		aWorker->myAdmitCredit = 0;
+		PrivAdmitGive(credit);
+	}
+
+	void
+	TaskScheduler::PrivAdmitWakeup()
+	{
+		TaskSchedulerAdmitWaiterList ready;
+		{
+			mg::box::MutexLock lock(myAdmitMutex);
+			while (!myAdmitWaiters.IsEmpty() && PrivAdmitTakeFree(1) == 1)
+				ready.Append(myAdmitWaiters.PopFirst());
+		}
+		while (!ready.IsEmpty())
+		{
+			TaskSchedulerAdmitWaiter* waiter = ready.PopFirst();
+			Task* waiterTask = waiter->myWaiterTask;
+			mg::box::Signal* waiterSignal = waiter->myWaiterSignal;
+			myAdmitWaitCount.Decrement();
+			PrivPostAdmitted(waiter->myTask);
+			// The waiter can be gone right after the wakeup.
+			if (waiterTask != nullptr)
+				waiterTask->PostSignal();
+			else
+				waiterSignal->Send();
+		}
+	}
+
+	void
+	TaskScheduler::PrivAdmitCheckWatermarks()
+	{
+		mg::box::MutexLock lock(myAdmitWatermarkMutex);
+		// The count could change while the flag was being changed, and the thread which
+		// changed it could see the old flag. So the count is checked again after each
+		// change of the flag.
+		while (true)
+		{
+			uint32_t count = myAdmitCapacity - myAdmitFree.Load();
+			if (!myAdmitIsHigh.LoadRelaxed())
+			{
+				if (count < myAdmitHighWatermark)
+					return;
+				myAdmitIsHigh.Store(true);
+				if (myOnAdmitHigh)
+					myOnAdmitHigh();
+				continue;
+			}
+			if (count > myAdmitLowWatermark)
+				return;
+			myAdmitIsHigh.Store(false);
+			if (myOnAdmitLow)
+				myOnAdmitLow();
+		}
+	}
+
+	uint32_t
+	TaskScheduler::PrivParallelHelperCount(
+		uint64_t aCount,
+		uint64_t aGrain,
+		bool aIsInline)
+	{
+		uint64_t chunkCount = (aCount + aGrain - 1) / aGrain;
+		uint64_t res = myThreadCount.LoadRelaxed();
+		if (aIsInline)
+		{
+			// The caller takes one chunk. And if it is a worker, it is busy with the
+			// loop.
+			--chunkCount;
+			TaskSchedulerThread* worker = ourCurrentThread;
+			if (worker != nullptr && worker->myScheduler == this && res > 0)
+				--res;
+		}
+		if (res > chunkCount)
+			res = chunkCount;
+		// Async loop must have at least one executor.
+		if (!aIsInline && res == 0)
+			res = 1;
+		return (uint32_t)res;
+	}
+
+	//////////////////////////////////////////////////////////////////////////////////////
+
+	TaskParallelFor::TaskParallelFor(
+		TaskScheduler* aScheduler,
+		uint64_t aBegin,
+		uint64_t aEnd,
+		uint64_t aGrain,
+		uint32_t aParticipantCount)
+		: myNext(aBegin)
+		, myDoneCount(0)
+		, myRefCount(0)
+		, myEnd(aEnd)
+		, myTotal(aEnd - aBegin)
+		, myGrain(aGrain)
+		, myParticipantCount(aParticipantCount)
+		, myScheduler(aScheduler)
+		, myCallback(nullptr)
+		, myDoneTask(nullptr)
+	{
+	}
+
+	bool
+	TaskParallelFor::Claim(
+		uint64_t& aOutBegin,
+		uint64_t& aOutEnd)
+	{
+		uint64_t next = myNext.LoadRelaxed();
+		while (next < myEnd)
+		{
+			// Guided chunking. The first chunks are big, so there are few claims. The
+			// last ones are small, so the participants finish at about the same time.
+			uint64_t left = myEnd - next;
+			uint64_t size = left / (myParticipantCount * 2);
+			if (size < myGrain)
+				size = myGrain;
+			if (size > left)
+				size = left;
+			if (myNext.CmpExchgWeakRelaxed(next, next + size))
+			{
+				aOutBegin = next;
+				aOutEnd = next + size;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void
+	TaskParallelFor::Run()
+	{
+		uint64_t begin;
+		uint64_t end;
+		while (Claim(begin, end))
+		{
+			(*myCallback)(begin, end);
+			uint64_t size = end - begin;
+			if (myDoneCount.FetchAddAcqRel(size) + size != myTotal)
+				continue;
+			// Done. The participant still holds a reference, so the state is alive
+			// even if the caller returns right away.
+			if (myDoneTask != nullptr)
+				myScheduler->Post(myDoneTask);
+			else
+				mySignal.Send();
+		}
+	}
+
+	void
+	TaskParallelFor::Unref()
+	{
+		if (myRefCount.DecrementFetchAcqRel() == 0)
+			delete this;
+	}
+
+	//////////////////////////////////////////////////////////////////////////////////////
+
+	TaskSchedulerNode::TaskSchedulerNode(
+		uint32_t aSubQueueSize,
+		uint32_t aClassCount)
+	{
+		myQueuesReady.reserve(aClassCount);
+		for (uint32_t i = 0; i < aClassCount; ++i)
+			myQueuesReady.push_back(new TaskSchedulerQueueReady(aSubQueueSize));
+	}
+
+	TaskSchedulerNode::~TaskSchedulerNode()
+	{
+		for (TaskSchedulerQueueReady* queue : myQueuesReady)
+			delete queue;
+	}
+
+	TaskSchedulerThread::TaskSchedulerThread(
+		const char* aSchedulerName,
+		TaskScheduler* aScheduler,
+		uint32_t aNodeIndex,
+		bool aIsSched)
+		: myScheduler(aScheduler)
+		, myThread(nullptr)
+		, myIsActive(false)
+		, myName(mg::box::StringFormat(aIsSched ? "mgsch.sch%s" : "mgsch.wrk%s",
+			aSchedulerName))
+		, myNodeIndex(aNodeIndex)
+		, myIsSched(aIsSched)
+		, myState(TASK_SCHEDULER_WORKER_STATE_IDLE)
+		, myClassPos(0)
+		, myNextTask(nullptr)
+		, myQueueLocal(theTaskSchedulerLocalQueueSize)
+		, myLocalStreak(0)
+		, myLifoStreak(0)
+		, myStealIndex(0)
+		, myExecuteCount(0)
+		, myScheduleCount(0)
+		, myStealCount(0)
+		, mySpinTime(0)
+		, mySpinWakeCount(0)
+		, myWakeCount(0)
+		, myNodeStealCount(0)
+		, mySliceOverrunCount(0)
+		// The per-class counters are not needed when everything is one class.
+		, myClassExecuteCount(aScheduler->myClassCount > 1 ?
+			aScheduler->myClassCount : 0)
+		, myStatClassReadyDelay(aScheduler->myIsStatEnabled &&
+			aScheduler->myClassCount > 1 ? aScheduler->myClassCount : 0)
+		, myAdmitCredit(0)
+		, mySliceEnd(MG_TIME_INFINITE)
+		, myJoinDepth(0)
+		, myPoolDeadline(MG_TIME_INFINITE)
+	{
+		const std::vector<TaskSchedulerNode*>& nodes = myScheduler->myNodes;
+		uint32_t nodeCount = (uint32_t)nodes.size();
+		MG_BOX_ASSERT(myNodeIndex < nodeCount);
+		// The sched-thread never pops. An idle consumer would keep the consumed
+		// sub-queues of the ready queues alive.
+		if (myIsSched)
+			return;
+		uint32_t classCount = myScheduler->myClassCount;
+		myConsumers.reserve(classCount);
+		for (TaskSchedulerQueueReady* queue : nodes[myNodeIndex]->myQueuesReady)
+		{
+			TaskSchedulerQueueReadyConsumer* c = new TaskSchedulerQueueReadyConsumer();
+			c->Attach(queue);
+			myConsumers.push_back(c);
+		}
+		// The workers of different nodes steal from the other nodes in different order.
+		// Then a loaded node doesn't get all the other nodes on it at once.
+		myNodeConsumers.reserve((nodeCount - 1) * classCount);
+		for (uint32_t i = 1; i < nodeCount; ++i)
+		{
+			TaskSchedulerNode* node = nodes[(myNodeIndex + i) % nodeCount];
+			for (uint32_t cls : myScheduler->myClassByWeight)
+			{
+				TaskSchedulerQueueReadyConsumer* c =
+					new TaskSchedulerQueueReadyConsumer();
+				c->Attach(node->myQueuesReady[cls]);
+				myNodeConsumers.push_back(c);
+			}
+		}
+	}
+
+	TaskSchedulerThread::~TaskSchedulerThread()
+	{
+		MG_BOX_ASSERT(myThread == nullptr);
+		MG_BOX_ASSERT(!PrivHasLocal());
+		for (TaskSchedulerQueueReadyConsumer* c : myConsumers)
+			delete c;
+		for (TaskSchedulerQueueReadyConsumer* c : myNodeConsumers)
+			delete c;
+	}
+
+	inline TaskSchedulerWorkerState
+	TaskSchedulerThread::GetState() const
+	{
+		return myState.LoadRelaxed();
+	}
+
+	void
+	TaskSchedulerThread::StatSnapshot(
+		TaskSchedulerStat& aOutStat) const
+	{
+		aOutStat.myReadyDelay.Merge(myStatReadyDelay);
+		aOutStat.myLateness.Merge(myStatLateness);
+		aOutStat.myRunTime.Merge(myStatRunTime);
+		aOutStat.mySchedHoldTime.Merge(myStatSchedHoldTime);
+		uint32_t classCount = (uint32_t)myStatClassReadyDelay.size();
+		if (classCount == 0)
+			return;
+		std::vector<mg::box::Histogram>& outDelay = aOutStat.myClassReadyDelay;
+		if (outDelay.size() != classCount)
+		{
+			// The histograms can't be moved, so the vector is rebuilt.
+			std::vector<mg::box::Histogram> delay(classCount);
+			for (uint32_t i = 0; i < classCount && i < outDelay.size(); ++i)
+				delay[i].Merge(outDelay[i]);
+			outDelay.swap(delay);
+		}
+		for (uint32_t i = 0; i < classCount; ++i)
+			outDelay[i].Merge(myStatClassReadyDelay[i]);
+	}
+
+	bool
+	TaskSchedulerThread::IsRunning() const
+	{
+		return myIsActive.LoadRelaxed();
+	}
+
+	void
+	TaskSchedulerThread::PrivStart()
+	{
+		MG_BOX_ASSERT(myThread == nullptr);
+		MG_BOX_ASSERT(!myIsActive.LoadRelaxed());
+		myIsActive.StoreRelaxed(true);
+		if (myIsSched)
+			myThread = new mg::box::ThreadFunc(myName.c_str(), [this]() { RunSched(); });
+		else
+			myThread = new mg::box::ThreadFunc(myName.c_str(), [this]() { Run(); });
+		const std::vector<uint32_t>& cpus = myScheduler->myNodes[myNodeIndex]->myCPUs;
+		if (!cpus.empty())
+			myThread->SetAffinity(cpus);
+		myThread->Start();
+	}
+
+	void
+	TaskSchedulerThread::PrivStop()
+	{
+		if (myThread != nullptr)
+			myThread->Stop();
+	}
+
+	void
+	TaskSchedulerThread::PrivBlockingStop()
+	{
+		if (myThread == nullptr)
+			return;
+		myThread->BlockingStop();
+		delete myThread;
+		myThread = nullptr;
+		myIsActive.StoreRelaxed(false);
+	}
+
+	void
+	TaskSchedulerThread::Run()
 	{
 		TaskScheduler::ourCurrent = myScheduler;
+		TaskScheduler::ourCurrentThread = this;
 		uint64_t maxBatch = myScheduler->myExecBatchSize;
 		uint64_t batch;
-		while (!StopRequested())
+		while (!myThread->StopRequested())
 		{
 			myState.StoreRelaxed(TASK_SCHEDULER_WORKER_STATE_RUNNING);
 			do
 			{
-				if (myScheduler->PrivSchedule())
+				// The sched can't sleep on the front queue while this worker has own
+				// tasks. Nobody else is obliged to execute them.
+				if (!myScheduler->myIsSchedDedicated &&
+					myScheduler->PrivSchedule(!PrivHasLocal()))
+				{
 					myScheduleCount.IncrementRelaxed();
-				batch = 0;
-				while (myScheduler->PrivExecute(myConsumer.Pop()) && ++batch < maxBatch);
+				}
+				batch = (myScheduler->*myScheduler->myExecuteBatch)(this, maxBatch);
 				myExecuteCount.AddRelaxed(batch);
 			} while (batch == maxBatch);
 			MG_DEV_ASSERT(batch < maxBatch);
+			// The cached admission slots must not be stuck with an idle worker.
+			myScheduler->PrivAdmitFlush(this);
 			myState.StoreRelaxed(TASK_SCHEDULER_WORKER_STATE_IDLE);
-			myScheduler->PrivWaitReady();
+			if (!myScheduler->PrivWaitReady())
+				break;
 		}
+		// Normally the local tasks are all executed before the worker goes idle. But
+		// still the stop or the retirement must not lose anything.
+		Task* t;
+		while ((t = PrivPopLocal()) != nullptr)
+			myScheduler->PrivPost(t);
+		myScheduler->PrivAdmitFlush(this);
 		myState.StoreRelaxed(TASK_SCHEDULER_WORKER_STATE_IDLE);
 		myScheduler->PrivSignalReady();
 		MG_BOX_ASSERT(TaskScheduler::ourCurrent == myScheduler);
+		MG_BOX_ASSERT(TaskScheduler::ourCurrentThread == this);
 		TaskScheduler::ourCurrent = nullptr;
+		TaskScheduler::ourCurrentThread = nullptr;
+	}
+
+	void
+	TaskSchedulerThread::RunSched()
+	{
+		TaskScheduler::ourCurrent = myScheduler;
+		TaskScheduler::ourCurrentThread = this;
+		myState.StoreRelaxed(TASK_SCHEDULER_WORKER_STATE_RUNNING);
+		while (!myThread->StopRequested())
+		{
+			// Whoever else needs the role, like IsEmpty() or Stop(), interrupts the
+			// sleep and takes the role for a moment.
+			myScheduler->PrivSchedulerLock();
+			MG_TRACE(SCHED_ENTER, myScheduler);
+			(myScheduler->*myScheduler->myScheduleRound)(true);
+			MG_TRACE(SCHED_EXIT, myScheduler);
+			myScheduler->PrivSchedulerUnlock();
+			myScheduleCount.IncrementRelaxed();
+		}
+		myState.StoreRelaxed(TASK_SCHEDULER_WORKER_STATE_IDLE);
+		MG_BOX_ASSERT(TaskScheduler::ourCurrent == myScheduler);
+		MG_BOX_ASSERT(TaskScheduler::ourCurrentThread == this);
+		TaskScheduler::ourCurrent = nullptr;
+		TaskScheduler::ourCurrentThread = nullptr;
+	}
+
+	void
+	TaskSchedulerThread::PrivPostLocal(
+		Task* aTask)
+	{
+		MG_DEV_ASSERT(aTask->myScheduler == myScheduler);
+		MG_DEV_ASSERT(aTask->myIndex == -1);
+		// The task doesn't have a deadline, so is ready right away. Its status stays
+		// as is. Pending means the same as ready for a task which is never going to
+		// the waiting queue.
+		aTask->myIsExpired = true;
+		// The newest task goes to the LIFO slot. The one which was there before is moved
+		// to the local queue.
+		aTask = myNextTask.ExchangeAcqRel(aTask);
+		if (aTask != nullptr && !myQueueLocal.Push(aTask))
+		{
+			// The local queue is full. The task can't stay with this worker, but the
+			// other workers might pick it up from the front queue.
+			myScheduler->PrivPost(aTask);
+		}
+		if (myScheduler->PrivHasIdle())
+		{
+			// Somebody has nothing to do. Let it steal.
+			myScheduler->PrivSignalReady();
+			myScheduler->PrivSignalFront();
+		}
+	}
+
+	Task*
+	TaskSchedulerThread::PrivPop()
+	{
+		Task* res;
+		if (myScheduler->myQueueMode != TASK_SCHEDULER_QUEUE_MODE_LOCAL)
+		{
+			res = PrivPopShared();
+			if (res != nullptr)
+				return res;
+			return PrivStealNode();
+		}
+
+		if (++myLocalStreak >= theTaskSchedulerLocalStreakMax)
+		{
+			myLocalStreak = 0;
+			res = PrivPopShared();
+			if (res != nullptr)
+				return res;
+		}
+		res = PrivPopLocal();
+		if (res != nullptr)
+			return res;
+		myLocalStreak = 0;
+		res = PrivPopShared();
+		if (res != nullptr)
+			return res;
+		// The other nodes' ready tasks might have nobody to execute them. While the
+		// other workers' local tasks will be executed by their owners anyway.
+		res = PrivStealNode();
+		if (res != nullptr)
+			return res;
+		return PrivSteal();
+	}
+
+	Task*
+	TaskSchedulerThread::PrivPopShared()
+	{
+		if (myConsumers.size() == 1)
+			return myConsumers[0]->Pop();
+		// The class having the turn goes first. If it has nothing, then the others are
+		// tried from the heaviest one. So a worker never idles while any class has
+		// ready tasks.
+		const std::vector<uint32_t>& order = myScheduler->myClassOrder;
+		uint32_t cls = order[myClassPos];
+		if (++myClassPos == order.size())
+			myClassPos = 0;
+		Task* res = myConsumers[cls]->Pop();
+		if (res != nullptr)
+			return res;
+		for (uint32_t i : myScheduler->myClassByWeight)
+		{
+			if (i == cls)
+				continue;
+			res = myConsumers[i]->Pop();
+			if (res != nullptr)
+				return res;
+		}
+		return nullptr;
+	}
+
+	Task*
+	TaskSchedulerThread::PrivPopLocal()
+	{
+		Task* res;
+		if (myLifoStreak < theTaskSchedulerLifoStreakMax)
+		{
+			// Exchange, because the other workers might be stealing the task.
+			if (myNextTask.LoadRelaxed() != nullptr)
+			{
+				res = myNextTask.ExchangeAcqRel(nullptr);
+				if (res != nullptr)
+				{
+					++myLifoStreak;
+					return res;
+				}
+			}
+		}
+		myLifoStreak = 0;
+		res = myQueueLocal.Pop();
+		if (res != nullptr)
+			return res;
+		if (myNextTask.LoadRelaxed() == nullptr)
+			return nullptr;
+		return myNextTask.ExchangeAcqRel(nullptr);
+	}
+
+	Task*
+	TaskSchedulerThread::PrivSteal()
+	{
+		const std::vector<TaskSchedulerThread*>& threads = myScheduler->myThreads;
+		uint32_t count = (uint32_t)threads.size();
+		if (count < 2)
+			return nullptr;
+		Task* res;
+		// The local queues first. A half of the victim's queue is taken, so the next
+		// tasks are found locally and there is no need to steal again so soon.
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			TaskSchedulerThread* victim = threads[(myStealIndex + i) % count];
+			if (victim == this || victim->myQueueLocal.IsEmpty())
+				continue;
+			res = victim->myQueueLocal.StealHalf(myQueueLocal);
+			if (res != nullptr)
+			{
+				myStealIndex = (myStealIndex + i + 1) % count;
+				myStealCount.IncrementRelaxed();
+				return res;
+			}
+		}
+		// The LIFO slots are taken only as a last resort. A task there was just posted
+		// and most likely its owner is going to execute it very soon, with hot cache.
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			TaskSchedulerThread* victim = threads[(myStealIndex + i) % count];
+			if (victim == this || victim->myNextTask.LoadRelaxed() == nullptr)
+				continue;
+			res = victim->myNextTask.ExchangeAcqRel(nullptr);
+			if (res != nullptr)
+			{
+				myStealIndex = (myStealIndex + i + 1) % count;
+				myStealCount.IncrementRelaxed();
+				return res;
+			}
+		}
+		return nullptr;
+	}
+
+	Task*
+	TaskSchedulerThread::PrivStealNode()
+	{
+		Task* res;
+		for (TaskSchedulerQueueReadyConsumer* c : myNodeConsumers)
+		{
+			res = c->Pop();
+			if (res != nullptr)
+			{
+				myNodeStealCount.IncrementRelaxed();
+				return res;
+			}
+		}
+		return nullptr;
+	}
+
+	bool
+	TaskSchedulerThread::PrivHasLocal() const
+	{
+		return myNextTask.LoadRelaxed() != nullptr || !myQueueLocal.IsEmpty();
+	}
+
+	bool
+	TaskSchedulerThread::PrivShouldYield() const
+	{
+		// The clock is checked first. It is the cheapest, and most of the calls are
+		// expected to be within the slice.
+		if (mg::box::GetTicks() <= mySliceEnd)
+			return false;
+		// No sense to yield if nobody is waiting. The pending tasks are not visible
+		// outside of the sched-role, but they become ready soon anyway. Then the task
+		// yields on the next check.
+		return PrivHasLocal() || myScheduler->PrivReadyCount() > 0 ||
+			!myScheduler->PrivFrontIsEmpty();
+	}
+
+	TaskSchedulerPool::TaskSchedulerPool(
+		const char* aName)
+		: myVersion(0)
+		, myIdleCount(0)
+		, myName(aName)
+	{
+	}
+
+	TaskSchedulerPool::~TaskSchedulerPool()
+	{
+		Stop();
+	}
+
+	void
+	TaskSchedulerPool::Start(
+		uint32_t aThreadCount)
+	{
+		MG_BOX_ASSERT(aThreadCount > 0);
+		MG_BOX_ASSERT(myThreads.empty());
+		myThreads.reserve(aThreadCount);
+		for (uint32_t i = 0; i < aThreadCount; ++i)
+			myThreads.push_back(new TaskSchedulerPoolThread(myName.c_str(), this, i));
+		for (TaskSchedulerPoolThread* t : myThreads)
+			t->myThread->Start();
+	}
+
+	void
+	TaskSchedulerPool::Stop()
+	{
+		myMutex.Lock();
+		MG_BOX_ASSERT(myEntries.empty());
+		myMutex.Unlock();
+		for (TaskSchedulerPoolThread* t : myThreads)
+			t->myThread->Stop();
+		// The signal wakes up only one thread. The others are woken up in a chain, each
+		// by the previous one leaving.
+		mySignal.Send();
+		for (TaskSchedulerPoolThread* t : myThreads)
+			delete t;
+		myThreads.clear();
+	}
+
+	void
+	TaskSchedulerPool::PrivAttach(
+		TaskScheduler* aScheduler,
+		uint32_t aShare)
+	{
+		myMutex.Lock();
+		MG_BOX_ASSERT(!myThreads.empty());
+		TaskSchedulerPoolEntry entry;
+		entry.myScheduler = aScheduler;
+		entry.myShare = aShare;
+		myEntries.push_back(entry);
+		myVersion.IncrementRelaxed();
+		myMutex.Unlock();
+		// The scheduler might have the tasks posted before the start.
+		PrivSignal();
+	}
+
+	void
+	TaskSchedulerPool::PrivDetach(
+		TaskScheduler* aScheduler)
+	{
+		myMutex.Lock();
+		bool isFound = false;
+		for (auto it = myEntries.begin(); it != myEntries.end(); ++it)
+		{
+			if (it->myScheduler == aScheduler)
+			{
+				myEntries.erase(it);
+				isFound = true;
+				break;
+			}
+		}
+		MG_BOX_ASSERT(isFound);
+		myVersion.IncrementRelaxed();
+		myMutex.Unlock();
+		// A thread holds its mutex while it is inside of the schedulers. When the mutex
+		// is taken next time, the thread is guaranteed to see the new version.
+		for (TaskSchedulerPoolThread* t : myThreads)
+		{
+			t->myMutex.Lock();
+			t->myMutex.Unlock();
+		}
+	}
+
+	void
+	TaskSchedulerPool::PrivSignal()
+	{
+		mySignal.Send();
+	}
+
+	TaskSchedulerPoolThread::TaskSchedulerPoolThread(
+		const char* aPoolName,
+		TaskSchedulerPool* aPool,
+		uint32_t aIndex)
+		: myPool(aPool)
+		, myThread(nullptr)
+		, myIndex(aIndex)
+	{
+		myThread = new mg::box::ThreadFunc(
+			mg::box::StringFormat("mgsch.pool%s", aPoolName).c_str(),
+			[this]() { Run(); });
+	}
+
+	TaskSchedulerPoolThread::~TaskSchedulerPoolThread()
+	{
+		myThread->BlockingStop();
+		delete myThread;
+	}
+
+	void
+	TaskSchedulerPoolThread::Run()
+	{
+		// Own copy of the scheduler list. The pool's list is locked only when changes.
+		std::vector<TaskSchedulerPoolEntry> entries;
+		uint32_t version = 0;
+		while (!myThread->StopRequested())
+		{
+			uint64_t deadline = MG_TIME_INFINITE;
+			bool isBusy = false;
+			myMutex.Lock();
+			if (myPool->myVersion.LoadRelaxed() != version)
+			{
+				myPool->myMutex.Lock();
+				entries = myPool->myEntries;
+				version = myPool->myVersion.LoadRelaxed();
+				myPool->myMutex.Unlock();
+			}
+			for (const TaskSchedulerPoolEntry& e : entries)
+			{
+				TaskScheduler* sched = e.myScheduler;
+				if (sched->PrivPoolExecute(sched->myThreads[myIndex], e.myShare,
+					deadline))
+				{
+					isBusy = true;
+				}
+			}
+			myMutex.Unlock();
+			if (isBusy)
+				continue;
+			// Nothing to do in any of the schedulers. The new tasks wake the thread up
+			// via the pool signal, and the waiting ones expire not earlier than the
+			// deadline.
+			uint64_t timeout = MG_TIME_INFINITE;
+			if (deadline != MG_TIME_INFINITE)
+			{
+				uint64_t now = mg::box::GetMicroseconds();
+				if (deadline <= now)
+					continue;
+				timeout = deadline - now;
+			}
+			myPool->myIdleCount.Increment();
+			if (timeout == MG_TIME_INFINITE)
+				myPool->mySignal.ReceiveBlocking();
+			else
+				myPool->mySignal.ReceiveTimedUs(timeout);
+			myPool->myIdleCount.Decrement();
+		}
+		// Wake up the next thread to see the stop.
+		myPool->mySignal.Send();
 	}
 
 	void
 	TaskOneShot::Execute(
 		Task* aTask)
 	{
-		MG_DEV_ASSERT(aTask == this);
-		myCallback();
-		delete this;
+		TaskOneShot* self = static_cast<TaskOneShot*>(aTask);
+		self->myCallback();
+		delete self;
+	}
+
+	//////////////////////////////////////////////////////////////////////////////////////
+
+#if MG_CORO_IS_ENABLED
+	TaskCoroOpPostWithBackpressure::TaskCoroOpPostWithBackpressure(
+		TaskScheduler& aSched,
+		Task* aSelf,
+		Task* aTask)
+		: mySched(aSched)
+	{
+		myWaiter.myTask = aTask;
+		myWaiter.myWaiterTask = aSelf;
+		myWaiter.myWaiterSignal = nullptr;
+		myWaiter.myNext = nullptr;
+	}
+
+	bool
+	TaskCoroOpPostWithBackpressure::await_ready() noexcept
+	{
+		return mySched.TryPost(myWaiter.myTask);
+	}
+
+	bool
+	TaskCoroOpPostWithBackpressure::await_suspend(
+		mg::box::CoroHandle) noexcept
+	{
+		if (mySched.PrivAdmitTakeOrEnqueue(&myWaiter))
+		{
+			mySched.PrivPostAdmitted(myWaiter.myTask);
+			return false;
+		}
+		TaskCoroSyncWait(myWaiter.myWaiterTask);
+		return true;
 	}
+#endif
 
 }
 }
@@ -1,15 +1,23 @@
 #pragma once
 
-#include "mg/box/BinaryHeap.h"
 #include "mg/box/ForwardList.h"
+#include "mg/box/Histogram.h"
 #include "mg/box/InterruptibleMutex.h"
 #include "mg/box/MultiConsumerQueue.h"
 #include "mg/box/MultiProducerQueueIntrusive.h"
+#include "mg/box/Mutex.h"
+#include "mg/box/PeriodicTimingWheel.h"
 #include "mg/box/Signal.h"
+#include "mg/box/Sysinfo.h"
 #include "mg/box/Thread.h"
+#include "mg/box/ThreadFunc.h"
+#include "mg/box/ThreadLocalPool.h"
+#include "mg/box/WorkStealingQueue.h"
 
 #include "mg/sch/Task.h"
 
+#include <functional>
+#include <initializer_list>
 #include <vector>
 
 namespace mg {
@@ -19,13 +27,17 @@ namespace sch {
 	// threads. So it is multi-producer. It is dispatched by
 	// sched-thread only, so it is single-consumer. Each task goes
 	// firstly to the front queue.
+	// The front queue is split into shards. Each worker posts into its own shard, and
+	// all the external threads share one more. So the producers don't fight for a
+	// single cache line, and the tasks of each producer stay in FIFO order.
 	using TaskSchedulerQueueFront = mg::box::MultiProducerQueueIntrusive<Task>;
 	// Waiting queue is only used by one worker thread at a time,
 	// so it has no concurrent access and is therefore not
 	// protected with a lock. Tasks move from the front queue to
 	// the waiting queue only if they have a deadline in the
-	// future.
-	using TaskSchedulerQueueWaiting = mg::box::BinaryHeapMinIntrusive<Task>;
+	// future. It is a timing wheel, so adding and removing of a
+	// task is O(1) regardless of how many tasks are waiting.
+	using TaskSchedulerQueueWaiting = mg::box::PeriodicTimingWheel<Task>;
 	// Ready queue is populated only by the sched-thread and
 	// consumed by all workers when dispatching tasks. Tasks move
 	// to the ready queue from either the front queue if a task is
@@ -39,16 +51,209 @@ namespace sch {
 	// for processing in pieces of a limited size. It is accessed only by the
 	// sched-thread.
 	using TaskSchedulerQueuePending = mg::box::ForwardList<Task>;
+	// Local queue belongs to a single worker thread. Only this worker pushes into it.
+	// Tasks get there when they are posted by the worker itself without a deadline.
+	// Popped by the owner, and stolen by the other workers when they have nothing to do.
+	using TaskSchedulerQueueLocal = mg::box::WorkStealingQueue<Task>;
 
 	// Special type to post callbacks not bound to a task. The
-	// scheduler creates tasks for them inside. Keep in mind, that
-	// **it is not free**, as the scheduler will need to allocate
-	// the task object on its own, and it adds +1 virtual call,
-	// because the one-shot callback is called via a normal task
-	// callback. Avoid it for all perf-critical code.
-	using TaskCallbackOneShot = std::function<void(void)>;
+	// scheduler creates tasks for them inside. The task objects
+	// are taken from a thread-local pool, and the callback is
+	// stored inside of the task. So in a steady state there is no
+	// heap usage. A callback not fitting into the task is wrapped
+	// into std::function, which costs one heap allocation. Keep
+	// in mind, that it still adds +1 indirect call, because the
+	// one-shot callback is called via a normal task callback.
+	using TaskCallbackOneShot = mg::box::InlineFunction<void(void),
+		theTaskCallbackCapacity>;
 
+	class TaskSchedulerPool;
+	class TaskSchedulerPoolThread;
 	class TaskSchedulerThread;
+	struct TaskSchedulerNode;
+
+	// Poster waiting for an admission slot in a scheduler with a limit. When a slot is
+	// free, it is given to the first waiter, the task is posted, and the waiter is
+	// woken up.
+	struct TaskSchedulerAdmitWaiter
+	{
+		Task* myTask;
+		// Either a task waiting for the signal, or a thread waiting on the signal object.
+		Task* myWaiterTask;
+		mg::box::Signal* myWaiterSignal;
+		TaskSchedulerAdmitWaiter* myNext;
+	};
+
+	using TaskSchedulerAdmitWaiterList = mg::box::ForwardList<TaskSchedulerAdmitWaiter>;
+
+#if MG_CORO_IS_ENABLED
+	//////////////////////////////////////////////////////////////////////////////////////
+	// C++20 coroutine operations.
+
+	struct TaskCoroOpPostWithBackpressure
+		: public mg::box::CoroOp
+		, public mg::box::CoroOpIsEmptyReturn
+	{
+		TaskCoroOpPostWithBackpressure(
+			TaskScheduler& aSched,
+			Task* aSelf,
+			Task* aTask);
+		bool await_ready() noexcept;
+		bool await_suspend(
+			mg::box::CoroHandle aThisCoro) noexcept;
+
+	private:
+		TaskScheduler& mySched;
+		TaskSchedulerAdmitWaiter myWaiter;
+	};
+
+	//////////////////////////////////////////////////////////////////////////////////////
+#endif
+
+	enum TaskSchedulerQueueMode
+	{
+		// All tasks go through the front queue and the sched-thread before they are
+		// executed. Each task is dispatched to the shared ready queue.
+		TASK_SCHEDULER_QUEUE_MODE_SHARED,
+		// Tasks posted from a worker thread without a deadline skip the front queue and
+		// the sched-thread. They go to the worker's local queue and are executed by the
+		// same worker, unless the other workers are idle and steal them. The last posted
+		// task is executed first, in a LIFO order, to keep its data hot in the cache.
+		TASK_SCHEDULER_QUEUE_MODE_LOCAL,
+	};
+
+	struct TaskSchedulerParams
+	{
+		TaskSchedulerParams();
+
+		TaskSchedulerQueueMode myQueueMode;
+		// Allow to execute the tasks with deadlines later than the deadlines, but not
+		// more than by this number of milliseconds. Is converted to microseconds and
+		// rounded down to a power of 2.
+		// Tasks with close deadlines are then expired together, in batches, which makes
+		// the waiting queue cheaper and reduces the sched-thread wakeups. 0 = precise.
+		uint32_t myTimerSlack;
+		// An idle worker spins for this many microseconds checking for new tasks before
+		// going to sleep in the kernel. Spinning burns CPU, but a task arriving during
+		// the spin is picked up without a wakeup and a context switch. 0 = sleep right
+		// away.
+		uint32_t myIdleSpinUs;
+		// Give the CPU to other threads on each spin iteration. Makes the spinning
+		// cheaper when the cores are oversubscribed, but adds a syscall to each
+		// iteration.
+		bool myIsIdleYield;
+		// The sched-thread never sleeps in the kernel. It spins until the next task
+		// deadline or until new tasks arrive. So when there is at least one idle worker,
+		// it is hot and picks up new tasks right away. It costs one CPU core being busy
+		// all the time.
+		bool myIsLatencyCritical;
+		// The sched-role is owned by one more thread, which does nothing else. The
+		// workers never schedule. They only execute the tasks, and are woken up by the
+		// sched-thread one by one, each via its own signal, as many as there are new
+		// ready tasks. So the expired deadlines and the new tasks are dispatched even
+		// when all the workers are busy with long tasks. Together with the latency
+		// critical mode the sched-thread busy-polls the queues. Can't be used with a
+		// pool.
+		bool myIsSchedDedicated;
+		// Elastic scheduler retires a worker above the minimal count when it was idle
+		// for this many milliseconds.
+		uint32_t myThreadIdleTimeout;
+		// Elastic scheduler starts one more worker when after scheduling the ready
+		// queue has at least this many tasks or the scheduling couldn't drain the pending
+		// tasks in one round, and none of the workers is idle.
+		uint32_t myThreadGrowReadyCount;
+		// Workers are split between the NUMA nodes and are pinned to their CPUs. Each
+		// node has own ready queue. A task is dispatched to the node where it was
+		// executed last time. New tasks go to the node of the posting worker, or are
+		// spread between the nodes when are posted from outside. The workers steal from
+		// the other nodes only when their own node has nothing to do.
+		bool myIsNUMAAware;
+		// Topology for the NUMA-aware mode. Empty means it is taken from the system. Can
+		// be used for testing on a single-node machine.
+		std::vector<mg::box::SysNUMANode> myNUMANodes;
+		// Collect the latency histograms and the queue depths. See TaskSchedulerStat.
+		// Costs a couple of clock reads per task.
+		bool myIsStatEnabled;
+		// Limit of the tasks posted via TryPost() and PostWithBackpressure() and not
+		// started yet. 0 = no limit. The other posts are never limited and don't count.
+		uint32_t myAdmitCapacity;
+		// When the admitted task count grows to the high watermark, the high callback
+		// is called. When it drops back to the low watermark, the low callback is
+		// called. They are called in turns, never twice in a row, under a mutex, by the
+		// posting and the executing threads. So they must be short and must not post
+		// anything with the admission. The workers cache a few free slots each, so the
+		// count can be seen by the watermarks a bit bigger than it is.
+		uint32_t myAdmitHighWatermark;
+		uint32_t myAdmitLowWatermark;
+		std::function<void()> myOnAdmitHigh;
+		std::function<void()> myOnAdmitLow;
+		// Weights of the task classes (see Task::SetClass()), one per class. Each class
+		// has own pending and ready queues, and the workers take the ready tasks from
+		// them in a weighted round-robin. For example, weights {8, 1} give class 0
+		// eight of each nine executions while both classes have ready tasks. A class
+		// without ready tasks doesn't waste its turns, they go to the other classes. A
+		// big weight works like a strict priority, but the other classes still get
+		// their turns and don't starve. The classes can also stand for tenants sharing
+		// the scheduler. Empty = one class.
+		std::vector<uint32_t> myClassWeights;
+		// Time slice of one task execution in microseconds. A long task can check
+		// Task::ShouldYield() to learn if it has run out of its slice while other tasks
+		// are waiting, and then re-post itself to let them go first. The executions
+		// longer than the slice are counted per worker. 0 = no slice, the tasks are never
+		// asked to yield. The slice costs two reads of the CPU timestamp counter per
+		// task.
+		uint32_t myTimeSliceUs;
+	};
+
+	// Statistics of a scheduler with the stats enabled. All the times are in
+	// microseconds.
+	struct TaskSchedulerStat
+	{
+		TaskSchedulerStat();
+
+		// From Post() to the execution start, for the tasks due right away.
+		mg::box::Histogram myReadyDelay;
+		// From the deadline to the execution start, for the tasks posted with a
+		// deadline in the future and not woken up before it.
+		mg::box::Histogram myLateness;
+		// Of the task callbacks.
+		mg::box::Histogram myRunTime;
+		// Of the sched-role being held by a worker for one scheduling round, not
+		// counting the sleep while waiting for new tasks.
+		mg::box::Histogram mySchedHoldTime;
+		// The queue sizes seen by the last scheduling round. The front queue depth is
+		// how many tasks were taken from it in that round.
+		uint32_t myFrontDepth;
+		uint32_t myPendingDepth;
+		uint32_t myWaitingDepth;
+		uint32_t myReadyDepth;
+		// Per task class, if the scheduler has more than one. The ready delay of the
+		// class and how many of its ready tasks are in the queues right now.
+		std::vector<mg::box::Histogram> myClassReadyDelay;
+		std::vector<uint32_t> myClassReadyDepth;
+	};
+
+	// Compile-time policies of the scheduler. See TaskSchedulerWithPolicy. The default
+	// one supports all the features.
+	struct TaskSchedulerPolicyDefault
+	{
+		static constexpr bool theHasDeadlines = true;
+	};
+
+	// The tasks can't have deadlines, can't wait, and can't be woken up or signaled.
+	// It means no PostDelay/Deadline/Wait(), no Task::PostWakeup/Signal(), and no
+	// coroutine operations or synchronization primitives which put the task to sleep.
+	// A wakeup or a signal of such a task is caught by the debug asserts. A cancellation
+	// only makes Task::IsCancelled() true, without a wakeup. In return the scheduler
+	// doesn't read the time, doesn't check the waiting queue, and changes the task
+	// statuses without compare-exchange.
+	struct TaskSchedulerPolicyNoDeadlines
+	{
+		static constexpr bool theHasDeadlines = false;
+	};
+
+	template<typename Policy>
+	class TaskSchedulerWithPolicy;
 
 	// Scheduler for asynchronous execution of tasks. Can be used
 	// for tons of one-shot short-living tasks, as well as for
@@ -69,10 +274,33 @@ namespace sch {
 			const char* aName,
 			uint32_t aSubQueueSize);
 
+		TaskScheduler(
+			const char* aName,
+			uint32_t aSubQueueSize,
+			const TaskSchedulerParams& aParams);
+
 		~TaskScheduler();
 
 		void Start(
 			uint32_t aThreadCount);
+
+		// Elastic scheduler. Starts with the min number of workers. More of them are
+		// started when the ready queue grows, up to the max number. The idle workers are
+		// retired back to the min number. See the params for the tuning.
+		void Start(
+			uint32_t aMinThreadCount,
+			uint32_t aMaxThreadCount);
+
+		// Start on the threads of the pool instead of own ones. The scheduler keeps its
+		// queues and its sched-role, and has a worker slot per pool thread. The pool
+		// threads take turns between all the attached schedulers. One turn of this
+		// scheduler lasts up to the given number of execution batches (of the sub-queue
+		// size each). So the share is how much of the pool the scheduler gets while all
+		// the schedulers are loaded. Stop() detaches the scheduler from the pool. It
+		// can't be called from the pool threads then.
+		void Start(
+			TaskSchedulerPool& aPool,
+			uint32_t aShare);
 		bool IsEmpty();
 		bool WaitEmpty(
 			mg::box::TimeLimit aTimeLimit = mg::box::theTimeDurationInf);
@@ -99,39 +327,266 @@ namespace sch {
 			Task* aTask,
 			uint64_t aDeadline);
 
+		// The same but the time is in microseconds.
+		void PostDelayUs(
+			Task* aTask,
+			uint64_t aDelay);
+
+		void PostDeadlineUs(
+			Task* aTask,
+			uint64_t aDeadline);
+
 		void PostWait(
 			Task* aTask);
 
+		// Post a null-terminated list of tasks linked via their 'next' members. Each
+		// task can be configured using its Set methods before the Post. The tasks are
+		// published into the front queue in a single operation with at most one
+		// sched-thread signal, regardless of the count. The tasks always go through the
+		// front queue, even when posted from a worker in the local queue mode. The ones
+		// without deadlines are dispatched in the order of the list.
+		void PostMany(
+			Task* aFirst);
+
+		// The same as PostWakeup() and PostSignal() called on each task, but the tasks
+		// waiting in the scheduler are re-pushed into the front queue all together, with
+		// at most one sched-thread signal. Makes sense for fan-out of a single event
+		// to many tasks. The tasks must belong to this scheduler.
+		void PostWakeupMany(
+			Task* const* aTasks,
+			uint32_t aCount);
+
+		void PostSignalMany(
+			Task* const* aTasks,
+			uint32_t aCount);
+
 		template<typename Functor>
 		void PostOneShot(
 			Functor&& aFunc);
 
-		// For statistics collection only.
+		// Post only if the admission limit allows it (see
+		// TaskSchedulerParams::myAdmitCapacity). Otherwise the task is not posted, and
+		// false is returned. Without the limit it is the same as Post(). The posts from
+		// the workers take the slots from small per-worker caches, so they don't touch
+		// any shared counter most of the time.
+		bool TryPost(
+			Task* aTask);
+
+		// Block the calling thread until the admission limit allows to post the task.
+		// The waiters get the freed slots in FIFO order. Can't be called from the
+		// workers of this scheduler, because they would stop executing the admitted
+		// tasks. The tasks can use AsyncPostWithBackpressure() instead.
+		void PostWithBackpressure(
+			Task* aTask);
+
+#if MG_CORO_IS_ENABLED
+		// The same for a coroutine task. The task sleeps until the other task is
+		// posted. The wakeups are ignored while it waits.
+		//
+		//     co_await scheduler.AsyncPostWithBackpressure(aTask, newTask);
+		//
+		TaskCoroOpPostWithBackpressure AsyncPostWithBackpressure(
+			Task* aSelf,
+			Task* aTask);
+#endif
+
+		// How many tasks are admitted and not started yet. Includes the free slots
+		// cached by the workers.
+		uint32_t GetAdmitCount() const;
+
+		// Split [aBegin, aEnd) into chunks and run the callback on them in parallel, on
+		// the workers and on the calling thread, and return when all of them are done.
+		// The chunks are at least aGrain long. They are claimed by the participants one
+		// by one and get smaller as the range is exhausted, so a slow participant
+		// doesn't delay the end of the loop by much.
+		//
+		// The calling thread can be a worker of this scheduler. The join waits only for
+		// the chunks being executed by the other workers right now. The helper tasks not
+		// started yet are not waited for, so the loop can't deadlock even if all the
+		// workers are busy. While waiting, the worker executes the other tasks of the
+		// scheduler instead of blocking, right on the caller's stack. Hence the caller
+		// must not hold any locks which the other tasks can take. The joins executing
+		// the tasks are nested up to a small depth. The deeper ones just wait.
+		void ParallelFor(
+			uint64_t aBegin,
+			uint64_t aEnd,
+			uint64_t aGrain,
+			const TaskParallelForCallback& aCallback);
+
+		// The same, but the calling thread doesn't participate and doesn't wait. When
+		// the loop is done, the given task is posted. It must not be in the scheduler at
+		// the moment of the call.
+		void ParallelForAsync(
+			uint64_t aBegin,
+			uint64_t aEnd,
+			uint64_t aGrain,
+			TaskParallelForCallback&& aCallback,
+			Task* aDoneTask);
+
+		// Run the functions in parallel, one of them on the calling thread, and return
+		// when all are done. The same as ParallelFor() by the function indexes.
+		void ForkJoin(
+			std::initializer_list<std::function<void()>> aFuncs);
+
+		// For statistics collection only. The elastic scheduler returns all the worker
+		// slots, including the ones not running right now.
 		TaskSchedulerThread*const* GetThreads(
 			uint32_t& aOutCount) const;
 
+		// Number of the currently running workers.
+		uint32_t GetThreadCount() const;
+
+		// For statistics collection only. The slot of the thread owning the sched-role
+		// when it is dedicated. Null otherwise.
+		TaskSchedulerThread* GetSchedThread() const;
+
+		uint32_t GetClassCount() const;
+
+		// Merge the stats of all the workers into the given object. The workers are
+		// not stopped, so the histograms might miss the last few values. The stats are
+		// not reset.
+		void StatSnapshot(
+			TaskSchedulerStat& aOutStat) const;
+
 		static TaskScheduler& This();
 
 	private:
+		void PrivStart(
+			uint32_t aMinThreadCount,
+			uint32_t aMaxThreadCount,
+			TaskSchedulerPool* aPool,
+			uint32_t aShare);
+
 		void PrivPost(
 			Task* aTask);
 
+		void PrivPostMany(
+			Task* aFirst,
+			Task* aLast);
+
 		void PrivSchedulerLock();
 		bool PrivSchedulerTryLock();
-		bool PrivSchedule();
+		bool PrivSchedule(
+			bool aCanWait);
+		template<typename Policy>
+		void PrivScheduleRound(
+			bool aCanWait);
 		void PrivSchedulerUnlock();
 
+		template<typename Policy>
+		void PrivSetPolicy();
+
+		template<typename Policy>
 		bool PrivExecute(
-			Task* aTask);
+			Task* aTask,
+			TaskSchedulerThread* aWorker);
+
+		// Execute up to the given number of the tasks available to the worker. Returns
+		// how many were executed.
+		template<typename Policy>
+		uint64_t PrivExecuteBatch(
+			TaskSchedulerThread* aWorker,
+			uint64_t aMaxCount);
+
+		// One turn of a pool thread in this scheduler. The deadline is lowered to when
+		// the next waiting task expires, if the sched-role was taken. Returns true if
+		// there is more work right away.
+		bool PrivPoolExecute(
+			TaskSchedulerThread* aWorker,
+			uint32_t aShare,
+			uint64_t& aInOutDeadline);
+
+		bool PrivWaitReady();
 
-		void PrivWaitReady();
+		bool PrivWaitSignal(
+			mg::box::Signal& aSignal,
+			uint64_t aTimeoutUs,
+			bool aIsHot);
+
+		void PrivThreadGrow();
+
+		bool PrivThreadTryRetire(
+			TaskSchedulerThread* aWorker);
+
+		void PrivSetThreadCount(
+			uint32_t aCount);
+
+		void PrivSignalFront();
 
 		void PrivSignalReady();
 
+		// Wake up to the given number of the idle workers, each via its own signal. Is
+		// used when the sched-role is dedicated.
+		void PrivWakeWorkers(
+			uint32_t aCount);
+
+		bool PrivHasIdle();
+
+		// For the task running in the current thread. See Task::ShouldYield().
+		static bool PrivShouldYield();
+
 		bool PrivIsStopped();
 
+		uint32_t PrivReadyCount();
+
+		// Shard of the front queue for the calling thread.
+		TaskSchedulerQueueFront& PrivFrontShard();
+
+		TaskSchedulerQueueFront& PrivFrontShard(
+			uint32_t aIndex);
+
+		uint32_t PrivFrontShardCount() const;
+
+		bool PrivFrontIsEmpty();
+
+		// Append the tasks to the pending queues of their classes.
+		void PrivPendingAppend(
+			Task* aFirst,
+			Task* aLast);
+
+		bool PrivPendingIsEmpty() const;
+
+		void PrivPostAdmitted(
+			Task* aTask);
+
+		// Take up to the given number of the free admission slots. Returns how many
+		// were taken.
+		uint32_t PrivAdmitTakeFree(
+			uint32_t aCount);
+
+		bool PrivAdmitTake();
+
+		// Try to take a slot, or queue the waiter. Returns true if the slot was taken.
+		// The queued waiter is served by the thread which frees a slot.
+		bool PrivAdmitTakeOrEnqueue(
+			TaskSchedulerAdmitWaiter* aWaiter);
+
+		void PrivAdmitGive(
+			uint32_t aCount);
+
+		// A task which took a slot is started by the worker.
+		void PrivAdmitRelease(
+			TaskSchedulerThread* aWorker);
+
+		// Return the slots cached by the worker.
+		void PrivAdmitFlush(
+			TaskSchedulerThread* aWorker);
+
+		void PrivAdmitWakeup();
+
+		void PrivAdmitCheckWatermarks();
+
+		// How many helper tasks to post for a parallel loop. The calling thread is not
+		// counted.
+		uint32_t PrivParallelHelperCount(
+			uint64_t aCount,
+			uint64_t aGrain,
+			bool aIsInline);
+
 		// Each task firstly goes to the front queue, from where
 		// it is dispatched to the other queues by sched-thread.
+		// This is the shard for the external threads. The workers
+		// have their own.
 		TaskSchedulerQueueFront myQueueFront;
 		mg::box::Signal mySignalFront;
 
@@ -141,7 +596,8 @@ namespace sch {
 		// separated from the fields below by a padding.
 		MG_UNUSED_MEMBER char myFalseSharingProtection1[MG_CACHE_LINE_SIZE];
 
-		TaskSchedulerQueuePending myQueuePending;
+		// One per task class.
+		std::vector<TaskSchedulerQueuePending> myQueuesPending;
 		TaskSchedulerQueueWaiting myQueueWaiting;
 		mg::box::Signal mySignalReady;
 		// Threads try to execute not just all ready tasks in a row - periodically they
@@ -153,12 +609,66 @@ namespace sch {
 		// the bottleneck when the scheduling takes too long time while the other threads
 		// are idle and the ready-queue is empty. For example, processing of a million of
 		// front queue tasks might take ~100-200ms.
-		uint32_t mySchedBatchSize;
+		// Depends on the worker count, which can change while the scheduler works. Hence
+		// atomic.
+		mg::box::AtomicU32 mySchedBatchSize;
+		const TaskSchedulerQueueMode myQueueMode;
+		const uint32_t myIdleSpinUs;
+		const bool myIsIdleYield;
+		const bool myIsLatencyCritical;
+		const bool myIsSchedDedicated;
+		const uint32_t myThreadIdleTimeout;
+		const uint32_t myThreadGrowReadyCount;
+		const bool myIsStatEnabled;
+		const uint32_t myAdmitCapacity;
+		const uint32_t myAdmitHighWatermark;
+		const uint32_t myAdmitLowWatermark;
+		const std::function<void()> myOnAdmitHigh;
+		const std::function<void()> myOnAdmitLow;
+		const bool myAdmitHasWatermarks;
+		// The time slice converted into the CPU ticks. 0 = no slice.
+		uint64_t myTimeSliceTicks;
+		// The policy is compiled into the scheduling round and into the execution. The
+		// flag is only stored into the posted tasks, to catch their misuse.
+		void (TaskScheduler::*myScheduleRound)(bool);
+		uint64_t (TaskScheduler::*myExecuteBatch)(TaskSchedulerThread*, uint64_t);
+		bool myHasDeadlines;
+		const uint32_t myClassCount;
+		const std::vector<uint32_t> myClassWeights;
+		uint32_t myClassWeightSum;
+		// Order of the class turns in the weighted round-robin. Each class is met there
+		// as many times as its weight, and its turns are spread evenly.
+		std::vector<uint32_t> myClassOrder;
+		// The classes sorted by their weights, the biggest first.
+		std::vector<uint32_t> myClassByWeight;
+		// How many free slots a worker takes at once into its cache. Is set on start,
+		// depending on the max worker count.
+		uint32_t myAdmitChunk;
+		// Queue depth gauges are updated by the sched-thread and read by anybody.
+		mg::box::AtomicU32 myStatFrontDepth;
+		mg::box::AtomicU32 myStatPendingDepth;
+		mg::box::AtomicU32 myStatWaitingDepth;
+		mg::box::AtomicU32 myStatReadyDepth;
+		// Is used only by the sched-thread and only when the stats are enabled.
+		uint32_t myQueuePendingCount;
+
+		// Next node for the tasks not having a preferred one. Is used only by the
+		// sched-thread.
+		uint32_t myNodeNext;
+		// The front queue shard to start the next round from. The shards are drained
+		// round-robin, so none of the producers is always the last. Is used only by the
+		// sched-thread.
+		uint32_t myFrontShardNext;
 
-		// The ready-queue is being used by multiple threads. Lets make sure they won't
-		// invalidate the scheduler-role's data.
+		// Without the NUMA-aware mode there is just one node. The nodes are allocated
+		// separately, so their ready-queues are used by multiple threads without
+		// invalidating the scheduler-role's data.
+		std::vector<TaskSchedulerNode*> myNodes;
 		MG_UNUSED_MEMBER char myFalseSharingProtection2[MG_CACHE_LINE_SIZE];
-		TaskSchedulerQueueReady myQueueReady;
+		// Number of workers sleeping on the ready-signal. Workers pushing into their
+		// local queues wake up the idle ones so as they could steal the new tasks. The
+		// elastic scheduler doesn't add workers while there are idle ones.
+		mg::box::AtomicU32 myIdleCount;
 
 		// The pending and waiting tasks must be dispatched
 		// somehow to be moved to the ready queue. For that there
@@ -176,13 +686,86 @@ namespace sch {
 		MG_UNUSED_MEMBER char myFalseSharingProtection3[MG_CACHE_LINE_SIZE];
 		mg::box::InterruptibleMutex mySchedulerMutex;
 
+		// The worker slots are all created on start and live until stop, even if the
+		// scheduler is elastic and not all of them are running. The workers look at each
+		// other when steal the tasks, so the list must be complete and not changing.
 		std::vector<TaskSchedulerThread*> myThreads;
+		// Slot of the thread owning the sched-role, when it is dedicated. Isn't in the
+		// worker list, doesn't execute tasks, and has no tasks in its front shard.
+		TaskSchedulerThread* mySchedThread;
+		// Protects starting and retirement of the workers.
+		mg::box::Mutex myThreadsMutex;
+		mg::box::AtomicU32 myThreadCount;
+		uint32_t myMinThreadCount;
+		uint32_t myMaxThreadCount;
+		bool myIsStopping;
 		const std::string myName;
+		// The pool whose threads execute the scheduler. Null when the scheduler has own
+		// threads or isn't started.
+		mg::box::Atomic<TaskSchedulerPool*> myPool;
+		// A pool thread couldn't take the sched-role. Then the sched-thread wakes up the
+		// pool once more when leaves the role, because the tasks which woke up that
+		// thread might have been not seen by the sched-thread.
+		mg::box::AtomicBool myPoolIsRetry;
+
+		// Free admission slots not cached by anybody. Is updated by the external posters
+		// on each post and by the workers once per a chunk of slots.
+		MG_UNUSED_MEMBER char myFalseSharingProtection4[MG_CACHE_LINE_SIZE];
+		mg::box::AtomicU32 myAdmitFree;
+		mg::box::AtomicU32 myAdmitWaitCount;
+		// Is changed under the watermarks mutex, but is read without it.
+		mg::box::AtomicBool myAdmitIsHigh;
+		mg::box::Mutex myAdmitWatermarkMutex;
+		mg::box::Mutex myAdmitMutex;
+		TaskSchedulerAdmitWaiterList myAdmitWaiters;
+		MG_UNUSED_MEMBER char myFalseSharingProtection5[MG_CACHE_LINE_SIZE];
 
 		static thread_local TaskScheduler* ourCurrent;
+		static thread_local TaskSchedulerThread* ourCurrentThread;
 
 		friend class Task;
+		friend class TaskSchedulerPool;
+		friend class TaskSchedulerPoolThread;
 		friend class TaskSchedulerThread;
+		template<typename Policy>
+		friend class TaskSchedulerWithPolicy;
+#if MG_CORO_IS_ENABLED
+		friend struct TaskCoroOpPostWithBackpressure;
+#endif
+	};
+
+	// The scheduler with the features not needed by the policy compiled out of its
+	// scheduling round. TaskScheduler itself is the default policy. Only the policies
+	// declared above are supported.
+	template<typename Policy>
+	class TaskSchedulerWithPolicy
+		: public TaskScheduler
+	{
+	public:
+		TaskSchedulerWithPolicy(
+			const char* aName,
+			uint32_t aSubQueueSize);
+
+		TaskSchedulerWithPolicy(
+			const char* aName,
+			uint32_t aSubQueueSize,
+			const TaskSchedulerParams& aParams);
+	};
+
+	struct TaskSchedulerNode
+	{
+		TaskSchedulerNode(
+			uint32_t aSubQueueSize,
+			uint32_t aClassCount);
+
+		~TaskSchedulerNode();
+
+		MG_UNUSED_MEMBER char myFalseSharingProtection[MG_CACHE_LINE_SIZE];
+		// One per task class. They are allocated separately, so the workers consuming
+		// different classes don't invalidate each other's cache.
+		std::vector<TaskSchedulerQueueReady*> myQueuesReady;
+		// The workers of the node are pinned to these CPUs. Empty = not pinned.
+		std::vector<uint32_t> myCPUs;
 	};
 
 	enum TaskSchedulerWorkerState
@@ -191,43 +774,270 @@ namespace sch {
 		TASK_SCHEDULER_WORKER_STATE_IDLE,
 	};
 
+	// Worker slot of the scheduler. The thread inside of it can be started and stopped
+	// multiple times, when the scheduler is elastic. The queues and the stats stay.
 	class TaskSchedulerThread
-		: public mg::box::Thread
 	{
 	public:
+		// The sched slot runs the dedicated sched-thread instead of a worker.
 		TaskSchedulerThread(
 			const char* aSchedulerName,
-			TaskScheduler* aScheduler);
+			TaskScheduler* aScheduler,
+			uint32_t aNodeIndex,
+			bool aIsSched = false);
+
+		~TaskSchedulerThread();
 
 		uint64_t StatPopExecuteCount();
 
 		uint64_t StatPopScheduleCount();
 
+		uint64_t StatPopStealCount();
+
+		// Microseconds spent in spinning while being idle.
+		uint64_t StatPopSpinTime();
+
+		// How many times the worker got new work while spinning, without sleeping.
+		uint64_t StatPopSpinWakeCount();
+
+		// How many times the worker woke up after sleeping in the kernel.
+		uint64_t StatPopWakeCount();
+
+		// How many tasks were taken from the ready queues of the other NUMA nodes.
+		uint64_t StatPopNodeStealCount();
+
+		// How many tasks of the given class were executed. Is counted only if the
+		// scheduler has more than one class.
+		uint64_t StatPopClassExecuteCount(
+			uint32_t aClass);
+
+		// How many task executions were longer than the time slice.
+		uint64_t StatPopSliceOverrunCount();
+
+		uint32_t GetNodeIndex() const;
+
+		// Merge the histograms of this worker into the given object. The queue depths
+		// aren't touched.
+		void StatSnapshot(
+			TaskSchedulerStat& aOutStat) const;
+
 		TaskSchedulerWorkerState GetState() const;
 
+		bool IsRunning() const;
+
 	private:
-		void Run() override;
+		void PrivStart();
+
+		void PrivStop();
+
+		void PrivBlockingStop();
+
+		void Run();
+
+		// Main loop of the dedicated sched-thread.
+		void RunSched();
+
+		void PrivPostLocal(
+			Task* aTask);
+
+		Task* PrivPop();
+
+		// Pop from the ready queues of the own node.
+		Task* PrivPopShared();
+
+		Task* PrivPopLocal();
+
+		Task* PrivSteal();
+
+		Task* PrivStealNode();
+
+		bool PrivHasLocal() const;
+
+		bool PrivShouldYield() const;
 
 		TaskScheduler* myScheduler;
+		// The thread of a retired worker is not deleted right away. It is joined and
+		// deleted when the slot is taken again or when the scheduler stops.
+		mg::box::ThreadFunc* myThread;
+		// Is protected by the scheduler's threads mutex. Atomic only to read it for the
+		// stats.
+		mg::box::AtomicBool myIsActive;
+		const std::string myName;
+		const uint32_t myNodeIndex;
+		const bool myIsSched;
 		mg::box::Atomic<TaskSchedulerWorkerState> myState;
-		TaskSchedulerQueueReadyConsumer myConsumer;
+		// The idle worker sleeps on it when the sched-role is dedicated. Then the
+		// sched-thread knows whom to wake up, and doesn't wake up more workers than
+		// there are new tasks.
+		mg::box::Signal mySignalWake;
+		// Consumers of the own node's ready queues, one per task class.
+		std::vector<TaskSchedulerQueueReadyConsumer*> myConsumers;
+		// Consumers of the other nodes' ready queues, starting from the next node. All
+		// the classes of a node go together.
+		std::vector<TaskSchedulerQueueReadyConsumer*> myNodeConsumers;
+		// Position in the order of the class turns. Each worker goes through the order
+		// on its own.
+		uint32_t myClassPos;
+		// LIFO slot for the last task posted by this worker. Is executed before the
+		// local queue. Other workers can steal it only when they have nothing else to do.
+		mg::box::Atomic<Task*> myNextTask;
+		TaskSchedulerQueueLocal myQueueLocal;
+		// How many tasks in a row were taken from the local queue and the LIFO slot.
+		// Used to look into the shared ready queue from time to time.
+		uint32_t myLocalStreak;
+		uint32_t myLifoStreak;
+		// Index of the next victim to try for stealing. Rotated to spread the stealing
+		// evenly between the workers.
+		uint32_t myStealIndex;
 		mg::box::AtomicU64 myExecuteCount;
 		mg::box::AtomicU64 myScheduleCount;
+		mg::box::AtomicU64 myStealCount;
+		mg::box::AtomicU64 mySpinTime;
+		mg::box::AtomicU64 mySpinWakeCount;
+		mg::box::AtomicU64 myWakeCount;
+		mg::box::AtomicU64 myNodeStealCount;
+		mg::box::AtomicU64 mySliceOverrunCount;
+		std::vector<mg::box::AtomicU64> myClassExecuteCount;
+		// The histograms are written only by this worker.
+		mg::box::Histogram myStatReadyDelay;
+		mg::box::Histogram myStatLateness;
+		mg::box::Histogram myStatRunTime;
+		mg::box::Histogram myStatSchedHoldTime;
+		std::vector<mg::box::Histogram> myStatClassReadyDelay;
+		// Free admission slots taken by this worker from the scheduler in advance. Is
+		// used only by this worker.
+		uint32_t myAdmitCredit;
+		// When the time slice of the currently executed task ends, in the CPU ticks.
+		// Infinite when the scheduler has no slice.
+		uint64_t mySliceEnd;
+		// How many parallel loop joins executing the other tasks are on the stack of
+		// this worker now.
+		uint32_t myJoinDepth;
+		// When the next waiting task expires, as seen by the last scheduling round of
+		// this worker. Is used only when the scheduler runs on a pool, to limit the
+		// sleep of the pool thread.
+		uint64_t myPoolDeadline;
+		// Shard of the front queue for the tasks posted by this worker. Is written by
+		// the worker only, except for being drained by the sched-thread. So it is
+		// separated from the fields above, which the other workers read when steal.
+		MG_UNUSED_MEMBER char myFalseSharingProtection1[MG_CACHE_LINE_SIZE];
+		TaskSchedulerQueueFront myQueueFront;
+		MG_UNUSED_MEMBER char myFalseSharingProtection2[MG_CACHE_LINE_SIZE];
+
+		friend class TaskScheduler;
+	};
+
+	struct TaskSchedulerPoolEntry
+	{
+		TaskScheduler* myScheduler;
+		uint32_t myShare;
+	};
+
+	// Set of threads shared by multiple schedulers. Each scheduler started on the pool
+	// (see TaskScheduler::Start()) keeps its own queues and sched-role. The pool threads
+	// go through the schedulers round-robin, execute a limited number of tasks in each,
+	// and sleep when all of them have nothing to do. So several schedulers don't need
+	// a thread set each, and don't oversubscribe the CPU cores.
+	class TaskSchedulerPool
+	{
+	public:
+		// The name is displayed as a part of the thread names.
+		TaskSchedulerPool(
+			const char* aName);
+
+		~TaskSchedulerPool();
+
+		void Start(
+			uint32_t aThreadCount);
+
+		// The schedulers must be stopped before.
+		void Stop();
+
+		uint32_t GetThreadCount() const;
+
+	private:
+		void PrivAttach(
+			TaskScheduler* aScheduler,
+			uint32_t aShare);
+
+		// Returns when none of the threads is inside of the scheduler.
+		void PrivDetach(
+			TaskScheduler* aScheduler);
+
+		void PrivSignal();
+
+		std::vector<TaskSchedulerPoolThread*> myThreads;
+		// Protects the scheduler list.
+		mg::box::Mutex myMutex;
+		std::vector<TaskSchedulerPoolEntry> myEntries;
+		// Is incremented on each change of the scheduler list. The threads take a copy
+		// of the list when see a new version.
+		mg::box::AtomicU32 myVersion;
+		// Is sent when any of the schedulers gets new tasks.
+		mg::box::Signal mySignal;
+		// Number of the threads sleeping on the signal.
+		mg::box::AtomicU32 myIdleCount;
+		const std::string myName;
+
+		friend class TaskScheduler;
+		friend class TaskSchedulerPoolThread;
+	};
+
+	class TaskSchedulerPoolThread
+	{
+	public:
+		TaskSchedulerPoolThread(
+			const char* aPoolName,
+			TaskSchedulerPool* aPool,
+			uint32_t aIndex);
+
+		~TaskSchedulerPoolThread();
+
+	private:
+		void Run();
+
+		TaskSchedulerPool* myPool;
+		mg::box::ThreadFunc* myThread;
+		// Index of the worker slot taken by this thread in each scheduler.
+		const uint32_t myIndex;
+		// Is held while the thread is inside of the schedulers. A detaching scheduler
+		// takes it to wait until the thread leaves.
+		mg::box::Mutex myMutex;
+
+		friend class TaskSchedulerPool;
 	};
 
 	struct TaskOneShot
 		: public Task
+		, public mg::box::ThreadPooled<TaskOneShot>
 	{
 		template<typename Functor>
 		TaskOneShot(
 			Functor&& aFunc);
 
-		void Execute(
+		static void Execute(
 			Task* aTask);
 
 		TaskCallbackOneShot myCallback;
 	};
 
+	// Callbacks fitting into the task are stored as is. The others are moved to the heap
+	// via std::function.
+	template<typename Functor, bool IsInline =
+		TaskCallbackOneShot::Fits<typename std::decay<Functor>::type>()>
+	struct TaskOneShotCallback
+	{
+		static Functor&& Make(
+			Functor&& aFunc) { return std::forward<Functor>(aFunc); }
+	};
+
+	template<typename Functor>
+	struct TaskOneShotCallback<Functor, false>
+	{
+		static std::function<void(void)> Make(
+			Functor&& aFunc) { return std::forward<Functor>(aFunc); }
+	};
+
 	inline void
 	TaskScheduler::PostDelay(
 		Task* aTask,
@@ -246,6 +1056,24 @@ namespace sch {
 		Post(aTask);
 	}
 
+	inline void
+	TaskScheduler::PostDelayUs(
+		Task* aTask,
+		uint64_t aDelay)
+	{
+		aTask->SetDelayUs(aDelay);
+		Post(aTask);
+	}
+
+	inline void
+	TaskScheduler::PostDeadlineUs(
+		Task* aTask,
+		uint64_t aDeadline)
+	{
+		aTask->SetDeadlineUs(aDeadline);
+		Post(aTask);
+	}
+
 	inline void
 	TaskScheduler::PostWait(
 		Task* aTask)
@@ -254,6 +1082,22 @@ namespace sch {
 		Post(aTask);
 	}
 
+#if MG_CORO_IS_ENABLED
+	inline TaskCoroOpPostWithBackpressure
+	TaskScheduler::AsyncPostWithBackpressure(
+		Task* aSelf,
+		Task* aTask)
+	{
+		return TaskCoroOpPostWithBackpressure(*this, aSelf, aTask);
+	}
+#endif
+
+	inline uint32_t
+	TaskScheduler::GetAdmitCount() const
+	{
+		return myAdmitCapacity - myAdmitFree.LoadRelaxed();
+	}
+
 	inline TaskSchedulerThread*const*
 	TaskScheduler::GetThreads(
 		uint32_t& aOutCount) const
@@ -262,6 +1106,30 @@ namespace sch {
 		return myThreads.data();
 	}
 
+	inline uint32_t
+	TaskScheduler::GetThreadCount() const
+	{
+		return myThreadCount.LoadRelaxed();
+	}
+
+	inline TaskSchedulerThread*
+	TaskScheduler::GetSchedThread() const
+	{
+		return mySchedThread;
+	}
+
+	inline uint32_t
+	TaskScheduler::GetClassCount() const
+	{
+		return myClassCount;
+	}
+
+	inline uint32_t
+	TaskSchedulerPool::GetThreadCount() const
+	{
+		return (uint32_t)myThreads.size();
+	}
+
 	inline TaskScheduler&
 	TaskScheduler::This()
 	{
@@ -281,6 +1149,57 @@ namespace sch {
 		return myScheduleCount.ExchangeRelaxed(0);
 	}
 
+	inline uint64_t
+	TaskSchedulerThread::StatPopStealCount()
+	{
+		return myStealCount.ExchangeRelaxed(0);
+	}
+
+	inline uint64_t
+	TaskSchedulerThread::StatPopSpinTime()
+	{
+		return mySpinTime.ExchangeRelaxed(0);
+	}
+
+	inline uint64_t
+	TaskSchedulerThread::StatPopSpinWakeCount()
+	{
+		return mySpinWakeCount.ExchangeRelaxed(0);
+	}
+
+	inline uint64_t
+	TaskSchedulerThread::StatPopWakeCount()
+	{
+		return myWakeCount.ExchangeRelaxed(0);
+	}
+
+	inline uint64_t
+	TaskSchedulerThread::StatPopNodeStealCount()
+	{
+		return myNodeStealCount.ExchangeRelaxed(0);
+	}
+
+	inline uint64_t
+	TaskSchedulerThread::StatPopClassExecuteCount(
+		uint32_t aClass)
+	{
+		if (aClass >= myClassExecuteCount.size())
+			return 0;
+		return myClassExecuteCount[aClass].ExchangeRelaxed(0);
+	}
+
+	inline uint64_t
+	TaskSchedulerThread::StatPopSliceOverrunCount()
+	{
+		return mySliceOverrunCount.ExchangeRelaxed(0);
+	}
+
+	inline uint32_t
+	TaskSchedulerThread::GetNodeIndex() const
+	{
+		return myNodeIndex;
+	}
+
 	template<typename Functor>
 	inline void
 	TaskScheduler::PostOneShot(
@@ -289,13 +1208,34 @@ namespace sch {
 		Post(new TaskOneShot(std::forward<Functor>(aFunc)));
 	}
 
+	template<typename Policy>
+	inline
+	TaskSchedulerWithPolicy<Policy>::TaskSchedulerWithPolicy(
+		const char* aName,
+		uint32_t aSubQueueSize)
+		: TaskScheduler(aName, aSubQueueSize)
+	{
+		PrivSetPolicy<Policy>();
+	}
+
+	template<typename Policy>
+	inline
+	TaskSchedulerWithPolicy<Policy>::TaskSchedulerWithPolicy(
+		const char* aName,
+		uint32_t aSubQueueSize,
+		const TaskSchedulerParams& aParams)
+		: TaskScheduler(aName, aSubQueueSize, aParams)
+	{
+		PrivSetPolicy<Policy>();
+	}
+
 	template<typename Functor>
 	inline
 	TaskOneShot::TaskOneShot(
 		Functor&& aFunc)
-		: Task(std::bind(&TaskOneShot::Execute, this,
-			std::placeholders::_1))
-		, myCallback(std::forward<Functor>(aFunc))
+		: Task(&TaskOneShot::Execute)
+		, myCallback(TaskOneShotCallback<Functor>::Make(
+			std::forward<Functor>(aFunc)))
 	{
 	}
 
@@ -0,0 +1,105 @@
+#include "TaskSync.h"
+
+#include "mg/sch/TaskScheduler.h"
+
+namespace mg {
+namespace sch {
+
+	static constexpr uint32_t theTaskSemaphoreHasWaitersBit = 1U << 31;
+
+	//////////////////////////////////////////////////////////////////////////////////////
+
+#if MG_CORO_IS_ENABLED
+	void
+	TaskCoroSyncWait(
+		Task* aTask) noexcept
+	{
+		aTask->myWait = TASK_WAIT_SIGNAL;
+		aTask->SetWait();
+		TaskScheduler::This().Post(aTask);
+	}
+#endif
+
+	//////////////////////////////////////////////////////////////////////////////////////
+
+	TaskSemaphore::TaskSemaphore(
+		uint32_t aCount)
+		: myState(aCount)
+	{
+		MG_BOX_ASSERT(aCount < theTaskSemaphoreHasWaitersBit);
+	}
+
+	TaskSemaphore::~TaskSemaphore()
+	{
+		MG_BOX_ASSERT(myWaiters.IsEmpty());
+	}
+
+	bool
+	TaskSemaphore::TryAcquire()
+	{
+		uint32_t old = myState.LoadRelaxed();
+		do
+		{
+			// No units, or they are handed over to the waiters.
+			if (old == 0 || old == theTaskSemaphoreHasWaitersBit)
+				return false;
+		} while (!myState.CmpExchgWeakAcquire(old, old - 1));
+		return true;
+	}
+
+	bool
+	TaskSemaphore::AcquireOrEnqueue(
+		Task* aTask)
+	{
+		if (TryAcquire())
+			return true;
+		mg::box::MutexLock lock(myMutex);
+		uint32_t old = myState.LoadRelaxed();
+		while (old != theTaskSemaphoreHasWaitersBit)
+		{
+			uint32_t state = old == 0 ? theTaskSemaphoreHasWaitersBit : old - 1;
+			if (!myState.CmpExchgWeakAcquire(old, state))
+				continue;
+			if (state != theTaskSemaphoreHasWaitersBit)
+				return true;
+			break;
+		}
+		// The waiters bit can only be dropped under the mutex. So it can't happen until
+		// the task is in the queue.
+		myWaiters.Append(aTask);
+		return false;
+	}
+
+	void
+	TaskSemaphore::Release()
+	{
+		uint32_t old = myState.LoadRelaxed();
+		while (true)
+		{
+			if (old != theTaskSemaphoreHasWaitersBit)
+			{
+				MG_DEV_ASSERT(old + 1 < theTaskSemaphoreHasWaitersBit);
+				if (myState.CmpExchgWeakRelease(old, old + 1))
+					return;
+				continue;
+			}
+			// Hand the unit over to the first waiter directly. The count stays zero.
+			Task* waiter;
+			{
+				mg::box::MutexLock lock(myMutex);
+				// Another release could hand over the last unit before the mutex was
+				// taken.
+				old = myState.LoadRelaxed();
+				if (old != theTaskSemaphoreHasWaitersBit)
+					continue;
+				waiter = myWaiters.PopFirst();
+				if (myWaiters.IsEmpty())
+					myState.StoreRelease(0);
+			}
+			waiter->PostSignal();
+			return;
+		}
+	}
+
+}
+}
@@ -0,0 +1,648 @@
+#pragma once
+
+#include "mg/box/Assert.h"
+#include "mg/box/ForwardList.h"
+#include "mg/box/Mutex.h"
+#include "mg/sch/Task.h"
+
+#include <memory>
+#include <optional>
+#include <utility>
+
+namespace mg {
+namespace sch {
+
+	class TaskSemaphore;
+
+	template<typename T>
+	class TaskChannel;
+
+	using TaskSyncList = mg::box::ForwardList<Task, &Task::mySyncNext>;
+
+#if MG_CORO_IS_ENABLED
+	//////////////////////////////////////////////////////////////////////////////////////
+	// C++20 coroutine operations.
+
+	// Internal helper of the operations. The task, already queued in a synchronization
+	// object, is posted to wait for the signal. Nothing else can resume the coroutine,
+	// and the signal is consumed before it is resumed.
+	void TaskCoroSyncWait(
+		Task* aTask) noexcept;
+
+	struct TaskCoroOpSemaphoreAcquire
+		: public mg::box::CoroOp
+		, public mg::box::CoroOpIsEmptyReturn
+	{
+		TaskCoroOpSemaphoreAcquire(
+			TaskSemaphore& aSem,
+			Task* aTask) : mySem(aSem), myTask(aTask) {}
+		bool await_ready() noexcept;
+		bool await_suspend(
+			mg::box::CoroHandle aThisCoro) noexcept;
+
+		TaskSemaphore& mySem;
+		Task* myTask;
+	};
+
+	template<typename T>
+	struct TaskCoroOpChannelSend
+		: public mg::box::CoroOp
+	{
+		TaskCoroOpChannelSend(
+			TaskChannel<T>& aChannel,
+			Task* aTask,
+			T&& aValue);
+		bool await_ready() noexcept;
+		bool await_suspend(
+			mg::box::CoroHandle aThisCoro) noexcept;
+		void await_resume() noexcept;
+
+		TaskChannel<T>& myChannel;
+		Task* myTask;
+		T* myValue;
+		bool myIsWaiting;
+	};
+
+	template<typename T>
+	struct TaskCoroOpChannelReceive
+		: public mg::box::CoroOp
+	{
+		TaskCoroOpChannelReceive(
+			TaskChannel<T>& aChannel,
+			Task* aTask);
+		bool await_ready() noexcept;
+		bool await_suspend(
+			mg::box::CoroHandle aThisCoro) noexcept;
+		T await_resume() noexcept;
+
+		TaskChannel<T>& myChannel;
+		Task* myTask;
+		std::optional<T> myValue;
+	};
+
+	//////////////////////////////////////////////////////////////////////////////////////
+#endif
+
+	// Synchronization objects for tasks. A task, which can't proceed, never blocks its
+	// worker thread. Instead it is queued inside of the object and must go to infinite
+	// wait in the scheduler. When the resource becomes available, it is handed over to
+	// the first queued task directly, and the task is signaled. The waiters are served
+	// in FIFO order. A newcomer can't steal the resource from a woken up waiter.
+	//
+	// The queues are intrusive, so there are no allocations. While a task waits in an
+	// object, its signal belongs to the object and mustn't be used for anything else.
+	// Obviously, a task can wait in only one object at a time. A waiting task can't
+	// leave the queue. So the wakeups, including the ones by the task's cancellation
+	// token, don't interrupt the wait.
+	//
+	// The queues are protected by a mutex, but it is held only for a few instructions.
+	// The semaphore doesn't take it at all when there are no waiters.
+	//
+	// Callback tasks use the *OrEnqueue methods:
+	//
+	//     void
+	//     TaskBody(Task* aTask)
+	//     {
+	//         if (!isWaiting)
+	//         {
+	//             if (!mutex.LockOrEnqueue(aTask))
+	//             {
+	//                 // The signal will come together with the lock.
+	//                 isWaiting = true;
+	//                 scheduler.PostWait(aTask);
+	//                 return;
+	//             }
+	//         }
+	//         else if (!aTask->ReceiveSignal())
+	//         {
+	//             // Woken up by something else.
+	//             scheduler.PostWait(aTask);
+	//             return;
+	//         }
+	//         isWaiting = false;
+	//         // Is locked here.
+	//     }
+	//
+	// Coroutine tasks just co_await. The wakeups are ignored while the coroutine waits.
+	// It is resumed only by the signal, and then owns the resource. A cancelled task
+	// can check IsCancelled() after that:
+	//
+	//     co_await mutex.AsyncLock(aTask);
+	//
+	class TaskSemaphore
+	{
+	public:
+		TaskSemaphore(
+			uint32_t aCount);
+		~TaskSemaphore();
+
+		// Take a unit if there is one. Never queues the task.
+		bool TryAcquire();
+
+		// Take a unit, or queue the task if there are none. When false is returned,
+		// the task will get a signal when a unit is handed over to it. It must be
+		// posted to wait, and owns the unit once the signal is received.
+		bool AcquireOrEnqueue(
+			Task* aTask);
+
+		// Give the unit to the first waiter if there is one. Can be called from any
+		// thread.
+		void Release();
+
+#if MG_CORO_IS_ENABLED
+		TaskCoroOpSemaphoreAcquire AsyncAcquire(
+			Task* aTask);
+#endif
+
+	private:
+		TaskSemaphore(
+			const TaskSemaphore&) = delete;
+		TaskSemaphore& operator=(
+			const TaskSemaphore&) = delete;
+
+		// Lower bits are the free unit count. The highest bit tells that there are
+		// waiters. Then the count is always zero, and the unit release goes to the
+		// queue under the mutex.
+		mg::box::AtomicU32 myState;
+		mg::box::Mutex myMutex;
+		TaskSyncList myWaiters;
+	};
+
+	// Mutex is a semaphore with a single unit.
+	class TaskMutex
+	{
+	public:
+		TaskMutex() : mySem(1) {}
+
+		bool TryLock() { return mySem.TryAcquire(); }
+
+		bool LockOrEnqueue(
+			Task* aTask) { return mySem.AcquireOrEnqueue(aTask); }
+
+		void Unlock() { mySem.Release(); }
+
+#if MG_CORO_IS_ENABLED
+		TaskCoroOpSemaphoreAcquire AsyncLock(
+			Task* aTask) { return mySem.AsyncAcquire(aTask); }
+#endif
+
+	private:
+		TaskSemaphore mySem;
+	};
+
+	// Bounded channel with any number of senders and receivers. The senders wait when it
+	// is full, the receivers wait when it is empty. When a waiter is woken up, it has a
+	// free slot or an item reserved for it. It must finish the operation with the
+	// *Reserved method then.
+	//
+	// The values are moved only when the operation succeeds.
+	//
+	template<typename T>
+	class TaskChannel
+	{
+	public:
+		TaskChannel(
+			uint32_t aCapacity);
+		~TaskChannel();
+
+		uint32_t GetCapacity() const { return myCapacity; }
+
+		bool TrySend(
+			T&& aValue);
+
+		bool SendOrEnqueue(
+			Task* aTask,
+			T&& aValue);
+
+		// Finish sending after the task was queued and signaled.
+		void SendReserved(
+			T&& aValue);
+
+		bool TryReceive(
+			T& aOutValue);
+
+		bool ReceiveOrEnqueue(
+			Task* aTask,
+			T& aOutValue);
+
+		// Finish receiving after the task was queued and signaled.
+		void ReceiveReserved(
+			T& aOutValue);
+
+#if MG_CORO_IS_ENABLED
+		TaskCoroOpChannelSend<T> AsyncSend(
+			Task* aTask,
+			T&& aValue);
+
+		TaskCoroOpChannelReceive<T> AsyncReceive(
+			Task* aTask);
+#endif
+
+	private:
+		TaskChannel(
+			const TaskChannel&) = delete;
+		TaskChannel& operator=(
+			const TaskChannel&) = delete;
+
+		// Receive into a value or into an optional. The latter is used by the coroutine
+		// operation, so the value doesn't need a default constructor.
+		template<typename Out>
+		bool PrivTryReceive(
+			Out& aOut);
+
+		template<typename Out>
+		bool PrivReceiveOrEnqueue(
+			Task* aTask,
+			Out& aOut);
+
+		template<typename Out>
+		void PrivReceiveReserved(
+			Out& aOut);
+
+		static void PrivSignal(
+			Task* aTask);
+
+		// The methods below are called under the mutex.
+
+		bool PrivCanSend() const;
+
+		bool PrivCanReceive() const;
+
+		// Push the value and reserve it for the first receiver if there is one. The
+		// returned receiver must be signaled after the mutex is unlocked.
+		Task* PrivPush(
+			T&& aValue);
+
+		// Pop a value and reserve the freed slot for the first sender if there is one.
+		// The returned sender must be signaled after the mutex is unlocked.
+		template<typename Out>
+		Task* PrivPop(
+			Out& aOut);
+
+		static void PrivPut(
+			T& aDst,
+			T&& aSrc) { aDst = std::move(aSrc); }
+
+		static void PrivPut(
+			std::optional<T>& aDst,
+			T&& aSrc) { aDst.emplace(std::move(aSrc)); }
+
+		mg::box::Mutex myMutex;
+		T* myItems;
+		const uint32_t myCapacity;
+		uint32_t myHead;
+		uint32_t myCount;
+		// Free slots, reserved for the woken up senders.
+		uint32_t mySendReservedCount;
+		// Items, reserved for the woken up receivers.
+		uint32_t myReceiveReservedCount;
+		TaskSyncList mySenders;
+		TaskSyncList myReceivers;
+
+#if MG_CORO_IS_ENABLED
+		friend struct TaskCoroOpChannelReceive<T>;
+#endif
+	};
+
+	//////////////////////////////////////////////////////////////////////////////////////
+
+#if MG_CORO_IS_ENABLED
+	inline TaskCoroOpSemaphoreAcquire
+	TaskSemaphore::AsyncAcquire(
+		Task* aTask)
+	{
+		return TaskCoroOpSemaphoreAcquire(*this, aTask);
+	}
+
+	inline bool
+	TaskCoroOpSemaphoreAcquire::await_ready() noexcept
+	{
+		return mySem.TryAcquire();
+	}
+
+	inline bool
+	TaskCoroOpSemaphoreAcquire::await_suspend(
+		mg::box::CoroHandle) noexcept
+	{
+		if (mySem.AcquireOrEnqueue(myTask))
+			return false;
+		TaskCoroSyncWait(myTask);
+		return true;
+	}
+
+	//////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename T>
+	inline
+	TaskCoroOpChannelSend<T>::TaskCoroOpChannelSend(
+		TaskChannel<T>& aChannel,
+		Task* aTask,
+		T&& aValue)
+		: myChannel(aChannel)
+		, myTask(aTask)
+		, myValue(&aValue)
+		, myIsWaiting(false)
+	{
+	}
+
+	template<typename T>
+	inline bool
+	TaskCoroOpChannelSend<T>::await_ready() noexcept
+	{
+		return myChannel.TrySend(std::move(*myValue));
+	}
+
+	template<typename T>
+	inline bool
+	TaskCoroOpChannelSend<T>::await_suspend(
+		mg::box::CoroHandle) noexcept
+	{
+		if (myChannel.SendOrEnqueue(myTask, std::move(*myValue)))
+			return false;
+		myIsWaiting = true;
+		TaskCoroSyncWait(myTask);
+		return true;
+	}
+
+	template<typename T>
+	inline void
+	TaskCoroOpChannelSend<T>::await_resume() noexcept
+	{
+		if (myIsWaiting)
+			myChannel.SendReserved(std::move(*myValue));
+	}
+
+	//////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename T>
+	inline
+	TaskCoroOpChannelReceive<T>::TaskCoroOpChannelReceive(
+		TaskChannel<T>& aChannel,
+		Task* aTask)
+		: myChannel(aChannel)
+		, myTask(aTask)
+	{
+	}
+
+	template<typename T>
+	inline bool
+	TaskCoroOpChannelReceive<T>::await_ready() noexcept
+	{
+		return myChannel.PrivTryReceive(myValue);
+	}
+
+	template<typename T>
+	inline bool
+	TaskCoroOpChannelReceive<T>::await_suspend(
+		mg::box::CoroHandle) noexcept
+	{
+		if (myChannel.PrivReceiveOrEnqueue(myTask, myValue))
+			return false;
+		TaskCoroSyncWait(myTask);
+		return true;
+	}
+
+	template<typename T>
+	inline T
+	TaskCoroOpChannelReceive<T>::await_resume() noexcept
+	{
+		if (!myValue.has_value())
+			myChannel.PrivReceiveReserved(myValue);
+		return std::move(*myValue);
+	}
+#endif
+
+	//////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename T>
+	inline
+	TaskChannel<T>::TaskChannel(
+		uint32_t aCapacity)
+		: myItems(std::allocator<T>().allocate(aCapacity))
+		, myCapacity(aCapacity)
+		, myHead(0)
+		, myCount(0)
+		, mySendReservedCount(0)
+		, myReceiveReservedCount(0)
+	{
+		MG_BOX_ASSERT(aCapacity > 0);
+	}
+
+	template<typename T>
+	inline
+	TaskChannel<T>::~TaskChannel()
+	{
+		MG_BOX_ASSERT(mySenders.IsEmpty() && myReceivers.IsEmpty());
+		MG_BOX_ASSERT(mySendReservedCount == 0 && myReceiveReservedCount == 0);
+		for (uint32_t i = 0; i < myCount; ++i)
+			myItems[(myHead + i) % myCapacity].~T();
+		std::allocator<T>().deallocate(myItems, myCapacity);
+	}
+
+	template<typename T>
+	inline bool
+	TaskChannel<T>::TrySend(
+		T&& aValue)
+	{
+		Task* waiter;
+		{
+			mg::box::MutexLock lock(myMutex);
+			if (!PrivCanSend())
+				return false;
+			waiter = PrivPush(std::move(aValue));
+		}
+		PrivSignal(waiter);
+		return true;
+	}
+
+	template<typename T>
+	inline bool
+	TaskChannel<T>::SendOrEnqueue(
+		Task* aTask,
+		T&& aValue)
+	{
+		Task* waiter;
+		{
+			mg::box::MutexLock lock(myMutex);
+			if (!PrivCanSend())
+			{
+				mySenders.Append(aTask);
+				return false;
+			}
+			waiter = PrivPush(std::move(aValue));
+		}
+		PrivSignal(waiter);
+		return true;
+	}
+
+	template<typename T>
+	inline void
+	TaskChannel<T>::SendReserved(
+		T&& aValue)
+	{
+		Task* waiter;
+		{
+			mg::box::MutexLock lock(myMutex);
+			MG_BOX_ASSERT(mySendReservedCount > 0);
+			--mySendReservedCount;
+			waiter = PrivPush(std::move(aValue));
+		}
+		PrivSignal(waiter);
+	}
+
+	template<typename T>
+	inline bool
+	TaskChannel<T>::TryReceive(
+		T& aOutValue)
+	{
+		return PrivTryReceive(aOutValue);
+	}
+
+	template<typename T>
+	inline bool
+	TaskChannel<T>::ReceiveOrEnqueue(
+		Task* aTask,
+		T& aOutValue)
+	{
+		return PrivReceiveOrEnqueue(aTask, aOutValue);
+	}
+
+	template<typename T>
+	inline void
+	TaskChannel<T>::ReceiveReserved(
+		T& aOutValue)
+	{
+		PrivReceiveReserved(aOutValue);
+	}
+
+#if MG_CORO_IS_ENABLED
+	template<typename T>
+	inline TaskCoroOpChannelSend<T>
+	TaskChannel<T>::AsyncSend(
+		Task* aTask,
+		T&& aValue)
+	{
+		return TaskCoroOpChannelSend<T>(*this, aTask, std::move(aValue));
+	}
+
+	template<typename T>
+	inline TaskCoroOpChannelReceive<T>
+	TaskChannel<T>::AsyncReceive(
+		Task* aTask)
+	{
+		return TaskCoroOpChannelReceive<T>(*this, aTask);
+	}
+#endif
+
+	template<typename T>
+	inline bool
+	TaskChannel<T>::PrivCanSend() const
+	{
+		return myCount + mySendReservedCount < myCapacity;
+	}
+
+	template<typename T>
+	inline bool
+	TaskChannel<T>::PrivCanReceive() const
+	{
+		return myCount > myReceiveReservedCount;
+	}
+
+	template<typename T>
+	inline Task*
+	TaskChannel<T>::PrivPush(
+		T&& aValue)
+	{
+		MG_DEV_ASSERT(myCount < myCapacity);
+		new (&myItems[(myHead + myCount) % myCapacity]) T(std::move(aValue));
+		++myCount;
+		if (myReceivers.IsEmpty())
+			return nullptr;
+		++myReceiveReservedCount;
+		return myReceivers.PopFirst();
+	}
+
+	template<typename T>
+	template<typename Out>
+	inline Task*
+	TaskChannel<T>::PrivPop(
+		Out& aOut)
+	{
+		MG_DEV_ASSERT(myCount > 0);
+		T& item = myItems[myHead];
+		PrivPut(aOut, std::move(item));
+		item.~T();
+		if (++myHead == myCapacity)
+			myHead = 0;
+		--myCount;
+		if (mySenders.IsEmpty())
+			return nullptr;
+		++mySendReservedCount;
+		return mySenders.PopFirst();
+	}
+
+	template<typename T>
+	template<typename Out>
+	inline bool
+	TaskChannel<T>::PrivTryReceive(
+		Out& aOut)
+	{
+		Task* waiter;
+		{
+			mg::box::MutexLock lock(myMutex);
+			if (!PrivCanReceive())
+				return false;
+			waiter = PrivPop(aOut);
+		}
+		PrivSignal(waiter);
+		return true;
+	}
+
+	template<typename T>
+	template<typename Out>
+	inline bool
+	TaskChannel<T>::PrivReceiveOrEnqueue(
+		Task* aTask,
+		Out& aOut)
+	{
+		Task* waiter;
+		{
+			mg::box::MutexLock lock(myMutex);
+			if (!PrivCanReceive())
+			{
+				myReceivers.Append(aTask);
+				return false;
+			}
+			waiter = PrivPop(aOut);
+		}
+		PrivSignal(waiter);
+		return true;
+	}
+
+	template<typename T>
+	template<typename Out>
+	inline void
+	TaskChannel<T>::PrivReceiveReserved(
+		Out& aOut)
+	{
+		Task* waiter;
+		{
+			mg::box::MutexLock lock(myMutex);
+			MG_BOX_ASSERT(myReceiveReservedCount > 0);
+			--myReceiveReservedCount;
+			waiter = PrivPop(aOut);
+		}
+		PrivSignal(waiter);
+	}
+
+	template<typename T>
+	inline void
+	TaskChannel<T>::PrivSignal(
+		Task* aTask)
+	{
+		if (aTask != nullptr)
+			aTask->PostSignal();
+	}
+
+}
+}
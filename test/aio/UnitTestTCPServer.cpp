@@ -103,12 +103,16 @@ namespace tcpserver {
 	}
 
 	static void
-	UnitTestTCPServerOnAccept()
+	UnitTestTCPServerOnAccept(
+		const char* aName,
+		const mg::aio::IOCoreParams& aParams,
+		uint32_t aMinThreadCount = 3)
 	{
-		TestCaseGuard guard("Accept");
+		TestCaseGuard guard("Accept, %s", aName);
 		TestTCPServerSubscription sub;
-		mg::aio::IOCore core;
-		core.Start(3);
+		mg::aio::IOCore core(aParams);
+		core.Start(aMinThreadCount, 3);
+		TEST_CHECK(core.GetThreadCount() == aMinThreadCount);
 
 		mg::box::Error::Ptr err;
 		mg::net::Host host = mg::net::HostMakeLocalIPV4(0);
@@ -169,6 +173,8 @@ namespace tcpserver {
 			});
 		}
 		server->PostClose();
+		// The elastic core retires the extra workers when idle.
+		Wait([&]() { return core.GetThreadCount() == aMinThreadCount; });
 	}
 }
 
@@ -180,7 +186,21 @@ namespace tcpserver {
 
 		UnitTestTCPServerBind();
 		UnitTestTCPServerListen();
-		UnitTestTCPServerOnAccept();
+		mg::aio::IOCoreParams params;
+		UnitTestTCPServerOnAccept("default", params);
+		params.myIdleSpinUs = 100;
+		params.myIsIdleYield = true;
+		UnitTestTCPServerOnAccept("idle spin", params);
+		params.myIsLatencyCritical = true;
+		UnitTestTCPServerOnAccept("latency critical", params);
+		params = mg::aio::IOCoreParams();
+		params.myThreadIdleTimeout = 10;
+		params.myThreadGrowReadyCount = 1;
+		UnitTestTCPServerOnAccept("elastic", params, 1);
+		// Fake topology, so the pinning works on any machine.
+		params.myIsNUMAAware = true;
+		params.myNUMANodes.resize(2, mg::box::SysGetNUMANodes()[0]);
+		UnitTestTCPServerOnAccept("numa", params, 1);
 	}
 
 	//////////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,207 @@
+#include "mg/box/Arena.h"
+
+#include "mg/box/ThreadFunc.h"
+
+#include "UnitTest.h"
+
+#include <cstring>
+#include <map>
+
+namespace mg {
+namespace unittests {
+namespace box {
+
+	static bool
+	UnitTestArenaIsAligned(
+		const void* aPtr,
+		size_t aAlignment)
+	{
+		return (uintptr_t)aPtr % aAlignment == 0;
+	}
+
+	static void
+	UnitTestArenaBasic()
+	{
+		TestCaseGuard guard("Basic");
+
+		mg::box::Arena arena;
+		TEST_CHECK(arena.IsEmpty());
+		arena.Reset();
+		TEST_CHECK(arena.IsEmpty());
+
+		// Allocations go one after another in the same chunk.
+		char* p1 = (char*)arena.Allocate(1, 1);
+		char* p2 = (char*)arena.Allocate(1, 1);
+		TEST_CHECK(!arena.IsEmpty());
+		TEST_CHECK(p2 == p1 + 1);
+		// Alignment.
+		uint64_t* p3 = arena.AllocateT<uint64_t>();
+		TEST_CHECK(UnitTestArenaIsAligned(p3, alignof(uint64_t)));
+		TEST_CHECK((char*)p3 > p2 && (char*)p3 < p2 + 1 + alignof(uint64_t));
+		void* p4 = arena.Allocate(3);
+		TEST_CHECK(UnitTestArenaIsAligned(p4, alignof(std::max_align_t)));
+		uint32_t* p5 = arena.AllocateT<uint32_t>(10);
+		for (uint32_t i = 0; i < 10; ++i)
+			p5[i] = i;
+		for (uint32_t i = 0; i < 10; ++i)
+			TEST_CHECK(p5[i] == i);
+
+		arena.Reset();
+		TEST_CHECK(arena.IsEmpty());
+		// Empty size works too.
+		void* p6 = arena.Allocate(0);
+		TEST_CHECK(p6 != nullptr);
+		TEST_CHECK(!arena.IsEmpty());
+	}
+
+	static void
+	UnitTestArenaChunks()
+	{
+		TestCaseGuard guard("Chunks");
+
+		mg::box::Arena arena;
+		// Many chunks. The memory must not overlap.
+		const uint32_t count = 10000;
+		const uint32_t size = 100;
+		std::vector<char*> ptrs;
+		ptrs.reserve(count);
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			char* p = (char*)arena.Allocate(size, 1);
+			memset(p, (int)(i % 256), size);
+			ptrs.push_back(p);
+		}
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			for (uint32_t j = 0; j < size; ++j)
+				TEST_CHECK((uint8_t)ptrs[i][j] == i % 256);
+		}
+		// Exactly one chunk.
+		arena.Reset();
+		const uint32_t pieceSize = (uint32_t)(mg::box::theArenaBigSize - 1);
+		const uint32_t pieceCount = (uint32_t)(mg::box::theArenaChunkSize / pieceSize);
+		char* first = (char*)arena.Allocate(pieceSize, 1);
+		char* last = first;
+		for (uint32_t i = 1; i < pieceCount; ++i)
+		{
+			char* p = (char*)arena.Allocate(pieceSize, 1);
+			TEST_CHECK(p == last + pieceSize);
+			last = p;
+		}
+		uint32_t left = (uint32_t)(mg::box::theArenaChunkSize - pieceSize * pieceCount);
+		last = (char*)arena.Allocate(left, 1);
+		TEST_CHECK(last == first + pieceSize * pieceCount);
+		// The next one doesn't fit.
+		char* next = (char*)arena.Allocate(1, 1);
+		TEST_CHECK(next < first || next >= last + left);
+
+		// Big allocations not fitting into the current chunk take own chunks, and don't
+		// waste the current one.
+		arena.Reset();
+		arena.Allocate(mg::box::theArenaChunkSize - 100, 1);
+		char* small1 = (char*)arena.Allocate(10, 1);
+		char* big = (char*)arena.Allocate(mg::box::theArenaBigSize, 1);
+		memset(big, 1, mg::box::theArenaBigSize);
+		char* small2 = (char*)arena.Allocate(10, 1);
+		TEST_CHECK(small2 == small1 + 10);
+		big = (char*)arena.Allocate(mg::box::theArenaChunkSize, 1);
+		memset(big, 1, mg::box::theArenaChunkSize);
+		small2 = (char*)arena.Allocate(10, 1);
+		TEST_CHECK(small2 == small1 + 20);
+		// Bigger than a chunk are separate heap blocks.
+		big = (char*)arena.Allocate(mg::box::theArenaChunkSize * 3);
+		TEST_CHECK(UnitTestArenaIsAligned(big, alignof(std::max_align_t)));
+		memset(big, 1, mg::box::theArenaChunkSize * 3);
+		small2 = (char*)arena.Allocate(10, 1);
+		TEST_CHECK(small2 == small1 + 30);
+		arena.Reset();
+		TEST_CHECK(arena.IsEmpty());
+		big = (char*)arena.Allocate(mg::box::theArenaChunkSize + 1);
+		memset(big, 1, mg::box::theArenaChunkSize + 1);
+		TEST_CHECK(!arena.IsEmpty());
+	}
+
+	static void
+	UnitTestArenaAllocator()
+	{
+		TestCaseGuard guard("Allocator");
+
+		mg::box::Arena arena;
+		{
+			mg::box::ArenaVector<uint64_t> vec{mg::box::ArenaAllocator<uint64_t>(arena)};
+			for (uint64_t i = 0; i < 10000; ++i)
+				vec.push_back(i);
+			for (uint64_t i = 0; i < 10000; ++i)
+				TEST_CHECK(vec[i] == i);
+
+			mg::box::ArenaString str{mg::box::ArenaAllocator<char>(arena)};
+			for (int i = 0; i < 100; ++i)
+				str += "a long enough string to not fit into the small buffer";
+			TEST_CHECK(str.size() == 100 * strlen(
+				"a long enough string to not fit into the small buffer"));
+
+			// Rebinding.
+			using Pair = std::pair<const int, int>;
+			std::map<int, int, std::less<int>, mg::box::ArenaAllocator<Pair>> map{
+				mg::box::ArenaAllocator<Pair>(arena)};
+			for (int i = 0; i < 1000; ++i)
+				map[i] = i * 2;
+			TEST_CHECK(map.size() == 1000);
+			TEST_CHECK(map[500] == 1000);
+
+			mg::box::ArenaAllocator<int> a1(arena);
+			mg::box::ArenaAllocator<char> a2(a1);
+			mg::box::Arena arena2;
+			mg::box::ArenaAllocator<char> a3(arena2);
+			TEST_CHECK(a1 == a2);
+			TEST_CHECK(a2 != a3);
+		}
+		arena.Reset();
+		TEST_CHECK(arena.IsEmpty());
+	}
+
+	static void
+	UnitTestArenaThreads()
+	{
+		TestCaseGuard guard("Threads");
+
+		// The chunks are allocated in one thread and freed in another. They are pooled
+		// per thread, and must not be lost or broken.
+		const uint32_t count = 1000;
+		std::vector<mg::box::Arena> arenas(count);
+		for (mg::box::Arena& a : arenas)
+		{
+			for (int i = 0; i < 10; ++i)
+				memset(a.Allocate(1000), 1, 1000);
+		}
+		mg::box::ThreadFunc* worker = new mg::box::ThreadFunc("mgtst", [&]() {
+			for (mg::box::Arena& a : arenas)
+			{
+				a.Reset();
+				memset(a.Allocate(1000), 2, 1000);
+			}
+		});
+		worker->Start();
+		worker->StopAndDelete();
+		for (mg::box::Arena& a : arenas)
+		{
+			TEST_CHECK(!a.IsEmpty());
+			a.Reset();
+			TEST_CHECK(a.IsEmpty());
+		}
+	}
+
+	void
+	UnitTestArena()
+	{
+		TestSuiteGuard suite("Arena");
+
+		UnitTestArenaBasic();
+		UnitTestArenaChunks();
+		UnitTestArenaAllocator();
+		UnitTestArenaThreads();
+	}
+
+}
+}
+}
@@ -0,0 +1,225 @@
+#include "mg/box/CancellationToken.h"
+
+#include "mg/box/ThreadFunc.h"
+
+#include "UnitTest.h"
+
+#include <vector>
+
+namespace mg {
+namespace unittests {
+namespace box {
+
+	struct UTCTokenWaiter;
+
+	static void UnitTestCancellationTokenOnCancelA(
+		mg::box::CancellationWaiter* aFirst);
+
+	static void UnitTestCancellationTokenOnCancelB(
+		mg::box::CancellationWaiter* aFirst);
+
+	struct UTCTokenWaiter
+	{
+		UTCTokenWaiter(
+			mg::box::CancellationHandler aHandler)
+			: myWaiter(aHandler, this)
+			, myCount(0)
+		{
+		}
+
+		mg::box::CancellationWaiter myWaiter;
+		mg::box::AtomicU32 myCount;
+	};
+
+	static mg::box::AtomicU32 theUTCTokenCallCountA(0);
+	static mg::box::AtomicU32 theUTCTokenCallCountB(0);
+	static uint32_t theUTCTokenBatchSize = 0;
+
+	static void
+	UnitTestCancellationTokenOnCancel(
+		mg::box::CancellationWaiter* aFirst)
+	{
+		theUTCTokenBatchSize = 0;
+		for (mg::box::CancellationWaiter* w = aFirst; w != nullptr; w = w->myNext)
+		{
+			w->GetOwner<UTCTokenWaiter>()->myCount.IncrementRelaxed();
+			++theUTCTokenBatchSize;
+		}
+	}
+
+	static void
+	UnitTestCancellationTokenOnCancelA(
+		mg::box::CancellationWaiter* aFirst)
+	{
+		theUTCTokenCallCountA.IncrementRelaxed();
+		UnitTestCancellationTokenOnCancel(aFirst);
+	}
+
+	static void
+	UnitTestCancellationTokenOnCancelB(
+		mg::box::CancellationWaiter* aFirst)
+	{
+		theUTCTokenCallCountB.IncrementRelaxed();
+		UnitTestCancellationTokenOnCancel(aFirst);
+	}
+
+	static void
+	UnitTestCancellationTokenBasic()
+	{
+		TestCaseGuard guard("Basic");
+
+		theUTCTokenCallCountA.StoreRelaxed(0);
+		mg::box::CancellationToken::Ptr token = mg::box::CancellationToken::NewShared();
+		TEST_CHECK(!token->IsCancelled());
+		UTCTokenWaiter w1(UnitTestCancellationTokenOnCancelA);
+		TEST_CHECK(w1.myWaiter.GetToken() == nullptr);
+		TEST_CHECK(!w1.myWaiter.IsCancelled());
+		TEST_CHECK(w1.myWaiter.Unsubscribe());
+		TEST_CHECK(w1.myWaiter.Subscribe(token.GetPointer()));
+		TEST_CHECK(w1.myWaiter.GetToken() == token);
+		TEST_CHECK(!w1.myWaiter.IsCancelled());
+		TEST_CHECK(w1.myWaiter.Unsubscribe());
+		TEST_CHECK(w1.myWaiter.GetToken() == nullptr);
+
+		// Cancel.
+		UTCTokenWaiter w2(UnitTestCancellationTokenOnCancelA);
+		TEST_CHECK(w1.myWaiter.Subscribe(token.GetPointer()));
+		TEST_CHECK(w2.myWaiter.Subscribe(token.GetPointer()));
+		token->Cancel();
+		TEST_CHECK(token->IsCancelled());
+		TEST_CHECK(w1.myWaiter.IsCancelled());
+		TEST_CHECK(theUTCTokenCallCountA.LoadRelaxed() == 1);
+		TEST_CHECK(theUTCTokenBatchSize == 2);
+		TEST_CHECK(w1.myCount.LoadRelaxed() == 1);
+		TEST_CHECK(w2.myCount.LoadRelaxed() == 1);
+		// Only the first cancel works.
+		token->Cancel();
+		TEST_CHECK(theUTCTokenCallCountA.LoadRelaxed() == 1);
+		TEST_CHECK(!w1.myWaiter.Unsubscribe());
+		TEST_CHECK(!w1.myWaiter.IsCancelled());
+
+		// Subscription to a cancelled token doesn't call the handler.
+		TEST_CHECK(!w1.myWaiter.Subscribe(token.GetPointer()));
+		TEST_CHECK(w1.myWaiter.IsCancelled());
+		TEST_CHECK(w1.myCount.LoadRelaxed() == 1);
+		TEST_CHECK(!w1.myWaiter.Unsubscribe());
+		// The other waiter is unsubscribed by its destructor.
+	}
+
+	static void
+	UnitTestCancellationTokenTree()
+	{
+		TestCaseGuard guard("Tree");
+
+		theUTCTokenCallCountA.StoreRelaxed(0);
+		theUTCTokenCallCountB.StoreRelaxed(0);
+		mg::box::CancellationToken::Ptr root = mg::box::CancellationToken::NewShared();
+		mg::box::CancellationToken::Ptr c1 = root->NewChild();
+		mg::box::CancellationToken::Ptr c2 = c1->NewChild();
+		mg::box::CancellationToken::Ptr c3 = root->NewChild();
+		UTCTokenWaiter wa1(UnitTestCancellationTokenOnCancelA);
+		UTCTokenWaiter wa2(UnitTestCancellationTokenOnCancelA);
+		UTCTokenWaiter wa3(UnitTestCancellationTokenOnCancelA);
+		UTCTokenWaiter wa4(UnitTestCancellationTokenOnCancelA);
+		UTCTokenWaiter wb1(UnitTestCancellationTokenOnCancelB);
+		UTCTokenWaiter wb2(UnitTestCancellationTokenOnCancelB);
+		TEST_CHECK(wa1.myWaiter.Subscribe(root.GetPointer()));
+		TEST_CHECK(wa2.myWaiter.Subscribe(c1.GetPointer()));
+		TEST_CHECK(wa3.myWaiter.Subscribe(c2.GetPointer()));
+		TEST_CHECK(wb1.myWaiter.Subscribe(c3.GetPointer()));
+		TEST_CHECK(wb2.myWaiter.Subscribe(c2.GetPointer()));
+		// The waiter keeps its token alive, and the token keeps its parent.
+		{
+			mg::box::CancellationToken::Ptr c4 = c2->NewChild();
+			TEST_CHECK(wa4.myWaiter.Subscribe(c4.GetPointer()));
+		}
+
+		// A child is cancelled alone.
+		c3->Cancel();
+		TEST_CHECK(c3->IsCancelled());
+		TEST_CHECK(!root->IsCancelled());
+		TEST_CHECK(theUTCTokenCallCountB.LoadRelaxed() == 1);
+		TEST_CHECK(theUTCTokenBatchSize == 1);
+		TEST_CHECK(wb1.myCount.LoadRelaxed() == 1);
+
+		// The whole tree. One call per handler.
+		root->Cancel();
+		TEST_CHECK(c1->IsCancelled());
+		TEST_CHECK(c2->IsCancelled());
+		TEST_CHECK(wa4.myWaiter.GetToken()->IsCancelled());
+		TEST_CHECK(theUTCTokenCallCountA.LoadRelaxed() == 1);
+		TEST_CHECK(theUTCTokenCallCountB.LoadRelaxed() == 2);
+		TEST_CHECK(wa1.myCount.LoadRelaxed() == 1);
+		TEST_CHECK(wa2.myCount.LoadRelaxed() == 1);
+		TEST_CHECK(wa3.myCount.LoadRelaxed() == 1);
+		TEST_CHECK(wa4.myCount.LoadRelaxed() == 1);
+		TEST_CHECK(wb1.myCount.LoadRelaxed() == 1);
+		TEST_CHECK(wb2.myCount.LoadRelaxed() == 1);
+
+		// A child of a cancelled token is born cancelled.
+		mg::box::CancellationToken::Ptr c5 = c3->NewChild();
+		TEST_CHECK(c5->IsCancelled());
+		c5->Cancel();
+		TEST_CHECK(theUTCTokenCallCountA.LoadRelaxed() == 1);
+		TEST_CHECK(theUTCTokenCallCountB.LoadRelaxed() == 2);
+	}
+
+	static void
+	UnitTestCancellationTokenThreads()
+	{
+		TestCaseGuard guard("Threads");
+
+		// Unsubscribe in parallel with the cancellation. If the handler was called, it
+		// is finished when the unsubscribe returns. If it wasn't, it is never called.
+		const uint32_t count = 100;
+		for (int iter = 0; iter < 200; ++iter)
+		{
+			mg::box::CancellationToken::Ptr root = mg::box::CancellationToken::NewShared();
+			std::vector<UTCTokenWaiter*> waiters;
+			waiters.reserve(count);
+			for (uint32_t i = 0; i < count; ++i)
+			{
+				UTCTokenWaiter* w = new UTCTokenWaiter(
+					i % 2 == 0 ? UnitTestCancellationTokenOnCancelA :
+					UnitTestCancellationTokenOnCancelB);
+				// Children die before the cancellation reaches them sometimes.
+				mg::box::CancellationToken::Ptr token = root;
+				if (i % 3 == 0)
+					token = root->NewChild();
+				TEST_CHECK(w->myWaiter.Subscribe(token.GetPointer()));
+				waiters.push_back(w);
+			}
+			mg::box::ThreadFunc* canceler = new mg::box::ThreadFunc("mgtst", [&]() {
+				root->Cancel();
+			});
+			canceler->Start();
+			for (UTCTokenWaiter* w : waiters)
+			{
+				if (w->myWaiter.Unsubscribe())
+					TEST_CHECK(w->myCount.LoadRelaxed() == 0);
+				else
+					TEST_CHECK(w->myCount.LoadRelaxed() == 1);
+			}
+			canceler->StopAndDelete();
+			TEST_CHECK(root->IsCancelled());
+			for (UTCTokenWaiter* w : waiters)
+			{
+				TEST_CHECK(w->myCount.LoadRelaxed() <= 1);
+				delete w;
+			}
+		}
+	}
+
+	void
+	UnitTestCancellationToken()
+	{
+		TestSuiteGuard suite("CancellationToken");
+
+		UnitTestCancellationTokenBasic();
+		UnitTestCancellationTokenTree();
+		UnitTestCancellationTokenThreads();
+	}
+
+}
+}
+}
@@ -0,0 +1,143 @@
+#include "mg/box/Coro.h"
+
+#include "mg/box/ThreadFunc.h"
+
+#include "UnitTest.h"
+
+#include <vector>
+
+namespace mg {
+namespace unittests {
+namespace box {
+
+#if MG_CORO_IS_ENABLED
+	static mg::box::Coro
+	UnitTestCoroNested(
+		int& aCounter,
+		int aDepth)
+	{
+		++aCounter;
+		if (aDepth > 0)
+			co_await mg::box::CoroCall(UnitTestCoroNested(aCounter, aDepth - 1));
+		co_return;
+	}
+
+	static mg::box::Coro
+	UnitTestCoroBig(
+		int& aCounter)
+	{
+		volatile char buf[10000];
+		buf[0] = 1;
+		// Keep the buffer in the frame.
+		co_await std::suspend_always();
+		aCounter += buf[0];
+		co_return;
+	}
+
+	static void
+	UnitTestCoroFramePool()
+	{
+		TestCaseGuard guard("Frame pool");
+
+		mg::box::CoroFrameStat stat1;
+		mg::box::CoroFrameStat stat2;
+		int counter = 0;
+		// Nested calls take the frames from the pools.
+		mg::box::CoroFrameStatSnapshot(stat1);
+		{
+			mg::box::CoroRef coro(UnitTestCoroNested(counter, 4));
+			coro.ResumeTop();
+			TEST_CHECK(counter == 5);
+		}
+		mg::box::CoroFrameStatSnapshot(stat2);
+		TEST_CHECK(stat2.myPoolAllocCount - stat1.myPoolAllocCount == 5);
+		TEST_CHECK(stat2.myPoolFreeCount - stat1.myPoolFreeCount == 5);
+		TEST_CHECK(stat2.myHeapAllocCount == stat1.myHeapAllocCount);
+		TEST_CHECK(stat2.myHeapFreeCount == stat1.myHeapFreeCount);
+
+		// The frame can be freed before completion.
+		counter = 0;
+		{
+			mg::box::CoroRef coro(UnitTestCoroNested(counter, 4));
+			TEST_CHECK(counter == 0);
+		}
+		mg::box::CoroFrameStatSnapshot(stat1);
+		TEST_CHECK(stat1.myPoolAllocCount - stat2.myPoolAllocCount == 1);
+		TEST_CHECK(stat1.myPoolFreeCount - stat2.myPoolFreeCount == 1);
+
+		// Too big frames go to the heap.
+		counter = 0;
+		{
+			mg::box::CoroRef coro(UnitTestCoroBig(counter));
+			coro.ResumeTop();
+			coro.ResumeTop();
+			TEST_CHECK(counter == 1);
+		}
+		mg::box::CoroFrameStatSnapshot(stat2);
+		TEST_CHECK(stat2.myPoolAllocCount == stat1.myPoolAllocCount);
+		TEST_CHECK(stat2.myHeapAllocCount - stat1.myHeapAllocCount == 1);
+		TEST_CHECK(stat2.myHeapFreeCount - stat1.myHeapFreeCount == 1);
+
+		// Without the pools.
+		mg::box::CoroFramePoolSetEnabled(false);
+		counter = 0;
+		{
+			mg::box::CoroRef coro(UnitTestCoroNested(counter, 2));
+			coro.ResumeTop();
+			TEST_CHECK(counter == 3);
+		}
+		mg::box::CoroFramePoolSetEnabled(true);
+		mg::box::CoroFrameStatSnapshot(stat1);
+		TEST_CHECK(stat1.myPoolAllocCount == stat2.myPoolAllocCount);
+		TEST_CHECK(stat1.myHeapAllocCount - stat2.myHeapAllocCount == 3);
+		TEST_CHECK(stat1.myHeapFreeCount - stat2.myHeapFreeCount == 3);
+	}
+
+	static void
+	UnitTestCoroFramePoolThreads()
+	{
+		TestCaseGuard guard("Frame pool threads");
+
+		// Frames are created in one thread and destroyed in another. The counters of
+		// the exited threads are kept.
+		mg::box::CoroFrameStat stat1;
+		mg::box::CoroFrameStat stat2;
+		mg::box::CoroFrameStatSnapshot(stat1);
+		const uint32_t count = 1000;
+		std::vector<mg::box::CoroRef> coros;
+		coros.reserve(count);
+		int counter = 0;
+		mg::box::ThreadFunc producer("mgtst", [&]() {
+			for (uint32_t i = 0; i < count; ++i)
+				coros.emplace_back(UnitTestCoroNested(counter, 0));
+		});
+		producer.Start();
+		producer.BlockingStop();
+		mg::box::ThreadFunc consumer("mgtst", [&]() {
+			for (mg::box::CoroRef& c : coros)
+				c.ResumeTop();
+			coros.clear();
+		});
+		consumer.Start();
+		consumer.BlockingStop();
+		TEST_CHECK(counter == (int)count);
+		mg::box::CoroFrameStatSnapshot(stat2);
+		TEST_CHECK(stat2.myPoolAllocCount - stat1.myPoolAllocCount == count);
+		TEST_CHECK(stat2.myPoolFreeCount - stat1.myPoolFreeCount == count);
+	}
+#endif
+
+	void
+	UnitTestCoro()
+	{
+		TestSuiteGuard suite("Coro");
+
+#if MG_CORO_IS_ENABLED
+		UnitTestCoroFramePool();
+		UnitTestCoroFramePoolThreads();
+#endif
+	}
+
+}
+}
+}
@@ -0,0 +1,149 @@
+#include "mg/box/Histogram.h"
+
+#include "mg/box/ThreadFunc.h"
+
+#include "UnitTest.h"
+
+namespace mg {
+namespace unittests {
+namespace box {
+
+	static void
+	UnitTestHistogramBasic()
+	{
+		TestCaseGuard guard("Basic");
+
+		mg::box::Histogram h;
+		TEST_CHECK(h.GetCount() == 0);
+		TEST_CHECK(h.GetSum() == 0);
+		TEST_CHECK(h.GetMax() == 0);
+		TEST_CHECK(h.GetAverage() == 0);
+		TEST_CHECK(h.GetPercentile(50) == 0);
+
+		// Small values are precise.
+		for (uint64_t i = 1; i <= 10; ++i)
+			h.Add(i);
+		TEST_CHECK(h.GetCount() == 10);
+		TEST_CHECK(h.GetSum() == 55);
+		TEST_CHECK(h.GetMax() == 10);
+		TEST_CHECK(h.GetAverage() == 5.5);
+		TEST_CHECK(h.GetPercentile(0) == 1);
+		TEST_CHECK(h.GetPercentile(50) == 5);
+		TEST_CHECK(h.GetPercentile(90) == 9);
+		TEST_CHECK(h.GetPercentile(100) == 10);
+
+		h.Clear();
+		TEST_CHECK(h.GetCount() == 0);
+		TEST_CHECK(h.GetMax() == 0);
+		TEST_CHECK(h.GetPercentile(99) == 0);
+
+		// Big values are within the relative error.
+		for (uint64_t i = 1; i <= 100000; ++i)
+			h.Add(i);
+		uint64_t p50 = h.GetPercentile(50);
+		TEST_CHECK(p50 >= 50000 && p50 <= 50000 + 50000 / 16);
+		uint64_t p99 = h.GetPercentile(99);
+		TEST_CHECK(p99 >= 99000 && p99 <= 99000 + 99000 / 16);
+		// The max is never exceeded.
+		TEST_CHECK(h.GetPercentile(100) == 100000);
+	}
+
+	static void
+	UnitTestHistogramBuckets()
+	{
+		TestCaseGuard guard("Buckets");
+
+		using mg::box::Histogram;
+		const uint32_t subCount = mg::box::theHistogramSubBucketCount;
+		for (uint32_t i = 0; i < subCount; ++i)
+		{
+			TEST_CHECK(Histogram::GetBucketIndex(i) == i);
+			TEST_CHECK(Histogram::GetBucketMax(i) == i);
+		}
+		TEST_CHECK(Histogram::GetBucketIndex(subCount) == subCount);
+		TEST_CHECK(Histogram::GetBucketIndex(subCount * 2 - 1) == subCount * 2 - 1);
+		// The next power of 2 has buckets 2 values wide.
+		TEST_CHECK(Histogram::GetBucketIndex(subCount * 2) == subCount * 2);
+		TEST_CHECK(Histogram::GetBucketIndex(subCount * 2 + 1) == subCount * 2);
+		TEST_CHECK(Histogram::GetBucketMax(subCount * 2) == subCount * 2 + 1);
+		TEST_CHECK(Histogram::GetBucketIndex(UINT64_MAX) ==
+			mg::box::theHistogramBucketCount - 1);
+		TEST_CHECK(Histogram::GetBucketMax(mg::box::theHistogramBucketCount - 1) ==
+			UINT64_MAX);
+		// Each value fits into its bucket, and the buckets are monotonic.
+		uint64_t values[] = {17, 100, 1000, 12345, 1ULL << 40, (1ULL << 40) + 12345};
+		for (uint64_t v : values)
+		{
+			uint32_t idx = Histogram::GetBucketIndex(v);
+			TEST_CHECK(v <= Histogram::GetBucketMax(idx));
+			TEST_CHECK(v > Histogram::GetBucketMax(idx - 1));
+		}
+	}
+
+	static void
+	UnitTestHistogramMerge()
+	{
+		TestCaseGuard guard("Merge");
+
+		mg::box::Histogram h1;
+		mg::box::Histogram h2;
+		h1.Add(1);
+		h1.Add(3);
+		h2.Add(2);
+		h2.Add(100);
+		mg::box::Histogram res;
+		res.Merge(h1);
+		res.Merge(h2);
+		TEST_CHECK(res.GetCount() == 4);
+		TEST_CHECK(res.GetSum() == 106);
+		TEST_CHECK(res.GetMax() == 100);
+		TEST_CHECK(res.GetPercentile(50) == 2);
+		TEST_CHECK(res.GetPercentile(75) == 3);
+		TEST_CHECK(res.GetPercentile(100) == 100);
+	}
+
+	static void
+	UnitTestHistogramConcurrent()
+	{
+		TestCaseGuard guard("Concurrent");
+
+		// The writer is never stopped, while the reader merges it.
+		mg::box::Histogram h;
+		mg::box::AtomicBool isDone(false);
+		const uint64_t count = 1000000;
+		mg::box::ThreadFunc* writer = new mg::box::ThreadFunc("mgtst", [&]() {
+			for (uint64_t i = 0; i < count; ++i)
+				h.Add(i % 1000);
+			isDone.StoreRelease(true);
+		});
+		writer->Start();
+		uint64_t lastCount = 0;
+		while (!isDone.LoadAcquire())
+		{
+			mg::box::Histogram snap;
+			snap.Merge(h);
+			TEST_CHECK(snap.GetCount() >= lastCount);
+			TEST_CHECK(snap.GetMax() < 1000);
+			lastCount = snap.GetCount();
+		}
+		writer->StopAndDelete();
+		mg::box::Histogram snap;
+		snap.Merge(h);
+		TEST_CHECK(snap.GetCount() == count);
+		TEST_CHECK(snap.GetMax() == 999);
+	}
+
+	void
+	UnitTestHistogram()
+	{
+		TestSuiteGuard suite("Histogram");
+
+		UnitTestHistogramBasic();
+		UnitTestHistogramBuckets();
+		UnitTestHistogramMerge();
+		UnitTestHistogramConcurrent();
+	}
+
+}
+}
+}
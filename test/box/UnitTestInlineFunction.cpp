@@ -0,0 +1,163 @@
+#include "mg/box/InlineFunction.h"
+
+#include "UnitTest.h"
+
+#include <string>
+
+namespace mg {
+namespace unittests {
+namespace box {
+
+	using UTIFFunc = mg::box::InlineFunction<int(int), 32>;
+
+	// Counts the live objects to ensure the function destroys them properly.
+	struct UTIFValue
+	{
+		UTIFValue(
+			int aValue,
+			int& aCounter)
+			: myValue(aValue)
+			, myCounter(&aCounter)
+		{
+			++*myCounter;
+		}
+
+		UTIFValue(
+			const UTIFValue& aOther)
+			: myValue(aOther.myValue)
+			, myCounter(aOther.myCounter)
+		{
+			++*myCounter;
+		}
+
+		~UTIFValue()
+		{
+			--*myCounter;
+		}
+
+		int myValue;
+		int* myCounter;
+	};
+
+	static int
+	UnitTestInlineFunctionDouble(
+		int aArg)
+	{
+		return aArg * 2;
+	}
+
+	static void
+	UnitTestInlineFunctionBasic()
+	{
+		UTIFFunc f;
+		TEST_CHECK(!f);
+		f = [](int aArg) { return aArg + 1; };
+		TEST_CHECK(f);
+		TEST_CHECK(f(1) == 2);
+
+		f = &UnitTestInlineFunctionDouble;
+		TEST_CHECK(f(3) == 6);
+
+		int mul = 3;
+		f = [mul](int aArg) { return aArg * mul; };
+		TEST_CHECK(f(3) == 9);
+
+		f = nullptr;
+		TEST_CHECK(!f);
+		f = [&mul](int aArg) { return aArg * mul++; };
+		TEST_CHECK(f(1) == 3);
+		TEST_CHECK(f(1) == 4);
+		TEST_CHECK(mul == 5);
+		f.Clear();
+		TEST_CHECK(!f);
+
+		// Mutable state is kept inside.
+		int counter = 0;
+		f = [counter](int aArg) mutable { return aArg + counter++; };
+		TEST_CHECK(f(0) == 0);
+		TEST_CHECK(f(0) == 1);
+		TEST_CHECK(f(0) == 2);
+		TEST_CHECK(counter == 0);
+
+		TEST_CHECK(UTIFFunc::Fits<char[32]>());
+		TEST_CHECK(!UTIFFunc::Fits<char[33]>());
+	}
+
+	static void
+	UnitTestInlineFunctionCopyMove()
+	{
+		int counter = 0;
+		{
+			UTIFValue v(10, counter);
+			UTIFFunc f1([v](int aArg) { return v.myValue + aArg; });
+			TEST_CHECK(counter == 2);
+			TEST_CHECK(f1(1) == 11);
+
+			// Copy.
+			UTIFFunc f2(f1);
+			TEST_CHECK(counter == 3);
+			TEST_CHECK(f1(1) == 11);
+			TEST_CHECK(f2(2) == 12);
+			UTIFFunc f3;
+			f3 = f2;
+			TEST_CHECK(counter == 4);
+			TEST_CHECK(f3(3) == 13);
+
+			// Move.
+			UTIFFunc f4(std::move(f3));
+			TEST_CHECK(counter == 4);
+			TEST_CHECK(!f3);
+			TEST_CHECK(f4(4) == 14);
+			f3 = std::move(f4);
+			TEST_CHECK(counter == 4);
+			TEST_CHECK(!f4);
+			TEST_CHECK(f3(5) == 15);
+
+			// Override.
+			f3 = [](int aArg) { return aArg; };
+			TEST_CHECK(counter == 3);
+			f2 = f1;
+			TEST_CHECK(counter == 3);
+			f2 = {};
+			TEST_CHECK(counter == 2);
+			TEST_CHECK(!f2);
+		}
+		TEST_CHECK(counter == 0);
+		// Self-override.
+		{
+			UTIFFunc f;
+			UTIFValue v(5, counter);
+			f = [v](int aArg) { return v.myValue + aArg; };
+			TEST_CHECK(counter == 2);
+			UTIFFunc& ref = f;
+			f = ref;
+			TEST_CHECK(f(1) == 6);
+			f = std::move(ref);
+			TEST_CHECK(f(1) == 6);
+			TEST_CHECK(counter == 2);
+		}
+		TEST_CHECK(counter == 0);
+		// Non-trivial capture.
+		{
+			std::string str("a long string which does not fit into SSO");
+			mg::box::InlineFunction<std::string(void), 64> f(
+				[str]() { return str + "!"; });
+			TEST_CHECK(f() == str + "!");
+			mg::box::InlineFunction<std::string(void), 64> f2(f);
+			f = nullptr;
+			TEST_CHECK(f2() == str + "!");
+		}
+	}
+
+	void
+	UnitTestInlineFunction()
+	{
+		TestSuiteGuard suite("InlineFunction");
+
+		UnitTestInlineFunctionBasic();
+		UnitTestInlineFunctionCopyMove();
+	}
+
+}
+}
+}
@@ -0,0 +1,298 @@
+#include "mg/box/PeriodicTimingWheel.h"
+
+#include "mg/test/Random.h"
+
+#include "UnitTest.h"
+
+#include <vector>
+
+namespace mg {
+namespace unittests {
+namespace box {
+
+	struct UTPTWheelValue
+	{
+		UTPTWheelValue()
+			: myDeadline(0)
+			, myPeriod(0)
+			, myWaitPrev(nullptr)
+			, myWaitNext(nullptr)
+			, myIndex(-1)
+		{
+		}
+
+		uint64_t myDeadline;
+		uint64_t myPeriod;
+		UTPTWheelValue* myWaitPrev;
+		UTPTWheelValue* myWaitNext;
+		int32_t myIndex;
+	};
+
+	using UTPTWheel = mg::box::PeriodicTimingWheel<UTPTWheelValue>;
+
+	static void
+	UnitTestPeriodicTimingWheelBasic()
+	{
+		TestCaseGuard guard("Basic");
+
+		UTPTWheel wheel;
+		TEST_CHECK(wheel.Count() == 0);
+		TEST_CHECK(wheel.GetGroupCount() == 0);
+		TEST_CHECK(wheel.GetNextDeadline() == MG_TIME_INFINITE);
+		TEST_CHECK(wheel.PopExpired(100) == nullptr);
+
+		// Non-periodic elements work like in the usual wheel.
+		UTPTWheelValue v1;
+		UTPTWheelValue v2;
+		v1.myDeadline = 120;
+		v2.myDeadline = 110;
+		wheel.Push(&v1);
+		wheel.Push(&v2);
+		TEST_CHECK(wheel.Count() == 2);
+		TEST_CHECK(wheel.GetGroupCount() == 0);
+		TEST_CHECK(wheel.GetNextDeadline() == 110);
+		TEST_CHECK(wheel.PopExpired(115) == &v2);
+		TEST_CHECK(wheel.PopExpired(115) == nullptr);
+		TEST_CHECK(wheel.PopExpired(120) == &v1);
+		TEST_CHECK(wheel.Count() == 0);
+
+		// Periodic elements of the same deadline are in one group.
+		UTPTWheelValue v3;
+		v1.myPeriod = 10;
+		v2.myPeriod = 10;
+		v3.myPeriod = 10;
+		v1.myDeadline = 150;
+		v2.myDeadline = 150;
+		v3.myDeadline = 150;
+		wheel.Push(&v1);
+		wheel.Push(&v2);
+		wheel.Push(&v3);
+		TEST_CHECK(v1.myIndex >= 0 && v2.myIndex >= 0 && v3.myIndex >= 0);
+		TEST_CHECK(wheel.Count() == 3);
+		TEST_CHECK(wheel.GetGroupCount() == 1);
+		// The groups are in a timing wheel too. So the next deadline is a hint, which
+		// can be earlier than the real one.
+		TEST_CHECK(wheel.GetNextDeadline() <= 150);
+		TEST_CHECK(wheel.PopExpired(149) == nullptr);
+		wheel.Remove(&v2);
+		TEST_CHECK(v2.myIndex == -1);
+		TEST_CHECK(wheel.Count() == 2);
+		TEST_CHECK(wheel.PopExpired(150) == &v1);
+		TEST_CHECK(v1.myIndex == -1);
+		TEST_CHECK(wheel.PopExpired(150) == &v3);
+		TEST_CHECK(wheel.GetGroupCount() == 0);
+		TEST_CHECK(wheel.Count() == 0);
+		TEST_CHECK(wheel.GetNextDeadline() == MG_TIME_INFINITE);
+
+		// Each tick of a period has own group, even an earlier one. Another period
+		// makes another group.
+		v2.myDeadline = 170;
+		v1.myDeadline = 160;
+		v3.myPeriod = 20;
+		v3.myDeadline = 160;
+		wheel.Push(&v2);
+		wheel.Push(&v1);
+		wheel.Push(&v3);
+		TEST_CHECK(wheel.Count() == 3);
+		TEST_CHECK(wheel.GetGroupCount() == 3);
+		TEST_CHECK(wheel.GetNextDeadline() <= 160);
+		UTPTWheelValue* e1 = wheel.PopExpired(160);
+		UTPTWheelValue* e2 = wheel.PopExpired(160);
+		TEST_CHECK((e1 == &v1 && e2 == &v3) || (e1 == &v3 && e2 == &v1));
+		TEST_CHECK(wheel.PopExpired(165) == nullptr);
+		TEST_CHECK(wheel.GetGroupCount() == 1);
+		TEST_CHECK(wheel.PopExpired(170) == &v2);
+		TEST_CHECK(wheel.Count() == 0);
+		TEST_CHECK(wheel.GetGroupCount() == 0);
+
+		// A deadline off the ticks of the period goes to the wheel.
+		v1.myDeadline = 185;
+		v2.myDeadline = 190;
+		v3.myPeriod = 10;
+		v3.myDeadline = 190;
+		wheel.Push(&v1);
+		wheel.Push(&v2);
+		wheel.Push(&v3);
+		TEST_CHECK(wheel.GetGroupCount() == 1);
+		TEST_CHECK(wheel.GetNextDeadline() <= 185);
+		TEST_CHECK(wheel.PopExpired(185) == &v1);
+		TEST_CHECK(wheel.PopExpired(185) == nullptr);
+		TEST_CHECK(wheel.GetGroupCount() == 1);
+		TEST_CHECK(wheel.PopExpired(190) == &v2);
+		TEST_CHECK(wheel.GetNextDeadline() == 190);
+		// The group being popped is not joined by the new elements.
+		v1.myDeadline = 190;
+		wheel.Push(&v1);
+		TEST_CHECK(wheel.GetGroupCount() == 2);
+		TEST_CHECK(wheel.PopExpired(190) == &v3);
+		TEST_CHECK(wheel.PopExpired(190) == &v1);
+		TEST_CHECK(wheel.Count() == 0);
+		TEST_CHECK(wheel.GetGroupCount() == 0);
+
+		// A far tick doesn't prevent the grouping of the nearer ones.
+		std::vector<UTPTWheelValue> values(1000);
+		v1.myPeriod = 1000;
+		v1.myDeadline = 100000;
+		wheel.Push(&v1);
+		for (UTPTWheelValue& v : values)
+		{
+			v.myPeriod = 1000;
+			v.myDeadline = 2000;
+			wheel.Push(&v);
+		}
+		TEST_CHECK(wheel.GetGroupCount() == 2);
+		TEST_CHECK(wheel.Count() == 1001);
+		for (UTPTWheelValue& v : values)
+			TEST_CHECK(wheel.PopExpired(2000) == &v);
+		TEST_CHECK(wheel.PopExpired(2000) == nullptr);
+		TEST_CHECK(wheel.GetGroupCount() == 1);
+		wheel.Remove(&v1);
+		TEST_CHECK(wheel.GetGroupCount() == 0);
+		TEST_CHECK(wheel.Count() == 0);
+		v1.myPeriod = 10;
+		v1.myDeadline = 180;
+
+		// Removal of the last element of a group drops the group.
+		wheel.Push(&v1);
+		TEST_CHECK(wheel.GetGroupCount() == 1);
+		wheel.Remove(&v1);
+		TEST_CHECK(wheel.GetGroupCount() == 0);
+		TEST_CHECK(wheel.Count() == 0);
+		TEST_CHECK(wheel.GetNextDeadline() == MG_TIME_INFINITE);
+	}
+
+	static void
+	UnitTestPeriodicTimingWheelTicks()
+	{
+		TestCaseGuard guard("Ticks");
+
+		// Many elements following the ticks of one period share one group all the time.
+		const uint32_t count = 1000;
+		const uint64_t period = 100;
+		UTPTWheel wheel;
+		std::vector<UTPTWheelValue> values(count);
+		uint64_t now = 12000;
+		for (UTPTWheelValue& v : values)
+		{
+			v.myPeriod = period;
+			// Any time within the same period gives the same tick.
+			v.myDeadline = mg::box::PeriodFirstTick(period,
+				now + mg::tst::RandomUniformUInt32(0, period - 1));
+			wheel.Push(&v);
+		}
+		TEST_CHECK(wheel.GetGroupCount() == 1);
+		for (int i = 0; i < 10; ++i)
+		{
+			now = mg::box::PeriodFirstTick(period, now);
+			TEST_CHECK(wheel.GetNextDeadline() <= now);
+			TEST_CHECK(wheel.PopExpired(now - 1) == nullptr);
+			uint32_t popped = 0;
+			UTPTWheelValue* v;
+			while ((v = wheel.PopExpired(now)) != nullptr)
+			{
+				uint32_t tickCount;
+				v->myDeadline = mg::box::PeriodNextTick(v->myDeadline, period,
+					mg::box::PERIOD_MISS_SKIP, now, tickCount);
+				TEST_CHECK(tickCount == 1);
+				// Popped elements are pushed back at once. They open a group of the
+				// next tick while the current one is not empty yet.
+				wheel.Push(v);
+				++popped;
+				if (popped == count)
+					break;
+			}
+			TEST_CHECK(popped == count);
+			TEST_CHECK(wheel.GetGroupCount() == 1);
+			TEST_CHECK(wheel.Count() == count);
+		}
+		for (UTPTWheelValue& v : values)
+			wheel.Remove(&v);
+		TEST_CHECK(wheel.Count() == 0);
+		TEST_CHECK(wheel.GetGroupCount() == 0);
+	}
+
+	static void
+	UnitTestPeriodicTimingWheelRandom()
+	{
+		TestCaseGuard guard("Random");
+
+		// Mix of periodic and non-periodic elements, checked via a full scan.
+		const uint32_t count = 2000;
+		const uint32_t iterCount = 20000;
+		const uint64_t periods[] = {0, 10, 100, 1000};
+		UTPTWheel wheel;
+		std::vector<UTPTWheelValue> values(count);
+		uint64_t now = mg::tst::RandomUInt32();
+		uint32_t inWheel = 0;
+		for (uint32_t iter = 0; iter < iterCount; ++iter)
+		{
+			UTPTWheelValue& v = values[mg::tst::RandomUniformUInt32(0, count - 1)];
+			if (v.myIndex >= 0)
+			{
+				if (mg::tst::RandomBool())
+				{
+					wheel.Remove(&v);
+					TEST_CHECK(v.myIndex == -1);
+					--inWheel;
+				}
+			}
+			else
+			{
+				v.myPeriod = periods[mg::tst::RandomUniformUInt32(0, 3)];
+				if (v.myPeriod != 0 && mg::tst::RandomBool())
+					v.myDeadline = mg::box::PeriodFirstTick(v.myPeriod, now);
+				else
+					v.myDeadline = now + mg::tst::RandomUniformUInt32(0, 2000);
+				wheel.Push(&v);
+				++inWheel;
+			}
+			TEST_CHECK(wheel.Count() == inWheel);
+			if (mg::tst::RandomUniformUInt32(0, 9) != 0)
+				continue;
+
+			uint64_t next = wheel.GetNextDeadline();
+			if (mg::tst::RandomBool() && next != MG_TIME_INFINITE)
+				now = next;
+			else
+				now += mg::tst::RandomUniformUInt32(0, 500);
+			UTPTWheelValue* e;
+			while ((e = wheel.PopExpired(now)) != nullptr)
+			{
+				TEST_CHECK(e->myIndex == -1);
+				TEST_CHECK(e->myDeadline <= now);
+				--inWheel;
+			}
+			TEST_CHECK(wheel.Count() == inWheel);
+			next = MG_TIME_INFINITE;
+			for (const UTPTWheelValue& r : values)
+			{
+				if (r.myIndex < 0)
+					continue;
+				TEST_CHECK(r.myDeadline > now);
+				if (r.myDeadline < next)
+					next = r.myDeadline;
+			}
+			TEST_CHECK(wheel.GetNextDeadline() <= next);
+		}
+		for (UTPTWheelValue& v : values)
+		{
+			if (v.myIndex >= 0)
+				wheel.Remove(&v);
+		}
+		TEST_CHECK(wheel.Count() == 0);
+		TEST_CHECK(wheel.GetGroupCount() == 0);
+	}
+
+	void
+	UnitTestPeriodicTimingWheel()
+	{
+		TestSuiteGuard suite("PeriodicTimingWheel");
+
+		UnitTestPeriodicTimingWheelBasic();
+		UnitTestPeriodicTimingWheelTicks();
+		UnitTestPeriodicTimingWheelRandom();
+	}
+
+}
+}
+}
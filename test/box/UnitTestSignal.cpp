@@ -33,6 +33,25 @@ namespace box {
 		TEST_CHECK(!s.Receive());
 
 		TEST_CHECK(!s.ReceiveTimed(mg::box::TimeDuration(1)));
+
+		s.Send();
+		TEST_CHECK(s.ReceiveSpin(0, false));
+		TEST_CHECK(!s.Receive());
+
+		uint64_t ts = mg::box::GetMicroseconds();
+		TEST_CHECK(!s.ReceiveSpin(200, false));
+		TEST_CHECK(!s.ReceiveSpin(200, true));
+		TEST_CHECK(mg::box::GetMicroseconds() - ts >= 400);
+
+		// Spin until the signal comes from another thread.
+		mg::box::ThreadFunc sender("mgtst", [&]() {
+			mg::box::Sleep(1);
+			s.Send();
+		});
+		sender.Start();
+		TEST_CHECK(s.ReceiveSpin(MG_TIME_INFINITE, true));
+		TEST_CHECK(!s.Receive());
+		sender.BlockingStop();
 	}
 
 	static void
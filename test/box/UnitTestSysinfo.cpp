@@ -14,6 +14,18 @@ namespace box {
 		// Just ensure it is not crashing.
 		Report("Is WSL:     %d", (int)mg::box::SysIsWSL());
 		Report("Core count: %u", mg::box::SysGetCPUCoreCount());
+
+		const std::vector<mg::box::SysNUMANode>& nodes = mg::box::SysGetNUMANodes();
+		TEST_CHECK(!nodes.empty());
+		uint32_t cpuCount = 0;
+		for (uint32_t i = 0; i < nodes.size(); ++i)
+		{
+			const std::vector<uint32_t>& cpus = nodes[i].myCPUs;
+			TEST_CHECK(!cpus.empty());
+			Report("Node %u:     %u CPUs, first %u", i, (uint32_t)cpus.size(), cpus[0]);
+			cpuCount += (uint32_t)cpus.size();
+		}
+		TEST_CHECK(cpuCount >= 1);
 	}
 
 }
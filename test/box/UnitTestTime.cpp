@@ -1,3 +1,4 @@
+#include "mg/box/Thread.h"
 #include "mg/box/Time.h"
 
 #include "UnitTest.h"
@@ -137,6 +138,99 @@ namespace time {
 			TEST_CHECK(l.myPoint.myValue == 0);
 		}
 	}
+
+	static void
+	UnitTestTimeMicroseconds()
+	{
+		TestCaseGuard guard("Microseconds");
+
+		// The same clock as milliseconds.
+		uint64_t ms1 = mg::box::GetMilliseconds();
+		uint64_t us = mg::box::GetMicroseconds();
+		uint64_t ms2 = mg::box::GetMilliseconds();
+		TEST_CHECK(us / 1000 >= ms1 && us / 1000 <= ms2);
+
+		uint64_t us2 = mg::box::GetMicroseconds();
+		TEST_CHECK(us2 >= us);
+		mg::box::Sleep(2);
+		TEST_CHECK(mg::box::GetMicroseconds() >= us2 + 2000);
+
+		TEST_CHECK(mg::box::TimeMsToUs(0) == 0);
+		TEST_CHECK(mg::box::TimeMsToUs(12) == 12000);
+		TEST_CHECK(mg::box::TimeMsToUs(MG_TIME_INFINITE) == MG_TIME_INFINITE);
+		TEST_CHECK(mg::box::TimeMsToUs(MG_TIME_INFINITE / 10) == MG_TIME_INFINITE);
+		TEST_CHECK(mg::box::TimeUsToMs(0) == 0);
+		TEST_CHECK(mg::box::TimeUsToMs(12999) == 12);
+		TEST_CHECK(mg::box::TimeUsToMs(MG_TIME_INFINITE) == MG_TIME_INFINITE);
+	}
+
+	static void
+	UnitTestTimePeriod()
+	{
+		TestCaseGuard guard("Period");
+
+		TEST_CHECK(mg::box::PeriodFirstTick(10, 0) == 10);
+		TEST_CHECK(mg::box::PeriodFirstTick(10, 9) == 10);
+		TEST_CHECK(mg::box::PeriodFirstTick(10, 10) == 20);
+		TEST_CHECK(mg::box::PeriodFirstTick(10, 123) == 130);
+
+		// Before the tick.
+		uint32_t count = 100;
+		TEST_CHECK(mg::box::PeriodNextTick(130, 10, mg::box::PERIOD_MISS_SKIP, 125,
+			count) == 130);
+		TEST_CHECK(count == 0);
+		count = 100;
+		TEST_CHECK(mg::box::PeriodNextTick(130, 10, mg::box::PERIOD_MISS_CATCH_UP, 129,
+			count) == 130);
+		TEST_CHECK(count == 0);
+		// On time.
+		const mg::box::PeriodMissPolicy policies[] = {
+			mg::box::PERIOD_MISS_SKIP, mg::box::PERIOD_MISS_CATCH_UP,
+			mg::box::PERIOD_MISS_COALESCE,
+		};
+		for (mg::box::PeriodMissPolicy p : policies)
+		{
+			TEST_CHECK(mg::box::PeriodNextTick(130, 10, p, 130, count) == 140);
+			TEST_CHECK(count == 1);
+			TEST_CHECK(mg::box::PeriodNextTick(130, 10, p, 139, count) == 140);
+			TEST_CHECK(count == 1);
+		}
+		// Late by several periods.
+		TEST_CHECK(mg::box::PeriodNextTick(130, 10, mg::box::PERIOD_MISS_SKIP, 165,
+			count) == 170);
+		TEST_CHECK(count == 1);
+		TEST_CHECK(mg::box::PeriodNextTick(130, 10, mg::box::PERIOD_MISS_CATCH_UP, 165,
+			count) == 140);
+		TEST_CHECK(count == 1);
+		TEST_CHECK(mg::box::PeriodNextTick(130, 10, mg::box::PERIOD_MISS_COALESCE, 165,
+			count) == 170);
+		TEST_CHECK(count == 4);
+		TEST_CHECK(mg::box::PeriodNextTick(130, 10, mg::box::PERIOD_MISS_COALESCE, 170,
+			count) == 180);
+		TEST_CHECK(count == 5);
+	}
+
+	static void
+	UnitTestTimeTicks()
+	{
+		TestCaseGuard guard("Ticks");
+
+		double ticksPerUs = mg::box::GetTicksPerMicrosecond();
+		TEST_CHECK(ticksPerUs > 0);
+		// Is measured only once.
+		TEST_CHECK(mg::box::GetTicksPerMicrosecond() == ticksPerUs);
+
+		uint64_t ticks1 = mg::box::GetTicks();
+		uint64_t us1 = mg::box::GetMicroseconds();
+		mg::box::Sleep(10);
+		uint64_t ticks2 = mg::box::GetTicks();
+		uint64_t us2 = mg::box::GetMicroseconds();
+		TEST_CHECK(ticks2 > ticks1);
+		// The conversion is roughly right. The sleep could be interrupted by the OS
+		// anywhere, so the precision is low.
+		double us = (ticks2 - ticks1) / ticksPerUs;
+		TEST_CHECK(us >= (us2 - us1) * 0.5 && us <= (us2 - us1) * 2);
+	}
 }
 
 	void
@@ -148,6 +242,9 @@ namespace time {
 		UnitTestTimePoint();
 		UnitTestTimeDuration();
 		UnitTestTimeLimit();
+		UnitTestTimeMicroseconds();
+		UnitTestTimePeriod();
+		UnitTestTimeTicks();
 	}
 
 }
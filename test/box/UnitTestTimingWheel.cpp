@@ -0,0 +1,319 @@
+#include "mg/box/TimingWheel.h"
+
+#include "mg/test/Random.h"
+
+#include "UnitTest.h"
+
+#include <vector>
+
+namespace mg {
+namespace unittests {
+namespace box {
+
+	struct UTTWheelValue
+	{
+		UTTWheelValue()
+			: myDeadline(0)
+			, myWaitPrev(nullptr)
+			, myWaitNext(nullptr)
+			, myIndex(-1)
+		{
+		}
+
+		uint64_t myDeadline;
+		UTTWheelValue* myWaitPrev;
+		UTTWheelValue* myWaitNext;
+		int32_t myIndex;
+	};
+
+	using UTTWheel = mg::box::TimingWheel<UTTWheelValue>;
+
+	static void
+	UnitTestTimingWheelBasic()
+	{
+		TestCaseGuard guard("Basic");
+
+		UTTWheel wheel;
+		TEST_CHECK(wheel.Count() == 0);
+		TEST_CHECK(wheel.GetNextDeadline() == MG_TIME_INFINITE);
+		TEST_CHECK(wheel.PopExpired(100) == nullptr);
+
+		// Expired right away.
+		UTTWheelValue v1;
+		v1.myDeadline = 50;
+		wheel.Push(&v1);
+		TEST_CHECK(v1.myIndex >= 0);
+		TEST_CHECK(wheel.Count() == 1);
+		TEST_CHECK(wheel.GetNextDeadline() <= 100);
+		TEST_CHECK(wheel.PopExpired(100) == &v1);
+		TEST_CHECK(v1.myIndex == -1);
+		TEST_CHECK(wheel.Count() == 0);
+
+		// Order by deadline.
+		UTTWheelValue v2;
+		UTTWheelValue v3;
+		v1.myDeadline = 130;
+		v2.myDeadline = 110;
+		v3.myDeadline = 120;
+		wheel.Push(&v1);
+		wheel.Push(&v2);
+		wheel.Push(&v3);
+		TEST_CHECK(wheel.Count() == 3);
+		TEST_CHECK(wheel.GetNextDeadline() == 110);
+		TEST_CHECK(wheel.PopExpired(109) == nullptr);
+		TEST_CHECK(wheel.PopExpired(125) == &v2);
+		TEST_CHECK(wheel.PopExpired(125) == &v3);
+		TEST_CHECK(wheel.PopExpired(125) == nullptr);
+		// Might be not precise for far deadlines, but never too late.
+		TEST_CHECK(wheel.GetNextDeadline() > 125);
+		TEST_CHECK(wheel.GetNextDeadline() <= 130);
+		TEST_CHECK(wheel.PopExpired(129) == nullptr);
+		TEST_CHECK(wheel.PopExpired(200) == &v1);
+		TEST_CHECK(wheel.Count() == 0);
+
+		// Same deadline.
+		v1.myDeadline = 300;
+		v2.myDeadline = 300;
+		wheel.Push(&v1);
+		wheel.Push(&v2);
+		TEST_CHECK(wheel.PopExpired(300) == &v1);
+		TEST_CHECK(wheel.PopExpired(300) == &v2);
+		TEST_CHECK(wheel.PopExpired(300) == nullptr);
+
+		// Remove.
+		v1.myDeadline = 400;
+		v2.myDeadline = 500;
+		v3.myDeadline = 1000000;
+		wheel.Push(&v1);
+		wheel.Push(&v2);
+		wheel.Push(&v3);
+		wheel.Remove(&v2);
+		TEST_CHECK(v2.myIndex == -1);
+		TEST_CHECK(wheel.Count() == 2);
+		wheel.Remove(&v3);
+		TEST_CHECK(wheel.Count() == 1);
+		TEST_CHECK(wheel.PopExpired(1000000) == &v1);
+		TEST_CHECK(wheel.PopExpired(1000000) == nullptr);
+
+		// Remove an expired one.
+		v1.myDeadline = 10;
+		v2.myDeadline = 20;
+		wheel.Push(&v1);
+		wheel.Push(&v2);
+		wheel.Remove(&v1);
+		TEST_CHECK(wheel.PopExpired(1000000) == &v2);
+		TEST_CHECK(wheel.Count() == 0);
+	}
+
+	static void
+	UnitTestTimingWheelFar()
+	{
+		TestCaseGuard guard("Far");
+
+		// Deadlines on all the levels, including the infinite one.
+		UTTWheel wheel;
+		const uint32_t count = 64;
+		UTTWheelValue values[count];
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			values[i].myDeadline = i == count - 1 ? MG_TIME_INFINITE : 1ULL << i;
+			wheel.Push(&values[i]);
+		}
+		TEST_CHECK(wheel.Count() == count);
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			uint64_t deadline = values[i].myDeadline;
+			TEST_CHECK(wheel.GetNextDeadline() <= deadline);
+			TEST_CHECK(wheel.PopExpired(deadline - 1) == nullptr);
+			TEST_CHECK(wheel.PopExpired(deadline) == &values[i]);
+			TEST_CHECK(wheel.PopExpired(deadline) == nullptr);
+		}
+		TEST_CHECK(wheel.Count() == 0);
+		TEST_CHECK(wheel.GetNextDeadline() == MG_TIME_INFINITE);
+
+		// The time can't go backwards, so the old deadlines are expired right away.
+		values[0].myDeadline = 1;
+		wheel.Push(&values[0]);
+		TEST_CHECK(wheel.PopExpired(0) == &values[0]);
+	}
+
+	static void
+	UnitTestTimingWheelCascade()
+	{
+		TestCaseGuard guard("Cascade");
+
+		// Elements with different deadlines share a slot on a higher level. Then they get
+		// cascaded down and must keep expiring in order.
+		UTTWheel wheel;
+		const uint32_t count = 1000;
+		std::vector<UTTWheelValue> values(count);
+		uint64_t start = 12345;
+		TEST_CHECK(wheel.PopExpired(start) == nullptr);
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			values[i].myDeadline = start + 1 + i * 7;
+			wheel.Push(&values[i]);
+		}
+		uint64_t now = start;
+		uint32_t next = 0;
+		while (next < count)
+		{
+			uint64_t deadline = wheel.GetNextDeadline();
+			TEST_CHECK(deadline > now);
+			TEST_CHECK(deadline <= values[next].myDeadline);
+			now = deadline;
+			UTTWheelValue* v;
+			while ((v = wheel.PopExpired(now)) != nullptr)
+			{
+				TEST_CHECK(v == &values[next]);
+				TEST_CHECK(v->myDeadline == now);
+				++next;
+			}
+		}
+		TEST_CHECK(wheel.Count() == 0);
+	}
+
+	static void
+	UnitTestTimingWheelSlack()
+	{
+		TestCaseGuard guard("Slack");
+
+		UTTWheel wheel;
+		// Rounded down to 2^N - 1.
+		wheel.SetSlack(10);
+		const uint64_t slack = 7;
+		const uint32_t count = 100;
+		UTTWheelValue values[count];
+		uint64_t now = 1000;
+		TEST_CHECK(wheel.PopExpired(now) == nullptr);
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			values[i].myDeadline = 1001 + i;
+			wheel.Push(&values[i]);
+		}
+		uint32_t next = 0;
+		while (next < count)
+		{
+			uint64_t deadline = wheel.GetNextDeadline();
+			TEST_CHECK(deadline > now);
+			now = deadline;
+			UTTWheelValue* v;
+			uint32_t batch = 0;
+			while ((v = wheel.PopExpired(now)) != nullptr)
+			{
+				// Never earlier than the deadline and never later than the deadline
+				// + slack.
+				TEST_CHECK(v == &values[next]);
+				TEST_CHECK(v->myDeadline <= now);
+				TEST_CHECK(v->myDeadline + slack >= now);
+				++next;
+				++batch;
+			}
+			// Close deadlines are coalesced.
+			TEST_CHECK(batch == 0 || batch == slack + 1 || next == count);
+		}
+		TEST_CHECK(wheel.Count() == 0);
+		wheel.SetSlack(0);
+	}
+
+	static void
+	UnitTestTimingWheelRandom()
+	{
+		TestCaseGuard guard("Random");
+
+		// Compare with a trivial reference - a list of elements sorted by nothing, where
+		// each expiration is checked via a full scan.
+		const uint32_t count = 5000;
+		const uint32_t iterCount = 20000;
+		const uint64_t slacks[] = {0, 1, 15};
+		for (uint64_t slack : slacks)
+		{
+			UTTWheel wheel;
+			wheel.SetSlack(slack);
+			std::vector<UTTWheelValue> values(count);
+			uint64_t now = mg::tst::RandomUInt32();
+			TEST_CHECK(wheel.PopExpired(now) == nullptr);
+			uint32_t inWheel = 0;
+			for (uint32_t iter = 0; iter < iterCount; ++iter)
+			{
+				UTTWheelValue& v = values[mg::tst::RandomUniformUInt32(0, count - 1)];
+				if (v.myIndex >= 0)
+				{
+					if (mg::tst::RandomBool())
+					{
+						wheel.Remove(&v);
+						TEST_CHECK(v.myIndex == -1);
+						--inWheel;
+					}
+				}
+				else
+				{
+					uint32_t range;
+					switch (mg::tst::RandomUniformUInt32(0, 3))
+					{
+					case 0: range = 10; break;
+					case 1: range = 1000; break;
+					case 2: range = 1000000; break;
+					default: range = UINT32_MAX; break;
+					}
+					v.myDeadline = now + mg::tst::RandomUniformUInt32(0, range);
+					wheel.Push(&v);
+					++inWheel;
+				}
+				TEST_CHECK(wheel.Count() == inWheel);
+				if (mg::tst::RandomUniformUInt32(0, 9) != 0)
+					continue;
+
+				uint64_t next = wheel.GetNextDeadline();
+				if (mg::tst::RandomBool() && next != MG_TIME_INFINITE)
+					now = next;
+				else
+					now += mg::tst::RandomUniformUInt32(0, 5000);
+				UTTWheelValue* e;
+				while ((e = wheel.PopExpired(now)) != nullptr)
+				{
+					TEST_CHECK(e->myIndex == -1);
+					TEST_CHECK(e->myDeadline <= now);
+					--inWheel;
+				}
+				TEST_CHECK(wheel.Count() == inWheel);
+				// Nothing is left behind.
+				next = MG_TIME_INFINITE;
+				for (const UTTWheelValue& r : values)
+				{
+					if (r.myIndex < 0)
+						continue;
+					TEST_CHECK(r.myDeadline + slack > now);
+					if (r.myDeadline < next)
+						next = r.myDeadline;
+				}
+				// The infinity + slack would overflow.
+				if (next == MG_TIME_INFINITE)
+					TEST_CHECK(wheel.GetNextDeadline() == MG_TIME_INFINITE);
+				else
+					TEST_CHECK(wheel.GetNextDeadline() <= next + slack);
+			}
+			for (UTTWheelValue& v : values)
+			{
+				if (v.myIndex >= 0)
+					wheel.Remove(&v);
+			}
+			TEST_CHECK(wheel.Count() == 0);
+		}
+	}
+
+	void
+	UnitTestTimingWheel()
+	{
+		TestSuiteGuard suite("TimingWheel");
+
+		UnitTestTimingWheelBasic();
+		UnitTestTimingWheelFar();
+		UnitTestTimingWheelCascade();
+		UnitTestTimingWheelSlack();
+		UnitTestTimingWheelRandom();
+	}
+
+}
+}
+}
@@ -0,0 +1,218 @@
+#include "mg/box/Trace.h"
+
+#include "mg/box/StringFunctions.h"
+#include "mg/box/ThreadFunc.h"
+
+#include "UnitTest.h"
+
+#include <string.h>
+
+namespace mg {
+namespace unittests {
+namespace box {
+
+	static uint32_t
+	UnitTestTraceCount(
+		const std::string& aStr,
+		const char* aToFind)
+	{
+		uint32_t res = 0;
+		size_t len = strlen(aToFind);
+		size_t pos = aStr.find(aToFind);
+		while (pos != std::string::npos)
+		{
+			++res;
+			pos = aStr.find(aToFind, pos + len);
+		}
+		return res;
+	}
+
+	static void
+	UnitTestTraceBasic()
+	{
+		TestCaseGuard guard("Basic");
+
+		int task1 = 0;
+		int task2 = 0;
+		mg::box::TraceClear();
+		mg::box::TraceSetThreadName("main \"thread\"");
+		mg::box::TraceSetLabel(&task1, "task one");
+		mg::box::TraceAdd(mg::box::TRACE_EVENT_TASK_POST, &task1);
+		mg::box::TraceAdd(mg::box::TRACE_EVENT_SCHED_ENTER, nullptr);
+		mg::box::TraceAdd(mg::box::TRACE_EVENT_TASK_SCHEDULE, &task1);
+		mg::box::TraceAdd(mg::box::TRACE_EVENT_SCHED_EXIT, nullptr);
+		mg::box::TraceAdd(mg::box::TRACE_EVENT_TASK_EXEC_BEGIN, &task1);
+		mg::box::TraceAdd(mg::box::TRACE_EVENT_TASK_WAKEUP, &task2);
+		mg::box::TraceAdd(mg::box::TRACE_EVENT_TASK_EXEC_END, &task1);
+		mg::box::TraceAdd(mg::box::TRACE_EVENT_TASK_EXEC_BEGIN, &task2);
+		mg::box::TraceAdd(mg::box::TRACE_EVENT_TASK_EXEC_END, &task2);
+
+		std::string res = mg::box::TraceExportChrome();
+		TEST_CHECK(res.find("{\"traceEvents\":[") == 0);
+		TEST_CHECK(res.rfind("]}") == res.size() - 2);
+		TEST_CHECK(res.find("\"name\":\"main \\\"thread\\\"\"") != std::string::npos);
+		TEST_CHECK(UnitTestTraceCount(res, "\"name\":\"task one\",\"ph\":\"B\"") == 1);
+		TEST_CHECK(UnitTestTraceCount(res, "\"name\":\"task\",\"ph\":\"B\"") == 1);
+		TEST_CHECK(UnitTestTraceCount(res, "\"name\":\"sched\",\"ph\":\"B\"") == 1);
+		TEST_CHECK(UnitTestTraceCount(res, "\"ph\":\"E\"") == 3);
+		TEST_CHECK(UnitTestTraceCount(res, "\"name\":\"post\",\"ph\":\"i\"") == 1);
+		TEST_CHECK(UnitTestTraceCount(res, "\"name\":\"schedule\",\"ph\":\"i\"") == 1);
+		TEST_CHECK(UnitTestTraceCount(res, "\"name\":\"wakeup\",\"ph\":\"i\"") == 1);
+		// Flow from the post to the execution.
+		TEST_CHECK(UnitTestTraceCount(res, "\"ph\":\"s\"") == 1);
+		TEST_CHECK(UnitTestTraceCount(res, "\"ph\":\"f\"") == 2);
+
+		// Clear drops everything.
+		mg::box::TraceClear();
+		res = mg::box::TraceExportChrome();
+		TEST_CHECK(UnitTestTraceCount(res, "\"ph\":\"M\"") >= 1);
+		TEST_CHECK(UnitTestTraceCount(res, "\"ts\"") == 0);
+
+		// An end without a beginning is dropped.
+		mg::box::TraceAdd(mg::box::TRACE_EVENT_TASK_EXEC_END, &task1);
+		mg::box::TraceAdd(mg::box::TRACE_EVENT_TASK_SIGNAL, &task1);
+		res = mg::box::TraceExportChrome();
+		TEST_CHECK(UnitTestTraceCount(res, "\"ph\":\"E\"") == 0);
+		TEST_CHECK(UnitTestTraceCount(res, "\"name\":\"signal\",\"ph\":\"i\"") == 1);
+
+		// The macros are gone when the tracing is not compiled in.
+		mg::box::TraceClear();
+		MG_TRACE(TASK_POST, &task1);
+		MG_TRACE(TASK_EXEC_BEGIN, &task1);
+		MG_TRACE(TASK_EXEC_END, &task1);
+		res = mg::box::TraceExportChrome();
+#if MG_ENABLE_TRACE
+		TEST_CHECK(UnitTestTraceCount(res, "\"ts\"") == 5);
+#else
+		TEST_CHECK(UnitTestTraceCount(res, "\"ts\"") == 0);
+#endif
+		mg::box::TraceSetLabel(&task1, nullptr);
+		mg::box::TraceClear();
+	}
+
+	static void
+	UnitTestTraceOverflow()
+	{
+		TestCaseGuard guard("Overflow");
+
+		// Only the newest events are kept. The oldest one in a full ring is dropped too,
+		// because the exporter can't know if it is being overwritten right now.
+		mg::box::TraceClear();
+		const uint64_t count = mg::box::theTraceRingSize * 3 + 123;
+		for (uint64_t i = 1; i <= count; ++i)
+			mg::box::TraceAdd(mg::box::TRACE_EVENT_TASK_WAKEUP, (const void*)i);
+		std::string res = mg::box::TraceExportChrome();
+		TEST_CHECK(UnitTestTraceCount(res, "\"name\":\"wakeup\"") ==
+			mg::box::theTraceRingSize - 1);
+		char buf[64];
+		snprintf(buf, sizeof(buf), "\"object\":\"%p\"", (const void*)count);
+		TEST_CHECK(res.find(buf) != std::string::npos);
+		snprintf(buf, sizeof(buf), "\"object\":\"%p\"",
+			(const void*)(count - mg::box::theTraceRingSize + 1));
+		TEST_CHECK(res.find(buf) == std::string::npos);
+		mg::box::TraceClear();
+	}
+
+	static void
+	UnitTestTraceThreads()
+	{
+		TestCaseGuard guard("Threads");
+
+		// The threads write while the export is running.
+		mg::box::TraceClear();
+		const uint32_t threadCount = 3;
+		const uint32_t eventCount = 100000;
+		mg::box::AtomicU32 doneCount(0);
+		// The threads stay alive until the checks are done. Otherwise an exited thread
+		// would give its ring to a thread started later.
+		mg::box::AtomicBool isReleased(false);
+		std::vector<mg::box::ThreadFunc*> threads;
+		for (uint32_t i = 0; i < threadCount; ++i)
+		{
+			threads.push_back(new mg::box::ThreadFunc("mgtst", [&, i]() {
+				std::string name = mg::box::StringFormat("tracer %u", i);
+				mg::box::TraceSetThreadName(name.c_str());
+				for (uint32_t j = 0; j < eventCount; ++j)
+				{
+					mg::box::TraceAdd(mg::box::TRACE_EVENT_TASK_EXEC_BEGIN, &j);
+					mg::box::TraceAdd(mg::box::TRACE_EVENT_TASK_EXEC_END, &j);
+				}
+				doneCount.IncrementRelease();
+				while (!isReleased.LoadAcquire())
+					mg::box::Sleep(1);
+			}));
+			threads.back()->Start();
+		}
+		while (doneCount.LoadAcquire() != threadCount)
+		{
+			std::string res = mg::box::TraceExportChrome();
+			TEST_CHECK(UnitTestTraceCount(res, "\"name\":\"task\",\"ph\":\"B\"") >=
+				UnitTestTraceCount(res, "\"name\":\"task\",\"ph\":\"E\""));
+		}
+		std::string res = mg::box::TraceExportChrome();
+		for (uint32_t i = 0; i < threadCount; ++i)
+		{
+			std::string name = mg::box::StringFormat("\"name\":\"tracer %u\"", i);
+			TEST_CHECK(res.find(name) != std::string::npos);
+		}
+		// Each thread has a full ring of pairs. Except for the oldest pair, which lost
+		// its beginning.
+		TEST_CHECK(UnitTestTraceCount(res, "\"name\":\"task\",\"ph\":\"E\"") ==
+			threadCount * (mg::box::theTraceRingSize / 2 - 1));
+		isReleased.StoreRelease(true);
+		for (mg::box::ThreadFunc* t : threads)
+			t->StopAndDelete();
+		mg::box::TraceClear();
+	}
+
+	static void
+	UnitTestTraceReuse()
+	{
+		TestCaseGuard guard("Reuse");
+
+		// The ring of an exited thread is taken by the next new thread. The old events
+		// are not exported as the new thread's ones, and the ring count doesn't grow.
+		mg::box::TraceClear();
+		int oldObj = 0;
+		int newObj = 0;
+		mg::box::ThreadFunc* t = new mg::box::ThreadFunc("mgtst", [&]() {
+			mg::box::TraceSetThreadName("tracer old");
+			for (int i = 0; i < 10; ++i)
+				mg::box::TraceAdd(mg::box::TRACE_EVENT_TASK_WAKEUP, &oldObj);
+		});
+		t->Start();
+		t->StopAndDelete();
+		std::string res = mg::box::TraceExportChrome();
+		uint32_t ringCount = UnitTestTraceCount(res, "\"name\":\"thread_name\"");
+		TEST_CHECK(ringCount > 0);
+
+		t = new mg::box::ThreadFunc("mgtst", [&]() {
+			mg::box::TraceSetThreadName("tracer new");
+			for (int i = 0; i < 5; ++i)
+				mg::box::TraceAdd(mg::box::TRACE_EVENT_TASK_WAKEUP, &newObj);
+		});
+		t->Start();
+		t->StopAndDelete();
+		res = mg::box::TraceExportChrome();
+		TEST_CHECK(UnitTestTraceCount(res, "\"name\":\"thread_name\"") == ringCount);
+		TEST_CHECK(res.find("\"name\":\"tracer new\"") != std::string::npos);
+		char buf[64];
+		snprintf(buf, sizeof(buf), "\"object\":\"%p\"", (const void*)&newObj);
+		TEST_CHECK(UnitTestTraceCount(res, buf) == 5);
+		mg::box::TraceClear();
+	}
+
+	void
+	UnitTestTrace()
+	{
+		TestSuiteGuard suite("Trace");
+
+		UnitTestTraceBasic();
+		UnitTestTraceOverflow();
+		UnitTestTraceThreads();
+		UnitTestTraceReuse();
+	}
+
+}
+}
+}
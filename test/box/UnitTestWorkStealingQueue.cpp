@@ -0,0 +1,208 @@
+#include "mg/box/WorkStealingQueue.h"
+
+#include "mg/box/ThreadFunc.h"
+
+#include "UnitTest.h"
+
+#include <vector>
+
+namespace mg {
+namespace unittests {
+namespace box {
+
+	struct UTWSQValue
+	{
+		UTWSQValue()
+			: myValue(0)
+			, myPopCount(0)
+		{
+		}
+
+		uint32_t myValue;
+		mg::box::AtomicU32 myPopCount;
+	};
+
+	using UTWSQueue = mg::box::WorkStealingQueue<UTWSQValue>;
+
+	static void
+	UnitTestWorkStealingQueueBasic()
+	{
+		TestCaseGuard guard("Basic");
+
+		const uint32_t capacity = 8;
+		UTWSQValue values[capacity * 2];
+		for (uint32_t i = 0; i < capacity * 2; ++i)
+			values[i].myValue = i;
+
+		UTWSQueue queue(capacity);
+		TEST_CHECK(queue.GetCapacity() == capacity);
+		TEST_CHECK(queue.IsEmpty());
+		TEST_CHECK(queue.Count() == 0);
+		TEST_CHECK(queue.Pop() == nullptr);
+
+		// FIFO order.
+		TEST_CHECK(queue.Push(&values[0]));
+		TEST_CHECK(queue.Push(&values[1]));
+		TEST_CHECK(!queue.IsEmpty());
+		TEST_CHECK(queue.Count() == 2);
+		TEST_CHECK(queue.Pop() == &values[0]);
+		TEST_CHECK(queue.Pop() == &values[1]);
+		TEST_CHECK(queue.Pop() == nullptr);
+		TEST_CHECK(queue.IsEmpty());
+
+		// Overflow.
+		for (uint32_t i = 0; i < capacity; ++i)
+			TEST_CHECK(queue.Push(&values[i]));
+		TEST_CHECK(queue.Count() == capacity);
+		TEST_CHECK(!queue.Push(&values[capacity]));
+		TEST_CHECK(queue.Pop() == &values[0]);
+		TEST_CHECK(queue.Push(&values[capacity]));
+		TEST_CHECK(!queue.Push(&values[capacity + 1]));
+
+		// Wrap around the buffer border.
+		for (uint32_t i = 1; i <= capacity; ++i)
+			TEST_CHECK(queue.Pop() == &values[i]);
+		TEST_CHECK(queue.IsEmpty());
+		for (uint32_t i = 0; i < capacity * 2; ++i)
+		{
+			TEST_CHECK(queue.Push(&values[i]));
+			TEST_CHECK(queue.Pop() == &values[i]);
+		}
+		TEST_CHECK(queue.IsEmpty());
+	}
+
+	static void
+	UnitTestWorkStealingQueueStealHalf()
+	{
+		TestCaseGuard guard("StealHalf");
+
+		const uint32_t capacity = 8;
+		UTWSQValue values[capacity];
+		UTWSQueue src(capacity);
+		UTWSQueue dst(capacity);
+
+		// Empty.
+		TEST_CHECK(src.StealHalf(dst) == nullptr);
+		TEST_CHECK(dst.IsEmpty());
+
+		// One item is returned without touching the destination.
+		TEST_CHECK(src.Push(&values[0]));
+		TEST_CHECK(src.StealHalf(dst) == &values[0]);
+		TEST_CHECK(src.IsEmpty());
+		TEST_CHECK(dst.IsEmpty());
+
+		// Odd count. The bigger half is stolen.
+		for (uint32_t i = 0; i < 5; ++i)
+			TEST_CHECK(src.Push(&values[i]));
+		TEST_CHECK(src.StealHalf(dst) == &values[2]);
+		TEST_CHECK(dst.Count() == 2);
+		TEST_CHECK(dst.Pop() == &values[0]);
+		TEST_CHECK(dst.Pop() == &values[1]);
+		TEST_CHECK(dst.IsEmpty());
+		TEST_CHECK(src.Count() == 2);
+		TEST_CHECK(src.Pop() == &values[3]);
+		TEST_CHECK(src.Pop() == &values[4]);
+		TEST_CHECK(src.IsEmpty());
+
+		// Full.
+		for (uint32_t i = 0; i < capacity; ++i)
+			TEST_CHECK(src.Push(&values[i]));
+		TEST_CHECK(src.StealHalf(dst) == &values[capacity / 2 - 1]);
+		TEST_CHECK(dst.Count() == capacity / 2 - 1);
+		TEST_CHECK(src.Count() == capacity / 2);
+		for (uint32_t i = 0; i < capacity / 2 - 1; ++i)
+			TEST_CHECK(dst.Pop() == &values[i]);
+		for (uint32_t i = capacity / 2; i < capacity; ++i)
+			TEST_CHECK(src.Pop() == &values[i]);
+		TEST_CHECK(src.IsEmpty());
+		TEST_CHECK(dst.IsEmpty());
+	}
+
+	static void
+	UnitTestWorkStealingQueueStress()
+	{
+		TestCaseGuard guard("Stress");
+
+		// The owner pushes and pops, the thieves steal from it and from each other. Each
+		// value must be popped exactly once.
+		const uint32_t capacity = 64;
+		const uint32_t valueCount = 1000000;
+		const uint32_t thiefCount = 4;
+		std::vector<UTWSQValue> values(valueCount);
+		UTWSQueue owner(capacity);
+		std::vector<UTWSQueue*> thiefQueues;
+		thiefQueues.reserve(thiefCount);
+		for (uint32_t i = 0; i < thiefCount; ++i)
+			thiefQueues.push_back(new UTWSQueue(capacity));
+
+		mg::box::AtomicU32 popCount(0);
+		mg::box::AtomicBool isDone(false);
+		std::vector<mg::box::ThreadFunc*> threads;
+		threads.reserve(thiefCount);
+		for (uint32_t ti = 0; ti < thiefCount; ++ti)
+		{
+			threads.push_back(new mg::box::ThreadFunc("mgtst", [&, ti]() {
+				UTWSQueue& self = *thiefQueues[ti];
+				UTWSQueue& neighbour = *thiefQueues[(ti + 1) % thiefCount];
+				while (!isDone.LoadRelaxed())
+				{
+					UTWSQValue* v = self.Pop();
+					if (v == nullptr)
+						v = owner.StealHalf(self);
+					if (v == nullptr)
+						v = neighbour.StealHalf(self);
+					if (v == nullptr)
+						continue;
+					v->myPopCount.IncrementRelaxed();
+					popCount.IncrementRelaxed();
+				}
+			}));
+			threads.back()->Start();
+		}
+		uint32_t pushed = 0;
+		while (pushed < valueCount)
+		{
+			if (owner.Push(&values[pushed]))
+			{
+				++pushed;
+				continue;
+			}
+			UTWSQValue* v = owner.Pop();
+			if (v == nullptr)
+				continue;
+			v->myPopCount.IncrementRelaxed();
+			popCount.IncrementRelaxed();
+		}
+		UTWSQValue* v;
+		while ((v = owner.Pop()) != nullptr)
+		{
+			v->myPopCount.IncrementRelaxed();
+			popCount.IncrementRelaxed();
+		}
+		while (popCount.LoadRelaxed() != valueCount)
+			mg::box::Sleep(1);
+		isDone.StoreRelaxed(true);
+		for (mg::box::ThreadFunc* f : threads)
+			delete f;
+		for (UTWSQueue* q : thiefQueues)
+		{
+			TEST_CHECK(q->IsEmpty());
+			delete q;
+		}
+		for (const UTWSQValue& val : values)
+			TEST_CHECK(val.myPopCount.LoadRelaxed() == 1);
+	}
+
+	void
+	UnitTestWorkStealingQueue()
+	{
+		TestSuiteGuard suite("WorkStealingQueue");
+
+		UnitTestWorkStealingQueueBasic();
+		UnitTestWorkStealingQueueStealHalf();
+		UnitTestWorkStealingQueueStress();
+	}
+
+}
+}
+}
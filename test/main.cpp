@@ -36,18 +36,24 @@ namespace aio {
 }
 namespace box {
 	void UnitTestAlgorithm();
+	void UnitTestArena();
 	void UnitTestAtomic();
 	void UnitTestBinaryHeap();
+	void UnitTestCancellationToken();
 	void UnitTestConditionVariable();
+	void UnitTestCoro();
 	void UnitTestDoublyList();
 	void UnitTestError();
 	void UnitTestForwardList();
+	void UnitTestHistogram();
+	void UnitTestInlineFunction();
 	void UnitTestInterruptibleMutex();
 	void UnitTestIOVec();
 	void UnitTestLog();
 	void UnitTestMultiConsumerQueue();
 	void UnitTestMultiProducerQueue();
 	void UnitTestMutex();
+	void UnitTestPeriodicTimingWheel();
 	void UnitTestRefCount();
 	void UnitTestSharedPtr();
 	void UnitTestSignal();
@@ -55,6 +61,9 @@ namespace box {
 	void UnitTestSysinfo();
 	void UnitTestThreadLocalPool();
 	void UnitTestTime();
+	void UnitTestTimingWheel();
+	void UnitTestTrace();
+	void UnitTestWorkStealingQueue();
 }
 namespace net {
 	void UnitTestBuffer();
@@ -64,7 +73,10 @@ namespace net {
 	void UnitTestURL();
 }
 namespace sch {
+	void UnitTestTaskFuture();
+	void UnitTestTaskGraph();
 	void UnitTestTaskScheduler();
+	void UnitTestTaskSync();
 }
 namespace sio {
 	void UnitTestTCPServer();
@@ -101,18 +113,24 @@ main(
 	MG_RUN_TEST(aio, UnitTestTCPServer);
 	MG_RUN_TEST(aio, UnitTestTCPSocketIFace);
 	MG_RUN_TEST(box, UnitTestAlgorithm);
+	MG_RUN_TEST(box, UnitTestArena);
 	MG_RUN_TEST(box, UnitTestAtomic);
 	MG_RUN_TEST(box, UnitTestBinaryHeap);
+	MG_RUN_TEST(box, UnitTestCancellationToken);
 	MG_RUN_TEST(box, UnitTestConditionVariable);
+	MG_RUN_TEST(box, UnitTestCoro);
 	MG_RUN_TEST(box, UnitTestDoublyList);
 	MG_RUN_TEST(box, UnitTestError);
 	MG_RUN_TEST(box, UnitTestForwardList);
+	MG_RUN_TEST(box, UnitTestHistogram);
+	MG_RUN_TEST(box, UnitTestInlineFunction);
 	MG_RUN_TEST(box, UnitTestInterruptibleMutex);
 	MG_RUN_TEST(box, UnitTestIOVec);
 	MG_RUN_TEST(box, UnitTestLog);
 	MG_RUN_TEST(box, UnitTestMultiConsumerQueue);
 	MG_RUN_TEST(box, UnitTestMultiProducerQueue);
 	MG_RUN_TEST(box, UnitTestMutex);
+	MG_RUN_TEST(box, UnitTestPeriodicTimingWheel);
 	MG_RUN_TEST(box, UnitTestRefCount);
 	MG_RUN_TEST(box, UnitTestSharedPtr);
 	MG_RUN_TEST(box, UnitTestSignal);
@@ -120,12 +138,18 @@ main(
 	MG_RUN_TEST(box, UnitTestSysinfo);
 	MG_RUN_TEST(box, UnitTestThreadLocalPool);
 	MG_RUN_TEST(box, UnitTestTime);
+	MG_RUN_TEST(box, UnitTestTimingWheel);
+	MG_RUN_TEST(box, UnitTestTrace);
+	MG_RUN_TEST(box, UnitTestWorkStealingQueue);
 	MG_RUN_TEST(net, UnitTestBuffer);
 	MG_RUN_TEST(net, UnitTestDomainToIP);
 	MG_RUN_TEST(net, UnitTestHost);
 	MG_RUN_TEST(net, UnitTestSSL);
 	MG_RUN_TEST(net, UnitTestURL);
+	MG_RUN_TEST(sch, UnitTestTaskFuture);
+	MG_RUN_TEST(sch, UnitTestTaskGraph);
 	MG_RUN_TEST(sch, UnitTestTaskScheduler);
+	MG_RUN_TEST(sch, UnitTestTaskSync);
 	MG_RUN_TEST(sio, UnitTestTCPServer);
 	MG_RUN_TEST(sio, UnitTestTCPSocket);
 
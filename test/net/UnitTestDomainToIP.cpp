@@ -110,6 +110,64 @@ namespace domaintoip {
 #endif
 	}
 
+	static void
+	UnitTestDomainToIPCancelToken()
+	{
+		TestCaseGuard guard("Cancel token");
+
+#if IS_BUILD_DEBUG
+		mg::net::DomainToIPDebugSetProcessLatency(10);
+#endif
+		constexpr uint32_t reqCount = 50;
+		mg::box::AtomicI32 endCount(0);
+		mg::box::AtomicI32 cancelCount(0);
+		auto callback = [&](const char* aDomain,
+			const std::vector<mg::net::DomainEndpoint>& aEndpoints,
+			mg::box::Error* aError) {
+
+			TEST_CHECK(mg::box::Strcmp(aDomain, "google.com") == 0);
+			if (aError != nullptr)
+			{
+				if (aError->myCode == mg::box::ERR_BOX_CANCEL)
+					cancelCount.IncrementRelaxed();
+				TEST_CHECK(aEndpoints.empty());
+			}
+			endCount.IncrementRelaxed();
+		};
+		mg::box::CancellationToken::Ptr token = mg::box::CancellationToken::NewShared();
+		std::vector<mg::net::DomainToIPRequest> reqs;
+		for (uint32_t i = 0; i < reqCount; ++i)
+		{
+			mg::net::DomainToIPRequest req;
+			// Half of the requests are in the child tokens. They are cancelled together
+			// with the parent.
+			mg::box::CancellationToken::Ptr reqToken = token;
+			if (i % 2 == 0)
+				reqToken = token->NewChild();
+			mg::net::DomainToIPAsync(req, "google.com", mg::box::theTimeDurationInf,
+				reqToken.GetPointer(), callback);
+			reqs.push_back(std::move(req));
+		}
+		// The manual cancel and the token can meet.
+		for (uint32_t i = 0; i < reqCount; i += 3)
+			mg::net::DomainToIPCancel(reqs[i]);
+		token->Cancel();
+		while (endCount.LoadRelaxed() != reqCount)
+			mg::box::Sleep(1);
+#if IS_BUILD_DEBUG
+		TEST_CHECK(cancelCount.LoadRelaxed() > 0);
+		mg::net::DomainToIPDebugSetProcessLatency(0);
+#endif
+		// Already cancelled token cancels the request right away.
+		mg::net::DomainToIPRequest req;
+		cancelCount.StoreRelaxed(0);
+		mg::net::DomainToIPAsync(req, "google.com", mg::box::theTimeDurationInf,
+			token.GetPointer(), callback);
+		while (endCount.LoadRelaxed() != reqCount + 1)
+			mg::box::Sleep(1);
+		TEST_CHECK(cancelCount.LoadRelaxed() == 1);
+	}
+
 	static void
 	UnitTestDomainToIPBlocking()
 	{
@@ -145,6 +203,7 @@ namespace domaintoip {
 		UnitTestDomainToIPBasic();
 		UnitTestDomainToIPTimeout();
 		UnitTestDomainToIPCancel();
+		UnitTestDomainToIPCancelToken();
 		UnitTestDomainToIPBlocking();
 	}
 
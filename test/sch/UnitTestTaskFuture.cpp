@@ -0,0 +1,335 @@
+#include "mg/sch/TaskFuture.h"
+
+#include "mg/box/Signal.h"
+#include "mg/box/Time.h"
+#include "mg/sch/TaskScheduler.h"
+#include "mg/test/Random.h"
+
+#include "UnitTest.h"
+
+#include <string>
+
+namespace mg {
+namespace unittests {
+namespace sch {
+
+#if MG_CORO_IS_ENABLED
+	// The promise must stay alive until it is completed. It is kept by the coroutine,
+	// and the one-shot task only completes it.
+	template<typename T, typename... Args>
+	static void
+	UnitTestTaskFuturePostSet(
+		mg::sch::TaskScheduler& aSched,
+		mg::sch::TaskPromise<T>& aPromise,
+		Args... aArgs)
+	{
+		aSched.PostOneShot([p = &aPromise, aArgs...]() {
+			p->SetValue(aArgs...);
+		});
+	}
+
+	static void
+	UnitTestTaskFutureBasic()
+	{
+		TestCaseGuard guard("Basic");
+
+		mg::sch::TaskScheduler sched("tst", 5);
+		sched.Start(2);
+		mg::box::Signal s;
+		mg::sch::Task t;
+		t.SetCallback([](mg::sch::Task& aTask, mg::sch::TaskScheduler& aSched,
+			mg::box::Signal& aSignal) -> mg::box::Coro {
+			// Completed later by another task.
+			mg::sch::TaskFuture<int> f1(&aTask);
+			TEST_CHECK(!f1.IsReady());
+			mg::sch::TaskPromise<int> p = f1.GetPromise();
+			UnitTestTaskFuturePostSet(aSched, p, 10);
+			TEST_CHECK(co_await f1 == 10);
+			TEST_CHECK(f1.IsReady() && f1.GetValue() == 10);
+
+			// Completed before the wait.
+			p = f1.GetPromise();
+			TEST_CHECK(!f1.IsReady());
+			TEST_CHECK(p.IsValid());
+			p.SetValue(20);
+			TEST_CHECK(!p.IsValid());
+			TEST_CHECK(f1.IsReady());
+			TEST_CHECK(co_await f1 == 20);
+
+			// Non-trivial values.
+			mg::sch::TaskFuture<std::string> f2(&aTask);
+			mg::sch::TaskPromise<std::string> p2;
+			for (int i = 0; i < 100; ++i)
+			{
+				p2 = f2.GetPromise();
+				UnitTestTaskFuturePostSet(aSched, p2, std::string(100, 'a' + i % 26));
+				std::string& res = co_await f2;
+				TEST_CHECK(res == std::string(100, 'a' + i % 26));
+			}
+
+			// Void.
+			mg::sch::TaskFuture<void> f3(&aTask);
+			mg::sch::TaskPromise<void> p3 = f3.GetPromise();
+			UnitTestTaskFuturePostSet(aSched, p3);
+			co_await f3;
+			TEST_CHECK(f3.IsReady());
+
+			// The task's signal works as usual when no futures are awaited.
+			aSignal.Send();
+			aTask.SetWait();
+			TEST_CHECK(co_await aTask.AsyncReceiveSignal());
+
+			co_await aTask.AsyncExitSendSignal(aSignal);
+			TEST_CHECK(!"Unreachable");
+			co_return;
+		}(t, sched, s));
+		sched.Post(&t);
+		s.ReceiveBlocking();
+		t.PostSignal();
+		s.ReceiveBlocking();
+		TEST_CHECK(sched.WaitEmpty());
+		sched.Stop();
+	}
+
+	static void
+	UnitTestTaskFutureWhenAll()
+	{
+		TestCaseGuard guard("When all");
+
+		mg::sch::TaskScheduler sched("tst", 5);
+		sched.Start(3);
+		mg::box::Signal s;
+		mg::sch::Task t;
+		t.SetCallback([](mg::sch::Task& aTask, mg::sch::TaskScheduler& aSched,
+			mg::box::Signal& aSignal) -> mg::box::Coro {
+			mg::sch::TaskFuture<int> f1(&aTask);
+			mg::sch::TaskFuture<int> f2(&aTask);
+			mg::sch::TaskFuture<void> f3(&aTask);
+			mg::sch::TaskPromise<int> p1;
+			mg::sch::TaskPromise<int> p2;
+			mg::sch::TaskPromise<void> p3;
+			for (int i = 0; i < 1000; ++i)
+			{
+				p1 = f1.GetPromise();
+				p2 = f2.GetPromise();
+				p3 = f3.GetPromise();
+				UnitTestTaskFuturePostSet(aSched, p1, i);
+				UnitTestTaskFuturePostSet(aSched, p2, i * 2);
+				UnitTestTaskFuturePostSet(aSched, p3);
+				TEST_CHECK(co_await mg::sch::TaskWhenAll(f1, f2, f3));
+				TEST_CHECK(f1.GetValue() == i);
+				TEST_CHECK(f2.GetValue() == i * 2);
+				TEST_CHECK(f3.IsReady());
+			}
+			// Timeout.
+			p1 = f1.GetPromise();
+			p2 = f2.GetPromise();
+			p1.SetValue(1);
+			uint64_t deadline = mg::box::GetMilliseconds() + 5;
+			TEST_CHECK(!co_await mg::sch::TaskWhenAllUntil(deadline, f1, f2));
+			TEST_CHECK(mg::box::GetMilliseconds() >= deadline);
+			TEST_CHECK(f1.IsReady() && !f2.IsReady());
+			// The futures stay valid after a timeout.
+			UnitTestTaskFuturePostSet(aSched, p2, 2);
+			TEST_CHECK(co_await mg::sch::TaskWhenAllUntil(MG_TIME_INFINITE, f1, f2));
+			TEST_CHECK(f1.GetValue() == 1 && f2.GetValue() == 2);
+			// Array of futures.
+			mg::sch::TaskFutureBase* list[] = {&f1, &f2};
+			p1 = f1.GetPromise();
+			p2 = f2.GetPromise();
+			UnitTestTaskFuturePostSet(aSched, p1, 3);
+			UnitTestTaskFuturePostSet(aSched, p2, 4);
+			TEST_CHECK(co_await mg::sch::TaskWhenAll(list, 2));
+			TEST_CHECK(f1.GetValue() == 3 && f2.GetValue() == 4);
+
+			co_await aTask.AsyncExitSendSignal(aSignal);
+			TEST_CHECK(!"Unreachable");
+			co_return;
+		}(t, sched, s));
+		sched.Post(&t);
+		s.ReceiveBlocking();
+		TEST_CHECK(sched.WaitEmpty());
+		sched.Stop();
+	}
+
+	static void
+	UnitTestTaskFutureWhenAny()
+	{
+		TestCaseGuard guard("When any");
+
+		mg::sch::TaskScheduler sched("tst", 5);
+		sched.Start(3);
+		mg::box::Signal s;
+		mg::sch::Task t;
+		t.SetCallback([](mg::sch::Task& aTask, mg::sch::TaskScheduler& aSched,
+			mg::box::Signal& aSignal) -> mg::box::Coro {
+			mg::sch::TaskFuture<int> f1(&aTask);
+			mg::sch::TaskFuture<int> f2(&aTask);
+			mg::sch::TaskFuture<int> f3(&aTask);
+			// Only one is completed.
+			mg::sch::TaskPromise<int> p1 = f1.GetPromise();
+			mg::sch::TaskPromise<int> p2 = f2.GetPromise();
+			mg::sch::TaskPromise<int> p3 = f3.GetPromise();
+			UnitTestTaskFuturePostSet(aSched, p2, 2);
+			TEST_CHECK(co_await mg::sch::TaskWhenAny(f1, f2, f3) == 1);
+			TEST_CHECK(f2.GetValue() == 2);
+			// Already ready.
+			TEST_CHECK(co_await mg::sch::TaskWhenAny(f1, f2, f3) == 1);
+			// Timeout.
+			TEST_CHECK(co_await mg::sch::TaskWhenAnyUntil(
+				mg::box::GetMilliseconds() + 5, f1, f3) == -1);
+			// The first in the list wins when many are ready.
+			p3.SetValue(3);
+			p1.SetValue(1);
+			TEST_CHECK(co_await mg::sch::TaskWhenAny(f3, f1) == 0);
+			// Concurrent completions.
+			for (int i = 0; i < 1000; ++i)
+			{
+				p1 = f1.GetPromise();
+				p2 = f2.GetPromise();
+				UnitTestTaskFuturePostSet(aSched, p1, i);
+				UnitTestTaskFuturePostSet(aSched, p2, i);
+				int idx = co_await mg::sch::TaskWhenAny(f1, f2);
+				TEST_CHECK(idx == 0 || idx == 1);
+				TEST_CHECK(co_await mg::sch::TaskWhenAll(f1, f2));
+				TEST_CHECK(f1.GetValue() == i && f2.GetValue() == i);
+			}
+
+			co_await aTask.AsyncExitSendSignal(aSignal);
+			TEST_CHECK(!"Unreachable");
+			co_return;
+		}(t, sched, s));
+		sched.Post(&t);
+		s.ReceiveBlocking();
+		TEST_CHECK(sched.WaitEmpty());
+		sched.Stop();
+	}
+
+	struct UTTaskFutureCancelCtx
+	{
+		mg::sch::TaskPromise<int> myPromise;
+		mg::box::CancellationToken::Ptr myToken;
+		mg::box::AtomicU32 myStage;
+	};
+
+	static void
+	UnitTestTaskFutureCancel()
+	{
+		TestCaseGuard guard("Cancel");
+
+		mg::sch::TaskScheduler sched("tst", 5);
+		sched.Start(2);
+		mg::box::Signal s;
+		UTTaskFutureCancelCtx ctx;
+		ctx.myStage.StoreRelaxed(0);
+		mg::box::CancellationToken::Ptr token = mg::box::CancellationToken::NewShared();
+		mg::sch::Task t;
+		t.SetCancellation(token.GetPointer());
+		t.SetCallback([](mg::sch::Task& aTask, UTTaskFutureCancelCtx& aCtx,
+			mg::box::Signal& aSignal) -> mg::box::Coro {
+			// A single future ignores the cancellation.
+			mg::sch::TaskFuture<int> f1(&aTask);
+			aCtx.myPromise = f1.GetPromise();
+			aCtx.myStage.StoreRelease(1);
+			TEST_CHECK(co_await f1 == 10);
+			TEST_CHECK(aTask.IsCancelled());
+
+			// But it interrupts the wait for any or all of the futures.
+			aTask.SetCancellation(aCtx.myToken.GetPointer());
+			mg::sch::TaskPromise<int> p = f1.GetPromise();
+			aCtx.myStage.StoreRelease(2);
+			TEST_CHECK(co_await mg::sch::TaskWhenAny(f1) == -1);
+			TEST_CHECK(aTask.IsCancelled());
+			TEST_CHECK(!f1.IsReady());
+			p.SetValue(20);
+			TEST_CHECK(co_await mg::sch::TaskWhenAll(f1));
+			aTask.SetCancellation(nullptr);
+
+			co_await aTask.AsyncExitSendSignal(aSignal);
+			TEST_CHECK(!"Unreachable");
+			co_return;
+		}(t, ctx, s));
+		sched.Post(&t);
+		while (ctx.myStage.LoadAcquire() != 1)
+			mg::box::Sleep(1);
+		mg::box::Sleep(10);
+		ctx.myToken = mg::box::CancellationToken::NewShared();
+		token->Cancel();
+		mg::box::Sleep(10);
+		TEST_CHECK(ctx.myStage.LoadAcquire() == 1);
+		ctx.myPromise.SetValue(10);
+		while (ctx.myStage.LoadAcquire() != 2)
+			mg::box::Sleep(1);
+		mg::box::Sleep(10);
+		ctx.myToken->Cancel();
+		s.ReceiveBlocking();
+		TEST_CHECK(sched.WaitEmpty());
+		sched.Stop();
+	}
+
+	static void
+	UnitTestTaskFutureStress()
+	{
+		TestCaseGuard guard("Stress");
+
+		// Tasks wait for futures with short deadlines and delete themselves as soon as
+		// everything is done. Any use of a task by a late promise would be a crash.
+		mg::sch::TaskScheduler sched("tst", 5);
+		sched.Start(3);
+		const uint32_t taskCount = 200;
+		mg::box::AtomicU32 doneCount(0);
+		for (uint32_t i = 0; i < taskCount; ++i)
+		{
+			mg::sch::Task* t = new mg::sch::Task();
+			t->SetCallback([](mg::sch::Task* aTask, mg::sch::TaskScheduler& aSched,
+				mg::box::AtomicU32& aDoneCount) -> mg::box::Coro {
+				mg::sch::TaskFuture<uint32_t> f1(aTask);
+				mg::sch::TaskFuture<uint32_t> f2(aTask);
+				mg::sch::TaskPromise<uint32_t> p1;
+				mg::sch::TaskPromise<uint32_t> p2;
+				for (uint32_t j = 0; j < 20; ++j)
+				{
+					p1 = f1.GetPromise();
+					p2 = f2.GetPromise();
+					UnitTestTaskFuturePostSet(aSched, p1, j);
+					UnitTestTaskFuturePostSet(aSched, p2, j + 1);
+					if (mg::tst::RandomBool())
+					{
+						while (co_await mg::sch::TaskWhenAnyUntil(
+							mg::box::GetMilliseconds() + 1, f1, f2) < 0);
+					}
+					while (!co_await mg::sch::TaskWhenAllUntil(
+						mg::box::GetMilliseconds() + 1, f1, f2));
+					TEST_CHECK(f1.GetValue() == j && f2.GetValue() == j + 1);
+				}
+				aDoneCount.IncrementRelease();
+				co_await aTask->AsyncExitDelete();
+				TEST_CHECK(!"Unreachable");
+				co_return;
+			}(t, sched, doneCount));
+			sched.Post(t);
+		}
+		while (doneCount.LoadAcquire() != taskCount)
+			mg::box::Sleep(1);
+		TEST_CHECK(sched.WaitEmpty());
+		sched.Stop();
+	}
+#endif
+
+	void
+	UnitTestTaskFuture()
+	{
+		TestSuiteGuard suite("TaskFuture");
+
+#if MG_CORO_IS_ENABLED
+		UnitTestTaskFutureBasic();
+		UnitTestTaskFutureWhenAll();
+		UnitTestTaskFutureWhenAny();
+		UnitTestTaskFutureCancel();
+		UnitTestTaskFutureStress();
+#endif
+	}
+
+}
+}
+}
@@ -0,0 +1,203 @@
+#include "mg/sch/TaskGraph.h"
+
+#include "mg/box/Time.h"
+#include "mg/sch/TaskScheduler.h"
+#include "mg/test/Random.h"
+
+#include "UnitTest.h"
+
+namespace mg {
+namespace unittests {
+namespace sch {
+
+	static void
+	UnitTestTaskGraphBasic()
+	{
+		TestCaseGuard guard("Basic");
+
+		mg::sch::TaskScheduler sched("tst", 5);
+		sched.Start(3);
+		// Empty graph is done right away.
+		{
+			mg::sch::TaskGraph graph(sched);
+			graph.RunBlocking();
+			TEST_CHECK(graph.GetNodeCount() == 0);
+		}
+		// Single node.
+		{
+			mg::sch::TaskGraph graph(sched);
+			uint32_t counter = 0;
+			graph.AddNode([&]() { ++counter; });
+			graph.RunBlocking();
+			TEST_CHECK(counter == 1);
+			graph.RunBlocking();
+			TEST_CHECK(counter == 2);
+		}
+		// Fan-out and fan-in: A -> {B, C, D} -> E.
+		{
+			mg::sch::TaskGraph graph(sched);
+			mg::box::AtomicU32 a(0);
+			mg::box::AtomicU32 mid(0);
+			mg::box::AtomicU32 e(0);
+			mg::sch::TaskGraphNode* nodeA = graph.AddNode([&]() {
+				TEST_CHECK(mid.LoadRelaxed() == 0 && e.LoadRelaxed() == 0);
+				a.IncrementRelaxed();
+			});
+			mg::sch::TaskGraphNode* nodeE = graph.AddNode([&]() {
+				TEST_CHECK(a.LoadRelaxed() == 1 && mid.LoadRelaxed() == 3);
+				e.IncrementRelaxed();
+			});
+			for (int i = 0; i < 3; ++i)
+			{
+				mg::sch::TaskGraphNode* node = graph.AddNode([&]() {
+					TEST_CHECK(a.LoadRelaxed() == 1 && e.LoadRelaxed() == 0);
+					mid.IncrementRelaxed();
+				});
+				node->DependOn(nodeA);
+				nodeE->DependOn(node);
+			}
+			graph.Prepare();
+			TEST_CHECK(nodeA->GetCriticalPath() == 3);
+			TEST_CHECK(nodeE->GetCriticalPath() == 1);
+			for (int i = 0; i < 10; ++i)
+			{
+				graph.RunBlocking();
+				TEST_CHECK(a.LoadRelaxed() == 1 && mid.LoadRelaxed() == 3);
+				TEST_CHECK(e.LoadRelaxed() == 1);
+				a.StoreRelaxed(0);
+				mid.StoreRelaxed(0);
+				e.StoreRelaxed(0);
+			}
+		}
+		TEST_CHECK(sched.WaitEmpty());
+		sched.Stop();
+	}
+
+	static void
+	UnitTestTaskGraphCriticalPath()
+	{
+		TestCaseGuard guard("Critical path");
+
+		// A single worker executes the ready nodes in the order they are posted. The
+		// head of the longest chain must go first, even though it was added last.
+		mg::sch::TaskScheduler sched("tst", 5);
+		sched.Start(1);
+		mg::sch::TaskGraph graph(sched);
+		std::vector<int> order;
+		for (int i = 0; i < 10; ++i)
+			graph.AddNode([&, i]() { order.push_back(i); });
+		// A heavy leaf outweighs a longer chain of cheap nodes.
+		graph.AddNode([&]() { order.push_back(100); }, 20);
+		mg::sch::TaskGraphNode* prev = nullptr;
+		for (int i = 0; i < 5; ++i)
+		{
+			mg::sch::TaskGraphNode* node = graph.AddNode([&, i]() {
+				order.push_back(200 + i);
+			}, 5);
+			if (prev != nullptr)
+				node->DependOn(prev);
+			prev = node;
+		}
+		graph.RunBlocking();
+		TEST_CHECK(order.size() == 16);
+		TEST_CHECK(order[0] == 200);
+		TEST_CHECK(order[1] == 100);
+		// The other roots keep their order.
+		for (int i = 0; i < 10; ++i)
+			TEST_CHECK(order[2 + i] == i);
+		TEST_CHECK(sched.WaitEmpty());
+		sched.Stop();
+	}
+
+	static void
+	UnitTestTaskGraphAsync()
+	{
+		TestCaseGuard guard("Async");
+
+		mg::sch::TaskScheduler sched("tst", 5);
+		sched.Start(3);
+		mg::sch::TaskGraph graph(sched);
+		mg::box::AtomicU32 counter(0);
+		mg::sch::TaskGraphNode* root = graph.AddNode([&]() {
+			counter.IncrementRelaxed();
+		});
+		for (int i = 0; i < 5; ++i)
+		{
+			graph.AddNode([&]() {
+				counter.IncrementRelaxed();
+			})->DependOn(root);
+		}
+		// The graph can be restarted from its own done task.
+		const uint32_t runCount = 100;
+		mg::box::AtomicU32 doneCount(0);
+		mg::sch::Task doneTask([&](mg::sch::Task* aTask) {
+			TEST_CHECK(counter.LoadRelaxed() == 6);
+			counter.StoreRelaxed(0);
+			if (doneCount.IncrementFetchRelaxed() < runCount)
+				graph.Run(aTask);
+		});
+		graph.Run(&doneTask);
+		while (doneCount.LoadRelaxed() != runCount)
+			mg::box::Sleep(1);
+		TEST_CHECK(sched.WaitEmpty());
+		sched.Stop();
+	}
+
+	static void
+	UnitTestTaskGraphRandom()
+	{
+		TestCaseGuard guard("Random");
+
+		// Random graphs where each node checks that all its dependencies are done.
+		mg::sch::TaskScheduler sched("tst", 5);
+		sched.Start(3);
+		const uint32_t nodeCount = 200;
+		for (int graphIdx = 0; graphIdx < 10; ++graphIdx)
+		{
+			mg::sch::TaskGraph graph(sched);
+			std::vector<mg::box::AtomicU32> runs(nodeCount);
+			std::vector<std::vector<uint32_t>> deps(nodeCount);
+			std::vector<mg::sch::TaskGraphNode*> nodes;
+			uint32_t runIdx = 0;
+			for (uint32_t i = 0; i < nodeCount; ++i)
+			{
+				runs[i].StoreRelaxed(0);
+				nodes.push_back(graph.AddNode([&, i]() {
+					for (uint32_t dep : deps[i])
+						TEST_CHECK(runs[dep].LoadRelaxed() == runIdx + 1);
+					TEST_CHECK(runs[i].IncrementFetchRelaxed() == runIdx + 1);
+				}, mg::tst::RandomUniformUInt32(1, 10)));
+				uint32_t depCount = i == 0 ? 0 :
+					mg::tst::RandomUniformUInt32(0, 3);
+				for (uint32_t j = 0; j < depCount; ++j)
+				{
+					uint32_t dep = mg::tst::RandomUniformUInt32(0, i - 1);
+					deps[i].push_back(dep);
+					nodes[i]->DependOn(nodes[dep]);
+				}
+			}
+			for (runIdx = 0; runIdx < 10; ++runIdx)
+			{
+				graph.RunBlocking();
+				for (mg::box::AtomicU32& r : runs)
+					TEST_CHECK(r.LoadRelaxed() == runIdx + 1);
+			}
+		}
+		TEST_CHECK(sched.WaitEmpty());
+		sched.Stop();
+	}
+
+	void
+	UnitTestTaskGraph()
+	{
+		TestSuiteGuard suite("TaskGraph");
+
+		UnitTestTaskGraphBasic();
+		UnitTestTaskGraphCriticalPath();
+		UnitTestTaskGraphAsync();
+		UnitTestTaskGraphRandom();
+	}
+
+}
+}
+}
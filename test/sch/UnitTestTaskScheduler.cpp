@@ -1,6 +1,7 @@
 #include "mg/sch/TaskScheduler.h"
 
 #include "mg/box/Time.h"
+#include "mg/box/Trace.h"
 #include "mg/test/Random.h"
 
 #include "UnitTest.h"
@@ -194,6 +195,55 @@ namespace sch {
 			mg::box::Sleep(1);
 	}
 
+	static void
+	UnitTestTaskSchedulerFrontOrder()
+	{
+		TestCaseGuard guard("Front order");
+
+		// The front queue is sharded, but the tasks of each producer must be still
+		// executed in the order they were posted. With one worker it is visible.
+		mg::sch::TaskScheduler sched("tst", 5);
+		sched.Start(1);
+		const uint32_t producerCount = 4;
+		const uint32_t taskCount = 2000;
+		std::vector<mg::sch::Task> tasks(producerCount * taskCount);
+		// The last producer is the worker itself.
+		uint32_t nextIndex[producerCount] = {};
+		mg::box::AtomicU32 doneCount(0);
+		for (uint32_t p = 0; p < producerCount; ++p)
+		{
+			for (uint32_t i = 0; i < taskCount; ++i)
+			{
+				tasks[p * taskCount + i].SetCallback([&, p, i](mg::sch::Task*) {
+					TEST_CHECK(nextIndex[p]++ == i);
+					doneCount.IncrementRelease();
+				});
+			}
+		}
+		mg::sch::Task starter([&](mg::sch::Task*) {
+			mg::sch::Task* first = &tasks[(producerCount - 1) * taskCount];
+			for (uint32_t i = 0; i < taskCount; ++i)
+				mg::sch::TaskScheduler::This().Post(first + i);
+		});
+		std::vector<mg::box::ThreadFunc*> producers;
+		for (uint32_t p = 0; p + 1 < producerCount; ++p)
+		{
+			producers.push_back(new mg::box::ThreadFunc("mgtst", [&, p]() {
+				for (uint32_t i = 0; i < taskCount; ++i)
+					sched.Post(&tasks[p * taskCount + i]);
+			}));
+		}
+		sched.Post(&starter);
+		for (mg::box::ThreadFunc* t : producers)
+			t->Start();
+		while (doneCount.LoadAcquire() != producerCount * taskCount)
+			mg::box::Sleep(1);
+		for (mg::box::ThreadFunc* t : producers)
+			delete t;
+		for (uint32_t p = 0; p < producerCount; ++p)
+			TEST_CHECK(nextIndex[p] == taskCount);
+	}
+
 	static void
 	UnitTestTaskSchedulerDomino()
 	{
@@ -530,109 +580,2046 @@ namespace sch {
 		while (progress.LoadRelaxed() != 1)
 			mg::box::Sleep(1);
 
-		t1.PostWakeup();
-		mg::box::Sleep(1);
-		TEST_CHECK(progress.LoadRelaxed() == 1);
-		sched1.PostWait(&t1);
-		while (progress.LoadRelaxed() != 2)
+		t1.PostWakeup();
+		mg::box::Sleep(1);
+		TEST_CHECK(progress.LoadRelaxed() == 1);
+		sched1.PostWait(&t1);
+		while (progress.LoadRelaxed() != 2)
+			mg::box::Sleep(1);
+	}
+
+	static void
+	UnitTestTaskSchedulerSignal()
+	{
+		TestCaseGuard guard("Signal");
+
+		mg::sch::TaskScheduler sched("tst", 2);
+		sched.Start(1);
+
+		// Signal works during execution.
+		mg::box::AtomicU32 progress(0);
+		mg::sch::Task t([&](mg::sch::Task* aTask) {
+			bool isSignaled = aTask->ReceiveSignal();
+			progress.IncrementRelaxed();
+			if (isSignaled)
+				return;
+			// Inject a sleep to ensure the signal works
+			// during execution.
+			while (progress.LoadRelaxed() != 2)
+				mg::box::Sleep(1);
+			sched.PostWait(aTask);
+		});
+		sched.Post(&t);
+		while (progress.LoadRelaxed() != 1)
+			mg::box::Sleep(1);
+		t.PostSignal();
+		progress.IncrementRelaxed();
+		while (progress.LoadRelaxed() != 3)
+			mg::box::Sleep(1);
+
+		// Signal works for tasks in the front queue.
+		progress.StoreRelaxed(false);
+		t.SetCallback([&](mg::sch::Task*) {
+			TEST_CHECK(t.ReceiveSignal());
+			progress.StoreRelaxed(true);
+		});
+		sched.PostDeadline(&t, MG_TIME_INFINITE);
+		t.PostSignal();
+		while (!progress.LoadRelaxed())
+			mg::box::Sleep(1);
+
+		// Signal works for tasks in the waiting queue. Without
+		// -1 the task won't be saved to the waiting queue.
+		progress.StoreRelaxed(false);
+		sched.PostDeadline(&t, MG_TIME_INFINITE - 1);
+		mg::box::Sleep(1);
+		t.PostSignal();
+		while (!progress.LoadRelaxed())
+			mg::box::Sleep(1);
+
+		// Signal can be checked before receipt.
+		t.SetCallback([&](mg::sch::Task* aTask) {
+			if (!aTask->IsSignaled())
+				return sched.PostWait(aTask);
+			TEST_CHECK(aTask->ReceiveSignal());
+		});
+		sched.Post(&t);
+		t.PostSignal();
+		while (t.IsSignaled())
+			mg::box::Sleep(1);
+
+		// Double signal works.
+		progress.StoreRelaxed(false);
+		t.SetCallback([&](mg::sch::Task* aTask) {
+			while (!progress.LoadRelaxed())
+				mg::box::Sleep(1);
+			TEST_CHECK(aTask->IsSignaled());
+			TEST_CHECK(aTask->ReceiveSignal());
+		});
+		sched.Post(&t);
+		t.PostSignal();
+		t.PostSignal();
+		progress.StoreRelaxed(true);
+		while (t.IsSignaled())
+			mg::box::Sleep(1);
+
+		// Task is rescheduled until signal is received.
+		progress.StoreRelaxed(0);
+		t.SetCallback([&](mg::sch::Task* aTask) {
+			TEST_CHECK(aTask->IsSignaled());
+			uint32_t p = progress.IncrementFetchRelaxed();
+			if (p == 1)
+				return sched.PostWait(aTask);
+			if (p == 2)
+				return sched.PostDeadline(aTask, MG_TIME_INFINITE - 1);
+			if (p == 3)
+				return sched.PostDelay(aTask, 1000000);
+			if (p == 4)
+				return sched.Post(aTask);
+			TEST_CHECK(aTask->ReceiveSignal());
+		});
+		t.PostSignal();
+		sched.Post(&t);
+		while (t.IsSignaled())
+			mg::box::Sleep(1);
+		TEST_CHECK(progress.LoadRelaxed() == 5);
+	}
+
+	static void
+	UnitTestTaskSchedulerTimerSlack()
+	{
+		TestCaseGuard guard("Timer slack");
+
+		// The tasks can be executed later than their deadlines, but never earlier.
+		mg::sch::TaskSchedulerParams params;
+		params.myTimerSlack = 16;
+		mg::sch::TaskScheduler sched("tst", 5, params);
+		sched.Start(2);
+		const uint32_t count = 100;
+		mg::box::AtomicU32 doneCount(0);
+		mg::sch::Task tasks[count];
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			tasks[i].SetCallback([&](mg::sch::Task* aTask) {
+				TEST_CHECK(aTask->IsExpired());
+				TEST_CHECK(mg::box::GetMilliseconds() >= aTask->GetDeadline());
+				doneCount.IncrementRelaxed();
+			});
+			tasks[i].SetDelay(i % 50);
+		}
+		for (mg::sch::Task& t : tasks)
+			sched.Post(&t);
+		while (doneCount.LoadRelaxed() != count)
+			mg::box::Sleep(1);
+
+		// Wakeup works regardless of the slack.
+		doneCount.StoreRelaxed(0);
+		mg::sch::Task t([&](mg::sch::Task* aTask) {
+			TEST_CHECK(!aTask->IsExpired());
+			doneCount.IncrementRelaxed();
+		});
+		sched.PostWait(&t);
+		mg::box::Sleep(10);
+		TEST_CHECK(doneCount.LoadRelaxed() == 0);
+		t.PostWakeup();
+		while (doneCount.LoadRelaxed() != 1)
+			mg::box::Sleep(1);
+	}
+
+	static void
+	UnitTestTaskSchedulerMicroseconds()
+	{
+		TestCaseGuard guard("Microseconds");
+
+		mg::sch::TaskScheduler sched("tst", 5);
+		sched.Start(2);
+
+		// Deadline getters and setters in both units.
+		mg::sch::Task t1;
+		t1.SetDeadline(5);
+		TEST_CHECK(t1.GetDeadline() == 5);
+		TEST_CHECK(t1.GetDeadlineUs() == 5000);
+		t1.AdjustDeadlineUs(4500);
+		TEST_CHECK(t1.GetDeadline() == 4);
+		TEST_CHECK(t1.GetDeadlineUs() == 4500);
+		t1.AdjustDeadline(5);
+		TEST_CHECK(t1.GetDeadlineUs() == 4500);
+		t1.SetDeadlineUs(MG_TIME_INFINITE);
+		TEST_CHECK(t1.GetDeadline() == MG_TIME_INFINITE);
+		t1.SetWait();
+		TEST_CHECK(t1.GetDeadlineUs() == MG_TIME_INFINITE);
+		uint64_t ts = mg::box::GetMicroseconds();
+		t1.SetDelayUs(100);
+		TEST_CHECK(t1.GetDeadlineUs() >= ts + 100);
+		t1.AdjustDelayUs(1000000);
+		TEST_CHECK(t1.GetDeadlineUs() < ts + 1000000);
+
+		// The tasks are never executed before their deadlines.
+		const uint32_t count = 100;
+		mg::box::AtomicU32 doneCount(0);
+		mg::sch::Task tasks[count];
+		uint64_t deadlines[count];
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			tasks[i].SetCallback([&, i](mg::sch::Task* aTask) {
+				TEST_CHECK(aTask->IsExpired());
+				TEST_CHECK(mg::box::GetMicroseconds() >= deadlines[i]);
+				doneCount.IncrementRelaxed();
+			});
+		}
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			// Mix of the sub-millisecond and millisecond deadlines.
+			if (i % 2 == 0)
+				tasks[i].SetDelayUs(50 + i * 7);
+			else
+				tasks[i].SetDelay(i % 3);
+			deadlines[i] = tasks[i].GetDeadlineUs();
+		}
+		for (uint32_t i = 0; i < count; ++i)
+			sched.Post(&tasks[i]);
+		while (doneCount.LoadRelaxed() != count)
+			mg::box::Sleep(1);
+
+		// Repeated short delays.
+		doneCount.StoreRelaxed(0);
+		uint64_t deadline = 0;
+		mg::sch::Task t2([&](mg::sch::Task* aTask) {
+			TEST_CHECK(mg::box::GetMicroseconds() >= deadline);
+			if (doneCount.IncrementFetchRelaxed() == 20)
+				return;
+			aTask->SetDelayUs(200);
+			deadline = aTask->GetDeadlineUs();
+			sched.Post(aTask);
+		});
+		sched.PostDelayUs(&t2, 200);
+		while (doneCount.LoadRelaxed() != 20)
+			mg::box::Sleep(1);
+		TEST_CHECK(sched.WaitEmpty());
+	}
+
+	static void
+	UnitTestTaskSchedulerIdleSpinRun(
+		const mg::sch::TaskSchedulerParams& aParams)
+	{
+		mg::sch::TaskScheduler sched("tst", 5, aParams);
+		sched.Start(2);
+		// Ping-pong with pauses, so the workers have time to become idle between the
+		// rounds. Part of the rounds is delayed, to make the sched wait for deadlines.
+		const uint32_t count = 50;
+		mg::box::AtomicU32 doneCount(0);
+		mg::sch::Task pong([&](mg::sch::Task*) {
+			doneCount.IncrementRelaxed();
+		});
+		mg::sch::Task ping([&](mg::sch::Task*) {
+			sched.Post(&pong);
+		});
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			if (i % 2 == 0)
+				sched.Post(&ping);
+			else
+				sched.PostDelayUs(&ping, 300);
+			while (doneCount.LoadRelaxed() != i + 1)
+				mg::box::Sleep(1);
+		}
+		TEST_CHECK(sched.WaitEmpty());
+
+		uint32_t threadCount;
+		mg::sch::TaskSchedulerThread*const* threads = sched.GetThreads(threadCount);
+		uint64_t spinTime = 0;
+		uint64_t spinWakeCount = 0;
+		uint64_t wakeCount = 0;
+		for (uint32_t i = 0; i < threadCount; ++i)
+		{
+			spinTime += threads[i]->StatPopSpinTime();
+			spinWakeCount += threads[i]->StatPopSpinWakeCount();
+			wakeCount += threads[i]->StatPopWakeCount();
+		}
+		TEST_CHECK(spinTime > 0);
+		TEST_CHECK(spinWakeCount + wakeCount > 0);
+		// The hot sched never sleeps, so it gets the new tasks while spinning.
+		if (aParams.myIsLatencyCritical)
+			TEST_CHECK(spinWakeCount > 0);
+	}
+
+	static void
+	UnitTestTaskSchedulerIdleSpin()
+	{
+		TestCaseGuard guard("Idle spin");
+
+		mg::sch::TaskSchedulerParams params;
+		params.myIdleSpinUs = 200;
+		UnitTestTaskSchedulerIdleSpinRun(params);
+
+		params.myIsIdleYield = true;
+		UnitTestTaskSchedulerIdleSpinRun(params);
+
+		params.myQueueMode = mg::sch::TASK_SCHEDULER_QUEUE_MODE_LOCAL;
+		UnitTestTaskSchedulerIdleSpinRun(params);
+
+		// Latency-critical mode keeps the sched spinning until stop.
+		params = mg::sch::TaskSchedulerParams();
+		params.myIsLatencyCritical = true;
+		params.myIsIdleYield = true;
+		UnitTestTaskSchedulerIdleSpinRun(params);
+
+		params.myIdleSpinUs = 100;
+		params.myQueueMode = mg::sch::TASK_SCHEDULER_QUEUE_MODE_LOCAL;
+		UnitTestTaskSchedulerIdleSpinRun(params);
+	}
+
+	static void
+	UnitTestTaskSchedulerElasticRun(
+		mg::sch::TaskSchedulerQueueMode aMode)
+	{
+		mg::sch::TaskSchedulerParams params;
+		params.myQueueMode = aMode;
+		params.myThreadIdleTimeout = 20;
+		params.myThreadGrowReadyCount = 10;
+		mg::sch::TaskScheduler sched("tst", 5, params);
+		sched.Start(1, 4);
+		TEST_CHECK(sched.GetThreadCount() == 1);
+		uint32_t slotCount;
+		sched.GetThreads(slotCount);
+		TEST_CHECK(slotCount == 4);
+
+		const uint32_t count = 200;
+		mg::box::AtomicU32 doneCount(0);
+		mg::box::AtomicU32 maxThreadCount(0);
+		mg::sch::Task tasks[count];
+		for (mg::sch::Task& t : tasks)
+		{
+			t.SetCallback([&](mg::sch::Task*) {
+				// Slow tasks to make the ready queue grow.
+				mg::box::Sleep(1);
+				uint32_t threadCount = sched.GetThreadCount();
+				uint32_t oldMax = maxThreadCount.LoadRelaxed();
+				while (threadCount > oldMax &&
+					!maxThreadCount.CmpExchgWeakRelaxed(oldMax, threadCount));
+				doneCount.IncrementRelaxed();
+			});
+		}
+		// A few bursts to make sure the worker slots are reused after retirement.
+		for (int i = 0; i < 3; ++i)
+		{
+			doneCount.StoreRelaxed(0);
+			maxThreadCount.StoreRelaxed(0);
+			for (mg::sch::Task& t : tasks)
+				sched.Post(&t);
+			while (doneCount.LoadRelaxed() != count)
+				mg::box::Sleep(1);
+			TEST_CHECK(maxThreadCount.LoadRelaxed() > 1);
+			TEST_CHECK(maxThreadCount.LoadRelaxed() <= 4);
+			TEST_CHECK(sched.GetThreadCount() <= 4);
+			// The idle workers retire down to the min count.
+			while (sched.GetThreadCount() != 1)
+				mg::box::Sleep(1);
+		}
+		TEST_CHECK(sched.WaitEmpty());
+		sched.Stop();
+		TEST_CHECK(sched.GetThreadCount() == 0);
+	}
+
+	static void
+	UnitTestTaskSchedulerElastic()
+	{
+		TestCaseGuard guard("Elastic");
+
+		UnitTestTaskSchedulerElasticRun(mg::sch::TASK_SCHEDULER_QUEUE_MODE_SHARED);
+		UnitTestTaskSchedulerElasticRun(mg::sch::TASK_SCHEDULER_QUEUE_MODE_LOCAL);
+	}
+
+	static void
+	UnitTestTaskSchedulerNUMARun(
+		mg::sch::TaskSchedulerQueueMode aMode)
+	{
+		// Fake topology with the CPUs of the real first node repeated in each fake node.
+		// Then the pinning works on any machine.
+		mg::sch::TaskSchedulerParams params;
+		params.myQueueMode = aMode;
+		params.myIsNUMAAware = true;
+		params.myNUMANodes.resize(3, mg::box::SysGetNUMANodes()[0]);
+		mg::sch::TaskScheduler sched("tst", 5, params);
+		sched.Start(2, 5);
+		uint32_t slotCount;
+		mg::sch::TaskSchedulerThread*const* threads = sched.GetThreads(slotCount);
+		TEST_CHECK(slotCount == 5);
+		for (uint32_t i = 0; i < slotCount; ++i)
+			TEST_CHECK(threads[i]->GetNodeIndex() == i % 3);
+
+		const uint32_t count = 1000;
+		const uint32_t repostCount = 10;
+		mg::box::AtomicU32 doneCount(0);
+		mg::box::AtomicU32 executeCount(0);
+		mg::sch::Task tasks[count];
+		uint32_t reposts[count];
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			reposts[i] = 0;
+			uint32_t* repostsPtr = &reposts[i];
+			tasks[i].SetCallback([&, repostsPtr](mg::sch::Task* aTask) {
+				executeCount.IncrementRelaxed();
+				if (++*repostsPtr == repostCount)
+				{
+					doneCount.IncrementRelaxed();
+					return;
+				}
+				// Re-post from a worker, so the task goes to the same node. Sometimes
+				// with a deadline, to go through the sched.
+				if (*repostsPtr % 3 == 0)
+					sched.PostDelay(aTask, 1);
+				else
+					sched.Post(aTask);
+			});
+		}
+		for (mg::sch::Task& t : tasks)
+			sched.Post(&t);
+		while (doneCount.LoadRelaxed() != count)
+			mg::box::Sleep(1);
+		TEST_CHECK(executeCount.LoadRelaxed() == count * repostCount);
+		TEST_CHECK(sched.WaitEmpty());
+		sched.Stop();
+	}
+
+	static void
+	UnitTestTaskSchedulerNUMA()
+	{
+		TestCaseGuard guard("NUMA");
+
+		UnitTestTaskSchedulerNUMARun(mg::sch::TASK_SCHEDULER_QUEUE_MODE_SHARED);
+		UnitTestTaskSchedulerNUMARun(mg::sch::TASK_SCHEDULER_QUEUE_MODE_LOCAL);
+	}
+
+	static void
+	UnitTestTaskSchedulerStat()
+	{
+		TestCaseGuard guard("Stat");
+
+		mg::sch::TaskSchedulerParams params;
+		params.myIsStatEnabled = true;
+		mg::sch::TaskScheduler sched("tst", 5, params);
+		sched.Start(2);
+		mg::sch::TaskSchedulerStat stat;
+		sched.StatSnapshot(stat);
+		TEST_CHECK(stat.myReadyDelay.GetCount() == 0);
+		TEST_CHECK(stat.myLateness.GetCount() == 0);
+		TEST_CHECK(stat.myRunTime.GetCount() == 0);
+
+		// Ready tasks, a part of them is slow.
+		const uint32_t count = 100;
+		mg::box::AtomicU32 doneCount(0);
+		mg::sch::Task tasks[count];
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			bool isSlow = i % 10 == 0;
+			tasks[i].SetCallback([&, isSlow](mg::sch::Task*) {
+				if (isSlow)
+					mg::box::Sleep(2);
+				doneCount.IncrementRelaxed();
+			});
+		}
+		for (mg::sch::Task& t : tasks)
+			sched.Post(&t);
+		while (doneCount.LoadRelaxed() != count)
+			mg::box::Sleep(1);
+		TEST_CHECK(sched.WaitEmpty());
+		mg::sch::TaskSchedulerStat stat2;
+		sched.StatSnapshot(stat2);
+		TEST_CHECK(stat2.myReadyDelay.GetCount() == count);
+		TEST_CHECK(stat2.myLateness.GetCount() == 0);
+		TEST_CHECK(stat2.myRunTime.GetCount() == count);
+		TEST_CHECK(stat2.myRunTime.GetMax() >= 2000);
+		// 10% of the tasks are slow.
+		TEST_CHECK(stat2.myRunTime.GetPercentile(95) >= 2000);
+		TEST_CHECK(stat2.myRunTime.GetPercentile(50) < 2000);
+		TEST_CHECK(stat2.mySchedHoldTime.GetCount() > 0);
+		TEST_CHECK(stat2.myPendingDepth == 0);
+		TEST_CHECK(stat2.myReadyDepth == 0);
+
+		// Tasks with deadlines. Lateness is measured instead of the delay.
+		doneCount.StoreRelaxed(0);
+		for (mg::sch::Task& t : tasks)
+			sched.PostDelay(&t, 5);
+		while (doneCount.LoadRelaxed() != count)
+			mg::box::Sleep(1);
+		TEST_CHECK(sched.WaitEmpty());
+		mg::sch::TaskSchedulerStat stat3;
+		sched.StatSnapshot(stat3);
+		TEST_CHECK(stat3.myReadyDelay.GetCount() == count);
+		TEST_CHECK(stat3.myLateness.GetCount() == count);
+		TEST_CHECK(stat3.myRunTime.GetCount() == count * 2);
+
+		// Infinite wait and a wakeup is neither a delay nor a lateness.
+		doneCount.StoreRelaxed(0);
+		sched.PostWait(&tasks[0]);
+		tasks[0].PostWakeup();
+		while (doneCount.LoadRelaxed() != 1)
+			mg::box::Sleep(1);
+		TEST_CHECK(sched.WaitEmpty());
+		mg::sch::TaskSchedulerStat stat4;
+		sched.StatSnapshot(stat4);
+		TEST_CHECK(stat4.myReadyDelay.GetCount() == count);
+		TEST_CHECK(stat4.myLateness.GetCount() == count);
+		TEST_CHECK(stat4.myRunTime.GetCount() == count * 2 + 1);
+
+		// Waiting tasks are seen in the gauges.
+		sched.PostDelay(&tasks[0], 1000000);
+		uint64_t deadline = mg::box::GetMilliseconds() + 10000;
+		mg::sch::TaskSchedulerStat stat5;
+		do
+		{
+			TEST_CHECK(mg::box::GetMilliseconds() < deadline);
+			mg::box::Sleep(1);
+			sched.StatSnapshot(stat5);
+		} while (stat5.myWaitingDepth != 1);
+		tasks[0].PostWakeup();
+		while (doneCount.LoadRelaxed() != 2)
+			mg::box::Sleep(1);
+		TEST_CHECK(sched.WaitEmpty());
+		sched.Stop();
+	}
+
+	static void
+	UnitTestTaskSchedulerTrace()
+	{
+		TestCaseGuard guard("Trace");
+
+		mg::sch::TaskScheduler sched("tst", 5);
+		sched.Start(2);
+		mg::box::TraceClear();
+		mg::box::AtomicU32 doneCount(0);
+		mg::sch::Task task([&](mg::sch::Task*) {
+			doneCount.IncrementRelaxed();
+		});
+		MG_TRACE_LABEL(&task, "traced task");
+		sched.Post(&task);
+		while (doneCount.LoadRelaxed() != 1)
+			mg::box::Sleep(1);
+		TEST_CHECK(sched.WaitEmpty());
+		std::string res = mg::box::TraceExportChrome();
+		bool isFound = res.find("\"name\":\"traced task\",\"ph\":\"B\"") !=
+			std::string::npos;
+#if MG_ENABLE_TRACE
+		TEST_CHECK(isFound);
+		TEST_CHECK(res.find("\"name\":\"post\",\"ph\":\"i\"") != std::string::npos);
+		TEST_CHECK(res.find("\"name\":\"sched\",\"ph\":\"B\"") != std::string::npos);
+#else
+		TEST_CHECK(!isFound);
+#endif
+		sched.Stop();
+		MG_TRACE_LABEL(&task, nullptr);
+		mg::box::TraceClear();
+	}
+
+	// Nesting of the tasks on the stack of one thread.
+	static thread_local uint32_t theUTParallelForDepth = 0;
+
+	static void
+	UnitTestTaskSchedulerParallelFor()
+	{
+		TestCaseGuard guard("Parallel for");
+
+		mg::sch::TaskScheduler sched("tst", 5);
+		const uint32_t count = 10000;
+		std::vector<mg::box::AtomicU32> hits(count);
+		auto checkHits = [&]() {
+			for (mg::box::AtomicU32& h : hits)
+			{
+				TEST_CHECK(h.LoadRelaxed() == 1);
+				h.StoreRelaxed(0);
+			}
+		};
+		auto body = [&](uint64_t aBegin, uint64_t aEnd) {
+			TEST_CHECK(aBegin < aEnd && aEnd <= count);
+			for (uint64_t i = aBegin; i < aEnd; ++i)
+				hits[i].IncrementRelaxed();
+		};
+		// Not started scheduler. The caller does everything.
+		sched.ParallelFor(0, count, 10, body);
+		checkHits();
+
+		sched.Start(3);
+		// Empty range.
+		sched.ParallelFor(5, 5, 1, body);
+		// Various grains, including bigger than the range and 0.
+		uint64_t grains[] = {0, 1, 7, 100, count, count * 2};
+		for (uint64_t grain : grains)
+		{
+			sched.ParallelFor(0, count, grain, body);
+			checkHits();
+		}
+		// Subrange.
+		sched.ParallelFor(100, 200, 3, body);
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			TEST_CHECK(hits[i].LoadRelaxed() == (i >= 100 && i < 200));
+			hits[i].StoreRelaxed(0);
+		}
+		// The chunks are not smaller than the grain, except for the last one.
+		mg::box::AtomicU32 chunkCount(0);
+		sched.ParallelFor(0, count, 1000, [&](uint64_t aBegin, uint64_t aEnd) {
+			TEST_CHECK(aEnd - aBegin >= 1000 || aEnd == count);
+			chunkCount.IncrementRelaxed();
+		});
+		TEST_CHECK(chunkCount.LoadRelaxed() <= count / 1000 + 1);
+
+		// From inside of the workers, nested, when all the workers are busy.
+		mg::box::AtomicU32 doneCount(0);
+		const uint32_t taskCount = 5;
+		std::vector<mg::box::AtomicU64> sums(taskCount);
+		for (uint32_t i = 0; i < taskCount; ++i)
+		{
+			sums[i].StoreRelaxed(0);
+			sched.PostOneShot([&, i]() {
+				sched.ParallelFor(0, 100, 1, [&, i](uint64_t aBegin, uint64_t aEnd) {
+					for (uint64_t j = aBegin; j < aEnd; ++j)
+					{
+						sched.ParallelFor(0, j, 4, [&, i](uint64_t aBegin2,
+							uint64_t aEnd2) {
+							sums[i].AddFetchRelaxed(aEnd2 - aBegin2);
+						});
+					}
+				});
+				doneCount.IncrementRelease();
+			});
+		}
+		while (doneCount.LoadAcquire() != taskCount)
+			mg::box::Sleep(1);
+		for (mg::box::AtomicU64& sum : sums)
+			TEST_CHECK(sum.LoadRelaxed() == 99 * 100 / 2);
+
+		// A worker waiting for the loop executes the other tasks. Here the helper's chunk
+		// can't finish until another task is executed, and the caller is the only free
+		// worker.
+		mg::sch::TaskScheduler sched2("tst", 5);
+		sched2.Start(2);
+		doneCount.StoreRelaxed(0);
+		mg::box::AtomicBool isHelperStarted(false);
+		mg::box::AtomicBool isOtherDone(false);
+		mg::sch::Task other([&](mg::sch::Task*) {
+			isOtherDone.StoreRelease(true);
+		});
+		sched2.PostOneShot([&]() {
+			mg::box::ThreadId callerID = mg::box::GetCurrentThreadId();
+			sched2.ParallelFor(0, 2, 1, [&, callerID](uint64_t, uint64_t) {
+				if (mg::box::GetCurrentThreadId() == callerID)
+				{
+					while (!isHelperStarted.LoadAcquire())
+						mg::box::Sleep(1);
+					return;
+				}
+				isHelperStarted.StoreRelease(true);
+				sched2.Post(&other);
+				while (!isOtherDone.LoadAcquire())
+					mg::box::Sleep(1);
+			});
+			doneCount.IncrementRelease();
+		});
+		while (doneCount.LoadAcquire() != 1)
+			mg::box::Sleep(1);
+		TEST_CHECK(isOtherDone.LoadRelaxed());
+
+		// The tasks executed in a join run own loops, and so on. The nesting on one
+		// worker's stack is limited.
+		doneCount.StoreRelaxed(0);
+		mg::box::AtomicU32 maxDepth(0);
+		const uint32_t nestCount = 50;
+		for (uint32_t i = 0; i < nestCount; ++i)
+		{
+			sched2.PostOneShot([&]() {
+				uint32_t depth = ++theUTParallelForDepth;
+				uint32_t old = maxDepth.LoadRelaxed();
+				while (old < depth && !maxDepth.CmpExchgWeakRelaxed(old, depth))
+					continue;
+				sched2.ParallelFor(0, 2, 1, [](uint64_t, uint64_t) {
+					mg::box::Sleep(1);
+				});
+				--theUTParallelForDepth;
+				doneCount.IncrementRelease();
+			});
+		}
+		while (doneCount.LoadAcquire() != nestCount)
+			mg::box::Sleep(1);
+		TEST_CHECK(maxDepth.LoadRelaxed() <= 5);
+		sched2.Stop();
+
+		// Async. The done task is posted when everything is finished.
+		doneCount.StoreRelaxed(0);
+		mg::sch::Task doneTask([&](mg::sch::Task*) {
+			checkHits();
+			doneCount.IncrementRelease();
+		});
+		sched.ParallelForAsync(0, count, 10, body, &doneTask);
+		while (doneCount.LoadAcquire() != 1)
+			mg::box::Sleep(1);
+		TEST_CHECK(sched.WaitEmpty());
+		doneTask.SetCallback([&](mg::sch::Task*) {
+			doneCount.IncrementRelease();
+		});
+		sched.ParallelForAsync(0, 0, 10, body, &doneTask);
+		while (doneCount.LoadAcquire() != 2)
+			mg::box::Sleep(1);
+		TEST_CHECK(sched.WaitEmpty());
+
+		// Fork-join.
+		mg::box::AtomicU32 forkCount(0);
+		sched.ForkJoin({
+			[&]() { forkCount.AddFetchRelaxed(1); },
+			[&]() { forkCount.AddFetchRelaxed(10); },
+			[&]() { forkCount.AddFetchRelaxed(100); },
+		});
+		TEST_CHECK(forkCount.LoadRelaxed() == 111);
+		sched.ForkJoin({});
+		sched.ForkJoin({[&]() { forkCount.AddFetchRelaxed(1000); }});
+		TEST_CHECK(forkCount.LoadRelaxed() == 1111);
+		TEST_CHECK(sched.WaitEmpty());
+		sched.Stop();
+	}
+
+	static void
+	UnitTestTaskSchedulerPostMany()
+	{
+		TestCaseGuard guard("Post many");
+
+		mg::sch::TaskScheduler sched("tst", 5);
+		sched.Start(2);
+		mg::box::AtomicU32 doneCount(0);
+		const uint32_t count = 1000;
+		mg::sch::Task tasks[count];
+		for (mg::sch::Task& t : tasks)
+		{
+			t.SetCallback([&](mg::sch::Task* aTask) {
+				TEST_CHECK(aTask->IsExpired());
+				doneCount.IncrementRelaxed();
+			});
+		}
+		// Empty list.
+		sched.PostMany(nullptr);
+
+		// Single task.
+		sched.PostMany(&tasks[0]);
+		while (doneCount.LoadRelaxed() != 1)
+			mg::box::Sleep(1);
+
+		// Many tasks, some of them with deadlines.
+		doneCount.StoreRelaxed(0);
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			if (i % 10 == 0)
+				tasks[i].SetDelay(i % 7);
+			tasks[i].myNext = i + 1 < count ? &tasks[i + 1] : nullptr;
+		}
+		sched.PostMany(&tasks[0]);
+		while (doneCount.LoadRelaxed() != count)
+			mg::box::Sleep(1);
+		TEST_CHECK(sched.WaitEmpty());
+
+		// The tasks are dispatched in the order of the list.
+		mg::sch::TaskScheduler sched1("tst", 5);
+		std::vector<uint32_t> order;
+		const uint32_t orderCount = 10;
+		for (uint32_t i = 0; i < orderCount; ++i)
+		{
+			tasks[i].SetCallback([&, i](mg::sch::Task*) {
+				order.push_back(i);
+			});
+			tasks[i].myNext = i + 1 < orderCount ? &tasks[i + 1] : nullptr;
+		}
+		sched1.PostMany(&tasks[0]);
+		sched1.Start(1);
+		TEST_CHECK(sched1.WaitEmpty());
+		TEST_CHECK(order.size() == orderCount);
+		for (uint32_t i = 0; i < order.size(); ++i)
+			TEST_CHECK(order[i] == i);
+	}
+
+	static void
+	UnitTestTaskSchedulerWakeupMany()
+	{
+		TestCaseGuard guard("Wakeup and signal many");
+
+		mg::sch::TaskScheduler sched("tst", 5);
+		sched.Start(2);
+		mg::box::AtomicU32 doneCount(0);
+		mg::box::AtomicU32 signalCount(0);
+		const uint32_t count = 1000;
+		mg::sch::Task tasks[count];
+		mg::sch::Task* taskPtrs[count];
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			tasks[i].SetCallback([&](mg::sch::Task* aTask) {
+				TEST_CHECK(!aTask->IsExpired());
+				if (aTask->ReceiveSignal())
+					signalCount.IncrementRelaxed();
+				doneCount.IncrementRelaxed();
+			});
+			taskPtrs[i] = &tasks[i];
+		}
+		// Empty.
+		sched.PostWakeupMany(taskPtrs, 0);
+		sched.PostSignalMany(taskPtrs, 0);
+
+		for (int round = 0; round < 3; ++round)
+		{
+			// Wakeup.
+			doneCount.StoreRelaxed(0);
+			for (mg::sch::Task& t : tasks)
+				sched.PostWait(&t);
+			mg::box::Sleep(10);
+			TEST_CHECK(doneCount.LoadRelaxed() == 0);
+			sched.PostWakeupMany(taskPtrs, count);
+			while (doneCount.LoadRelaxed() != count)
+				mg::box::Sleep(1);
+			TEST_CHECK(signalCount.LoadRelaxed() == 0);
+
+			// Signal.
+			doneCount.StoreRelaxed(0);
+			for (mg::sch::Task& t : tasks)
+				sched.PostWait(&t);
+			sched.PostSignalMany(taskPtrs, count);
+			while (doneCount.LoadRelaxed() != count)
+				mg::box::Sleep(1);
+			TEST_CHECK(signalCount.ExchangeRelaxed(0) == count);
+
+			// Wakeup of the tasks which are not posted yet, or are being posted. Must
+			// not be lost.
+			doneCount.StoreRelaxed(0);
+			sched.PostWakeupMany(taskPtrs, count / 2);
+			for (mg::sch::Task& t : tasks)
+				sched.PostWait(&t);
+			sched.PostWakeupMany(taskPtrs + count / 2, count - count / 2);
+			while (doneCount.LoadRelaxed() != count)
+				mg::box::Sleep(1);
+		}
+		TEST_CHECK(sched.WaitEmpty());
+	}
+
+	static void
+	UnitTestTaskSchedulerOneShot()
+	{
+		TestCaseGuard guard("One shot");
+
+		mg::sch::TaskScheduler sched("tst", 5);
+		sched.Start(2);
+		mg::box::AtomicU32 doneCount(0);
+		const uint32_t count = 1000;
+		// Small callbacks are stored inside of the pooled tasks.
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			sched.PostOneShot([&doneCount, i]() {
+				TEST_CHECK(i < count);
+				doneCount.IncrementRelaxed();
+			});
+		}
+		while (doneCount.LoadRelaxed() != count)
+			mg::box::Sleep(1);
+
+		// Too big callbacks go to the heap.
+		doneCount.StoreRelaxed(0);
+		uint64_t data[16];
+		for (uint32_t i = 0; i < 16; ++i)
+			data[i] = i;
+		static_assert(!mg::sch::TaskCallbackOneShot::Fits<decltype(data)>(),
+			"The data must not fit into the one-shot callback");
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			sched.PostOneShot([&doneCount, data]() {
+				for (uint32_t j = 0; j < 16; ++j)
+					TEST_CHECK(data[j] == j);
+				doneCount.IncrementRelaxed();
+			});
+		}
+		// Ready callback object.
+		mg::sch::TaskCallbackOneShot cb([&doneCount]() {
+			doneCount.IncrementRelaxed();
+		});
+		for (uint32_t i = 0; i < count; ++i)
+			sched.PostOneShot(cb);
+		while (doneCount.LoadRelaxed() != count * 2)
+			mg::box::Sleep(1);
+		TEST_CHECK(sched.WaitEmpty());
+	}
+
+	static void
+	UnitTestTaskSchedulerAdmission()
+	{
+		TestCaseGuard guard("Admission");
+
+		mg::box::AtomicU32 doneCount(0);
+		mg::sch::TaskCallback cb([&](mg::sch::Task*) {
+			doneCount.IncrementRelaxed();
+		});
+		// Without a limit everything is admitted.
+		{
+			mg::sch::TaskScheduler sched("tst", 5);
+			sched.Start(1);
+			std::vector<mg::sch::Task> tasks(101);
+			for (uint32_t i = 0; i < 100; ++i)
+			{
+				tasks[i].SetCallback(cb);
+				TEST_CHECK(sched.TryPost(&tasks[i]));
+			}
+			tasks[100].SetCallback(cb);
+			sched.PostWithBackpressure(&tasks[100]);
+			while (doneCount.LoadRelaxed() != 101)
+				mg::box::Sleep(1);
+			TEST_CHECK(sched.WaitEmpty());
+			TEST_CHECK(sched.GetAdmitCount() == 0);
+		}
+		// The limit is reached while the worker is busy.
+		const uint32_t capacity = 10;
+		mg::sch::TaskSchedulerParams params;
+		params.myAdmitCapacity = capacity;
+		mg::sch::TaskScheduler sched("tst", 5, params);
+		sched.Start(1);
+		mg::box::Signal blockStart;
+		mg::box::Signal blockEnd;
+		mg::sch::Task blocker([&](mg::sch::Task*) {
+			blockStart.Send();
+			blockEnd.ReceiveBlocking();
+		});
+		sched.Post(&blocker);
+		blockStart.ReceiveBlocking();
+
+		doneCount.StoreRelaxed(0);
+		std::vector<mg::sch::Task> tasks(capacity + 2);
+		for (mg::sch::Task& t : tasks)
+			t.SetCallback(cb);
+		for (uint32_t i = 0; i < capacity; ++i)
+			TEST_CHECK(sched.TryPost(&tasks[i]));
+		TEST_CHECK(!sched.TryPost(&tasks[capacity]));
+		TEST_CHECK(sched.GetAdmitCount() == capacity);
+		// The normal posts are not limited and don't take the slots.
+		sched.Post(&tasks[capacity]);
+		TEST_CHECK(sched.GetAdmitCount() == capacity);
+		// The blocked poster gets a slot when an admitted task starts.
+		mg::box::AtomicBool isPosted(false);
+		mg::box::ThreadFunc* poster = new mg::box::ThreadFunc("mgtst", [&]() {
+			sched.PostWithBackpressure(&tasks[capacity + 1]);
+			isPosted.StoreRelease(true);
+		});
+		poster->Start();
+		mg::box::Sleep(10);
+		TEST_CHECK(!isPosted.LoadAcquire());
+		blockEnd.Send();
+		delete poster;
+		TEST_CHECK(isPosted.LoadAcquire());
+		while (doneCount.LoadRelaxed() != capacity + 2)
+			mg::box::Sleep(1);
+		TEST_CHECK(sched.WaitEmpty());
+		// The idle worker doesn't keep the slots in its cache.
+		TEST_CHECK(sched.GetAdmitCount() == 0);
+
+		// The worker takes the slots in chunks, but the limit still holds.
+		doneCount.StoreRelaxed(0);
+		std::vector<mg::sch::Task> tasks2(capacity * 2);
+		for (mg::sch::Task& t : tasks2)
+			t.SetCallback(cb);
+		uint32_t postCount = 0;
+		mg::sch::Task poster2([&](mg::sch::Task*) {
+			while (sched.TryPost(&tasks2[postCount]))
+				++postCount;
+		});
+		sched.Post(&poster2);
+		TEST_CHECK(sched.WaitEmpty());
+		TEST_CHECK(postCount == capacity);
+		TEST_CHECK(doneCount.LoadRelaxed() == capacity);
+		TEST_CHECK(sched.GetAdmitCount() == 0);
+	}
+
+	static void
+	UnitTestTaskSchedulerAdmissionBackpressure()
+	{
+		TestCaseGuard guard("Admission backpressure");
+
+		// The producer is much faster than the workers. Without the limit the tasks
+		// would pile up in the queues. With it the number of the live tasks stays
+		// bounded.
+		const uint32_t threadCount = 3;
+		const uint32_t capacity = 100;
+		const uint32_t taskCount = 20000;
+		mg::box::AtomicU32 highCount(0);
+		mg::box::AtomicU32 lowCount(0);
+		mg::sch::TaskSchedulerParams params;
+		params.myAdmitCapacity = capacity;
+		params.myAdmitHighWatermark = 80;
+		params.myAdmitLowWatermark = 20;
+		params.myOnAdmitHigh = [&]() {
+			TEST_CHECK(highCount.LoadRelaxed() == lowCount.LoadRelaxed());
+			highCount.IncrementRelaxed();
+		};
+		params.myOnAdmitLow = [&]() {
+			TEST_CHECK(highCount.LoadRelaxed() == lowCount.LoadRelaxed() + 1);
+			lowCount.IncrementRelaxed();
+		};
+		mg::sch::TaskScheduler sched("tst", 5, params);
+		sched.Start(threadCount);
+
+		mg::box::AtomicU32 liveCount(0);
+		mg::box::AtomicU32 doneCount(0);
+		mg::sch::TaskCallback cb([&](mg::sch::Task* aTask) {
+			uint64_t deadline = mg::box::GetMicroseconds() + 20;
+			while (mg::box::GetMicroseconds() < deadline);
+			liveCount.DecrementRelaxed();
+			doneCount.IncrementRelaxed();
+			delete aTask;
+		});
+		uint32_t maxLiveCount = 0;
+		uint32_t rejectCount = 0;
+		for (uint32_t i = 0; i < taskCount; ++i)
+		{
+			uint32_t live = liveCount.IncrementFetchRelaxed();
+			if (live > maxLiveCount)
+				maxLiveCount = live;
+			TEST_CHECK(sched.GetAdmitCount() <= capacity);
+			mg::sch::Task* t = new mg::sch::Task(cb);
+			if (i % 2 == 0)
+			{
+				sched.PostWithBackpressure(t);
+				continue;
+			}
+			while (!sched.TryPost(t))
+			{
+				++rejectCount;
+				mg::box::Sleep(1);
+			}
+		}
+		while (doneCount.LoadRelaxed() != taskCount)
+			mg::box::Sleep(1);
+		TEST_CHECK(sched.WaitEmpty());
+		// The running tasks have already freed their slots, but they are still alive.
+		// Plus the one being posted.
+		TEST_CHECK(maxLiveCount <= capacity + threadCount + 1);
+		TEST_CHECK(rejectCount > 0);
+		TEST_CHECK(sched.GetAdmitCount() == 0);
+		TEST_CHECK(highCount.LoadRelaxed() > 0);
+		TEST_CHECK(highCount.LoadRelaxed() == lowCount.LoadRelaxed());
+	}
+
+	static void
+	UnitTestTaskSchedulerClassesRun(
+		mg::sch::TaskSchedulerQueueMode aMode)
+	{
+		// Heavy class keeps the worker busy all the time, but the light class still
+		// gets its turns.
+		mg::sch::TaskSchedulerParams params;
+		params.myQueueMode = aMode;
+		params.myClassWeights = {100, 1};
+		mg::sch::TaskScheduler sched("tst", 5, params);
+		sched.Start(1);
+		const uint32_t count = 10;
+		mg::box::AtomicBool isStopped(false);
+		mg::box::AtomicU32 doneCount(0);
+		std::vector<mg::sch::Task> tasks(count);
+		for (mg::sch::Task& t : tasks)
+		{
+			t.SetCallback([&](mg::sch::Task* aTask) {
+				if (isStopped.LoadRelaxed())
+				{
+					doneCount.IncrementRelaxed();
+					return;
+				}
+				sched.Post(aTask);
+			});
+			sched.Post(&t);
+		}
+		mg::sch::Task light([&](mg::sch::Task*) {
+			isStopped.StoreRelaxed(true);
+		});
+		light.SetClass(1);
+		TEST_CHECK(light.GetClass() == 1);
+		mg::box::Sleep(1);
+		sched.Post(&light);
+		while (doneCount.LoadRelaxed() != count)
+			mg::box::Sleep(1);
+		TEST_CHECK(sched.WaitEmpty());
+	}
+
+	static void
+	UnitTestTaskSchedulerClasses()
+	{
+		TestCaseGuard guard("Classes");
+
+		// One class by default. Then the task classes are ignored.
+		{
+			mg::sch::TaskScheduler sched("tst", 5);
+			TEST_CHECK(sched.GetClassCount() == 1);
+			sched.Start(1);
+			mg::box::AtomicU32 doneCount(0);
+			mg::sch::Task task([&](mg::sch::Task*) {
+				doneCount.IncrementRelaxed();
+			});
+			TEST_CHECK(task.GetClass() == 0);
+			task.SetClass(3);
+			sched.Post(&task);
+			while (doneCount.LoadRelaxed() != 1)
+				mg::box::Sleep(1);
+			TEST_CHECK(sched.WaitEmpty());
+			uint32_t threadCount;
+			mg::sch::TaskSchedulerThread*const* threads = sched.GetThreads(threadCount);
+			TEST_CHECK(threads[0]->StatPopClassExecuteCount(0) == 0);
+		}
+		// The ready tasks of the classes are executed interleaved according to the
+		// weights.
+		{
+			mg::sch::TaskSchedulerParams params;
+			params.myIsStatEnabled = true;
+			params.myClassWeights = {3, 1};
+			// Big batches, so all the tasks become ready in one scheduling round.
+			mg::sch::TaskScheduler sched("tst", 100, params);
+			TEST_CHECK(sched.GetClassCount() == 2);
+			sched.Start(1);
+			mg::box::Signal blockStart;
+			mg::box::Signal blockEnd;
+			mg::sch::Task blocker([&](mg::sch::Task*) {
+				blockStart.Send();
+				blockEnd.ReceiveBlocking();
+			});
+			sched.Post(&blocker);
+			blockStart.ReceiveBlocking();
+
+			const uint32_t count = 40;
+			// Only one worker, no need to protect it.
+			std::vector<uint32_t> classes;
+			classes.reserve(count * 2);
+			std::vector<mg::sch::Task> tasks(count * 2);
+			for (mg::sch::Task& t : tasks)
+			{
+				t.SetCallback([&](mg::sch::Task* aTask) {
+					classes.push_back(aTask->GetClass());
+				});
+			}
+			// The light class goes first, but doesn't get ahead anyway.
+			for (uint32_t i = 0; i < count; ++i)
+			{
+				tasks[i].SetClass(1);
+				sched.Post(&tasks[i]);
+			}
+			for (uint32_t i = count; i < count * 2; ++i)
+				sched.Post(&tasks[i]);
+			blockEnd.Send();
+			TEST_CHECK(sched.WaitEmpty());
+			TEST_CHECK(classes.size() == count * 2);
+			// While both classes have tasks, the heavy one gets 3 of each 4 turns.
+			uint32_t heavyCount = 0;
+			for (uint32_t i = 0; i < count; ++i)
+				heavyCount += classes[i] == 0;
+			TEST_CHECK(heavyCount >= count * 3 / 4 - 1 && heavyCount <= count * 3 / 4 + 1);
+			// Then the light class has the worker for itself.
+			for (uint32_t i = count * 2 - count / 2; i < count * 2; ++i)
+				TEST_CHECK(classes[i] == 1);
+
+			uint32_t threadCount;
+			mg::sch::TaskSchedulerThread*const* threads = sched.GetThreads(threadCount);
+			// Plus the blocker.
+			TEST_CHECK(threads[0]->StatPopClassExecuteCount(0) == count + 1);
+			TEST_CHECK(threads[0]->StatPopClassExecuteCount(1) == count);
+			TEST_CHECK(threads[0]->StatPopClassExecuteCount(0) == 0);
+			TEST_CHECK(threads[0]->StatPopClassExecuteCount(2) == 0);
+
+			mg::sch::TaskSchedulerStat stat;
+			sched.StatSnapshot(stat);
+			TEST_CHECK(stat.myReadyDelay.GetCount() == count * 2 + 1);
+			TEST_CHECK(stat.myClassReadyDelay.size() == 2);
+			TEST_CHECK(stat.myClassReadyDelay[0].GetCount() == count + 1);
+			TEST_CHECK(stat.myClassReadyDelay[1].GetCount() == count);
+			TEST_CHECK(stat.myClassReadyDepth.size() == 2);
+			TEST_CHECK(stat.myClassReadyDepth[0] == 0);
+			TEST_CHECK(stat.myClassReadyDepth[1] == 0);
+		}
+		// The classes work with several NUMA nodes too. Each task class has its ready
+		// queue on each node.
+		{
+			mg::sch::TaskSchedulerParams params;
+			params.myIsNUMAAware = true;
+			params.myNUMANodes.resize(2, mg::box::SysGetNUMANodes()[0]);
+			params.myClassWeights = {2, 1, 1};
+			mg::sch::TaskScheduler sched("tst", 5, params);
+			sched.Start(3);
+			const uint32_t count = 1000;
+			mg::box::AtomicU32 doneCount(0);
+			std::vector<mg::sch::Task> tasks(count);
+			for (uint32_t i = 0; i < count; ++i)
+			{
+				tasks[i].SetCallback([&](mg::sch::Task* aTask) {
+					// Go through the sched again, to get into the node of the worker.
+					if (aTask->GetClass() != 0)
+					{
+						aTask->SetClass(aTask->GetClass() - 1);
+						sched.Post(aTask);
+						return;
+					}
+					doneCount.IncrementRelaxed();
+				});
+				tasks[i].SetClass(i % 3);
+				sched.Post(&tasks[i]);
+			}
+			while (doneCount.LoadRelaxed() != count)
+				mg::box::Sleep(1);
+			TEST_CHECK(sched.WaitEmpty());
+		}
+		UnitTestTaskSchedulerClassesRun(mg::sch::TASK_SCHEDULER_QUEUE_MODE_SHARED);
+		UnitTestTaskSchedulerClassesRun(mg::sch::TASK_SCHEDULER_QUEUE_MODE_LOCAL);
+	}
+
+	static void
+	UnitTestTaskSchedulerTimeSliceBusyLoop(
+		uint64_t aDurationUs)
+	{
+		uint64_t end = mg::box::GetMicroseconds() + aDurationUs;
+		while (mg::box::GetMicroseconds() < end);
+	}
+
+	static uint64_t
+	UnitTestTaskSchedulerTimeSliceRun(
+		mg::sch::TaskSchedulerQueueMode aMode,
+		bool aDoYield)
+	{
+		// A long task and short tasks posted while it runs. Returns the max delay of
+		// the short tasks.
+		mg::sch::TaskSchedulerParams params;
+		params.myQueueMode = aMode;
+		params.myTimeSliceUs = 1000;
+		mg::sch::TaskScheduler sched("tst", 5, params);
+		sched.Start(1);
+		// 100ms in total.
+		const uint32_t stepCount = 1000;
+		const uint64_t stepDurationUs = 100;
+		mg::box::Signal longStart;
+		uint32_t longStep = 0;
+		uint32_t yieldCount = 0;
+		mg::sch::Task longTask([&](mg::sch::Task* aTask) {
+			if (longStep == 0)
+				longStart.Send();
+			while (longStep < stepCount)
+			{
+				UnitTestTaskSchedulerTimeSliceBusyLoop(stepDurationUs);
+				++longStep;
+				if (aDoYield && aTask->ShouldYield())
+				{
+					++yieldCount;
+					sched.Post(aTask);
+					return;
+				}
+			}
+		});
+		sched.Post(&longTask);
+		longStart.ReceiveBlocking();
+
+		const uint32_t shortCount = 10;
+		mg::box::AtomicU64 maxDelay(0);
+		mg::box::AtomicU32 doneCount(0);
+		std::vector<mg::sch::Task> shortTasks(shortCount);
+		for (mg::sch::Task& t : shortTasks)
+		{
+			uint64_t postTime = mg::box::GetMicroseconds();
+			t.SetCallback([&, postTime](mg::sch::Task*) {
+				uint64_t delay = mg::box::GetMicroseconds() - postTime;
+				if (delay > maxDelay.LoadRelaxed())
+					maxDelay.StoreRelaxed(delay);
+				doneCount.IncrementRelaxed();
+			});
+			sched.Post(&t);
+			mg::box::Sleep(1);
+		}
+		while (doneCount.LoadRelaxed() != shortCount)
+			mg::box::Sleep(1);
+		TEST_CHECK(sched.WaitEmpty());
+		TEST_CHECK(longStep == stepCount);
+		TEST_CHECK(aDoYield == (yieldCount > 0));
+
+		uint32_t threadCount;
+		mg::sch::TaskSchedulerThread*const* threads = sched.GetThreads(threadCount);
+		TEST_CHECK(threads[0]->StatPopSliceOverrunCount() > 0);
+		return maxDelay.LoadRelaxed();
+	}
+
+	static void
+	UnitTestTaskSchedulerTimeSlice()
+	{
+		TestCaseGuard guard("Time slice");
+
+		// Not in a worker thread.
+		mg::sch::Task task;
+		TEST_CHECK(!task.ShouldYield());
+		// Without a slice the tasks never yield.
+		{
+			mg::sch::TaskScheduler sched("tst", 5);
+			sched.Start(1);
+			bool shouldYield = true;
+			mg::sch::Task blocker;
+			blocker.SetCallback([](mg::sch::Task*) {});
+			task.SetCallback([&](mg::sch::Task* aTask) {
+				sched.Post(&blocker);
+				UnitTestTaskSchedulerTimeSliceBusyLoop(2000);
+				shouldYield = aTask->ShouldYield();
+			});
+			sched.Post(&task);
+			TEST_CHECK(sched.WaitEmpty());
+			TEST_CHECK(!shouldYield);
+			uint32_t threadCount;
+			mg::sch::TaskSchedulerThread*const* threads = sched.GetThreads(threadCount);
+			TEST_CHECK(threads[0]->StatPopSliceOverrunCount() == 0);
+		}
+		// Nobody is waiting, no sense to yield.
+		{
+			mg::sch::TaskSchedulerParams params;
+			params.myTimeSliceUs = 1000;
+			mg::sch::TaskScheduler sched("tst", 5, params);
+			sched.Start(1);
+			bool shouldYield = true;
+			task.SetCallback([&](mg::sch::Task* aTask) {
+				UnitTestTaskSchedulerTimeSliceBusyLoop(2000);
+				shouldYield = aTask->ShouldYield();
+			});
+			sched.Post(&task);
+			TEST_CHECK(sched.WaitEmpty());
+			TEST_CHECK(!shouldYield);
+			uint32_t threadCount;
+			mg::sch::TaskSchedulerThread*const* threads = sched.GetThreads(threadCount);
+			TEST_CHECK(threads[0]->StatPopSliceOverrunCount() == 1);
+		}
+		// The short tasks wait for the whole long task, unless it yields.
+		for (mg::sch::TaskSchedulerQueueMode mode : {
+			mg::sch::TASK_SCHEDULER_QUEUE_MODE_SHARED,
+			mg::sch::TASK_SCHEDULER_QUEUE_MODE_LOCAL})
+		{
+			uint64_t delayNoYield = UnitTestTaskSchedulerTimeSliceRun(mode, false);
+			uint64_t delayYield = UnitTestTaskSchedulerTimeSliceRun(mode, true);
+			TEST_CHECK(delayNoYield >= 50 * 1000);
+			TEST_CHECK(delayYield < delayNoYield / 2);
+		}
+#if MG_CORO_IS_ENABLED
+		// The same in a coroutine.
+		{
+			mg::sch::TaskSchedulerParams params;
+			params.myTimeSliceUs = 1000;
+			mg::sch::TaskScheduler sched("tst", 5, params);
+			sched.Start(1);
+			mg::box::AtomicBool isShortDone(false);
+			mg::sch::Task shortTask([&](mg::sch::Task*) {
+				isShortDone.StoreRelaxed(true);
+			});
+			uint32_t yieldCount = 0;
+			mg::sch::Task coro;
+			coro.SetCallback([](
+				mg::sch::Task* aTask,
+				mg::sch::TaskScheduler& aSched,
+				mg::sch::Task* aShortTask,
+				mg::box::AtomicBool& aIsShortDone,
+				uint32_t& aYieldCount) -> mg::box::Coro {
+
+				aSched.Post(aShortTask);
+				while (!aIsShortDone.LoadRelaxed())
+				{
+					UnitTestTaskSchedulerTimeSliceBusyLoop(100);
+					bool shouldYield = aTask->ShouldYield();
+					co_await aTask->AsyncYieldIfNeeded();
+					aYieldCount += shouldYield;
+				}
+				// Nothing is waiting.
+				co_await aTask->AsyncYieldIfNeeded();
+				co_return;
+			}(&coro, sched, &shortTask, isShortDone, yieldCount));
+			sched.Post(&coro);
+			TEST_CHECK(sched.WaitEmpty());
+			TEST_CHECK(isShortDone.LoadRelaxed());
+			TEST_CHECK(yieldCount > 0);
+		}
+#endif
+	}
+
+	static void
+	UnitTestTaskSchedulerPool()
+	{
+		TestCaseGuard guard("Pool");
+
+		mg::sch::TaskSchedulerPool pool("tst");
+		pool.Start(3);
+		TEST_CHECK(pool.GetThreadCount() == 3);
+		// Two schedulers on the pool. The tasks jump between them.
+		{
+			mg::sch::TaskSchedulerParams params;
+			params.myQueueMode = mg::sch::TASK_SCHEDULER_QUEUE_MODE_LOCAL;
+			mg::sch::TaskScheduler sched1("tst", 5);
+			mg::sch::TaskScheduler sched2("tst", 5, params);
+			sched1.Start(pool, 1);
+			sched2.Start(pool, 1);
+			TEST_CHECK(sched1.GetThreadCount() == 3);
+			TEST_CHECK(sched2.GetThreadCount() == 3);
+
+			const uint32_t taskCount = 100;
+			const uint32_t stepCount = 100;
+			mg::box::AtomicU32 execCount(0);
+			std::vector<mg::sch::Task> tasks(taskCount);
+			std::vector<uint32_t> steps(taskCount, 0);
+			for (uint32_t i = 0; i < taskCount; ++i)
+			{
+				tasks[i].SetCallback([&, i](mg::sch::Task* aTask) {
+					execCount.IncrementRelaxed();
+					TEST_CHECK(&mg::sch::TaskScheduler::This() ==
+						(steps[i] % 2 == 0 ? &sched1 : &sched2));
+					if (++steps[i] == stepCount)
+						return;
+					mg::sch::TaskScheduler& next = steps[i] % 2 == 0 ? sched1 : sched2;
+					// Re-post into the own scheduler goes to the local queue.
+					next.Post(aTask);
+				});
+				sched1.Post(&tasks[i]);
+			}
+			TEST_CHECK(sched1.WaitEmpty());
+			TEST_CHECK(sched2.WaitEmpty());
+			TEST_CHECK(execCount.LoadRelaxed() == taskCount * stepCount);
+
+			// Deadlines are respected, while the pool threads sleep.
+			mg::box::AtomicU32 doneCount(0);
+			uint64_t start = mg::box::GetMilliseconds();
+			for (uint32_t i = 0; i < taskCount; ++i)
+			{
+				tasks[i].SetCallback([&](mg::sch::Task*) {
+					TEST_CHECK(mg::box::GetMilliseconds() >= start + 50);
+					doneCount.IncrementRelaxed();
+				});
+				(i % 2 == 0 ? sched1 : sched2).PostDelay(&tasks[i], 50);
+			}
+			while (doneCount.LoadRelaxed() != taskCount)
+				mg::box::Sleep(1);
+
+			// Wakeup from another scheduler.
+			mg::sch::Task waiter;
+			mg::box::AtomicBool isWoken(false);
+			waiter.SetCallback([&](mg::sch::Task* aTask) {
+				if (aTask->ReceiveSignal())
+				{
+					isWoken.StoreRelaxed(true);
+					return;
+				}
+				sched2.PostWait(aTask);
+			});
+			sched2.PostWait(&waiter);
+			sched1.PostOneShot([&]() {
+				waiter.PostSignal();
+			});
+			while (!isWoken.LoadRelaxed())
+				mg::box::Sleep(1);
+			TEST_CHECK(sched1.WaitEmpty());
+			TEST_CHECK(sched2.WaitEmpty());
+
+			// Can move to own threads and back.
+			sched2.Stop();
+			sched2.Start(2);
+			TEST_CHECK(sched2.GetThreadCount() == 2);
+			sched2.PostOneShot([&]() {
+				TEST_CHECK(&mg::sch::TaskScheduler::This() == &sched2);
+				isWoken.StoreRelaxed(false);
+			});
+			TEST_CHECK(sched2.WaitEmpty());
+			TEST_CHECK(!isWoken.LoadRelaxed());
+			sched2.Stop();
+			// The tasks posted to a stopped scheduler are executed after the start.
+			sched2.PostOneShot([&]() {
+				isWoken.StoreRelaxed(true);
+			});
+			sched2.Start(pool, 1);
+			TEST_CHECK(sched2.WaitEmpty());
+			TEST_CHECK(isWoken.LoadRelaxed());
+			sched1.Stop();
+			sched2.Stop();
+		}
+		pool.Stop();
+		// The shares split the threads between the loaded schedulers.
+		{
+			pool.Start(1);
+			mg::sch::TaskScheduler sched1("tst", 5);
+			mg::sch::TaskScheduler sched2("tst", 5);
+			mg::box::AtomicBool isStopped(false);
+			mg::box::AtomicU32 doneCount(0);
+			mg::box::AtomicU64 execCount1(0);
+			mg::box::AtomicU64 execCount2(0);
+			const uint32_t taskCount = 50;
+			std::vector<mg::sch::Task> tasks(taskCount * 2);
+			for (uint32_t i = 0; i < taskCount * 2; ++i)
+			{
+				mg::sch::TaskScheduler* sched = i < taskCount ? &sched1 : &sched2;
+				mg::box::AtomicU64* count = i < taskCount ? &execCount1 : &execCount2;
+				tasks[i].SetCallback([&, sched, count](mg::sch::Task* aTask) {
+					count->IncrementRelaxed();
+					if (isStopped.LoadRelaxed())
+					{
+						doneCount.IncrementRelaxed();
+						return;
+					}
+					sched->Post(aTask);
+				});
+				sched->Post(&tasks[i]);
+			}
+			sched1.Start(pool, 3);
+			sched2.Start(pool, 1);
+			while (execCount1.LoadRelaxed() + execCount2.LoadRelaxed() < 100000)
+				mg::box::Sleep(1);
+			isStopped.StoreRelaxed(true);
+			while (doneCount.LoadRelaxed() != taskCount * 2)
+				mg::box::Sleep(1);
+			double ratio = (double)execCount1.LoadRelaxed() / execCount2.LoadRelaxed();
+			TEST_CHECK(ratio > 2 && ratio < 4);
+			sched1.Stop();
+			sched2.Stop();
+			pool.Stop();
+		}
+	}
+
+	static void
+	UnitTestTaskSchedulerNoDeadlines()
+	{
+		TestCaseGuard guard("No deadlines");
+
+		using TaskScheduler = mg::sch::TaskSchedulerWithPolicy<
+			mg::sch::TaskSchedulerPolicyNoDeadlines>;
+		mg::sch::TaskSchedulerQueueMode modes[] = {
+			mg::sch::TASK_SCHEDULER_QUEUE_MODE_SHARED,
+			mg::sch::TASK_SCHEDULER_QUEUE_MODE_LOCAL,
+		};
+		for (mg::sch::TaskSchedulerQueueMode mode : modes)
+		{
+			mg::sch::TaskSchedulerParams params;
+			params.myQueueMode = mode;
+			params.myIsStatEnabled = true;
+			TaskScheduler sched("tst", 5, params);
+			sched.Start(3);
+
+			// Tasks re-posting themselves, from the workers and from outside.
+			mg::box::AtomicU32 doneCount(0);
+			const uint32_t count = 100;
+			const uint32_t repostCount = 100;
+			std::vector<mg::sch::Task> tasks(count);
+			std::vector<uint32_t> counters(count, 0);
+			for (uint32_t i = 0; i < count; ++i)
+			{
+				uint32_t* counter = &counters[i];
+				tasks[i].SetCallback([&, counter](mg::sch::Task* aTask) {
+					TEST_CHECK(aTask->IsExpired());
+					if (++*counter < repostCount)
+						return sched.Post(aTask);
+					doneCount.IncrementRelaxed();
+				});
+				sched.Post(&tasks[i]);
+			}
+			while (doneCount.LoadRelaxed() != count)
+				mg::box::Sleep(1);
+
+			// Many tasks at once.
+			doneCount.StoreRelaxed(0);
+			for (uint32_t i = 0; i < count; ++i)
+			{
+				tasks[i].SetCallback([&](mg::sch::Task*) {
+					doneCount.IncrementRelaxed();
+				});
+				tasks[i].myNext = i + 1 < count ? &tasks[i + 1] : nullptr;
+			}
+			sched.PostMany(&tasks[0]);
+			while (doneCount.LoadRelaxed() != count)
+				mg::box::Sleep(1);
+
+			sched.PostOneShot([&]() {
+				doneCount.IncrementRelaxed();
+			});
+			while (doneCount.LoadRelaxed() != count + 1)
+				mg::box::Sleep(1);
+
+			// The cancellation doesn't wake the tasks up. They only see it.
+			doneCount.StoreRelaxed(0);
+			mg::box::CancellationToken::Ptr token =
+				mg::box::CancellationToken::NewShared();
+			tasks[0].SetCancellation(token.GetPointer());
+			tasks[0].SetCallback([&](mg::sch::Task* aTask) {
+				if (!aTask->IsCancelled())
+					return sched.Post(aTask);
+				aTask->SetCancellation(nullptr);
+				doneCount.IncrementRelaxed();
+			});
+			sched.Post(&tasks[0]);
+			token->Cancel();
+			while (doneCount.LoadRelaxed() != 1)
+				mg::box::Sleep(1);
+			TEST_CHECK(sched.WaitEmpty());
+			mg::sch::TaskSchedulerStat stat;
+			sched.StatSnapshot(stat);
+			TEST_CHECK(stat.myWaitingDepth == 0);
+		}
+
+		// On a pool.
+		mg::sch::TaskSchedulerPool pool("tst");
+		pool.Start(2);
+		TaskScheduler sched("tst", 5);
+		sched.Start(pool, 1);
+		mg::box::AtomicU32 counter(0);
+		mg::sch::Task task([&](mg::sch::Task* aTask) {
+			if (counter.IncrementFetchRelaxed() < 1000)
+				sched.Post(aTask);
+		});
+		sched.Post(&task);
+		while (counter.LoadRelaxed() != 1000)
 			mg::box::Sleep(1);
+		TEST_CHECK(sched.WaitEmpty());
+		sched.Stop();
+		pool.Stop();
 	}
 
 	static void
-	UnitTestTaskSchedulerSignal()
+	UnitTestTaskSchedulerArena()
 	{
-		TestCaseGuard guard("Signal");
+		TestCaseGuard guard("Arena");
 
-		mg::sch::TaskScheduler sched("tst", 2);
-		sched.Start(1);
+		mg::sch::TaskScheduler sched("tst", 5);
+		sched.Start(2);
+		mg::box::Signal done;
+		// The arena data survives the re-posts.
+		mg::sch::Task* task = new mg::sch::Task();
+		mg::box::ArenaVector<uint32_t>* vec = nullptr;
+		uint32_t step = 0;
+		task->SetCallback([&](mg::sch::Task* aTask) {
+			mg::box::Arena& arena = aTask->GetArena();
+			if (step == 0)
+			{
+				TEST_CHECK(arena.IsEmpty());
+				vec = new (arena.AllocateT<mg::box::ArenaVector<uint32_t>>())
+					mg::box::ArenaVector<uint32_t>(
+						mg::box::ArenaAllocator<uint32_t>(arena));
+			}
+			TEST_CHECK(vec->size() == step);
+			vec->push_back(step);
+			if (++step < 100)
+				return sched.Post(aTask);
+			done.Send();
+		});
+		TEST_CHECK(task->GetArena().IsEmpty());
+		sched.Post(task);
+		done.ReceiveBlocking();
+		TEST_CHECK(!task->GetArena().IsEmpty());
+		for (uint32_t i = 0; i < 100; ++i)
+			TEST_CHECK((*vec)[i] == i);
+
+		// A new callback means a new job. The arena is reset.
+		task->SetCallback([&](mg::sch::Task* aTask) {
+			TEST_CHECK(aTask->GetArena().IsEmpty());
+			mg::box::ArenaString str{mg::box::ArenaAllocator<char>(aTask->GetArena())};
+			str = "a string long enough to be not in the small buffer";
+			TEST_CHECK(!aTask->GetArena().IsEmpty());
+			done.Send();
+		});
+		TEST_CHECK(task->GetArena().IsEmpty());
+		sched.Post(task);
+		done.ReceiveBlocking();
+		TEST_CHECK(!task->GetArena().IsEmpty());
+		// Deletion frees the arena too.
+		delete task;
+		TEST_CHECK(sched.WaitEmpty());
+	}
 
-		// Signal works during execution.
-		mg::box::AtomicU32 progress(0);
-		mg::sch::Task t([&](mg::sch::Task* aTask) {
-			bool isSignaled = aTask->ReceiveSignal();
-			progress.IncrementRelaxed();
-			if (isSignaled)
-				return;
-			// Inject a sleep to ensure the signal works
-			// during execution.
-			while (progress.LoadRelaxed() != 2)
-				mg::box::Sleep(1);
-			sched.PostWait(aTask);
+	static void
+	UnitTestTaskSchedulerPeriod()
+	{
+		TestCaseGuard guard("Period");
+
+		mg::sch::TaskScheduler sched("tst", 5);
+		sched.Start(2);
+		mg::box::Signal done;
+		const uint64_t period = 2000;
+		uint64_t prevTick;
+		uint32_t step;
+		// The ticks are on the multiples of the period, and a simple re-post waits for
+		// the next one.
+		mg::sch::Task task;
+		task.SetPeriodUs(period);
+		prevTick = task.GetDeadlineUs();
+		TEST_CHECK(prevTick % period == 0);
+		TEST_CHECK(prevTick > mg::box::GetMicroseconds() - period);
+		step = 0;
+		task.SetCallback([&](mg::sch::Task* aTask) {
+			TEST_CHECK(mg::box::GetMicroseconds() >= prevTick);
+			TEST_CHECK(aTask->IsExpired());
+			TEST_CHECK(aTask->GetTickCount() == 1);
+			uint64_t tick = aTask->GetDeadlineUs();
+			TEST_CHECK(tick % period == 0);
+			TEST_CHECK(tick > prevTick);
+			prevTick = tick;
+			if (++step < 10)
+				return sched.Post(aTask);
+			done.Send();
 		});
-		sched.Post(&t);
-		while (progress.LoadRelaxed() != 1)
-			mg::box::Sleep(1);
-		t.PostSignal();
-		progress.IncrementRelaxed();
-		while (progress.LoadRelaxed() != 3)
-			mg::box::Sleep(1);
+		sched.Post(&task);
+		done.ReceiveBlocking();
 
-		// Signal works for tasks in the front queue.
-		progress.StoreRelaxed(false);
-		t.SetCallback([&](mg::sch::Task*) {
-			TEST_CHECK(t.ReceiveSignal());
-			progress.StoreRelaxed(true);
+		// Many tasks of the same period.
+		const uint32_t count = 100;
+		mg::box::AtomicU32 doneCount(0);
+		std::vector<mg::sch::Task> tasks(count);
+		for (mg::sch::Task& t : tasks)
+		{
+			t.SetPeriodUs(period);
+			t.SetCallback([&](mg::sch::Task* aTask) {
+				TEST_CHECK(aTask->GetTickCount() > 0);
+				TEST_CHECK(aTask->GetDeadlineUs() % period == 0);
+				uint32_t n = doneCount.FetchIncrementRelaxed() + 1;
+				if (n < count * 5)
+					return sched.Post(aTask);
+				if (n == count * 5)
+					done.Send();
+			});
+		}
+		for (mg::sch::Task& t : tasks)
+			sched.Post(&t);
+		done.ReceiveBlocking();
+		TEST_CHECK(sched.WaitEmpty());
+		TEST_CHECK(doneCount.LoadRelaxed() >= count * 5);
+
+		// Catch up. A late task runs each missed tick one by one.
+		task.SetPeriodUs(period, mg::box::PERIOD_MISS_CATCH_UP);
+		step = 0;
+		task.SetCallback([&](mg::sch::Task* aTask) {
+			TEST_CHECK(aTask->GetTickCount() == 1);
+			uint64_t tick = aTask->GetDeadlineUs();
+			if (step == 0)
+				mg::box::Sleep(period * 6 / 1000);
+			else
+				TEST_CHECK(tick == prevTick + period);
+			prevTick = tick;
+			if (++step < 8)
+				return sched.Post(aTask);
+			done.Send();
 		});
-		sched.PostDeadline(&t, MG_TIME_INFINITE);
-		t.PostSignal();
-		while (!progress.LoadRelaxed())
-			mg::box::Sleep(1);
+		sched.Post(&task);
+		done.ReceiveBlocking();
+
+		// Coalesce. A late task gets all the missed ticks at once.
+		task.SetPeriodUs(period, mg::box::PERIOD_MISS_COALESCE);
+		step = 0;
+		task.SetCallback([&](mg::sch::Task* aTask) {
+			if (step == 0)
+			{
+				TEST_CHECK(aTask->GetTickCount() == 1);
+				mg::box::Sleep(period * 6 / 1000);
+			}
+			else
+			{
+				TEST_CHECK(aTask->GetTickCount() >= 5);
+				TEST_CHECK(aTask->GetDeadlineUs() > mg::box::GetMicroseconds());
+				TEST_CHECK(aTask->GetDeadlineUs() % period == 0);
+			}
+			if (++step < 2)
+				return sched.Post(aTask);
+			done.Send();
+		});
+		sched.Post(&task);
+		done.ReceiveBlocking();
+
+		// Skip. A late task drops the missed ticks.
+		task.SetPeriodUs(period, mg::box::PERIOD_MISS_SKIP);
+		step = 0;
+		task.SetCallback([&](mg::sch::Task* aTask) {
+			TEST_CHECK(aTask->GetTickCount() == 1);
+			if (step == 0)
+			{
+				mg::box::Sleep(period * 6 / 1000);
+			}
+			else
+			{
+				TEST_CHECK(aTask->GetDeadlineUs() > mg::box::GetMicroseconds());
+				TEST_CHECK(aTask->GetDeadlineUs() % period == 0);
+			}
+			if (++step < 2)
+				return sched.Post(aTask);
+			done.Send();
+		});
+		sched.Post(&task);
+		done.ReceiveBlocking();
+
+		// Wakeup before the tick doesn't consume it.
+		const uint64_t bigPeriod = 1000000000;
+		task.SetPeriodUs(bigPeriod);
+		prevTick = task.GetDeadlineUs();
+		task.SetCallback([&](mg::sch::Task* aTask) {
+			TEST_CHECK(!aTask->IsExpired());
+			TEST_CHECK(aTask->GetTickCount() == 0);
+			TEST_CHECK(aTask->GetDeadlineUs() == prevTick);
+			done.Send();
+		});
+		sched.Post(&task);
+		task.PostWakeup();
+		done.ReceiveBlocking();
+		TEST_CHECK(sched.WaitEmpty());
+
+		// Period 0 makes the task usual again.
+		task.SetPeriodUs(0);
+		task.SetDeadline(0);
+		task.SetCallback([&](mg::sch::Task* aTask) {
+			TEST_CHECK(aTask->GetTickCount() == 0);
+			TEST_CHECK(aTask->GetDeadlineUs() == 0);
+			done.Send();
+		});
+		sched.Post(&task);
+		done.ReceiveBlocking();
+		TEST_CHECK(sched.WaitEmpty());
+	}
 
-		// Signal works for tasks in the waiting queue. Without
-		// -1 the task won't be saved to the waiting queue.
-		progress.StoreRelaxed(false);
-		sched.PostDeadline(&t, MG_TIME_INFINITE - 1);
-		mg::box::Sleep(1);
-		t.PostSignal();
-		while (!progress.LoadRelaxed())
-			mg::box::Sleep(1);
+	static void
+	UnitTestTaskSchedulerCancel()
+	{
+		TestCaseGuard guard("Cancel");
 
-		// Signal can be checked before receipt.
-		t.SetCallback([&](mg::sch::Task* aTask) {
-			if (!aTask->IsSignaled())
-				return sched.PostWait(aTask);
-			TEST_CHECK(aTask->ReceiveSignal());
+		mg::sch::TaskScheduler sched1("tst1", 5);
+		sched1.Start(2);
+		mg::sch::TaskScheduler sched2("tst2", 5);
+		sched2.Start(2);
+		mg::box::Signal done;
+		const uint32_t count = 200;
+		mg::box::AtomicU32 waitCount(0);
+		mg::box::AtomicU32 doneCount(0);
+		mg::box::CancellationToken::Ptr root = mg::box::CancellationToken::NewShared();
+		mg::box::CancellationToken::Ptr child1 = root->NewChild();
+		mg::box::CancellationToken::Ptr child2 = child1->NewChild();
+		// Tasks on different schedulers and tokens wait infinitely. They are woken up by
+		// the cancellation of the token tree.
+		std::vector<mg::sch::Task> tasks(count);
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			mg::sch::Task& t = tasks[i];
+			mg::sch::TaskScheduler* sched = i % 2 == 0 ? &sched1 : &sched2;
+			if (i % 3 == 0)
+				t.SetCancellation(root.GetPointer());
+			else if (i % 3 == 1)
+				t.SetCancellation(child1.GetPointer());
+			else
+				t.SetCancellation(child2.GetPointer());
+			t.SetCallback([&, sched](mg::sch::Task* aTask) {
+				if (!aTask->IsCancelled())
+				{
+					if (waitCount.FetchIncrementRelaxed() + 1 == count)
+						done.Send();
+					return sched->PostWait(aTask);
+				}
+				if (doneCount.FetchIncrementRelaxed() + 1 == count)
+					done.Send();
+			});
+			sched->Post(&t);
+		}
+		done.ReceiveBlocking();
+		TEST_CHECK(doneCount.LoadRelaxed() == 0);
+		root->Cancel();
+		done.ReceiveBlocking();
+		TEST_CHECK(sched1.WaitEmpty());
+		TEST_CHECK(sched2.WaitEmpty());
+		TEST_CHECK(doneCount.LoadRelaxed() == count);
+		for (mg::sch::Task& t : tasks)
+			TEST_CHECK(t.IsCancelled());
+
+		// A child is cancelled alone. Already cancelled token doesn't wake the task
+		// up, the callback sees it right away.
+		mg::box::CancellationToken::Ptr root2 = mg::box::CancellationToken::NewShared();
+		mg::box::CancellationToken::Ptr child3 = root2->NewChild();
+		mg::sch::Task t1;
+		mg::sch::Task t2;
+		TEST_CHECK(t1.GetCancellation() == nullptr);
+		TEST_CHECK(!t1.IsCancelled());
+		t1.SetCancellation(root2.GetPointer());
+		TEST_CHECK(t1.GetCancellation() == root2.GetPointer());
+		TEST_CHECK(!t1.IsCancelled());
+		t2.SetCancellation(child3.GetPointer());
+		t1.SetCallback([&](mg::sch::Task* aTask) {
+			if (!aTask->IsCancelled())
+				return sched1.PostWait(aTask);
+			done.Send();
 		});
-		sched.Post(&t);
-		t.PostSignal();
-		while (t.IsSignaled())
-			mg::box::Sleep(1);
+		t2.SetCallback([&](mg::sch::Task* aTask) {
+			if (!aTask->IsCancelled())
+				return sched1.PostWait(aTask);
+			done.Send();
+		});
+		sched1.Post(&t1);
+		sched1.Post(&t2);
+		child3->Cancel();
+		done.ReceiveBlocking();
+		TEST_CHECK(t2.IsCancelled());
+		TEST_CHECK(!t1.IsCancelled());
+		sched1.Post(&t2);
+		done.ReceiveBlocking();
+		// Detach. The task isn't woken up by the token anymore.
+		mg::sch::Task t3;
+		t3.SetCancellation(root2.GetPointer());
+		t3.SetCancellation(nullptr);
+		TEST_CHECK(t3.GetCancellation() == nullptr);
+		root2->Cancel();
+		done.ReceiveBlocking();
+		TEST_CHECK(t1.IsCancelled());
+		TEST_CHECK(!t3.IsCancelled());
+		TEST_CHECK(sched1.WaitEmpty());
+	}
 
-		// Double signal works.
-		progress.StoreRelaxed(false);
-		t.SetCallback([&](mg::sch::Task* aTask) {
-			while (!progress.LoadRelaxed())
+	static void
+	UnitTestTaskSchedulerSchedDedicated()
+	{
+		TestCaseGuard guard("Sched dedicated");
+
+		mg::sch::TaskSchedulerParams params;
+		params.myIsSchedDedicated = true;
+		params.myIsStatEnabled = true;
+		mg::sch::TaskScheduler sched("tst", 5, params);
+		TEST_CHECK(sched.GetSchedThread() == nullptr);
+		sched.Start(2);
+		TEST_CHECK(sched.GetSchedThread() != nullptr);
+		mg::box::Signal done;
+		// All the workers are busy. The expired task is dispatched anyway, so it gets
+		// the first free worker.
+		mg::box::AtomicBool isReleased(false);
+		mg::box::AtomicU32 blockCount(0);
+		mg::sch::Task blocker1;
+		mg::sch::Task blocker2;
+		auto blockFunc = [&](mg::sch::Task*) {
+			if (blockCount.FetchIncrementRelaxed() + 1 == 2)
+				done.Send();
+			while (!isReleased.LoadRelaxed())
 				mg::box::Sleep(1);
-			TEST_CHECK(aTask->IsSignaled());
-			TEST_CHECK(aTask->ReceiveSignal());
+		};
+		blocker1.SetCallback(blockFunc);
+		blocker2.SetCallback(blockFunc);
+		sched.Post(&blocker1);
+		sched.Post(&blocker2);
+		done.ReceiveBlocking();
+		mg::sch::Task task([&](mg::sch::Task* aTask) {
+			TEST_CHECK(aTask->IsExpired());
+			done.Send();
 		});
-		sched.Post(&t);
-		t.PostSignal();
-		t.PostSignal();
-		progress.StoreRelaxed(true);
-		while (t.IsSignaled())
+		sched.PostDelay(&task, 1);
+		mg::sch::TaskSchedulerStat stat;
+		uint64_t deadline = mg::box::GetMilliseconds() + 5000;
+		do
+		{
 			mg::box::Sleep(1);
+			sched.StatSnapshot(stat);
+		} while (stat.myReadyDepth == 0 && mg::box::GetMilliseconds() < deadline);
+		TEST_CHECK(stat.myWaitingDepth == 0);
+		TEST_CHECK(stat.myReadyDepth == 1);
+		isReleased.StoreRelaxed(true);
+		done.ReceiveBlocking();
+		TEST_CHECK(sched.WaitEmpty());
+		TEST_CHECK(sched.GetSchedThread()->StatPopScheduleCount() > 0);
+		TEST_CHECK(sched.GetSchedThread()->StatPopExecuteCount() == 0);
+
+		// Many tasks wake up many workers.
+		const uint32_t count = 1000;
+		mg::box::AtomicU32 doneCount(0);
+		std::vector<mg::sch::Task> tasks(count);
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			mg::sch::Task& t = tasks[i];
+			t.SetCallback([&](mg::sch::Task* aTask) {
+				if (!aTask->IsExpired())
+					return sched.PostDelay(aTask, 1);
+				if (doneCount.FetchIncrementRelaxed() + 1 == count)
+					done.Send();
+			});
+			if (i % 2 == 0)
+				sched.Post(&t);
+			else
+				sched.PostWait(&t);
+		}
+		for (uint32_t i = 1; i < count; i += 2)
+			tasks[i].PostWakeup();
+		done.ReceiveBlocking();
+		TEST_CHECK(sched.WaitEmpty());
+		uint32_t threadCount = 0;
+		mg::sch::TaskSchedulerThread*const* threads = sched.GetThreads(threadCount);
+		for (uint32_t i = 0; i < threadCount; ++i)
+			TEST_CHECK(threads[i]->StatPopScheduleCount() == 0);
+
+		// Restart.
+		sched.Stop();
+		TEST_CHECK(sched.GetSchedThread() == nullptr);
+		doneCount.StoreRelaxed(0);
+		for (mg::sch::Task& t : tasks)
+			sched.Post(&t);
+		sched.Start(3);
+		done.ReceiveBlocking();
+		TEST_CHECK(sched.WaitEmpty());
+		sched.Stop();
+
+		// Busy-polling, elastic, with the local queues.
+		params.myIsLatencyCritical = true;
+		params.myQueueMode = mg::sch::TASK_SCHEDULER_QUEUE_MODE_LOCAL;
+		params.myThreadGrowReadyCount = 10;
+		params.myThreadIdleTimeout = 1;
+		mg::sch::TaskScheduler sched2("tst", 5, params);
+		sched2.Start(1, 4);
+		doneCount.StoreRelaxed(0);
+		for (mg::sch::Task& t : tasks)
+		{
+			t.SetCallback([&](mg::sch::Task* aTask) {
+				uint32_t n = doneCount.FetchIncrementRelaxed() + 1;
+				if (n < count * 10)
+					return sched2.Post(aTask);
+				if (n == count * 10)
+					done.Send();
+			});
+			sched2.Post(&t);
+		}
+		done.ReceiveBlocking();
+		TEST_CHECK(sched2.WaitEmpty());
+	}
 
-		// Task is rescheduled until signal is received.
-		progress.StoreRelaxed(0);
-		t.SetCallback([&](mg::sch::Task* aTask) {
-			TEST_CHECK(aTask->IsSignaled());
-			uint32_t p = progress.IncrementFetchRelaxed();
-			if (p == 1)
-				return sched.PostWait(aTask);
-			if (p == 2)
-				return sched.PostDeadline(aTask, MG_TIME_INFINITE - 1);
-			if (p == 3)
-				return sched.PostDelay(aTask, 1000000);
-			if (p == 4)
-				return sched.Post(aTask);
-			TEST_CHECK(aTask->ReceiveSignal());
+	static void
+	UnitTestTaskSchedulerCoroutineAdmission()
+	{
+#if MG_CORO_IS_ENABLED
+		TestCaseGuard guard("Coroutine admission");
+
+		const uint32_t threadCount = 2;
+		const uint32_t capacity = 5;
+		const uint32_t taskCount = 2000;
+		mg::sch::TaskSchedulerParams params;
+		params.myAdmitCapacity = capacity;
+		mg::sch::TaskScheduler sched("tst", 5, params);
+		sched.Start(threadCount);
+
+		mg::box::AtomicU32 liveCount(0);
+		mg::box::AtomicU32 maxLiveCount(0);
+		mg::box::AtomicU32 doneCount(0);
+		mg::sch::TaskCallback cb([&](mg::sch::Task* aTask) {
+			uint64_t deadline = mg::box::GetMicroseconds() + 20;
+			while (mg::box::GetMicroseconds() < deadline);
+			liveCount.DecrementRelaxed();
+			doneCount.IncrementRelaxed();
+			delete aTask;
 		});
-		t.PostSignal();
+		mg::box::Signal s;
+		mg::sch::Task t;
+		t.SetCallback([](
+			mg::sch::Task* aTask,
+			mg::sch::TaskScheduler& aSched,
+			mg::sch::TaskCallback& aCb,
+			mg::box::AtomicU32& aLiveCount,
+			mg::box::AtomicU32& aMaxLiveCount,
+			mg::box::Signal& aSignal) -> mg::box::Coro {
+			for (uint32_t i = 0; i < taskCount; ++i)
+			{
+				uint32_t live = aLiveCount.IncrementFetchRelaxed();
+				if (live > aMaxLiveCount.LoadRelaxed())
+					aMaxLiveCount.StoreRelaxed(live);
+				co_await aSched.AsyncPostWithBackpressure(aTask,
+					new mg::sch::Task(aCb));
+			}
+			co_await aTask->AsyncExitSendSignal(aSignal);
+			TEST_CHECK(!"Unreachable");
+			co_return;
+		}(&t, sched, cb, liveCount, maxLiveCount, s));
 		sched.Post(&t);
-		while (t.IsSignaled())
+		s.ReceiveBlocking();
+		while (doneCount.LoadRelaxed() != taskCount)
 			mg::box::Sleep(1);
-		TEST_CHECK(progress.LoadRelaxed() == 5);
+		TEST_CHECK(sched.WaitEmpty());
+		TEST_CHECK(maxLiveCount.LoadRelaxed() <= capacity + threadCount + 1);
+		TEST_CHECK(sched.GetAdmitCount() == 0);
+#endif
 	}
 
 	static void
@@ -1299,6 +3286,43 @@ namespace sch {
 		delete[] myTasks;
 	}
 
+	static void
+	UnitTestTaskSchedulerCoroutineParallelFor()
+	{
+#if MG_CORO_IS_ENABLED
+		TestCaseGuard guard("Coroutine parallel for");
+		mg::sch::TaskScheduler sched("tst", 100);
+		sched.Start(3);
+		mg::box::Signal s;
+		mg::sch::Task t;
+		const uint32_t count = 1000;
+		std::vector<mg::box::AtomicU32> hits(count);
+		t.SetCallback([](mg::sch::Task& t, mg::box::Signal& s,
+			std::vector<mg::box::AtomicU32>& hits) -> mg::box::Coro {
+			for (int i = 0; i < 10; ++i)
+			{
+				co_await t.AsyncParallelFor(0, hits.size(), 5,
+					[&hits](uint64_t aBegin, uint64_t aEnd) {
+					for (uint64_t j = aBegin; j < aEnd; ++j)
+						hits[j].IncrementRelaxed();
+				});
+				// Everything is visible right after the loop.
+				for (mg::box::AtomicU32& h : hits)
+					TEST_CHECK(h.LoadRelaxed() == (uint32_t)i + 1);
+			}
+			// Empty loop.
+			co_await t.AsyncParallelFor(0, 0, 5, [](uint64_t, uint64_t) {
+				TEST_CHECK(!"Unreachable");
+			});
+			co_await t.AsyncExitSendSignal(s);
+			TEST_CHECK(!"Unreachable");
+			co_return;
+		}(t, s, hits));
+		sched.Post(&t);
+		s.ReceiveBlocking();
+#endif
+	}
+
 	static void
 	UnitTestTaskSchedulerPrintStat(
 		const mg::sch::TaskScheduler* aSched)
@@ -1310,8 +3334,17 @@ namespace sch {
 		{
 			uint64_t execCount = threads[i]->StatPopExecuteCount();
 			uint64_t schedCount = threads[i]->StatPopScheduleCount();
-			Report("Thread %2u: exec: %12llu, sched: %9llu", i, (unsigned long long)execCount,
-				(unsigned long long)schedCount);
+			uint64_t stealCount = threads[i]->StatPopStealCount();
+			uint64_t spinTime = threads[i]->StatPopSpinTime();
+			uint64_t spinWakeCount = threads[i]->StatPopSpinWakeCount();
+			uint64_t wakeCount = threads[i]->StatPopWakeCount();
+			uint64_t nodeStealCount = threads[i]->StatPopNodeStealCount();
+			Report("Thread %2u: exec: %12llu, sched: %9llu, steal: %9llu, spin us: %9llu, "
+				"spin wake: %9llu, wake: %9llu, node %u steal: %9llu", i,
+				(unsigned long long)execCount, (unsigned long long)schedCount,
+				(unsigned long long)stealCount, (unsigned long long)spinTime,
+				(unsigned long long)spinWakeCount, (unsigned long long)wakeCount,
+				threads[i]->GetNodeIndex(), (unsigned long long)nodeStealCount);
 		}
 		Report("");
 	}
@@ -1492,9 +3525,9 @@ namespace sch {
 
 		// The test checks how slow is the scheduler on the
 		// slowest case - when tons of tasks are woken up in the
-		// order reversed from their insertion. It would cost
-		// logarithmic time to remove each of them from the
-		// waiting tasks queue's root, which is a binary heap.
+		// order reversed from their insertion. Each of them has
+		// to be removed from the middle of the waiting tasks
+		// queue.
 		Report("Timeouts test: %u tasks", aTaskCount);
 		mg::sch::TaskScheduler sched("tst", 5000);
 		sched.Start(1);
@@ -1523,7 +3556,7 @@ namespace sch {
 			mg::box::Sleep(1);
 
 		// Wakeup so as the scheduler would remove tasks from the
-		// binary heap from its root - the slowest case. For that
+		// waiting queue in the order of their deadlines. For that
 		// wakeup from the end, because the front queue is
 		// reversed.
 		for (int i = aTaskCount - 1; i >= 0; --i)
@@ -1566,6 +3599,100 @@ namespace sch {
 		UnitTestTaskSchedulerPrintStat(&sched);
 	}
 
+	static void
+	UnitTestTaskSchedulerLocalBatch(
+		uint32_t aThreadCount,
+		uint32_t aTaskCount,
+		uint32_t aExecuteCount)
+	{
+		TestCaseGuard guard("Local batch");
+
+		// The heavy tasks re-post themselves from the workers, sometimes with delays, and
+		// wakeup and signal each other. Mix of the local and the front queues.
+		Report("Local batch test: %u threads, %u tasks, %u executes", aThreadCount,
+			aTaskCount, aExecuteCount);
+		mg::sch::TaskSchedulerParams params;
+		params.myQueueMode = mg::sch::TASK_SCHEDULER_QUEUE_MODE_LOCAL;
+		mg::sch::TaskScheduler sched("tst", 5000, params);
+		sched.Start(aThreadCount);
+		UTTSchedulerTaskCtx ctx(aTaskCount, aExecuteCount, &sched);
+
+		ctx.CreateHeavy();
+		ctx.PostAll();
+		ctx.WaitAllStopped();
+
+		UnitTestTaskSchedulerPrintStat(&sched);
+	}
+
+	static void
+	UnitTestTaskSchedulerNUMABatch(
+		uint32_t aThreadCount,
+		uint32_t aTaskCount,
+		uint32_t aExecuteCount)
+	{
+		TestCaseGuard guard("NUMA batch");
+
+		Report("NUMA batch test: %u threads, %u tasks, %u executes", aThreadCount,
+			aTaskCount, aExecuteCount);
+		mg::sch::TaskSchedulerParams params;
+		params.myQueueMode = mg::sch::TASK_SCHEDULER_QUEUE_MODE_LOCAL;
+		params.myIsNUMAAware = true;
+		params.myNUMANodes.resize(2, mg::box::SysGetNUMANodes()[0]);
+		mg::sch::TaskScheduler sched("tst", 5000, params);
+		sched.Start(aThreadCount);
+		UTTSchedulerTaskCtx ctx(aTaskCount, aExecuteCount, &sched);
+
+		ctx.CreateHeavy();
+		ctx.PostAll();
+		ctx.WaitAllStopped();
+
+		UnitTestTaskSchedulerPrintStat(&sched);
+	}
+
+	static void
+	UnitTestTaskSchedulerLocalFanOut(
+		uint32_t aThreadCount,
+		uint32_t aTaskCount)
+	{
+		TestCaseGuard guard("Local fan out");
+
+		// One task spawns many slow children from a worker thread. They all get into the
+		// local queue of that worker, and the other workers must steal them.
+		mg::sch::TaskSchedulerParams params;
+		params.myQueueMode = mg::sch::TASK_SCHEDULER_QUEUE_MODE_LOCAL;
+		mg::sch::TaskScheduler sched("tst", 5, params);
+		sched.Start(aThreadCount);
+		mg::box::AtomicU32 executeCount(0);
+		mg::box::AtomicU32 currentParallel(0);
+		mg::box::AtomicU32 maxParallel(0);
+		mg::sch::TaskCallback childCb([&](mg::sch::Task* aTask) {
+			TEST_CHECK(aTask->IsExpired());
+			uint32_t count = currentParallel.IncrementFetchRelaxed();
+			uint32_t max = maxParallel.LoadRelaxed();
+			while (count > max && !maxParallel.CmpExchgWeakRelaxed(max, count));
+			mg::box::Sleep(1);
+			currentParallel.DecrementRelaxed();
+			executeCount.IncrementRelaxed();
+			delete aTask;
+		});
+		mg::sch::Task root([&](mg::sch::Task*) {
+			for (uint32_t i = 0; i < aTaskCount; ++i)
+				sched.Post(new mg::sch::Task(childCb));
+		});
+		sched.Post(&root);
+		while (executeCount.LoadRelaxed() != aTaskCount)
+			mg::box::Sleep(1);
+		TEST_CHECK(sched.WaitEmpty());
+		TEST_CHECK(maxParallel.LoadRelaxed() > 1);
+
+		uint32_t threadCount;
+		mg::sch::TaskSchedulerThread*const* threads = sched.GetThreads(threadCount);
+		uint64_t stealCount = 0;
+		for (uint32_t i = 0; i < threadCount; ++i)
+			stealCount += threads[i]->StatPopStealCount();
+		TEST_CHECK(stealCount > 0);
+	}
+
 	void
 	UnitTestTaskScheduler()
 	{
@@ -1575,11 +3702,34 @@ namespace sch {
 		UnitTestTaskSchedulerDestroyWithFront();
 		UnitTestTaskSchedulerDestroyWithWaiting();
 		UnitTestTaskSchedulerOrder();
+		UnitTestTaskSchedulerFrontOrder();
 		UnitTestTaskSchedulerDomino();
 		UnitTestTaskSchedulerWakeup();
 		UnitTestTaskSchedulerExpiration();
 		UnitTestTaskSchedulerReschedule();
 		UnitTestTaskSchedulerSignal();
+		UnitTestTaskSchedulerTimerSlack();
+		UnitTestTaskSchedulerMicroseconds();
+		UnitTestTaskSchedulerIdleSpin();
+		UnitTestTaskSchedulerElastic();
+		UnitTestTaskSchedulerNUMA();
+		UnitTestTaskSchedulerStat();
+		UnitTestTaskSchedulerTrace();
+		UnitTestTaskSchedulerParallelFor();
+		UnitTestTaskSchedulerPostMany();
+		UnitTestTaskSchedulerWakeupMany();
+		UnitTestTaskSchedulerOneShot();
+		UnitTestTaskSchedulerAdmission();
+		UnitTestTaskSchedulerAdmissionBackpressure();
+		UnitTestTaskSchedulerClasses();
+		UnitTestTaskSchedulerTimeSlice();
+		UnitTestTaskSchedulerPool();
+		UnitTestTaskSchedulerNoDeadlines();
+		UnitTestTaskSchedulerArena();
+		UnitTestTaskSchedulerPeriod();
+		UnitTestTaskSchedulerCancel();
+		UnitTestTaskSchedulerSchedDedicated();
+		UnitTestTaskSchedulerCoroutineAdmission();
 		UnitTestTaskSchedulerCoroutineBasic();
 		UnitTestTaskSchedulerCoroutineAsyncReceiveSignal();
 		UnitTestTaskSchedulerCoroutineAsyncExitDelete();
@@ -1587,6 +3737,7 @@ namespace sch {
 		UnitTestTaskSchedulerCoroutineNested();
 		UnitTestTaskSchedulerCoroutineDifferentSchedulers();
 		UnitTestTaskSchedulerCoroutineStress();
+		UnitTestTaskSchedulerCoroutineParallelFor();
 		UnitTestTaskSchedulerMicro(5, 10000000);
 		UnitTestTaskSchedulerMicroNew(5, 10000000);
 		UnitTestTaskSchedulerMicroOneShot(5, 10000000);
@@ -1595,6 +3746,9 @@ namespace sch {
 		UnitTestTaskSchedulerMildLoad(5, 100000, 1, 10000);
 		UnitTestTaskSchedulerTimeouts(1000000);
 		UnitTestTaskSchedulerSignalStress(5, 1000000, 5);
+		UnitTestTaskSchedulerLocalBatch(5, 100000, 100);
+		UnitTestTaskSchedulerNUMABatch(5, 100000, 100);
+		UnitTestTaskSchedulerLocalFanOut(4, 1000);
 	}
 
 }
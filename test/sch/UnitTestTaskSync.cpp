@@ -0,0 +1,490 @@
+#include "mg/sch/TaskSync.h"
+
+#include "mg/box/Time.h"
+#include "mg/sch/TaskScheduler.h"
+#include "mg/test/Random.h"
+
+#include "UnitTest.h"
+
+#include <string>
+#include <vector>
+
+namespace mg {
+namespace unittests {
+namespace sch {
+
+	static void
+	UnitTestTaskSemaphoreBasic()
+	{
+		TestCaseGuard guard("Semaphore basic");
+
+		// Without waiters.
+		mg::sch::TaskSemaphore sem1(2);
+		TEST_CHECK(sem1.TryAcquire());
+		TEST_CHECK(sem1.TryAcquire());
+		TEST_CHECK(!sem1.TryAcquire());
+		sem1.Release();
+		TEST_CHECK(sem1.TryAcquire());
+		sem1.Release();
+		sem1.Release();
+
+		// The tasks aren't posted anywhere, only queued. The units are handed over in
+		// FIFO order, and a newcomer can't take them while there are waiters.
+		mg::sch::TaskSemaphore sem2(0);
+		mg::sch::Task t1;
+		mg::sch::Task t2;
+		mg::sch::Task t3;
+		TEST_CHECK(!sem2.TryAcquire());
+		TEST_CHECK(!sem2.AcquireOrEnqueue(&t1));
+		TEST_CHECK(!sem2.AcquireOrEnqueue(&t2));
+		TEST_CHECK(!sem2.AcquireOrEnqueue(&t3));
+		sem2.Release();
+		TEST_CHECK(t1.ReceiveSignal());
+		TEST_CHECK(!t2.IsSignaled() && !t3.IsSignaled());
+		TEST_CHECK(!sem2.TryAcquire());
+		sem2.Release();
+		TEST_CHECK(t2.ReceiveSignal());
+		TEST_CHECK(!t3.IsSignaled());
+		sem2.Release();
+		TEST_CHECK(t3.ReceiveSignal());
+		// No waiters anymore.
+		TEST_CHECK(!sem2.TryAcquire());
+		sem2.Release();
+		TEST_CHECK(sem2.AcquireOrEnqueue(&t1));
+		TEST_CHECK(!t1.IsSignaled());
+	}
+
+	struct UnitTestTaskMutexCtx
+	{
+		mg::sch::TaskScheduler* mySched;
+		mg::sch::TaskMutex myMutex;
+		mg::box::AtomicBool myIsInside;
+		uint64_t myCounter;
+		mg::box::AtomicU32 myDoneCount;
+	};
+
+	struct UnitTestTaskMutexTask
+	{
+		UnitTestTaskMutexTask(
+			UnitTestTaskMutexCtx* aCtx,
+			uint32_t aCount);
+
+		void Execute(
+			mg::sch::Task* aTask);
+
+		UnitTestTaskMutexCtx* myCtx;
+		uint32_t myCount;
+		bool myIsWaiting;
+		mg::sch::Task myTask;
+	};
+
+	UnitTestTaskMutexTask::UnitTestTaskMutexTask(
+		UnitTestTaskMutexCtx* aCtx,
+		uint32_t aCount)
+		: myCtx(aCtx)
+		, myCount(aCount)
+		, myIsWaiting(false)
+		, myTask([this](mg::sch::Task* aTask) { Execute(aTask); })
+	{
+	}
+
+	void
+	UnitTestTaskMutexTask::Execute(
+		mg::sch::Task* aTask)
+	{
+		if (!myIsWaiting)
+		{
+			if (!myCtx->myMutex.LockOrEnqueue(aTask))
+			{
+				myIsWaiting = true;
+				myCtx->mySched->PostWait(aTask);
+				return;
+			}
+		}
+		else if (!aTask->ReceiveSignal())
+		{
+			myCtx->mySched->PostWait(aTask);
+			return;
+		}
+		myIsWaiting = false;
+		TEST_CHECK(!myCtx->myIsInside.ExchangeRelaxed(true));
+		++myCtx->myCounter;
+		myCtx->myIsInside.StoreRelaxed(false);
+		myCtx->myMutex.Unlock();
+		if (--myCount == 0)
+		{
+			myCtx->myDoneCount.IncrementRelease();
+			return;
+		}
+		myCtx->mySched->Post(aTask);
+	}
+
+	static void
+	UnitTestTaskMutexCallback()
+	{
+		TestCaseGuard guard("Mutex callback");
+
+		mg::sch::TaskScheduler sched("tst", 5);
+		sched.Start(3);
+		UnitTestTaskMutexCtx ctx;
+		ctx.mySched = &sched;
+		ctx.myIsInside.StoreRelaxed(false);
+		ctx.myCounter = 0;
+		ctx.myDoneCount.StoreRelaxed(0);
+		const uint32_t taskCount = 50;
+		const uint32_t lockCount = 1000;
+		std::vector<UnitTestTaskMutexTask*> tasks;
+		tasks.reserve(taskCount);
+		for (uint32_t i = 0; i < taskCount; ++i)
+			tasks.push_back(new UnitTestTaskMutexTask(&ctx, lockCount));
+		for (UnitTestTaskMutexTask* t : tasks)
+			sched.Post(&t->myTask);
+		while (ctx.myDoneCount.LoadAcquire() != taskCount)
+			mg::box::Sleep(1);
+		TEST_CHECK(sched.WaitEmpty());
+		sched.Stop();
+		TEST_CHECK(ctx.myCounter == taskCount * lockCount);
+		for (UnitTestTaskMutexTask* t : tasks)
+			delete t;
+	}
+
+#if MG_CORO_IS_ENABLED
+	static void
+	UnitTestTaskMutexCoro()
+	{
+		TestCaseGuard guard("Mutex coro");
+
+		// The critical section is sometimes left to the scheduler while the mutex is
+		// locked. The other tasks wait for it without blocking the workers.
+		mg::sch::TaskScheduler sched("tst", 5);
+		sched.Start(3);
+		UnitTestTaskMutexCtx ctx;
+		ctx.mySched = &sched;
+		ctx.myIsInside.StoreRelaxed(false);
+		ctx.myCounter = 0;
+		ctx.myDoneCount.StoreRelaxed(0);
+		const uint32_t taskCount = 50;
+		const uint32_t lockCount = 1000;
+		std::vector<mg::sch::Task> tasks(taskCount);
+		for (mg::sch::Task& t : tasks)
+		{
+			t.SetCallback([](mg::sch::Task* aTask, UnitTestTaskMutexCtx& aCtx,
+				uint32_t aCount) -> mg::box::Coro {
+				for (uint32_t i = 0; i < aCount; ++i)
+				{
+					co_await aCtx.myMutex.AsyncLock(aTask);
+					TEST_CHECK(!aCtx.myIsInside.ExchangeRelaxed(true));
+					if (i % 10 == 0)
+						co_await aTask->AsyncYield();
+					++aCtx.myCounter;
+					aCtx.myIsInside.StoreRelaxed(false);
+					aCtx.myMutex.Unlock();
+				}
+				aCtx.myDoneCount.IncrementRelease();
+				co_return;
+			}(&t, ctx, lockCount));
+			sched.Post(&t);
+		}
+		while (ctx.myDoneCount.LoadAcquire() != taskCount)
+			mg::box::Sleep(1);
+		TEST_CHECK(sched.WaitEmpty());
+		sched.Stop();
+		TEST_CHECK(ctx.myCounter == taskCount * lockCount);
+	}
+
+	static void
+	UnitTestTaskSemaphoreCoro()
+	{
+		TestCaseGuard guard("Semaphore coro");
+
+		mg::sch::TaskScheduler sched("tst", 5);
+		sched.Start(3);
+		const uint32_t unitCount = 3;
+		const uint32_t taskCount = 50;
+		const uint32_t acquireCount = 1000;
+		mg::sch::TaskSemaphore sem(unitCount);
+		mg::box::AtomicU32 inside(0);
+		mg::box::AtomicU32 doneCount(0);
+		std::vector<mg::sch::Task> tasks(taskCount);
+		for (mg::sch::Task& t : tasks)
+		{
+			t.SetCallback([](mg::sch::Task* aTask, mg::sch::TaskSemaphore& aSem,
+				mg::box::AtomicU32& aInside, mg::box::AtomicU32& aDoneCount,
+				uint32_t aUnitCount, uint32_t aCount) -> mg::box::Coro {
+				for (uint32_t i = 0; i < aCount; ++i)
+				{
+					co_await aSem.AsyncAcquire(aTask);
+					TEST_CHECK(aInside.IncrementFetchRelaxed() <= aUnitCount);
+					if (mg::tst::RandomBool())
+						co_await aTask->AsyncYield();
+					aInside.DecrementRelaxed();
+					aSem.Release();
+				}
+				aDoneCount.IncrementRelease();
+				co_return;
+			}(&t, sem, inside, doneCount, unitCount, acquireCount));
+			sched.Post(&t);
+		}
+		while (doneCount.LoadAcquire() != taskCount)
+			mg::box::Sleep(1);
+		TEST_CHECK(sched.WaitEmpty());
+		sched.Stop();
+		// All the units are back.
+		for (uint32_t i = 0; i < unitCount; ++i)
+			TEST_CHECK(sem.TryAcquire());
+		TEST_CHECK(!sem.TryAcquire());
+	}
+#endif
+
+	static void
+	UnitTestTaskChannelBasic()
+	{
+		TestCaseGuard guard("Channel basic");
+
+		mg::sch::TaskChannel<std::string> ch(3);
+		TEST_CHECK(ch.GetCapacity() == 3);
+		std::string value;
+		TEST_CHECK(!ch.TryReceive(value));
+		// FIFO, including the wrap around the ring.
+		for (int i = 0; i < 10; ++i)
+		{
+			TEST_CHECK(ch.TrySend(std::to_string(i)));
+			TEST_CHECK(ch.TrySend(std::to_string(i + 100)));
+			TEST_CHECK(ch.TryReceive(value) && value == std::to_string(i));
+			TEST_CHECK(ch.TryReceive(value) && value == std::to_string(i + 100));
+		}
+		TEST_CHECK(!ch.TryReceive(value));
+		// Full. The value isn't moved on a failure.
+		TEST_CHECK(ch.TrySend("1"));
+		TEST_CHECK(ch.TrySend("2"));
+		TEST_CHECK(ch.TrySend("3"));
+		value = "4";
+		TEST_CHECK(!ch.TrySend(std::move(value)));
+		TEST_CHECK(value == "4");
+
+		// Waiting senders get the freed slots in FIFO order.
+		mg::sch::Task t1;
+		mg::sch::Task t2;
+		value = "5";
+		TEST_CHECK(!ch.SendOrEnqueue(&t1, std::move(value)));
+		TEST_CHECK(value == "5");
+		TEST_CHECK(!ch.SendOrEnqueue(&t2, "6"));
+		TEST_CHECK(ch.TryReceive(value) && value == "1");
+		TEST_CHECK(t1.ReceiveSignal());
+		TEST_CHECK(!t2.IsSignaled());
+		// The slot is reserved for the woken up sender.
+		TEST_CHECK(!ch.TrySend("7"));
+		ch.SendReserved("5");
+		TEST_CHECK(ch.TryReceive(value) && value == "2");
+		TEST_CHECK(t2.ReceiveSignal());
+		ch.SendReserved("6");
+
+		// Waiting receivers get the new items in FIFO order.
+		TEST_CHECK(ch.TryReceive(value) && value == "3");
+		TEST_CHECK(ch.TryReceive(value) && value == "5");
+		TEST_CHECK(ch.TryReceive(value) && value == "6");
+		TEST_CHECK(!ch.ReceiveOrEnqueue(&t1, value));
+		TEST_CHECK(!ch.ReceiveOrEnqueue(&t2, value));
+		TEST_CHECK(ch.TrySend("8"));
+		TEST_CHECK(t1.ReceiveSignal());
+		TEST_CHECK(!t2.IsSignaled());
+		// The item is reserved for the woken up receiver.
+		TEST_CHECK(!ch.TryReceive(value));
+		ch.ReceiveReserved(value);
+		TEST_CHECK(value == "8");
+		TEST_CHECK(ch.TrySend("9"));
+		TEST_CHECK(t2.ReceiveSignal());
+		ch.ReceiveReserved(value);
+		TEST_CHECK(value == "9");
+
+		// Not received items are destroyed together with the channel.
+		TEST_CHECK(ch.TrySend("10"));
+		TEST_CHECK(ch.TrySend("11"));
+	}
+
+#if MG_CORO_IS_ENABLED
+	static void
+	UnitTestTaskChannelCoro()
+	{
+		TestCaseGuard guard("Channel coro");
+
+		// Multiple senders and receivers through a tiny channel, so both sides wait a
+		// lot.
+		mg::sch::TaskScheduler sched("tst", 5);
+		sched.Start(3);
+		const uint32_t senderCount = 10;
+		const uint32_t receiverCount = 5;
+		const uint32_t valueCount = 2000;
+		const uint32_t receiveCount = senderCount * valueCount / receiverCount;
+		mg::sch::TaskChannel<uint64_t> ch(2);
+		mg::box::AtomicU64 sum(0);
+		mg::box::AtomicU32 doneCount(0);
+		std::vector<mg::sch::Task> tasks(senderCount + receiverCount);
+		for (uint32_t i = 0; i < senderCount; ++i)
+		{
+			mg::sch::Task& t = tasks[i];
+			t.SetCallback([](mg::sch::Task* aTask, mg::sch::TaskChannel<uint64_t>& aCh,
+				mg::box::AtomicU32& aDoneCount, uint32_t aCount) -> mg::box::Coro {
+				for (uint32_t j = 1; j <= aCount; ++j)
+					co_await aCh.AsyncSend(aTask, j);
+				aDoneCount.IncrementRelease();
+				co_return;
+			}(&t, ch, doneCount, valueCount));
+		}
+		for (uint32_t i = senderCount; i < senderCount + receiverCount; ++i)
+		{
+			mg::sch::Task& t = tasks[i];
+			t.SetCallback([](mg::sch::Task* aTask, mg::sch::TaskChannel<uint64_t>& aCh,
+				mg::box::AtomicU64& aSum, mg::box::AtomicU32& aDoneCount,
+				uint32_t aCount) -> mg::box::Coro {
+				uint64_t sum = 0;
+				for (uint32_t j = 0; j < aCount; ++j)
+				{
+					sum += co_await aCh.AsyncReceive(aTask);
+					if (j % 10 == 0)
+						co_await aTask->AsyncYield();
+				}
+				aSum.AddRelaxed(sum);
+				aDoneCount.IncrementRelease();
+				co_return;
+			}(&t, ch, sum, doneCount, receiveCount));
+		}
+		for (mg::sch::Task& t : tasks)
+			sched.Post(&t);
+		while (doneCount.LoadAcquire() != tasks.size())
+			mg::box::Sleep(1);
+		TEST_CHECK(sched.WaitEmpty());
+		sched.Stop();
+		uint64_t expected = (uint64_t)valueCount * (valueCount + 1) / 2 * senderCount;
+		TEST_CHECK(sum.LoadRelaxed() == expected);
+
+		// One sender and one receiver keep the order.
+		sched.Start(2);
+		doneCount.StoreRelaxed(0);
+		tasks[0].SetCallback([](mg::sch::Task* aTask, mg::sch::TaskChannel<uint64_t>& aCh,
+			mg::box::AtomicU32& aDoneCount, uint32_t aCount) -> mg::box::Coro {
+			for (uint32_t j = 0; j < aCount; ++j)
+				co_await aCh.AsyncSend(aTask, j);
+			aDoneCount.IncrementRelease();
+			co_return;
+		}(&tasks[0], ch, doneCount, valueCount));
+		tasks[1].SetCallback([](mg::sch::Task* aTask, mg::sch::TaskChannel<uint64_t>& aCh,
+			mg::box::AtomicU32& aDoneCount, uint32_t aCount) -> mg::box::Coro {
+			for (uint32_t j = 0; j < aCount; ++j)
+				TEST_CHECK(co_await aCh.AsyncReceive(aTask) == j);
+			aDoneCount.IncrementRelease();
+			co_return;
+		}(&tasks[1], ch, doneCount, valueCount));
+		sched.Post(&tasks[0]);
+		sched.Post(&tasks[1]);
+		while (doneCount.LoadAcquire() != 2)
+			mg::box::Sleep(1);
+		TEST_CHECK(sched.WaitEmpty());
+		sched.Stop();
+	}
+
+	static void
+	UnitTestTaskSyncCancelCoro()
+	{
+		TestCaseGuard guard("Cancel coro");
+
+		// The cancellation doesn't interrupt the waits. The tasks stay in the queues and
+		// get the resources later as usual.
+		mg::sch::TaskScheduler sched("tst", 5);
+		sched.Start(2);
+		mg::sch::TaskSemaphore sem(0);
+		mg::sch::TaskMutex mutex;
+		TEST_CHECK(mutex.TryLock());
+		mg::sch::TaskChannel<uint32_t> chEmpty(1);
+		mg::sch::TaskChannel<uint32_t> chFull(1);
+		TEST_CHECK(chFull.TrySend(1));
+		mg::box::CancellationToken::Ptr token = mg::box::CancellationToken::NewShared();
+		mg::box::AtomicU32 waitCount(0);
+		mg::box::AtomicU32 doneCount(0);
+		mg::sch::Task tasks[4];
+		tasks[0].SetCallback([](mg::sch::Task* aTask, mg::sch::TaskSemaphore& aSem,
+			mg::box::AtomicU32& aWaitCount, mg::box::AtomicU32& aDoneCount)
+			-> mg::box::Coro {
+			aWaitCount.IncrementRelease();
+			co_await aSem.AsyncAcquire(aTask);
+			TEST_CHECK(aTask->IsCancelled());
+			aDoneCount.IncrementRelease();
+			co_return;
+		}(&tasks[0], sem, waitCount, doneCount));
+		tasks[1].SetCallback([](mg::sch::Task* aTask, mg::sch::TaskMutex& aMutex,
+			mg::box::AtomicU32& aWaitCount, mg::box::AtomicU32& aDoneCount)
+			-> mg::box::Coro {
+			aWaitCount.IncrementRelease();
+			co_await aMutex.AsyncLock(aTask);
+			TEST_CHECK(aTask->IsCancelled());
+			aMutex.Unlock();
+			aDoneCount.IncrementRelease();
+			co_return;
+		}(&tasks[1], mutex, waitCount, doneCount));
+		tasks[2].SetCallback([](mg::sch::Task* aTask,
+			mg::sch::TaskChannel<uint32_t>& aCh, mg::box::AtomicU32& aWaitCount,
+			mg::box::AtomicU32& aDoneCount) -> mg::box::Coro {
+			aWaitCount.IncrementRelease();
+			TEST_CHECK(co_await aCh.AsyncReceive(aTask) == 2);
+			TEST_CHECK(aTask->IsCancelled());
+			aDoneCount.IncrementRelease();
+			co_return;
+		}(&tasks[2], chEmpty, waitCount, doneCount));
+		tasks[3].SetCallback([](mg::sch::Task* aTask,
+			mg::sch::TaskChannel<uint32_t>& aCh, mg::box::AtomicU32& aWaitCount,
+			mg::box::AtomicU32& aDoneCount) -> mg::box::Coro {
+			aWaitCount.IncrementRelease();
+			co_await aCh.AsyncSend(aTask, 3);
+			TEST_CHECK(aTask->IsCancelled());
+			aDoneCount.IncrementRelease();
+			co_return;
+		}(&tasks[3], chFull, waitCount, doneCount));
+		for (mg::sch::Task& t : tasks)
+		{
+			t.SetCancellation(token.GetPointer());
+			sched.Post(&t);
+		}
+		while (waitCount.LoadAcquire() != 4)
+			mg::box::Sleep(1);
+		// Let them go to sleep.
+		mg::box::Sleep(10);
+		token->Cancel();
+		mg::box::Sleep(10);
+		TEST_CHECK(doneCount.LoadAcquire() == 0);
+
+		sem.Release();
+		mutex.Unlock();
+		TEST_CHECK(chEmpty.TrySend(2));
+		uint32_t value = 0;
+		TEST_CHECK(chFull.TryReceive(value) && value == 1);
+		while (doneCount.LoadAcquire() != 4)
+			mg::box::Sleep(1);
+		TEST_CHECK(sched.WaitEmpty());
+		sched.Stop();
+		TEST_CHECK(chFull.TryReceive(value) && value == 3);
+		TEST_CHECK(mutex.TryLock());
+		mutex.Unlock();
+		for (mg::sch::Task& t : tasks)
+			t.SetCancellation(nullptr);
+	}
+#endif
+
+	void
+	UnitTestTaskSync()
+	{
+		TestSuiteGuard suite("TaskSync");
+
+		UnitTestTaskSemaphoreBasic();
+		UnitTestTaskMutexCallback();
+		UnitTestTaskChannelBasic();
+#if MG_CORO_IS_ENABLED
+		UnitTestTaskMutexCoro();
+		UnitTestTaskSemaphoreCoro();
+		UnitTestTaskChannelCoro();
+		UnitTestTaskSyncCancelCoro();
+#endif
+	}
+
+}
+}
+}
@@ -9,6 +9,13 @@
 \* This is where the users put their tasks. It contains a front task queue. And
 \* a signal variable which is signaled when the front queue becomes non-empty.
 \*
+\* The front queue is split into shards, one per producer. So the producers
+\* don't contend on a single queue head. The scheduler drains the shards in any
+\* order, but each shard is FIFO. Hence the tasks of one producer keep their
+\* order, and there is no order between the producers, the same as without the
+\* shards. A shard turning from empty to non-empty raises the same single front
+\* signal.
+\*
 \* ## Scheduler role.
 \* The role is single - done by a single thread at a time. It does work of
 \* taking the new jobs stacked in the front, checking deadlines, and putting
@@ -110,11 +117,28 @@
 \*   Signals allow to do steps (1) and (2) in a single atomic operation. So
 \*   The steps (3) and (4) won't see an intermediate state.
 \*
+\* ## Futures.
+\* A task can wait for futures. The future's readiness and the fact that the
+\* task waits for it are bits in a single atomic word in the task. The task
+\* sets the 'awaited' bit and posts itself with a deadline. The promise sets the
+\* 'ready' bit. Whoever of them sees the other bit already set knows what to do:
+\* the task doesn't sleep at all, or the promise must signal the task. The
+\* signal goes via the usual path above, so the task is woken up via the front
+\* queue, the same as with a plain signal.
+\*
+\* The task, when woken up, clears the 'awaited' bit. If the future was ready
+\* by then, the signal is owed by the promise and the task receives it, even if
+\* it wasn't delivered yet. Because otherwise it would arrive after the task is
+\* deleted, or would be mistaken for a signal of a next wait.
+\*
+\* The model has one future per task. More futures only change which
+\* combinations of 'ready' bits satisfy the wait, and it is the same atomic word.
+\*
 \* The implementation needs threads, mutexes, condition variables, atomics,
 \* multi-consumer-single-producer queue, and single-consumer-multi-producer
 \* queue. Both queues unbounded.
 \*
-EXTENDS TLC, Integers, Sequences
+EXTENDS TLC, Integers, Sequences, FiniteSets
 
 --------------------------------------------------------------------------------
 \*
@@ -188,7 +212,10 @@ UserVars == <<UserThreads, UserSignalCount>>
 VARIABLE IsFrontSignaled
 \* Unbounded multi-producer-single-consumer queue. It is populated by user
 \* threads with new tasks to execute (hence multi-producer). It is processed by
-\* the scheduler role (hence single-consumer).
+\* the scheduler role (hence single-consumer). It is a function from a user
+\* thread ID to its shard. In the code the workers have own shards and the
+\* external threads share one more. But a shard is a multi-producer queue
+\* anyway, so the model just gives each producer its own one.
 VARIABLE FrontQueue
 
 FrontVars == <<IsFrontSignaled, FrontQueue>>
@@ -227,6 +254,9 @@ SetState(v, b) == [b EXCEPT !.state = v]
 SetStatus(v, b) == [b EXCEPT !.status = v]
 SetTaskID(v, b) == [b EXCEPT !.task_id = v]
 SetExecCount(v, b) == [b EXCEPT !.exec_count = v]
+SetFutReady(v, b) == [b EXCEPT !.fut_ready = v]
+SetFutAwaited(v, b) == [b EXCEPT !.fut_awaited = v]
+SetFutPromise(v, b) == [b EXCEPT !.fut_promise = v]
 
 \* The same but for struct arrays.
 
@@ -242,6 +272,16 @@ ArrSetState(i, v, s) == ArrSet(i, SetState(v, s[i]), s)
 ArrSetStatus(i, v, s) == ArrSet(i, SetStatus(v, s[i]), s)
 ArrSetTaskID(i, v, s) == ArrSet(i, SetTaskID(v, s[i]), s)
 ArrSetExecCount(i, v, s) == ArrSet(i, SetExecCount(v, s[i]), s)
+ArrSetFutReady(i, v, s) == ArrSet(i, SetFutReady(v, s[i]), s)
+ArrSetFutAwaited(i, v, s) == ArrSet(i, SetFutAwaited(v, s[i]), s)
+ArrSetFutPromise(i, v, s) == ArrSet(i, SetFutPromise(v, s[i]), s)
+
+\* Front queue shards.
+
+FrontIsEmpty == \A uid \in UserThreadIDs: ArrIsEmpty(FrontQueue[uid])
+FrontHas(tid) ==
+  \E uid \in UserThreadIDs: \E i \in DOMAIN(FrontQueue[uid]):
+    FrontQueue[uid][i] = tid
 
 \* Constructors.
 
@@ -256,7 +296,14 @@ TaskNew == [
   \* would be a deadline value as a timestamp.
   do_wait |-> FALSE,
   \* How many times the task was executed already.
-  exec_count |-> 0
+  exec_count |-> 0,
+  \* Future state. The 'ready' and 'awaited' flags are bits of the same atomic
+  \* word, so they are always changed together in one step.
+  fut_ready |-> FALSE,
+  fut_awaited |-> FALSE,
+  \* The promise is given out and not completed yet. Not a part of the real
+  \* state, only tells the model that the user thread can complete it.
+  fut_promise |-> FALSE
 ]
 
 WorkerThreadNew == [
@@ -273,6 +320,18 @@ UserThreadNew == [
   task_id |-> NULL
 ]
 
+\* The task has a pending promise, or waits for a future, or is owed a signal
+\* by a completed promise, or its worker is about to receive that signal.
+IsFutureUsed(tid) ==
+  \/ Tasks[tid].fut_promise
+  \/ Tasks[tid].fut_awaited
+  \/ \E uid \in UserThreadIDs:
+     /\ UserThreads[uid].state = "future_signal"
+     /\ UserThreads[uid].task_id = tid
+  \/ \E wid \in WorkerThreadIDs:
+     /\ WorkerThreads[wid].state = "worker_future_recv"
+     /\ WorkerThreads[wid].task_id = tid
+
 Init ==
   /\ TaskPool = TaskIDs
   /\ Tasks = [tid \in TaskIDs |-> TaskNew]
@@ -282,7 +341,7 @@ Init ==
   /\ IsFrontSignaled = FALSE
   /\ IsReadySignaled = FALSE
   /\ IsSchedulerTaken = FALSE
-  /\ FrontQueue = << >>
+  /\ FrontQueue = [uid \in UserThreadIDs |-> << >>]
   /\ WaitingQueue = {}
   /\ ReadyQueue = << >>
 
@@ -302,13 +361,14 @@ UserPushTaskFrontDo(uid, tid) ==
       t == Tasks[tid] IN
   /\ Assert(t.exec_count < ExecTarget, "Max exec count")
   \* ---
-  /\ FrontQueue' = ArrAppend(tid, FrontQueue)
+  /\ FrontQueue' = [FrontQueue EXCEPT ![uid] = ArrAppend(tid, @)]
   \* Signal the front when 'empty' turns into 'non-empty'. This helps to avoid
   \* doing the signal most of the times under high load. Assuming that during
   \* push into the queue it is free to find whether it was empty before. Could
   \* be cheaper to send the signal every time if the front queue is not
-  \* efficient enough.
-  /\ IF ArrIsEmpty(FrontQueue) THEN
+  \* efficient enough. Only the own shard is checked. The other ones, if not
+  \* empty, had already raised the signal themselves.
+  /\ IF ArrIsEmpty(FrontQueue[uid]) THEN
      /\ UserThreads' = ArrSetState(uid, "push_front_signal", UserThreads)
      ELSE
      /\ UserThreads' = ArrSet(uid, UserThreadNew, UserThreads)
@@ -352,10 +412,32 @@ UserPostTaskNoWait(uid, tid) == UserPostTaskImpl(uid, tid, FALSE)
 
 UserPostTaskWait(uid, tid) == UserPostTaskImpl(uid, tid, TRUE)
 
+\* Post a task which waits for its future. The future gets a new promise
+\* unless the old one is still not completed. Setting of the 'awaited' bit is
+\* done together with checking if the future is ready. If it is, the task
+\* doesn't sleep. It is the same as a new promise given out, hence not modeled
+\* separately.
+UserPostTaskAwait(uid, tid) ==
+  LET w == UserThreads[uid]
+      t == Tasks[tid] IN
+  /\ w.state = "idle"
+  /\ t.exec_count < ExecTarget
+  /\ Assert(~t.fut_awaited, "Not awaiting yet")
+  \* ---
+  /\ Tasks' = ArrSet(tid,
+              SetFutAwaited(TRUE,
+              SetWait(TRUE,
+              IF t.fut_promise THEN t ELSE
+              SetFutPromise(TRUE,
+              SetFutReady(FALSE,
+              t)))), Tasks)
+  /\ UserPushTaskFrontDo(uid, tid)
+
 UserPostTask(uid) ==
   /\ \E tid \in TaskPool:
      /\ \/ UserPostTaskNoWait(uid, tid)
         \/ UserPostTaskWait(uid, tid)
+        \/ UserPostTaskAwait(uid, tid)
      /\ TaskPool' = TaskPool \ {tid}
   /\ UNCHANGED<<WorkerVars, IsFrontSignaled, SchedVars, UserSignalCount>>
 
@@ -432,6 +514,8 @@ UserSignalTask(uid) ==
   /\ \E tid \in TaskIDs: LET t == Tasks[tid] IN
      /\ t.exec_count < ExecTarget
      /\ t.status # "signaled"
+     \* While the task uses futures, its signal belongs to them.
+     /\ ~IsFutureUsed(tid)
      \* ---
      \* Works just like wakeup, but this status is stronger than 'ready'.
      /\ Tasks' = ArrSetStatus(tid, "signaled", Tasks)
@@ -444,6 +528,46 @@ UserSignalTask(uid) ==
         /\ UNCHANGED<<UserThreads>>
   /\ UNCHANGED<<TaskPool, WorkerVars, FrontVars, SchedVars>>
 
+--------------------------------------------------------------------------------
+\* Complete a promise. A single atomic 'or' of the 'ready' bit. If the task was
+\* waiting for the future, then this thread must signal it. It is done as a
+\* separate step, and the task can be woken up by its deadline in between.
+
+UserCompleteFuture(uid) ==
+  LET w == UserThreads[uid] IN
+  /\ w.state = "idle"
+  \* ---
+  /\ \E tid \in TaskIDs: LET t == Tasks[tid] IN
+     /\ t.fut_promise
+     \* ---
+     /\ Tasks' = ArrSetFutReady(tid, TRUE,
+                 ArrSetFutPromise(tid, FALSE,
+                 Tasks))
+     /\ IF t.fut_awaited THEN
+        /\ UserThreads' = ArrSetState(uid, "future_signal",
+                          ArrSetTaskID(uid, tid,
+                          UserThreads))
+        ELSE
+        /\ UNCHANGED<<UserThreads>>
+  /\ UNCHANGED<<TaskPool, WorkerVars, FrontVars, SchedVars, UserSignalCount>>
+
+\* The same as a signal from the user. Except that the task must not be deleted
+\* until it is sent, even if the task was already woken up by the deadline.
+UserFutureSignal(uid) ==
+  LET w == UserThreads[uid]
+      tid == w.task_id
+      t == Tasks[tid] IN
+  /\ w.state = "future_signal"
+  /\ Assert(t.status # "signaled", "Future signal is sent once")
+  \* ---
+  /\ Tasks' = ArrSetStatus(tid, "signaled", Tasks)
+  /\ UserSignalCount' = UserSignalCount + 1
+  /\ IF t.status = "waiting" THEN
+     /\ UserThreads' = ArrSetState(uid, "push_front", UserThreads)
+     ELSE
+     /\ UserThreads' = ArrSet(uid, UserThreadNew, UserThreads)
+  /\ UNCHANGED<<TaskPool, WorkerVars, FrontVars, SchedVars>>
+
 --------------------------------------------------------------------------------
 \* All the actions the user threads can do with the tasks.
 
@@ -452,6 +576,8 @@ User(uid) ==
   \/ UserPostTask(uid)
   \/ UserWakeupTask(uid)
   \/ UserSignalTask(uid)
+  \/ UserCompleteFuture(uid)
+  \/ UserFutureSignal(uid)
 
 --------------------------------------------------------------------------------
 \* Try to perform scheduling.
@@ -479,10 +605,10 @@ SchedCheckWaiting(wid) ==
   \* ---
   \* Do any of these 3 actions depending on which of them are available. TLA+
   \* will try all combinations of them.
-  /\ \/ /\ ~ArrIsEmpty(FrontQueue)
+  /\ \/ /\ ~FrontIsEmpty
         /\ WorkerThreads' = ArrSetState(wid, "sched_check_front", WorkerThreads)
         /\ UNCHANGED<<Tasks, WaitingQueue, ReadyQueue>>
-     \/ /\ ArrIsEmpty(FrontQueue)
+     \/ /\ FrontIsEmpty
         /\ WorkerThreads' = ArrSetState(wid, "sched_wait_front", WorkerThreads)
         /\ UNCHANGED<<Tasks, WaitingQueue, ReadyQueue>>
      \/ /\ \E tid \in WaitingQueue: LET t == Tasks[tid] IN
@@ -508,38 +634,44 @@ SchedCheckWaiting(wid) ==
 \* - Some have a deadline and want to wait for it or for a wakeup/signal;
 \* - Some are actually wake ups or signals for already waiting tasks stored in
 \*   the waiting queue;
+\*
+\* The shards are taken in any order. The code goes round-robin, which is one of
+\* the orders.
 SchedCheckFront(wid) ==
   LET w == WorkerThreads[wid] IN
   /\ w.state = "sched_check_front"
   /\ Assert(IsSchedulerTaken, "Is in scheduler")
-  /\ Assert(~ArrIsEmpty(FrontQueue), "Has front queue")
+  /\ Assert(~FrontIsEmpty, "Has front queue")
   \* ---
-  /\ LET tid == FrontQueue[1] t == Tasks[tid] IN
-     /\ IF ArrLen(FrontQueue) = 1 THEN
-        \* The entire front queue is consumed. Switch to the next state.
-        /\ WorkerThreads' = ArrSetState(wid, "sched_wait_front", WorkerThreads)
-        ELSE
-        /\ UNCHANGED<<WorkerThreads>>
-     /\ FrontQueue' = ArrPopHead(FrontQueue)
-     \* Status check + change can be done via atomic compare-exchange.
-     \* The 'wait' flag does not need to be atomic. It is never accessed by more
-     \* than one thread at a time.
-     /\ IF t.do_wait /\ t.status = "pending" THEN
-        \* 'Pending' means it is a regular post. And 'wait' means it has a
-        \* deadline. Put it into the waiting queue then.
-        /\ Tasks' = ArrSetStatus(tid, "waiting", Tasks)
-        /\ WaitingQueue' = WaitingQueue \union {tid}
-        /\ UNCHANGED<<ReadyQueue>>
-        ELSE
-        /\ IF t.status = "pending" THEN
-           \* Pending but no wait - regular post for immediate execution.
-           /\ Tasks' = ArrSetStatus(tid, "ready", Tasks)
+  /\ \E uid \in UserThreadIDs:
+     /\ ~ArrIsEmpty(FrontQueue[uid])
+     /\ LET tid == FrontQueue[uid][1] t == Tasks[tid] IN
+        /\ FrontQueue' = [FrontQueue EXCEPT ![uid] = ArrPopHead(@)]
+        /\ IF \A u \in UserThreadIDs: ArrIsEmpty(FrontQueue'[u]) THEN
+           \* The entire front queue is consumed. Switch to the next state.
+           /\ WorkerThreads' = ArrSetState(wid, "sched_wait_front",
+                                           WorkerThreads)
+           ELSE
+           /\ UNCHANGED<<WorkerThreads>>
+        \* Status check + change can be done via atomic compare-exchange.
+        \* The 'wait' flag does not need to be atomic. It is never accessed by
+        \* more than one thread at a time.
+        /\ IF t.do_wait /\ t.status = "pending" THEN
+           \* 'Pending' means it is a regular post. And 'wait' means it has a
+           \* deadline. Put it into the waiting queue then.
+           /\ Tasks' = ArrSetStatus(tid, "waiting", Tasks)
+           /\ WaitingQueue' = WaitingQueue \union {tid}
+           /\ UNCHANGED<<ReadyQueue>>
            ELSE
-           \* Not pending = signal or wakeup. Need to remove it from the waiting
-           \* queue if it is there and schedule for execution.
-           /\ UNCHANGED<<Tasks>>
-        /\ WaitingQueue' = WaitingQueue \ {tid}
-        /\ ReadyQueue' = ArrAppend(tid, ReadyQueue)
+           /\ IF t.status = "pending" THEN
+              \* Pending but no wait - regular post for immediate execution.
+              /\ Tasks' = ArrSetStatus(tid, "ready", Tasks)
+              ELSE
+              \* Not pending = signal or wakeup. Need to remove it from the
+              \* waiting queue if it is there and schedule for execution.
+              /\ UNCHANGED<<Tasks>>
+           /\ WaitingQueue' = WaitingQueue \ {tid}
+           /\ ReadyQueue' = ArrAppend(tid, ReadyQueue)
   /\ UNCHANGED<<IsFrontSignaled, IsReadySignaled, IsSchedulerTaken>>
 
 \* If has no ready tasks then wait until anything comes to the front or the
@@ -664,12 +796,8 @@ WorkerExecuteWait(wid) ==
   /\ WorkerThreads' = ArrSetState(wid, "idle", WorkerThreads)
   /\ UNCHANGED<<TaskPool, Tasks, ReadyQueue, UserSignalCount>>
 
-WorkerExecuteOne(wid) ==
-  LET w == WorkerThreads[wid]
-      tid == w.task_id
-      t == Tasks[tid] IN
-  /\ w.state = "worker_execute_one"
-  \* ---
+\* Finish the task execution and put it back to the user.
+WorkerExecuteEnd(wid, tid, t) ==
   \* Signal consumption can be done as a compare-exchange: set to 'pending' if
   \* is 'signaled'.
   /\ IF t.status = "signaled" THEN
@@ -677,21 +805,54 @@ WorkerExecuteOne(wid) ==
      /\ UserSignalCount' = UserSignalCount - 1
      ELSE
      /\ UNCHANGED<<UserSignalCount>>
-  /\ Tasks' = ArrSetStatus(tid, "pending",
-              ArrSetExecCount(tid, t.exec_count + 1,
-              ArrSetWait(tid, NULL,
-              Tasks)))
+  /\ Tasks' = ArrSet(tid,
+              SetStatus("pending",
+              SetExecCount(t.exec_count + 1,
+              SetWait(NULL,
+              t))), Tasks)
   /\ TaskPool' = TaskPool \union {tid}
   /\ WorkerThreads' = ArrSetState(wid, "worker_execute",
                       ArrSetTaskID(wid, NULL,
                       WorkerThreads))
   /\ UNCHANGED<<IsReadySignaled, ReadyQueue>>
 
+WorkerExecuteOne(wid) ==
+  LET w == WorkerThreads[wid]
+      tid == w.task_id
+      t == Tasks[tid] IN
+  /\ w.state = "worker_execute_one"
+  \* ---
+  \* The task stops waiting for the future. The 'awaited' bit is cleared with
+  \* a compare-exchange which also returns the 'ready' bit.
+  /\ IF t.fut_awaited /\ t.fut_ready /\ t.status # "signaled" THEN
+     \* The wait is satisfied, but the task was woken up by something else
+     \* before the promise's signal arrived. The promise is between its 2 steps.
+     \* Must wait for the signal before the task can be released.
+     /\ Tasks' = ArrSetFutAwaited(tid, FALSE, Tasks)
+     /\ WorkerThreads' = ArrSetState(wid, "worker_future_recv", WorkerThreads)
+     /\ UNCHANGED<<TaskPool, IsReadySignaled, ReadyQueue, UserSignalCount>>
+     ELSE
+     \* Either the wait wasn't satisfied (a deadline, a wakeup), or the signal
+     \* is already here.
+     /\ WorkerExecuteEnd(wid, tid, SetFutAwaited(FALSE, t))
+
+\* Receive the owed future signal. In the code it is a spin-loop, because the
+\* promise is already right before sending the signal.
+WorkerFutureRecv(wid) ==
+  LET w == WorkerThreads[wid]
+      tid == w.task_id
+      t == Tasks[tid] IN
+  /\ w.state = "worker_future_recv"
+  /\ t.status = "signaled"
+  \* ---
+  /\ WorkerExecuteEnd(wid, tid, t)
+
 Worker(wid) ==
   /\ \/ WorkerEnter(wid)
      \/ WorkerExecuteStart(wid)
      \/ WorkerExecuteWait(wid)
      \/ WorkerExecuteOne(wid)
+     \/ WorkerFutureRecv(wid)
   /\ UNCHANGED<<SchedVars, FrontVars, UserThreads>>
 
 --------------------------------------------------------------------------------
@@ -720,10 +881,11 @@ TerminalProperty == <>[](
   /\ ~IsFrontSignaled
   /\ ~IsReadySignaled
   /\ IsSchedulerTaken
-  /\ ArrIsEmpty(FrontQueue)
+  /\ FrontIsEmpty
   /\ WaitingQueue = {}
   /\ ArrIsEmpty(ReadyQueue)
   /\ \A tid \in TaskIDs: Tasks[tid].exec_count = ExecTarget
+  /\ \A tid \in TaskIDs: ~IsFutureUsed(tid)
   /\ UserSignalCount = 0)
 
 \* A task can never be in 2 places at the same time. Not counting the waiting
@@ -734,13 +896,26 @@ TerminalProperty == <>[](
 SinglePlaceInvariant ==
   /\ \A tid \in TaskIDs:
      (IF tid \in TaskPool THEN 1 ELSE 0) +
-     (IF \E i \in DOMAIN(FrontQueue): FrontQueue[i] = tid THEN 1 ELSE 0) +
+     (IF FrontHas(tid) THEN 1 ELSE 0) +
      (IF \E i \in DOMAIN(ReadyQueue): ReadyQueue[i] = tid THEN 1 ELSE 0) +
      (IF \E wid \in WorkerThreadIDs: WorkerThreads[wid].task_id = tid
          THEN 1 ELSE 0) <= 1
 
+\* A task waiting for a ready future is either already signaled or is going to
+\* be signaled by exactly one promise. Otherwise the wakeup would be lost.
+FutureWakeupInvariant ==
+  /\ \A tid \in TaskIDs:
+     LET t == Tasks[tid]
+         owners == {uid \in UserThreadIDs:
+                    /\ UserThreads[uid].state = "future_signal"
+                    /\ UserThreads[uid].task_id = tid} IN
+     /\ Cardinality(owners) <= 1
+     /\ t.fut_awaited /\ t.fut_ready =>
+        t.status = "signaled" \/ owners # {}
+
 TotalInvariant ==
   /\ SinglePlaceInvariant
+  /\ FutureWakeupInvariant
 
 Spec ==
   /\ Init